@@ -0,0 +1,143 @@
+#include "capture_format.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+void write_capture_file(const std::filesystem::path &path, const CaptureFile &capture) {
+    CaptureWriter writer;
+    writer.write(CAPTURE_MAGIC);
+    writer.write(CAPTURE_VERSION);
+
+    writer.write(static_cast<uint64_t>(capture.buffers.size()));
+    for (auto &buffer: capture.buffers) {
+        writer.write(buffer.id);
+        writer.write(buffer.size);
+        writer.write(buffer.usage);
+        writer.write(buffer.memory_properties);
+        writer.write_array(buffer.contents);
+    }
+
+    writer.write(static_cast<uint64_t>(capture.set_layouts.size()));
+    for (auto &layout: capture.set_layouts) {
+        writer.write(layout.id);
+        writer.write_array(layout.bindings);
+    }
+
+    writer.write(static_cast<uint64_t>(capture.pipeline_layouts.size()));
+    for (auto &layout: capture.pipeline_layouts) {
+        writer.write(layout.id);
+        writer.write_array(layout.set_layouts);
+        writer.write_array(layout.push_constant_ranges);
+    }
+
+    writer.write(static_cast<uint64_t>(capture.pipelines.size()));
+    for (auto &pipeline: capture.pipelines) {
+        writer.write(pipeline.id);
+        writer.write(pipeline.layout);
+        writer.write_array(pipeline.spirv);
+        writer.write_string(pipeline.entry_point);
+        writer.write_array(pipeline.specialization_entries);
+        writer.write_array(pipeline.specialization_data);
+    }
+
+    writer.write(static_cast<uint64_t>(capture.descriptor_sets.size()));
+    for (auto &set: capture.descriptor_sets) {
+        writer.write(set.id);
+        writer.write(set.layout);
+        writer.write_array(set.writes);
+    }
+
+    writer.write(static_cast<uint64_t>(capture.command_buffers.size()));
+    for (auto &command_buffer: capture.command_buffers) {
+        writer.write(command_buffer.id);
+        writer.write_array(command_buffer.commands);
+    }
+
+    writer.write(static_cast<uint64_t>(capture.submits.size()));
+    for (auto &submit: capture.submits) {
+        writer.write_array(submit);
+    }
+
+    // Write next to the destination and rename, so an interrupted capture never leaves a truncated file behind.
+    auto temporary_path = path;
+    temporary_path += ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char *>(writer.data.data()),
+                        static_cast<std::streamsize>(writer.data.size()))) {
+            throw std::runtime_error("Unable to write capture file " + temporary_path.string());
+        }
+    }
+    std::filesystem::rename(temporary_path, path);
+}
+
+CaptureFile read_capture_file(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Unable to open capture file " + path.string());
+    }
+    std::vector<std::byte> data(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error("Unable to read capture file " + path.string());
+    }
+
+    CaptureReader reader(data);
+    const auto magic = reader.read<std::array<char, 4>>();
+    if (!std::equal(magic.begin(), magic.end(), CAPTURE_MAGIC) || reader.read<uint32_t>() != CAPTURE_VERSION) {
+        throw std::runtime_error(path.string() + " is not a capture of this version");
+    }
+
+    CaptureFile capture;
+    capture.buffers.resize(reader.read_count());
+    for (auto &buffer: capture.buffers) {
+        buffer.id = reader.read<uint64_t>();
+        buffer.size = reader.read<VkDeviceSize>();
+        buffer.usage = reader.read<VkBufferUsageFlags>();
+        buffer.memory_properties = reader.read<VkMemoryPropertyFlags>();
+        buffer.contents = reader.read_array<std::byte>();
+    }
+
+    capture.set_layouts.resize(reader.read_count());
+    for (auto &layout: capture.set_layouts) {
+        layout.id = reader.read<uint64_t>();
+        layout.bindings = reader.read_array<CapturedDescriptorBinding>();
+    }
+
+    capture.pipeline_layouts.resize(reader.read_count());
+    for (auto &layout: capture.pipeline_layouts) {
+        layout.id = reader.read<uint64_t>();
+        layout.set_layouts = reader.read_array<uint64_t>();
+        layout.push_constant_ranges = reader.read_array<VkPushConstantRange>();
+    }
+
+    capture.pipelines.resize(reader.read_count());
+    for (auto &pipeline: capture.pipelines) {
+        pipeline.id = reader.read<uint64_t>();
+        pipeline.layout = reader.read<uint64_t>();
+        pipeline.spirv = reader.read_array<uint32_t>();
+        pipeline.entry_point = reader.read_string();
+        pipeline.specialization_entries = reader.read_array<VkSpecializationMapEntry>();
+        pipeline.specialization_data = reader.read_array<std::byte>();
+    }
+
+    capture.descriptor_sets.resize(reader.read_count());
+    for (auto &set: capture.descriptor_sets) {
+        set.id = reader.read<uint64_t>();
+        set.layout = reader.read<uint64_t>();
+        set.writes = reader.read_array<CapturedDescriptorWrite>();
+    }
+
+    capture.command_buffers.resize(reader.read_count());
+    for (auto &command_buffer: capture.command_buffers) {
+        command_buffer.id = reader.read<uint64_t>();
+        command_buffer.commands = reader.read_array<std::byte>();
+    }
+
+    capture.submits.resize(reader.read_count());
+    for (auto &submit: capture.submits) {
+        submit = reader.read_array<uint64_t>();
+    }
+    return capture;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+/*
+ * The file written by the capture layer and read by vulkan_replay. It holds one frame of compute and transfer work:
+ * the buffers the frame touched, with their contents from before the frame, the pipelines and descriptor sets it
+ * used, and every command buffer it submitted, in submission order. Objects are identified by their handle values at
+ * capture time.
+ * Everything is stored as raw little endian values behind a magic and version, so the file is only as large as the
+ * resource contents and SPIR-V it carries.
+ */
+
+inline constexpr char CAPTURE_MAGIC[4] = {'V', 'K', 'C', 'F'};
+inline constexpr uint32_t CAPTURE_VERSION = 1;
+
+/**
+ * The commands a captured command buffer can contain, each followed by its arguments.
+ */
+enum class CapturedCommand : uint32_t {
+    /// pipeline id
+    BindPipeline,
+    /// layout id, first set, set count, set ids, dynamic offset count, dynamic offsets
+    BindDescriptorSets,
+    /// layout id, stage flags, offset, size, bytes
+    PushConstants,
+    /// x, y, z
+    Dispatch,
+    /// buffer id, offset
+    DispatchIndirect,
+    /// source id, destination id, region count, VkBufferCopy regions
+    CopyBuffer,
+    /// buffer id, offset, size, data
+    FillBuffer,
+    /// buffer id, offset, size, bytes
+    UpdateBuffer,
+    /// source stages, source access, destination stages, destination access, as synchronization2 flags
+    Barrier,
+};
+
+struct CapturedBuffer {
+    uint64_t id = 0;
+    VkDeviceSize size = 0;
+    VkBufferUsageFlags usage = 0;
+    /// The properties of the memory the buffer was bound to, which replay prefers.
+    VkMemoryPropertyFlags memory_properties = 0;
+    /// The contents before the frame.
+    std::vector<std::byte> contents;
+};
+
+struct CapturedDescriptorBinding {
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    uint32_t count = 0;
+    VkShaderStageFlags stages = 0;
+};
+
+struct CapturedSetLayout {
+    uint64_t id = 0;
+    std::vector<CapturedDescriptorBinding> bindings;
+};
+
+struct CapturedPipelineLayout {
+    uint64_t id = 0;
+    std::vector<uint64_t> set_layouts;
+    std::vector<VkPushConstantRange> push_constant_ranges;
+};
+
+struct CapturedPipeline {
+    uint64_t id = 0;
+    uint64_t layout = 0;
+    std::vector<uint32_t> spirv;
+    std::string entry_point;
+    std::vector<VkSpecializationMapEntry> specialization_entries;
+    std::vector<std::byte> specialization_data;
+};
+
+struct CapturedDescriptorWrite {
+    uint32_t binding = 0;
+    uint32_t array_element = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    uint64_t buffer = 0;
+    VkDeviceSize offset = 0;
+    VkDeviceSize range = 0;
+};
+
+struct CapturedDescriptorSet {
+    uint64_t id = 0;
+    uint64_t layout = 0;
+    std::vector<CapturedDescriptorWrite> writes;
+};
+
+struct CapturedCommandBuffer {
+    uint64_t id = 0;
+    /// The encoded commands, see CapturedCommand.
+    std::vector<std::byte> commands;
+};
+
+/**
+ * A captured frame.
+ */
+struct CaptureFile {
+    std::vector<CapturedBuffer> buffers;
+    std::vector<CapturedSetLayout> set_layouts;
+    std::vector<CapturedPipelineLayout> pipeline_layouts;
+    std::vector<CapturedPipeline> pipelines;
+    std::vector<CapturedDescriptorSet> descriptor_sets;
+    std::vector<CapturedCommandBuffer> command_buffers;
+    /// The command buffers of each submission, in order. A command buffer may be submitted several times.
+    std::vector<std::vector<uint64_t>> submits;
+};
+
+/**
+ * Appends values to a byte stream.
+ */
+class CaptureWriter {
+public:
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void write(const T &value) {
+        write_bytes({reinterpret_cast<const std::byte *>(&value), sizeof(T)});
+    }
+
+    /**
+     * Writes the length of a range, then its elements.
+     */
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void write_array(std::span<const T> values) {
+        write(static_cast<uint64_t>(values.size()));
+        write_bytes(std::as_bytes(values));
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    void write_array(const std::vector<T> &values) {
+        write_array(std::span<const T>(values));
+    }
+
+    void write_string(const std::string &value) {
+        write_array(std::span<const char>(value));
+    }
+
+    void write_bytes(std::span<const std::byte> bytes) {
+        data.insert(data.end(), bytes.begin(), bytes.end());
+    }
+
+    std::vector<std::byte> data;
+};
+
+/**
+ * Reads values back from a byte stream written by CaptureWriter.
+ */
+class CaptureReader {
+public:
+    explicit CaptureReader(std::span<const std::byte> data) : data(data) {}
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    T read() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    /**
+     * Reads the number of elements of a collection, checking it against the bytes left so that a corrupt file cannot
+     * make the reader allocate more than the file holds.
+     * @param element_size The least number of bytes each element takes.
+     */
+    std::size_t read_count(std::size_t element_size = 1) {
+        const auto count = read<uint64_t>();
+        if (count > remaining() / std::max<std::size_t>(element_size, 1)) {
+            throw std::runtime_error("Unable to read capture: count is larger than the file");
+        }
+        return static_cast<std::size_t>(count);
+    }
+
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    std::vector<T> read_array() {
+        const auto count = read_count(sizeof(T));
+        std::vector<T> values(count);
+        std::memcpy(values.data(), take(count * sizeof(T)).data(), count * sizeof(T));
+        return values;
+    }
+
+    std::string read_string() {
+        auto characters = read_array<char>();
+        return {characters.begin(), characters.end()};
+    }
+
+    std::size_t remaining() const { return data.size() - position; }
+
+private:
+    std::span<const std::byte> take(std::size_t size) {
+        if (size > remaining()) {
+            throw std::runtime_error("Unable to read capture: unexpected end of data");
+        }
+        auto bytes = data.subspan(position, size);
+        position += size;
+        return bytes;
+    }
+
+    std::span<const std::byte> data;
+    std::size_t position = 0;
+};
+
+/**
+ * Writes a capture, replacing any file at the path.
+ */
+void write_capture_file(const std::filesystem::path &path, const CaptureFile &capture);
+
+/**
+ * Reads a capture.
+ * @throws std::runtime_error if the file cannot be read, is not a capture or is of another version.
+ */
+CaptureFile read_capture_file(const std::filesystem::path &path);
@@ -0,0 +1,1426 @@
+/*
+ * A vulkan layer capturing one frame of compute and transfer work to a file vulkan_replay can run, see
+ * capture_format.hpp. It is enabled as VK_LAYER_LEARNVULKAN_capture and configured through the environment:
+ *     VK_CAPTURE_FILE   The file to write. Without it the layer passes every call straight through.
+ *     VK_CAPTURE_FRAME  The index of the frame to capture, counting presents. 0 by default. Applications which never
+ *                       present are captured from device creation until the device is destroyed.
+ * Buffers are created with transfer source usage added, so that their contents can be copied out before the first
+ * captured submission using them runs.
+ * Only buffers, compute pipelines, buffer descriptors and the commands in CapturedCommand are captured. A frame
+ * recording anything else, such as a draw or an image copy, or taking buffer device addresses, is reported and not
+ * written, rather than written incomplete. Every command recorded into a command buffer is intercepted to notice this,
+ * except debug labels and markers, which are passed straight through.
+ * Replay creates its buffers at new addresses and cannot patch the addresses an application stored in buffers and push
+ * constants, so applications using ComputeSkinning, ParticleSystem or anything else built on device addresses cannot
+ * be captured at all. The layer manifest says so too.
+ * Exceptions never reach the application: the layer's bookkeeping failing fails the capture instead, and the call is
+ * still passed on.
+ * Entry points are static so that they never interpose on the loader's exports. The loader finds them through
+ * vkNegotiateLoaderLayerInterfaceVersion.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <vulkan/vk_layer.h>
+#include <vulkan/vulkan.h>
+
+#include "capture_format.hpp"
+#include "vulkan_reflection_tables.hpp"
+
+/**
+ * The name of every command recorded into a command buffer.
+ */
+static constexpr std::string_view COMMAND_BUFFER_COMMANDS[] = {
+#define COMMAND_NAME(NAME) #NAME,
+        VK_REFLECTION_COMMAND_BUFFER_COMMANDS(COMMAND_NAME)
+#undef COMMAND_NAME
+};
+
+/**
+ * @return The index of a command in COMMAND_BUFFER_COMMANDS.
+ */
+static consteval std::size_t command_index(std::string_view name) {
+    return std::ranges::find(COMMAND_BUFFER_COMMANDS, name) - std::ranges::begin(COMMAND_BUFFER_COMMANDS);
+}
+
+/**
+ * The next layer's or driver's device functions this layer calls.
+ */
+struct DeviceDispatch {
+    PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr = nullptr;
+    PFN_vkDestroyDevice vkDestroyDevice = nullptr;
+    PFN_vkGetDeviceQueue vkGetDeviceQueue = nullptr;
+    PFN_vkGetDeviceQueue2 vkGetDeviceQueue2 = nullptr;
+    PFN_vkDeviceWaitIdle vkDeviceWaitIdle = nullptr;
+    PFN_vkCreateBuffer vkCreateBuffer = nullptr;
+    PFN_vkDestroyBuffer vkDestroyBuffer = nullptr;
+    PFN_vkGetBufferMemoryRequirements vkGetBufferMemoryRequirements = nullptr;
+    PFN_vkAllocateMemory vkAllocateMemory = nullptr;
+    PFN_vkFreeMemory vkFreeMemory = nullptr;
+    PFN_vkMapMemory vkMapMemory = nullptr;
+    PFN_vkBindBufferMemory vkBindBufferMemory = nullptr;
+    // The core, KHR and EXT names share a signature.
+    PFN_vkGetBufferDeviceAddress vkGetBufferDeviceAddress = nullptr;
+    PFN_vkGetBufferDeviceAddress vkGetBufferDeviceAddressKHR = nullptr;
+    PFN_vkGetBufferDeviceAddress vkGetBufferDeviceAddressEXT = nullptr;
+    PFN_vkCreateShaderModule vkCreateShaderModule = nullptr;
+    PFN_vkDestroyShaderModule vkDestroyShaderModule = nullptr;
+    PFN_vkCreateDescriptorSetLayout vkCreateDescriptorSetLayout = nullptr;
+    PFN_vkCreatePipelineLayout vkCreatePipelineLayout = nullptr;
+    PFN_vkCreateComputePipelines vkCreateComputePipelines = nullptr;
+    PFN_vkAllocateDescriptorSets vkAllocateDescriptorSets = nullptr;
+    PFN_vkUpdateDescriptorSets vkUpdateDescriptorSets = nullptr;
+    PFN_vkCreateCommandPool vkCreateCommandPool = nullptr;
+    PFN_vkDestroyCommandPool vkDestroyCommandPool = nullptr;
+    PFN_vkAllocateCommandBuffers vkAllocateCommandBuffers = nullptr;
+    PFN_vkBeginCommandBuffer vkBeginCommandBuffer = nullptr;
+    PFN_vkEndCommandBuffer vkEndCommandBuffer = nullptr;
+    PFN_vkCreateFence vkCreateFence = nullptr;
+    PFN_vkDestroyFence vkDestroyFence = nullptr;
+    PFN_vkWaitForFences vkWaitForFences = nullptr;
+    PFN_vkQueueSubmit vkQueueSubmit = nullptr;
+    PFN_vkQueueSubmit2KHR vkQueueSubmit2 = nullptr;
+    PFN_vkQueueSubmit2KHR vkQueueSubmit2KHR = nullptr;
+    PFN_vkQueuePresentKHR vkQueuePresentKHR = nullptr;
+    PFN_vkCmdBindPipeline vkCmdBindPipeline = nullptr;
+    PFN_vkCmdBindDescriptorSets vkCmdBindDescriptorSets = nullptr;
+    PFN_vkCmdPushConstants vkCmdPushConstants = nullptr;
+    PFN_vkCmdDispatch vkCmdDispatch = nullptr;
+    PFN_vkCmdDispatchIndirect vkCmdDispatchIndirect = nullptr;
+    PFN_vkCmdCopyBuffer vkCmdCopyBuffer = nullptr;
+    PFN_vkCmdFillBuffer vkCmdFillBuffer = nullptr;
+    PFN_vkCmdUpdateBuffer vkCmdUpdateBuffer = nullptr;
+    PFN_vkCmdPipelineBarrier vkCmdPipelineBarrier = nullptr;
+    PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2 = nullptr;
+    PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR = nullptr;
+    /// Every command in COMMAND_BUFFER_COMMANDS, for those which are passed on without being captured.
+    std::array<PFN_vkVoidFunction, std::size(COMMAND_BUFFER_COMMANDS)> commands = {};
+};
+
+/**
+ * The commands recorded into a command buffer since it was last begun, and what they use.
+ */
+struct CommandStream {
+    /// Identifies this recording, as a command buffer may be recorded again within the frame.
+    uint64_t recording = 0;
+    CaptureWriter writer;
+    std::set<uint64_t> buffers;
+    std::set<uint64_t> pipelines;
+    std::set<uint64_t> descriptor_sets;
+    /// The first command recorded which cannot be captured, if any.
+    const char *unsupported = nullptr;
+};
+
+struct InstanceData {
+    VkInstance instance = VK_NULL_HANDLE;
+    PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+    PFN_vkDestroyInstance vkDestroyInstance = nullptr;
+    PFN_vkGetPhysicalDeviceMemoryProperties vkGetPhysicalDeviceMemoryProperties = nullptr;
+};
+
+struct DeviceData {
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceDispatch next;
+    PFN_vkSetDeviceLoaderData set_loader_data = nullptr;
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+
+    /// Guards everything below. Recording is serialised per device while capturing.
+    std::mutex mutex;
+    std::unordered_map<VkQueue, uint32_t> queue_families;
+    /// Every live buffer, without its contents.
+    std::unordered_map<uint64_t, CapturedBuffer> buffers;
+    std::unordered_map<uint64_t, uint32_t> memory_types;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> shader_modules;
+    // Layouts and pipelines are kept after they are destroyed, as objects created from them can outlive them.
+    std::unordered_map<uint64_t, CapturedSetLayout> set_layouts;
+    std::unordered_map<uint64_t, CapturedPipelineLayout> pipeline_layouts;
+    std::unordered_map<uint64_t, CapturedPipeline> pipelines;
+    std::unordered_map<uint64_t, CapturedDescriptorSet> descriptor_sets;
+    /// Descriptor sets holding descriptors other than buffers.
+    std::unordered_set<uint64_t> unsupported_sets;
+    std::unordered_map<VkCommandBuffer, CommandStream> command_streams;
+    uint64_t recordings = 0;
+
+    uint32_t frame = 0;
+    bool finished = false;
+    CaptureFile capture;
+    std::unordered_set<uint64_t> captured_buffers;
+    std::unordered_set<uint64_t> captured_pipelines;
+    std::unordered_set<uint64_t> captured_sets;
+    std::unordered_set<uint64_t> captured_recordings;
+    /// Why the frame cannot be written, if it cannot.
+    std::string failure;
+};
+
+struct CaptureSettings {
+    std::filesystem::path path;
+    uint32_t frame = 0;
+};
+
+static const std::optional<CaptureSettings> &capture_settings() {
+    static const auto settings = []() -> std::optional<CaptureSettings> {
+        const char *path = std::getenv("VK_CAPTURE_FILE");
+        if (!path || !*path) {
+            return std::nullopt;
+        }
+        const char *frame = std::getenv("VK_CAPTURE_FRAME");
+        return CaptureSettings{path, frame ? static_cast<uint32_t>(std::strtoul(frame, nullptr, 10)) : 0};
+    }();
+    return settings;
+}
+
+// Dispatchable handles point to objects starting with the loader's dispatch table, which every handle created from
+// the same instance or device shares, so it identifies them.
+
+static std::mutex layer_mutex;
+static std::unordered_map<void *, InstanceData> instances;
+static std::unordered_map<void *, std::unique_ptr<DeviceData>> devices;
+
+template<typename Handle>
+static void *dispatch_key(Handle handle) {
+    return *reinterpret_cast<void **>(handle);
+}
+
+template<typename Handle>
+static uint64_t id(Handle handle) {
+    return (uint64_t) handle;
+}
+
+template<typename Handle>
+static DeviceData &device_data(Handle handle) {
+    std::lock_guard lock(layer_mutex);
+    auto device = devices.find(dispatch_key(handle));
+    if (device == devices.end()) {
+        // Without the device's dispatch the call cannot be passed on, and an exception cannot reach the application.
+        std::cerr << "[capture] A handle from a device the layer did not see created was used" << std::endl;
+        std::abort();
+    }
+    return *device->second;
+}
+
+/**
+ * Runs the layer's bookkeeping for an entry point. An exception from it fails the capture rather than reaching the
+ * application. Must not be called with the device's mutex held.
+ */
+template<typename Function>
+static void guard(DeviceData &data, const char *entry_point, Function &&function) {
+    try {
+        function();
+    } catch (const std::exception &exception) {
+        std::cerr << "[capture] " << entry_point << ": " << exception.what() << std::endl;
+        std::lock_guard lock(data.mutex);
+        if (data.failure.empty()) {
+            data.failure = std::string("the layer failed in ") + entry_point;
+        }
+    }
+}
+
+/**
+ * @return Whether calls on a device are part of the frame being captured.
+ */
+static bool capturing(const DeviceData &data) {
+    const auto &settings = capture_settings();
+    return settings && !data.finished && data.frame == settings->frame;
+}
+
+template<typename CreateInfo>
+static CreateInfo *find_layer_info(const void *chain, VkStructureType type, VkLayerFunction function) {
+    for (auto *info = static_cast<const VkBaseInStructure *>(chain); info; info = info->pNext) {
+        auto *layer_info = reinterpret_cast<const CreateInfo *>(info);
+        if (info->sType == type && layer_info->function == function) {
+            return const_cast<CreateInfo *>(layer_info);
+        }
+    }
+    return nullptr;
+}
+
+// Capture
+
+/**
+ * Copies the contents of buffers out through a queue, after waiting for the device to be idle. Waiting only orders
+ * the copies after the application's work, so barriers make its writes visible to them, and theirs to the host.
+ */
+static void snapshot_buffers(DeviceData &data, VkQueue queue, const std::vector<uint64_t> &ids) {
+    auto &next = data.next;
+    next.vkDeviceWaitIdle(data.device);
+
+    VkCommandPoolCreateInfo pool_create_info;
+    pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.pNext = nullptr;
+    pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    const auto family = data.queue_families.find(queue);
+    if (family == data.queue_families.end()) {
+        data.failure = "the frame is submitted to a queue the layer did not see retrieved";
+        return;
+    }
+    pool_create_info.queueFamilyIndex = family->second;
+
+    VkCommandPool pool = VK_NULL_HANDLE;
+    if (next.vkCreateCommandPool(data.device, &pool_create_info, nullptr, &pool) != VK_SUCCESS) {
+        data.failure = "unable to create a command pool to copy buffers out";
+        return;
+    }
+
+    VkCommandBufferAllocateInfo allocate_info;
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.pNext = nullptr;
+    allocate_info.commandPool = pool;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    next.vkAllocateCommandBuffers(data.device, &allocate_info, &command_buffer);
+    // The loader only sets up the dispatch table of command buffers the application allocates.
+    data.set_loader_data(data.device, command_buffer);
+
+    VkCommandBufferBeginInfo begin_info;
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = nullptr;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = nullptr;
+    next.vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    VkMemoryBarrier application_writes;
+    application_writes.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    application_writes.pNext = nullptr;
+    application_writes.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    application_writes.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    next.vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                              1, &application_writes, 0, nullptr, 0, nullptr);
+
+    struct Readback {
+        CapturedBuffer *buffer;
+        VkBuffer readback;
+        VkDeviceMemory memory;
+    };
+    std::vector<Readback> readbacks;
+    for (auto buffer_id: ids) {
+        auto &buffer = data.buffers.at(buffer_id);
+
+        VkBufferCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.size = buffer.size;
+        create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        create_info.queueFamilyIndexCount = 0;
+        create_info.pQueueFamilyIndices = nullptr;
+
+        Readback readback = {&buffer, VK_NULL_HANDLE, VK_NULL_HANDLE};
+        next.vkCreateBuffer(data.device, &create_info, nullptr, &readback.readback);
+        VkMemoryRequirements requirements;
+        next.vkGetBufferMemoryRequirements(data.device, readback.readback, &requirements);
+
+        VkMemoryAllocateInfo memory_info;
+        memory_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memory_info.pNext = nullptr;
+        memory_info.allocationSize = requirements.size;
+        memory_info.memoryTypeIndex = UINT32_MAX;
+        constexpr VkMemoryPropertyFlags host_readable = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                                        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        for (uint32_t type = 0; type < data.memory_properties.memoryTypeCount; type++) {
+            if ((requirements.memoryTypeBits & (1u << type))
+                && (data.memory_properties.memoryTypes[type].propertyFlags & host_readable) == host_readable) {
+                memory_info.memoryTypeIndex = type;
+                break;
+            }
+        }
+        readbacks.push_back(readback);
+        if (memory_info.memoryTypeIndex == UINT32_MAX
+            || next.vkAllocateMemory(data.device, &memory_info, nullptr, &readbacks.back().memory) != VK_SUCCESS) {
+            data.failure = "unable to allocate host memory to copy buffers out";
+            break;
+        }
+        next.vkBindBufferMemory(data.device, readback.readback, readbacks.back().memory, 0);
+
+        VkBufferCopy region;
+        region.srcOffset = 0;
+        region.dstOffset = 0;
+        region.size = buffer.size;
+        next.vkCmdCopyBuffer(command_buffer, (VkBuffer) buffer.id, readback.readback, 1, &region);
+    }
+
+    VkMemoryBarrier copies;
+    copies.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    copies.pNext = nullptr;
+    copies.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    copies.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    next.vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                              &copies, 0, nullptr, 0, nullptr);
+    next.vkEndCommandBuffer(command_buffer);
+
+    if (data.failure.empty()) {
+        VkFenceCreateInfo fence_create_info;
+        fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_create_info.pNext = nullptr;
+        fence_create_info.flags = 0;
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+
+        VkFence fence = VK_NULL_HANDLE;
+        next.vkCreateFence(data.device, &fence_create_info, nullptr, &fence);
+        if (next.vkQueueSubmit(queue, 1, &submit_info, fence) != VK_SUCCESS
+            || next.vkWaitForFences(data.device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+            data.failure = "unable to copy buffers out";
+        }
+        next.vkDestroyFence(data.device, fence, nullptr);
+    }
+
+    for (auto &readback: readbacks) {
+        void *mapped = nullptr;
+        if (data.failure.empty()
+            && next.vkMapMemory(data.device, readback.memory, 0, VK_WHOLE_SIZE, 0, &mapped) == VK_SUCCESS) {
+            auto *bytes = static_cast<const std::byte *>(mapped);
+            readback.buffer->contents.assign(bytes, bytes + readback.buffer->size);
+            data.capture.buffers.push_back(*readback.buffer);
+            readback.buffer->contents.clear();
+        }
+        next.vkDestroyBuffer(data.device, readback.readback, nullptr);
+        // Freeing memory unmaps it.
+        next.vkFreeMemory(data.device, readback.memory, nullptr);
+    }
+    next.vkDestroyCommandPool(data.device, pool, nullptr);
+}
+
+/**
+ * Adds a submission to the frame, along with everything it uses which the frame does not have yet. Called before the
+ * submission is passed on, so that buffer contents are those from before it.
+ */
+static void capture_submit(DeviceData &data, VkQueue queue, const std::vector<VkCommandBuffer> &command_buffers) {
+    std::vector<uint64_t> recordings;
+    std::vector<uint64_t> new_buffers;
+    for (auto command_buffer: command_buffers) {
+        auto &stream = data.command_streams[command_buffer];
+        if (stream.unsupported && data.failure.empty()) {
+            data.failure = std::string("the frame records ") + stream.unsupported + ", which cannot be captured";
+        }
+
+        auto buffers = stream.buffers;
+        for (auto set_id: stream.descriptor_sets) {
+            if (data.unsupported_sets.contains(set_id) && data.failure.empty()) {
+                data.failure = "the frame uses descriptors other than buffers, which cannot be captured";
+            }
+            auto &set = data.descriptor_sets[set_id];
+            for (auto &write: set.writes) {
+                buffers.insert(write.buffer);
+            }
+            if (data.captured_sets.insert(set_id).second) {
+                data.capture.descriptor_sets.push_back(set);
+            }
+        }
+        for (auto buffer_id: buffers) {
+            if (data.buffers.contains(buffer_id) && data.captured_buffers.insert(buffer_id).second) {
+                new_buffers.push_back(buffer_id);
+            }
+        }
+        for (auto pipeline_id: stream.pipelines) {
+            auto pipeline = data.pipelines.find(pipeline_id);
+            if (pipeline == data.pipelines.end()) {
+                if (data.failure.empty()) {
+                    data.failure = "the frame binds a pipeline the layer did not see created";
+                }
+            } else if (data.captured_pipelines.insert(pipeline_id).second) {
+                data.capture.pipelines.push_back(pipeline->second);
+            }
+        }
+        if (data.captured_recordings.insert(stream.recording).second) {
+            data.capture.command_buffers.push_back({stream.recording, stream.writer.data});
+        }
+        recordings.push_back(stream.recording);
+    }
+
+    if (!new_buffers.empty() && data.failure.empty()) {
+        snapshot_buffers(data, queue, new_buffers);
+    }
+    data.capture.submits.push_back(std::move(recordings));
+}
+
+/**
+ * Writes the captured frame, or reports why it cannot be, and stops capturing.
+ */
+static void finish_capture(DeviceData &data) {
+    const auto &path = capture_settings()->path;
+    data.finished = true;
+    if (data.capture.submits.empty()) {
+        std::cerr << "[capture] Frame " << data.frame << " submitted nothing, not writing " << path << std::endl;
+        return;
+    }
+    if (!data.failure.empty()) {
+        std::cerr << "[capture] Unable to capture frame " << data.frame << ": " << data.failure << std::endl;
+        return;
+    }
+
+    for (auto &[layout_id, layout]: data.set_layouts) {
+        data.capture.set_layouts.push_back(layout);
+    }
+    for (auto &[layout_id, layout]: data.pipeline_layouts) {
+        data.capture.pipeline_layouts.push_back(layout);
+    }
+    try {
+        write_capture_file(path, data.capture);
+        std::cerr << "[capture] Wrote frame " << data.frame << " to " << path << std::endl;
+    } catch (const std::exception &exception) {
+        std::cerr << "[capture] " << exception.what() << std::endl;
+    }
+    data.capture = {};
+}
+
+/**
+ * Appends a command to the stream of a command buffer, if a capture is to be made.
+ * @param command The name of the command, for reporting failures.
+ */
+template<typename Function>
+static void record(DeviceData &data, VkCommandBuffer command_buffer, const char *command, Function &&write) {
+    if (!capture_settings()) {
+        return;
+    }
+    guard(data, command, [&] {
+        std::lock_guard lock(data.mutex);
+        if (!data.finished) {
+            write(data.command_streams[command_buffer]);
+        }
+    });
+}
+
+/**
+ * Marks the stream of a command buffer as recording something which cannot be captured.
+ * @param what What was recorded, for the report.
+ */
+static void record_unsupported(DeviceData &data, VkCommandBuffer command_buffer, const char *command,
+                               const char *what) {
+    record(data, command_buffer, command, [&](CommandStream &stream) {
+        if (!stream.unsupported) {
+            stream.unsupported = what;
+        }
+    });
+}
+
+// Instance
+
+static PFN_vkVoidFunction VKAPI_CALL get_instance_proc_addr(VkInstance instance, const char *name);
+
+static PFN_vkVoidFunction VKAPI_CALL get_device_proc_addr(VkDevice device, const char *name);
+
+static VkResult VKAPI_CALL create_instance(const VkInstanceCreateInfo *create_info,
+                                           const VkAllocationCallbacks *allocator, VkInstance *instance) {
+    auto *layer_info = find_layer_info<VkLayerInstanceCreateInfo>(
+            create_info->pNext, VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO, VK_LAYER_LINK_INFO);
+    if (!layer_info) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    const auto next_get_instance_proc_addr = layer_info->u.pLayerInfo->pfnNextGetInstanceProcAddr;
+    // Advance the chain for the next layer.
+    layer_info->u.pLayerInfo = layer_info->u.pLayerInfo->pNext;
+
+    const auto next_create_instance = reinterpret_cast<PFN_vkCreateInstance>(
+            next_get_instance_proc_addr(VK_NULL_HANDLE, "vkCreateInstance"));
+    const auto result = next_create_instance(create_info, allocator, instance);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    InstanceData data;
+    data.instance = *instance;
+    data.vkGetInstanceProcAddr = next_get_instance_proc_addr;
+    data.vkDestroyInstance = reinterpret_cast<PFN_vkDestroyInstance>(
+            next_get_instance_proc_addr(*instance, "vkDestroyInstance"));
+    data.vkGetPhysicalDeviceMemoryProperties = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties>(
+            next_get_instance_proc_addr(*instance, "vkGetPhysicalDeviceMemoryProperties"));
+
+    try {
+        std::lock_guard lock(layer_mutex);
+        instances[dispatch_key(*instance)] = data;
+    } catch (const std::exception &exception) {
+        std::cerr << "[capture] vkCreateInstance: " << exception.what() << std::endl;
+        data.vkDestroyInstance(*instance, allocator);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    return VK_SUCCESS;
+}
+
+static void VKAPI_CALL destroy_instance(VkInstance instance, const VkAllocationCallbacks *allocator) {
+    InstanceData data;
+    {
+        std::lock_guard lock(layer_mutex);
+        auto node = instances.extract(dispatch_key(instance));
+        data = node.mapped();
+    }
+    data.vkDestroyInstance(instance, allocator);
+}
+
+/**
+ * Sets up a device's data once it has been created.
+ */
+static void load_device(VkDevice device, VkPhysicalDevice physical_device, const InstanceData &instance_data,
+                        PFN_vkGetDeviceProcAddr next_get_device_proc_addr, PFN_vkSetDeviceLoaderData set_loader_data) {
+    auto data = std::make_unique<DeviceData>();
+    data->device = device;
+    data->set_loader_data = set_loader_data;
+    instance_data.vkGetPhysicalDeviceMemoryProperties(physical_device, &data->memory_properties);
+
+    auto &next = data->next;
+#define LOAD(NAME) next.NAME = reinterpret_cast<PFN_##NAME>(next_get_device_proc_addr(device, #NAME))
+    LOAD(vkGetDeviceProcAddr);
+    LOAD(vkDestroyDevice);
+    LOAD(vkGetDeviceQueue);
+    LOAD(vkGetDeviceQueue2);
+    LOAD(vkDeviceWaitIdle);
+    LOAD(vkCreateBuffer);
+    LOAD(vkDestroyBuffer);
+    LOAD(vkGetBufferMemoryRequirements);
+    LOAD(vkAllocateMemory);
+    LOAD(vkFreeMemory);
+    LOAD(vkMapMemory);
+    LOAD(vkBindBufferMemory);
+    LOAD(vkGetBufferDeviceAddress);
+    LOAD(vkCreateShaderModule);
+    LOAD(vkDestroyShaderModule);
+    LOAD(vkCreateDescriptorSetLayout);
+    LOAD(vkCreatePipelineLayout);
+    LOAD(vkCreateComputePipelines);
+    LOAD(vkAllocateDescriptorSets);
+    LOAD(vkUpdateDescriptorSets);
+    LOAD(vkCreateCommandPool);
+    LOAD(vkDestroyCommandPool);
+    LOAD(vkAllocateCommandBuffers);
+    LOAD(vkBeginCommandBuffer);
+    LOAD(vkEndCommandBuffer);
+    LOAD(vkCreateFence);
+    LOAD(vkDestroyFence);
+    LOAD(vkWaitForFences);
+    LOAD(vkQueueSubmit);
+    LOAD(vkQueuePresentKHR);
+    LOAD(vkCmdBindPipeline);
+    LOAD(vkCmdBindDescriptorSets);
+    LOAD(vkCmdPushConstants);
+    LOAD(vkCmdDispatch);
+    LOAD(vkCmdDispatchIndirect);
+    LOAD(vkCmdCopyBuffer);
+    LOAD(vkCmdFillBuffer);
+    LOAD(vkCmdUpdateBuffer);
+    LOAD(vkCmdPipelineBarrier);
+#undef LOAD
+    // The core and extension names of these commands share a signature.
+    next.vkGetBufferDeviceAddressKHR = reinterpret_cast<PFN_vkGetBufferDeviceAddress>(
+            next_get_device_proc_addr(device, "vkGetBufferDeviceAddressKHR"));
+    next.vkGetBufferDeviceAddressEXT = reinterpret_cast<PFN_vkGetBufferDeviceAddress>(
+            next_get_device_proc_addr(device, "vkGetBufferDeviceAddressEXT"));
+    next.vkQueueSubmit2 = reinterpret_cast<PFN_vkQueueSubmit2KHR>(next_get_device_proc_addr(device, "vkQueueSubmit2"));
+    next.vkQueueSubmit2KHR = reinterpret_cast<PFN_vkQueueSubmit2KHR>(
+            next_get_device_proc_addr(device, "vkQueueSubmit2KHR"));
+    next.vkCmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+            next_get_device_proc_addr(device, "vkCmdPipelineBarrier2"));
+    next.vkCmdPipelineBarrier2KHR = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+            next_get_device_proc_addr(device, "vkCmdPipelineBarrier2KHR"));
+    for (std::size_t i = 0; i < std::size(COMMAND_BUFFER_COMMANDS); i++) {
+        next.commands[i] = next_get_device_proc_addr(device, COMMAND_BUFFER_COMMANDS[i].data());
+    }
+
+    std::lock_guard lock(layer_mutex);
+    devices[dispatch_key(device)] = std::move(data);
+}
+
+static VkResult VKAPI_CALL create_device(VkPhysicalDevice physical_device, const VkDeviceCreateInfo *create_info,
+                                         const VkAllocationCallbacks *allocator, VkDevice *device) {
+    auto *layer_info = find_layer_info<VkLayerDeviceCreateInfo>(
+            create_info->pNext, VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO, VK_LAYER_LINK_INFO);
+    auto *callback_info = find_layer_info<VkLayerDeviceCreateInfo>(
+            create_info->pNext, VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO, VK_LOADER_DATA_CALLBACK);
+    if (!layer_info || !callback_info) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    const auto next_get_device_proc_addr = layer_info->u.pLayerInfo->pfnNextGetDeviceProcAddr;
+    layer_info->u.pLayerInfo = layer_info->u.pLayerInfo->pNext;
+
+    InstanceData instance_data;
+    {
+        std::lock_guard lock(layer_mutex);
+        auto instance = instances.find(dispatch_key(physical_device));
+        if (instance == instances.end()) {
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+        instance_data = instance->second;
+    }
+    const auto next_create_device = reinterpret_cast<PFN_vkCreateDevice>(
+            instance_data.vkGetInstanceProcAddr(instance_data.instance, "vkCreateDevice"));
+    const auto result = next_create_device(physical_device, create_info, allocator, device);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+
+    try {
+        load_device(*device, physical_device, instance_data, next_get_device_proc_addr,
+                    callback_info->u.pfnSetDeviceLoaderData);
+    } catch (const std::exception &exception) {
+        std::cerr << "[capture] vkCreateDevice: " << exception.what() << std::endl;
+        const auto next_destroy_device = reinterpret_cast<PFN_vkDestroyDevice>(
+                next_get_device_proc_addr(*device, "vkDestroyDevice"));
+        next_destroy_device(*device, allocator);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    return VK_SUCCESS;
+}
+
+// Device
+
+static void VKAPI_CALL destroy_device(VkDevice device, const VkAllocationCallbacks *allocator) {
+    std::unique_ptr<DeviceData> data;
+    {
+        std::lock_guard lock(layer_mutex);
+        data = std::move(devices.extract(dispatch_key(device)).mapped());
+    }
+    guard(*data, "vkDestroyDevice", [&] {
+        std::lock_guard lock(data->mutex);
+        if (capturing(*data)) {
+            finish_capture(*data);
+        }
+    });
+    data->next.vkDestroyDevice(device, allocator);
+}
+
+static void VKAPI_CALL get_device_queue(VkDevice device, uint32_t family, uint32_t index, VkQueue *queue) {
+    auto &data = device_data(device);
+    data.next.vkGetDeviceQueue(device, family, index, queue);
+    guard(data, "vkGetDeviceQueue", [&] {
+        std::lock_guard lock(data.mutex);
+        data.queue_families[*queue] = family;
+    });
+}
+
+static void VKAPI_CALL get_device_queue2(VkDevice device, const VkDeviceQueueInfo2 *queue_info, VkQueue *queue) {
+    auto &data = device_data(device);
+    data.next.vkGetDeviceQueue2(device, queue_info, queue);
+    // There is no queue if the flags do not match those it was created with.
+    if (!*queue) {
+        return;
+    }
+    guard(data, "vkGetDeviceQueue2", [&] {
+        std::lock_guard lock(data.mutex);
+        data.queue_families[*queue] = queue_info->queueFamilyIndex;
+    });
+}
+
+static VkResult VKAPI_CALL create_buffer(VkDevice device, const VkBufferCreateInfo *create_info,
+                                         const VkAllocationCallbacks *allocator, VkBuffer *buffer) {
+    auto &data = device_data(device);
+    if (!capture_settings()) {
+        return data.next.vkCreateBuffer(device, create_info, allocator, buffer);
+    }
+
+    auto readable_info = *create_info;
+    readable_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    const auto result = data.next.vkCreateBuffer(device, &readable_info, allocator, buffer);
+    if (result == VK_SUCCESS) {
+        guard(data, "vkCreateBuffer", [&] {
+            std::lock_guard lock(data.mutex);
+            data.buffers[id(*buffer)] = {id(*buffer), create_info->size, create_info->usage, 0, {}};
+        });
+    }
+    return result;
+}
+
+static void VKAPI_CALL destroy_buffer(VkDevice device, VkBuffer buffer, const VkAllocationCallbacks *allocator) {
+    auto &data = device_data(device);
+    {
+        std::lock_guard lock(data.mutex);
+        data.buffers.erase(id(buffer));
+    }
+    data.next.vkDestroyBuffer(device, buffer, allocator);
+}
+
+/**
+ * Fails the capture, as replay creates buffers at different addresses and cannot patch those the application
+ * stores.
+ */
+static void take_buffer_device_address(DeviceData &data, const char *entry_point) {
+    if (!capture_settings()) {
+        return;
+    }
+    guard(data, entry_point, [&] {
+        std::lock_guard lock(data.mutex);
+        if (data.failure.empty()) {
+            data.failure = "the application takes buffer device addresses, which replay cannot reproduce";
+        }
+    });
+}
+
+static VkDeviceAddress VKAPI_CALL get_buffer_device_address(VkDevice device, const VkBufferDeviceAddressInfo *info) {
+    auto &data = device_data(device);
+    take_buffer_device_address(data, "vkGetBufferDeviceAddress");
+    return data.next.vkGetBufferDeviceAddress(device, info);
+}
+
+static VkDeviceAddress VKAPI_CALL get_buffer_device_address_khr(VkDevice device,
+                                                                const VkBufferDeviceAddressInfo *info) {
+    auto &data = device_data(device);
+    take_buffer_device_address(data, "vkGetBufferDeviceAddressKHR");
+    return data.next.vkGetBufferDeviceAddressKHR(device, info);
+}
+
+static VkDeviceAddress VKAPI_CALL get_buffer_device_address_ext(VkDevice device,
+                                                                const VkBufferDeviceAddressInfo *info) {
+    auto &data = device_data(device);
+    take_buffer_device_address(data, "vkGetBufferDeviceAddressEXT");
+    return data.next.vkGetBufferDeviceAddressEXT(device, info);
+}
+
+static VkResult VKAPI_CALL allocate_memory(VkDevice device, const VkMemoryAllocateInfo *allocate_info,
+                                           const VkAllocationCallbacks *allocator, VkDeviceMemory *memory) {
+    auto &data = device_data(device);
+    const auto result = data.next.vkAllocateMemory(device, allocate_info, allocator, memory);
+    if (result == VK_SUCCESS) {
+        guard(data, "vkAllocateMemory", [&] {
+            std::lock_guard lock(data.mutex);
+            data.memory_types[id(*memory)] = allocate_info->memoryTypeIndex;
+        });
+    }
+    return result;
+}
+
+static void VKAPI_CALL free_memory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *allocator) {
+    auto &data = device_data(device);
+    {
+        std::lock_guard lock(data.mutex);
+        data.memory_types.erase(id(memory));
+    }
+    data.next.vkFreeMemory(device, memory, allocator);
+}
+
+static VkResult VKAPI_CALL bind_buffer_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory,
+                                              VkDeviceSize offset) {
+    auto &data = device_data(device);
+    {
+        std::lock_guard lock(data.mutex);
+        auto captured = data.buffers.find(id(buffer));
+        auto type = data.memory_types.find(id(memory));
+        if (captured != data.buffers.end() && type != data.memory_types.end()) {
+            captured->second.memory_properties = data.memory_properties.memoryTypes[type->second].propertyFlags;
+        }
+    }
+    return data.next.vkBindBufferMemory(device, buffer, memory, offset);
+}
+
+static VkResult VKAPI_CALL create_shader_module(VkDevice device, const VkShaderModuleCreateInfo *create_info,
+                                                const VkAllocationCallbacks *allocator, VkShaderModule *module) {
+    auto &data = device_data(device);
+    const auto result = data.next.vkCreateShaderModule(device, create_info, allocator, module);
+    if (result == VK_SUCCESS && capture_settings()) {
+        guard(data, "vkCreateShaderModule", [&] {
+            std::lock_guard lock(data.mutex);
+            data.shader_modules[id(*module)].assign(create_info->pCode,
+                                                    create_info->pCode + create_info->codeSize / 4);
+        });
+    }
+    return result;
+}
+
+static void VKAPI_CALL destroy_shader_module(VkDevice device, VkShaderModule module,
+                                             const VkAllocationCallbacks *allocator) {
+    auto &data = device_data(device);
+    {
+        std::lock_guard lock(data.mutex);
+        data.shader_modules.erase(id(module));
+    }
+    data.next.vkDestroyShaderModule(device, module, allocator);
+}
+
+static VkResult VKAPI_CALL create_descriptor_set_layout(VkDevice device,
+                                                        const VkDescriptorSetLayoutCreateInfo *create_info,
+                                                        const VkAllocationCallbacks *allocator,
+                                                        VkDescriptorSetLayout *layout) {
+    auto &data = device_data(device);
+    const auto result = data.next.vkCreateDescriptorSetLayout(device, create_info, allocator, layout);
+    if (result == VK_SUCCESS && capture_settings()) {
+        guard(data, "vkCreateDescriptorSetLayout", [&] {
+            CapturedSetLayout captured;
+            captured.id = id(*layout);
+            for (uint32_t i = 0; i < create_info->bindingCount; i++) {
+                const auto &binding = create_info->pBindings[i];
+                captured.bindings.push_back({binding.binding, binding.descriptorType, binding.descriptorCount,
+                                             binding.stageFlags});
+            }
+            std::lock_guard lock(data.mutex);
+            data.set_layouts[captured.id] = std::move(captured);
+        });
+    }
+    return result;
+}
+
+static VkResult VKAPI_CALL create_pipeline_layout(VkDevice device, const VkPipelineLayoutCreateInfo *create_info,
+                                                  const VkAllocationCallbacks *allocator, VkPipelineLayout *layout) {
+    auto &data = device_data(device);
+    const auto result = data.next.vkCreatePipelineLayout(device, create_info, allocator, layout);
+    if (result == VK_SUCCESS && capture_settings()) {
+        guard(data, "vkCreatePipelineLayout", [&] {
+            CapturedPipelineLayout captured;
+            captured.id = id(*layout);
+            for (uint32_t i = 0; i < create_info->setLayoutCount; i++) {
+                captured.set_layouts.push_back(id(create_info->pSetLayouts[i]));
+            }
+            captured.push_constant_ranges.assign(
+                    create_info->pPushConstantRanges,
+                    create_info->pPushConstantRanges + create_info->pushConstantRangeCount);
+            std::lock_guard lock(data.mutex);
+            data.pipeline_layouts[captured.id] = std::move(captured);
+        });
+    }
+    return result;
+}
+
+static VkResult VKAPI_CALL create_compute_pipelines(VkDevice device, VkPipelineCache cache, uint32_t count,
+                                                    const VkComputePipelineCreateInfo *create_infos,
+                                                    const VkAllocationCallbacks *allocator, VkPipeline *pipelines) {
+    auto &data = device_data(device);
+    const auto result = data.next.vkCreateComputePipelines(device, cache, count, create_infos, allocator, pipelines);
+    if (result != VK_SUCCESS || !capture_settings()) {
+        return result;
+    }
+
+    guard(data, "vkCreateComputePipelines", [&] {
+        std::lock_guard lock(data.mutex);
+        for (uint32_t i = 0; i < count; i++) {
+            const auto &stage = create_infos[i].stage;
+            CapturedPipeline captured;
+            captured.id = id(pipelines[i]);
+            captured.layout = id(create_infos[i].layout);
+            if (auto module = data.shader_modules.find(id(stage.module)); module != data.shader_modules.end()) {
+                captured.spirv = module->second;
+            }
+            captured.entry_point = stage.pName;
+            if (const auto *specialization = stage.pSpecializationInfo) {
+                captured.specialization_entries.assign(specialization->pMapEntries,
+                                                       specialization->pMapEntries + specialization->mapEntryCount);
+                const auto *bytes = static_cast<const std::byte *>(specialization->pData);
+                captured.specialization_data.assign(bytes, bytes + specialization->dataSize);
+            }
+            data.pipelines[captured.id] = std::move(captured);
+        }
+    });
+    return result;
+}
+
+static VkResult VKAPI_CALL allocate_descriptor_sets(VkDevice device, const VkDescriptorSetAllocateInfo *allocate_info,
+                                                    VkDescriptorSet *sets) {
+    auto &data = device_data(device);
+    const auto result = data.next.vkAllocateDescriptorSets(device, allocate_info, sets);
+    if (result == VK_SUCCESS && capture_settings()) {
+        guard(data, "vkAllocateDescriptorSets", [&] {
+            std::lock_guard lock(data.mutex);
+            for (uint32_t i = 0; i < allocate_info->descriptorSetCount; i++) {
+                data.descriptor_sets[id(sets[i])] = {id(sets[i]), id(allocate_info->pSetLayouts[i]), {}};
+                data.unsupported_sets.erase(id(sets[i]));
+            }
+        });
+    }
+    return result;
+}
+
+static bool buffer_descriptor(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+           || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+static void set_descriptor(CapturedDescriptorSet &set, const CapturedDescriptorWrite &write) {
+    for (auto &existing: set.writes) {
+        if (existing.binding == write.binding && existing.array_element == write.array_element) {
+            existing = write;
+            return;
+        }
+    }
+    set.writes.push_back(write);
+}
+
+/**
+ * Applies descriptor writes and copies to the captured sets.
+ */
+static void update_captured_sets(DeviceData &data, uint32_t write_count, const VkWriteDescriptorSet *writes,
+                                 uint32_t copy_count, const VkCopyDescriptorSet *copies) {
+    std::lock_guard lock(data.mutex);
+    for (uint32_t i = 0; i < write_count; i++) {
+        const auto &write = writes[i];
+        if (!buffer_descriptor(write.descriptorType)) {
+            data.unsupported_sets.insert(id(write.dstSet));
+            continue;
+        }
+        auto &set = data.descriptor_sets[id(write.dstSet)];
+        for (uint32_t element = 0; element < write.descriptorCount; element++) {
+            const auto &info = write.pBufferInfo[element];
+            set_descriptor(set, {write.dstBinding, write.dstArrayElement + element, write.descriptorType,
+                                 id(info.buffer), info.offset, info.range});
+        }
+    }
+    for (uint32_t i = 0; i < copy_count; i++) {
+        const auto &copy = copies[i];
+        if (data.unsupported_sets.contains(id(copy.srcSet))) {
+            data.unsupported_sets.insert(id(copy.dstSet));
+        }
+        const auto source = data.descriptor_sets[id(copy.srcSet)].writes;
+        auto &destination = data.descriptor_sets[id(copy.dstSet)];
+        for (auto write: source) {
+            const auto element = write.array_element - copy.srcArrayElement;
+            if (write.binding == copy.srcBinding && write.array_element >= copy.srcArrayElement
+                && element < copy.descriptorCount) {
+                write.binding = copy.dstBinding;
+                write.array_element = copy.dstArrayElement + element;
+                set_descriptor(destination, write);
+            }
+        }
+    }
+}
+
+static void VKAPI_CALL update_descriptor_sets(VkDevice device, uint32_t write_count, const VkWriteDescriptorSet *writes,
+                                              uint32_t copy_count, const VkCopyDescriptorSet *copies) {
+    auto &data = device_data(device);
+    data.next.vkUpdateDescriptorSets(device, write_count, writes, copy_count, copies);
+    if (capture_settings()) {
+        guard(data, "vkUpdateDescriptorSets",
+              [&] { update_captured_sets(data, write_count, writes, copy_count, copies); });
+    }
+}
+
+static VkResult VKAPI_CALL begin_command_buffer(VkCommandBuffer command_buffer,
+                                                const VkCommandBufferBeginInfo *begin_info) {
+    auto &data = device_data(command_buffer);
+    if (capture_settings()) {
+        guard(data, "vkBeginCommandBuffer", [&] {
+            std::lock_guard lock(data.mutex);
+            auto &stream = data.command_streams[command_buffer];
+            stream = {};
+            stream.recording = ++data.recordings;
+        });
+    }
+    return data.next.vkBeginCommandBuffer(command_buffer, begin_info);
+}
+
+static VkResult VKAPI_CALL queue_submit(VkQueue queue, uint32_t count, const VkSubmitInfo *submits, VkFence fence) {
+    auto &data = device_data(queue);
+    guard(data, "vkQueueSubmit", [&] {
+        std::lock_guard lock(data.mutex);
+        if (capturing(data)) {
+            for (uint32_t i = 0; i < count; i++) {
+                capture_submit(data, queue, {submits[i].pCommandBuffers,
+                                             submits[i].pCommandBuffers + submits[i].commandBufferCount});
+            }
+        }
+    });
+    return data.next.vkQueueSubmit(queue, count, submits, fence);
+}
+
+/**
+ * Captures the submissions of vkQueueSubmit2 or vkQueueSubmit2KHR.
+ */
+static void capture_submits2(DeviceData &data, VkQueue queue, uint32_t count, const VkSubmitInfo2KHR *submits) {
+    std::lock_guard lock(data.mutex);
+    if (!capturing(data)) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        std::vector<VkCommandBuffer> command_buffers;
+        for (uint32_t j = 0; j < submits[i].commandBufferInfoCount; j++) {
+            command_buffers.push_back(submits[i].pCommandBufferInfos[j].commandBuffer);
+        }
+        capture_submit(data, queue, command_buffers);
+    }
+}
+
+static VkResult VKAPI_CALL queue_submit2(VkQueue queue, uint32_t count, const VkSubmitInfo2KHR *submits,
+                                         VkFence fence) {
+    auto &data = device_data(queue);
+    guard(data, "vkQueueSubmit2", [&] { capture_submits2(data, queue, count, submits); });
+    return data.next.vkQueueSubmit2(queue, count, submits, fence);
+}
+
+static VkResult VKAPI_CALL queue_submit2_khr(VkQueue queue, uint32_t count, const VkSubmitInfo2KHR *submits,
+                                             VkFence fence) {
+    auto &data = device_data(queue);
+    guard(data, "vkQueueSubmit2KHR", [&] { capture_submits2(data, queue, count, submits); });
+    return data.next.vkQueueSubmit2KHR(queue, count, submits, fence);
+}
+
+static VkResult VKAPI_CALL queue_present(VkQueue queue, const VkPresentInfoKHR *present_info) {
+    auto &data = device_data(queue);
+    const auto result = data.next.vkQueuePresentKHR(queue, present_info);
+    guard(data, "vkQueuePresentKHR", [&] {
+        std::lock_guard lock(data.mutex);
+        if (capturing(data)) {
+            finish_capture(data);
+        }
+    });
+    std::lock_guard lock(data.mutex);
+    data.frame++;
+    return result;
+}
+
+// Commands
+
+static void VKAPI_CALL cmd_bind_pipeline(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point,
+                                         VkPipeline pipeline) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdBindPipeline(command_buffer, bind_point, pipeline);
+    if (bind_point != VK_PIPELINE_BIND_POINT_COMPUTE) {
+        return record_unsupported(data, command_buffer, "vkCmdBindPipeline", "a graphics pipeline");
+    }
+    record(data, command_buffer, "vkCmdBindPipeline", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::BindPipeline);
+        stream.writer.write(id(pipeline));
+        stream.pipelines.insert(id(pipeline));
+    });
+}
+
+static void VKAPI_CALL cmd_bind_descriptor_sets(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point,
+                                                VkPipelineLayout layout, uint32_t first_set, uint32_t set_count,
+                                                const VkDescriptorSet *sets, uint32_t dynamic_offset_count,
+                                                const uint32_t *dynamic_offsets) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdBindDescriptorSets(command_buffer, bind_point, layout, first_set, set_count, sets,
+                                      dynamic_offset_count, dynamic_offsets);
+    if (bind_point != VK_PIPELINE_BIND_POINT_COMPUTE) {
+        return record_unsupported(data, command_buffer, "vkCmdBindDescriptorSets", "graphics descriptor sets");
+    }
+    record(data, command_buffer, "vkCmdBindDescriptorSets", [&](CommandStream &stream) {
+        std::vector<uint64_t> set_ids;
+        for (uint32_t i = 0; i < set_count; i++) {
+            set_ids.push_back(id(sets[i]));
+            stream.descriptor_sets.insert(id(sets[i]));
+        }
+        stream.writer.write(CapturedCommand::BindDescriptorSets);
+        stream.writer.write(id(layout));
+        stream.writer.write(first_set);
+        stream.writer.write_array(set_ids);
+        stream.writer.write_array(std::span(dynamic_offsets, dynamic_offset_count));
+    });
+}
+
+static void VKAPI_CALL cmd_push_constants(VkCommandBuffer command_buffer, VkPipelineLayout layout,
+                                          VkShaderStageFlags stages, uint32_t offset, uint32_t size,
+                                          const void *values) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdPushConstants(command_buffer, layout, stages, offset, size, values);
+    record(data, command_buffer, "vkCmdPushConstants", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::PushConstants);
+        stream.writer.write(id(layout));
+        stream.writer.write(stages);
+        stream.writer.write(offset);
+        stream.writer.write_array(std::span(static_cast<const std::byte *>(values), size));
+    });
+}
+
+static void VKAPI_CALL cmd_dispatch(VkCommandBuffer command_buffer, uint32_t x, uint32_t y, uint32_t z) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdDispatch(command_buffer, x, y, z);
+    record(data, command_buffer, "vkCmdDispatch", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::Dispatch);
+        stream.writer.write(x);
+        stream.writer.write(y);
+        stream.writer.write(z);
+    });
+}
+
+static void VKAPI_CALL cmd_dispatch_indirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdDispatchIndirect(command_buffer, buffer, offset);
+    record(data, command_buffer, "vkCmdDispatchIndirect", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::DispatchIndirect);
+        stream.writer.write(id(buffer));
+        stream.writer.write(offset);
+        stream.buffers.insert(id(buffer));
+    });
+}
+
+static void VKAPI_CALL cmd_copy_buffer(VkCommandBuffer command_buffer, VkBuffer source, VkBuffer destination,
+                                       uint32_t region_count, const VkBufferCopy *regions) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdCopyBuffer(command_buffer, source, destination, region_count, regions);
+    record(data, command_buffer, "vkCmdCopyBuffer", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::CopyBuffer);
+        stream.writer.write(id(source));
+        stream.writer.write(id(destination));
+        stream.writer.write_array(std::span(regions, region_count));
+        stream.buffers.insert(id(source));
+        stream.buffers.insert(id(destination));
+    });
+}
+
+static void VKAPI_CALL cmd_fill_buffer(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset,
+                                       VkDeviceSize size, uint32_t value) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdFillBuffer(command_buffer, buffer, offset, size, value);
+    record(data, command_buffer, "vkCmdFillBuffer", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::FillBuffer);
+        stream.writer.write(id(buffer));
+        stream.writer.write(offset);
+        stream.writer.write(size);
+        stream.writer.write(value);
+        stream.buffers.insert(id(buffer));
+    });
+}
+
+static void VKAPI_CALL cmd_update_buffer(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset,
+                                         VkDeviceSize size, const void *values) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdUpdateBuffer(command_buffer, buffer, offset, size, values);
+    record(data, command_buffer, "vkCmdUpdateBuffer", [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::UpdateBuffer);
+        stream.writer.write(id(buffer));
+        stream.writer.write(offset);
+        stream.writer.write_array(std::span(static_cast<const std::byte *>(values), size));
+        stream.buffers.insert(id(buffer));
+    });
+}
+
+/**
+ * Records a barrier as a single memory barrier. Only buffers are captured, and a memory barrier covers every range of
+ * them, so this is at least as strong as the barriers it replaces.
+ */
+static void record_barrier(DeviceData &data, VkCommandBuffer command_buffer, const char *command,
+                           VkPipelineStageFlags2KHR source_stages, VkAccessFlags2KHR source_access,
+                           VkPipelineStageFlags2KHR destination_stages, VkAccessFlags2KHR destination_access) {
+    record(data, command_buffer, command, [&](CommandStream &stream) {
+        stream.writer.write(CapturedCommand::Barrier);
+        stream.writer.write(source_stages);
+        stream.writer.write(source_access);
+        stream.writer.write(destination_stages);
+        stream.writer.write(destination_access);
+    });
+}
+
+static void VKAPI_CALL cmd_pipeline_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags source_stages,
+                                            VkPipelineStageFlags destination_stages, VkDependencyFlags flags,
+                                            uint32_t memory_count, const VkMemoryBarrier *memory_barriers,
+                                            uint32_t buffer_count, const VkBufferMemoryBarrier *buffer_barriers,
+                                            uint32_t image_count, const VkImageMemoryBarrier *image_barriers) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdPipelineBarrier(command_buffer, source_stages, destination_stages, flags, memory_count,
+                                   memory_barriers, buffer_count, buffer_barriers, image_count, image_barriers);
+    // Legacy stage and access bits have the same values as their synchronization2 counterparts.
+    VkAccessFlags2KHR source_access = 0;
+    VkAccessFlags2KHR destination_access = 0;
+    for (uint32_t i = 0; i < memory_count; i++) {
+        source_access |= memory_barriers[i].srcAccessMask;
+        destination_access |= memory_barriers[i].dstAccessMask;
+    }
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        source_access |= buffer_barriers[i].srcAccessMask;
+        destination_access |= buffer_barriers[i].dstAccessMask;
+    }
+    for (uint32_t i = 0; i < image_count; i++) {
+        source_access |= image_barriers[i].srcAccessMask;
+        destination_access |= image_barriers[i].dstAccessMask;
+    }
+    record_barrier(data, command_buffer, "vkCmdPipelineBarrier", source_stages, source_access, destination_stages,
+                   destination_access);
+}
+
+static void record_barrier2(DeviceData &data, VkCommandBuffer command_buffer, const char *command,
+                            const VkDependencyInfoKHR *dependency) {
+    VkPipelineStageFlags2KHR source_stages = 0;
+    VkAccessFlags2KHR source_access = 0;
+    VkPipelineStageFlags2KHR destination_stages = 0;
+    VkAccessFlags2KHR destination_access = 0;
+    const auto add = [&](const auto *barriers, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            source_stages |= barriers[i].srcStageMask;
+            source_access |= barriers[i].srcAccessMask;
+            destination_stages |= barriers[i].dstStageMask;
+            destination_access |= barriers[i].dstAccessMask;
+        }
+    };
+    add(dependency->pMemoryBarriers, dependency->memoryBarrierCount);
+    add(dependency->pBufferMemoryBarriers, dependency->bufferMemoryBarrierCount);
+    add(dependency->pImageMemoryBarriers, dependency->imageMemoryBarrierCount);
+    record_barrier(data, command_buffer, command, source_stages, source_access, destination_stages,
+                   destination_access);
+}
+
+static void VKAPI_CALL cmd_pipeline_barrier2(VkCommandBuffer command_buffer, const VkDependencyInfoKHR *dependency) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdPipelineBarrier2(command_buffer, dependency);
+    record_barrier2(data, command_buffer, "vkCmdPipelineBarrier2", dependency);
+}
+
+static void VKAPI_CALL cmd_pipeline_barrier2_khr(VkCommandBuffer command_buffer,
+                                                 const VkDependencyInfoKHR *dependency) {
+    auto &data = device_data(command_buffer);
+    data.next.vkCmdPipelineBarrier2KHR(command_buffer, dependency);
+    record_barrier2(data, command_buffer, "vkCmdPipelineBarrier2KHR", dependency);
+}
+
+/**
+ * Passes on a command which cannot be captured, so that a frame recording it is reported rather than written without
+ * it. Instantiated for every command in COMMAND_BUFFER_COMMANDS.
+ * @tparam Function The command's function pointer type.
+ * @tparam Index The command's index in COMMAND_BUFFER_COMMANDS.
+ */
+template<typename Function, std::size_t Index>
+struct UnsupportedCommand;
+
+template<typename Result, typename... Args, std::size_t Index>
+struct UnsupportedCommand<Result (VKAPI_PTR *)(VkCommandBuffer, Args...), Index> {
+    static Result VKAPI_CALL call(VkCommandBuffer command_buffer, Args... args) {
+        using Function = Result (VKAPI_PTR *)(VkCommandBuffer, Args...);
+        static constexpr auto name = COMMAND_BUFFER_COMMANDS[Index];
+
+        auto &data = device_data(command_buffer);
+        record_unsupported(data, command_buffer, name.data(), name.data());
+        return reinterpret_cast<Function>(data.next.commands[Index])(command_buffer, args...);
+    }
+};
+
+// Entry points
+
+struct EntryPoint {
+    std::string_view name;
+    PFN_vkVoidFunction function;
+};
+
+#define ENTRY_POINT(NAME, FUNCTION) {NAME, reinterpret_cast<PFN_vkVoidFunction>(&FUNCTION)}
+
+static const EntryPoint INSTANCE_ENTRY_POINTS[] = {
+        ENTRY_POINT("vkGetInstanceProcAddr", get_instance_proc_addr),
+        ENTRY_POINT("vkCreateInstance", create_instance),
+        ENTRY_POINT("vkDestroyInstance", destroy_instance),
+        ENTRY_POINT("vkCreateDevice", create_device),
+};
+
+static const EntryPoint DEVICE_ENTRY_POINTS[] = {
+        ENTRY_POINT("vkGetDeviceProcAddr", get_device_proc_addr),
+        ENTRY_POINT("vkDestroyDevice", destroy_device),
+        ENTRY_POINT("vkGetDeviceQueue", get_device_queue),
+        ENTRY_POINT("vkGetDeviceQueue2", get_device_queue2),
+        ENTRY_POINT("vkCreateBuffer", create_buffer),
+        ENTRY_POINT("vkDestroyBuffer", destroy_buffer),
+        ENTRY_POINT("vkAllocateMemory", allocate_memory),
+        ENTRY_POINT("vkFreeMemory", free_memory),
+        ENTRY_POINT("vkBindBufferMemory", bind_buffer_memory),
+        ENTRY_POINT("vkGetBufferDeviceAddress", get_buffer_device_address),
+        ENTRY_POINT("vkGetBufferDeviceAddressKHR", get_buffer_device_address_khr),
+        ENTRY_POINT("vkGetBufferDeviceAddressEXT", get_buffer_device_address_ext),
+        ENTRY_POINT("vkCreateShaderModule", create_shader_module),
+        ENTRY_POINT("vkDestroyShaderModule", destroy_shader_module),
+        ENTRY_POINT("vkCreateDescriptorSetLayout", create_descriptor_set_layout),
+        ENTRY_POINT("vkCreatePipelineLayout", create_pipeline_layout),
+        ENTRY_POINT("vkCreateComputePipelines", create_compute_pipelines),
+        ENTRY_POINT("vkAllocateDescriptorSets", allocate_descriptor_sets),
+        ENTRY_POINT("vkUpdateDescriptorSets", update_descriptor_sets),
+        ENTRY_POINT("vkBeginCommandBuffer", begin_command_buffer),
+        ENTRY_POINT("vkQueueSubmit", queue_submit),
+        ENTRY_POINT("vkQueueSubmit2", queue_submit2),
+        ENTRY_POINT("vkQueueSubmit2KHR", queue_submit2_khr),
+        ENTRY_POINT("vkQueuePresentKHR", queue_present),
+        ENTRY_POINT("vkCmdBindPipeline", cmd_bind_pipeline),
+        ENTRY_POINT("vkCmdBindDescriptorSets", cmd_bind_descriptor_sets),
+        ENTRY_POINT("vkCmdPushConstants", cmd_push_constants),
+        ENTRY_POINT("vkCmdDispatch", cmd_dispatch),
+        ENTRY_POINT("vkCmdDispatchIndirect", cmd_dispatch_indirect),
+        ENTRY_POINT("vkCmdCopyBuffer", cmd_copy_buffer),
+        ENTRY_POINT("vkCmdFillBuffer", cmd_fill_buffer),
+        ENTRY_POINT("vkCmdUpdateBuffer", cmd_update_buffer),
+        ENTRY_POINT("vkCmdPipelineBarrier", cmd_pipeline_barrier),
+        ENTRY_POINT("vkCmdPipelineBarrier2", cmd_pipeline_barrier2),
+        ENTRY_POINT("vkCmdPipelineBarrier2KHR", cmd_pipeline_barrier2_khr),
+};
+
+#undef ENTRY_POINT
+
+/// Every command recorded into a command buffer, for those not in DEVICE_ENTRY_POINTS.
+static const EntryPoint UNSUPPORTED_ENTRY_POINTS[] = {
+#define UNSUPPORTED_ENTRY_POINT(NAME) \
+        {#NAME, reinterpret_cast<PFN_vkVoidFunction>(&UnsupportedCommand<PFN_##NAME, command_index(#NAME)>::call)},
+        VK_REFLECTION_COMMAND_BUFFER_COMMANDS(UNSUPPORTED_ENTRY_POINT)
+#undef UNSUPPORTED_ENTRY_POINT
+};
+
+/// Commands which only annotate a command buffer for debugging tools, so are passed straight through.
+static constexpr std::string_view ANNOTATION_COMMANDS[] = {
+        "vkCmdBeginDebugUtilsLabelEXT",
+        "vkCmdEndDebugUtilsLabelEXT",
+        "vkCmdInsertDebugUtilsLabelEXT",
+        "vkCmdDebugMarkerBeginEXT",
+        "vkCmdDebugMarkerEndEXT",
+        "vkCmdDebugMarkerInsertEXT",
+};
+
+template<std::size_t N>
+static PFN_vkVoidFunction find_entry_point(const EntryPoint (&entry_points)[N], std::string_view name) {
+    for (auto &entry_point: entry_points) {
+        if (entry_point.name == name) {
+            return entry_point.function;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @return The layer's function for a device command, or null if it passes the command straight through.
+ */
+static PFN_vkVoidFunction find_device_entry_point(std::string_view name) {
+    if (auto function = find_entry_point(DEVICE_ENTRY_POINTS, name)) {
+        return function;
+    }
+    if (std::ranges::find(ANNOTATION_COMMANDS, name) != std::ranges::end(ANNOTATION_COMMANDS)) {
+        return nullptr;
+    }
+    return find_entry_point(UNSUPPORTED_ENTRY_POINTS, name);
+}
+
+static PFN_vkVoidFunction VKAPI_CALL get_device_proc_addr(VkDevice device, const char *name) {
+    auto &data = device_data(device);
+    // Commands of extensions which are not enabled must stay null.
+    const auto next_function = data.next.vkGetDeviceProcAddr(device, name);
+    if (!next_function) {
+        return nullptr;
+    }
+    if (auto function = find_device_entry_point(name)) {
+        return function;
+    }
+    return next_function;
+}
+
+static PFN_vkVoidFunction VKAPI_CALL get_instance_proc_addr(VkInstance instance, const char *name) {
+    if (auto function = find_entry_point(INSTANCE_ENTRY_POINTS, name)) {
+        return function;
+    }
+    if (auto function = find_device_entry_point(name)) {
+        return function;
+    }
+    if (!instance) {
+        return nullptr;
+    }
+    std::lock_guard lock(layer_mutex);
+    auto data = instances.find(dispatch_key(instance));
+    return data != instances.end() ? data->second.vkGetInstanceProcAddr(instance, name) : nullptr;
+}
+
+extern "C" {
+
+#if defined(_WIN32)
+__declspec(dllexport)
+#else
+__attribute__((visibility("default")))
+#endif
+VKAPI_ATTR VkResult VKAPI_CALL vkNegotiateLoaderLayerInterfaceVersion(VkNegotiateLayerInterface *interface) {
+    if (interface->sType != LAYER_NEGOTIATE_INTERFACE_STRUCT || interface->loaderLayerInterfaceVersion < 2) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    interface->loaderLayerInterfaceVersion = 2;
+    interface->pfnGetInstanceProcAddr = get_instance_proc_addr;
+    interface->pfnGetDeviceProcAddr = get_device_proc_addr;
+    interface->pfnGetPhysicalDeviceProcAddr = nullptr;
+    return VK_SUCCESS;
+}
+
+}
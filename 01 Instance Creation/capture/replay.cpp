@@ -0,0 +1,604 @@
+/*
+ * Replays a frame written by the capture layer in a loop, timing each run, so that a frame's GPU work can be
+ * benchmarked and profiled without the application that produced it. Runs headless, so it works on lavapipe as well
+ * as on a GPU.
+ *     vulkan_replay <capture file> [iterations]
+ * Every buffer is restored to its captured contents before each run, so every run does the same work.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <unordered_map>
+
+#include "capture_format.hpp"
+#include "gpu_timer.hpp"
+#include "memory_pool.hpp"
+#include "staging_uploader.hpp"
+#include "synchronization.hpp"
+#include "vulkan_bootstrap.hpp"
+
+/// Runs made before timing, while caches and clocks warm up.
+static constexpr uint32_t WARM_UP_ITERATIONS = 3;
+static constexpr uint32_t DEFAULT_ITERATIONS = 100;
+
+/**
+ * The vulkan objects recreated from a capture.
+ */
+class Replay {
+public:
+    Replay(const LogicalDevice &device, const DeviceQueueFamily &family, const CaptureFile &capture);
+
+    Replay(const Replay &) = delete;
+
+    Replay &operator=(const Replay &) = delete;
+
+    ~Replay();
+
+    /**
+     * Restores the buffers and runs the frame once, waiting for it to complete.
+     * @return The time the frame took in nanoseconds, measured with timestamps if the queue supports them, else from
+     *         the host including the restore.
+     */
+    double run();
+
+private:
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocation allocation;
+        /// The captured contents, copied over the buffer before each run.
+        VkBuffer initial = VK_NULL_HANDLE;
+        MemoryAllocation initial_allocation;
+        VkDeviceSize size = 0;
+    };
+
+    template<typename Handle>
+    static Handle find(const std::unordered_map<uint64_t, Handle> &objects, uint64_t id, const char *kind) {
+        auto object = objects.find(id);
+        if (object == objects.end()) {
+            throw std::runtime_error(std::string("Unable to replay capture: it uses a ") + kind + " it does not hold");
+        }
+        return object->second;
+    }
+
+    VkBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags preferred,
+                           MemoryAllocation &allocation);
+
+    void create_buffers(const CaptureFile &capture);
+
+    void create_pipelines(const CaptureFile &capture);
+
+    void create_descriptor_sets(const CaptureFile &capture);
+
+    void record_command_buffers(const CaptureFile &capture);
+
+    void record(VkCommandBuffer command_buffer, const CapturedCommandBuffer &captured);
+
+    const LogicalDevice &device;
+    const DeviceQueueFamily &family;
+    VkQueue queue;
+    MemoryPool pool;
+    std::optional<GpuTimer> timer;
+
+    std::unordered_map<uint64_t, Buffer> buffers;
+    std::unordered_map<uint64_t, VkDescriptorSetLayout> set_layouts;
+    std::unordered_map<uint64_t, VkPipelineLayout> pipeline_layouts;
+    std::unordered_map<uint64_t, VkPipeline> pipelines;
+    std::unordered_map<uint64_t, VkDescriptorSet> descriptor_sets;
+    std::unordered_map<uint64_t, VkCommandBuffer> command_buffers;
+    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    /// Restores the buffers and starts the timer.
+    VkCommandBuffer begin_command_buffer = VK_NULL_HANDLE;
+    /// Stops the timer.
+    VkCommandBuffer end_command_buffer = VK_NULL_HANDLE;
+    /// The command buffers of each submission, bracketed by the begin and end command buffers.
+    std::vector<std::vector<VkCommandBufferSubmitInfoKHR>> submits;
+    VkFence fence = VK_NULL_HANDLE;
+};
+
+Replay::Replay(const LogicalDevice &device, const DeviceQueueFamily &family, const CaptureFile &capture)
+        : device(device), family(family), queue(family.queues.front()), pool(device) {
+    if (GpuTimer::supported(device, family)) {
+        timer.emplace(device, family, 2);
+    }
+
+    VkCommandPoolCreateInfo pool_create_info;
+    pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_create_info.pNext = nullptr;
+    pool_create_info.flags = 0;
+    pool_create_info.queueFamilyIndex = family.index;
+    check_device_result(vkCreateCommandPool(device.device, &pool_create_info, nullptr, &command_pool),
+                        "Unable to create command pool");
+
+    VkFenceCreateInfo fence_create_info;
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.pNext = nullptr;
+    fence_create_info.flags = 0;
+    check_device_result(vkCreateFence(device.device, &fence_create_info, nullptr, &fence), "Unable to create fence");
+
+    create_buffers(capture);
+    create_pipelines(capture);
+    create_descriptor_sets(capture);
+    record_command_buffers(capture);
+}
+
+Replay::~Replay() {
+    vkDeviceWaitIdle(device.device);
+    vkDestroyFence(device.device, fence, nullptr);
+    vkDestroyCommandPool(device.device, command_pool, nullptr);
+    vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
+    for (auto &[id, pipeline]: pipelines) {
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+    }
+    for (auto &[id, layout]: pipeline_layouts) {
+        vkDestroyPipelineLayout(device.device, layout, nullptr);
+    }
+    for (auto &[id, layout]: set_layouts) {
+        vkDestroyDescriptorSetLayout(device.device, layout, nullptr);
+    }
+    for (auto &[id, buffer]: buffers) {
+        vkDestroyBuffer(device.device, buffer.buffer, nullptr);
+        vkDestroyBuffer(device.device, buffer.initial, nullptr);
+        pool.free(buffer.allocation);
+        pool.free(buffer.initial_allocation);
+    }
+}
+
+VkBuffer Replay::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags preferred,
+                               MemoryAllocation &allocation) {
+    VkBufferCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.size = size;
+    create_info.usage = usage;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.queueFamilyIndexCount = 0;
+    create_info.pQueueFamilyIndices = nullptr;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    check_device_result(vkCreateBuffer(device.device, &create_info, nullptr, &buffer), "Unable to create buffer");
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+    allocation = pool.allocate(requirements, 0, preferred);
+    check_device_result(vkBindBufferMemory(device.device, buffer, allocation.memory, allocation.offset),
+                        "Unable to bind buffer memory");
+    return buffer;
+}
+
+void Replay::create_buffers(const CaptureFile &capture) {
+    StagingUploader uploader(device, pool);
+    for (auto &captured: capture.buffers) {
+        // Device addresses differ between runs, so they cannot be replayed.
+        const auto usage = (captured.usage & ~VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+                           | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        const auto preferred = captured.memory_properties & ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+        Buffer buffer;
+        buffer.size = captured.size;
+        buffer.buffer = create_buffer(captured.size, usage, preferred, buffer.allocation);
+        buffer.initial = create_buffer(captured.size,
+                                       VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer.initial_allocation);
+        uploader.upload(buffer.initial, 0, captured.contents);
+        buffers[captured.id] = buffer;
+    }
+    uploader.flush();
+}
+
+void Replay::create_pipelines(const CaptureFile &capture) {
+    for (auto &captured: capture.set_layouts) {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        for (auto &binding: captured.bindings) {
+            bindings.push_back({binding.binding, binding.type, binding.count, binding.stages, nullptr});
+        }
+
+        VkDescriptorSetLayoutCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        create_info.pBindings = bindings.data();
+        check_device_result(vkCreateDescriptorSetLayout(device.device, &create_info, nullptr,
+                                                        &set_layouts[captured.id]),
+                            "Unable to create descriptor set layout");
+    }
+
+    for (auto &captured: capture.pipeline_layouts) {
+        std::vector<VkDescriptorSetLayout> layouts;
+        for (auto layout_id: captured.set_layouts) {
+            layouts.push_back(find(set_layouts, layout_id, "descriptor set layout"));
+        }
+
+        VkPipelineLayoutCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.setLayoutCount = static_cast<uint32_t>(layouts.size());
+        create_info.pSetLayouts = layouts.data();
+        create_info.pushConstantRangeCount = static_cast<uint32_t>(captured.push_constant_ranges.size());
+        create_info.pPushConstantRanges = captured.push_constant_ranges.data();
+        check_device_result(vkCreatePipelineLayout(device.device, &create_info, nullptr,
+                                                   &pipeline_layouts[captured.id]),
+                            "Unable to create pipeline layout");
+    }
+
+    for (auto &captured: capture.pipelines) {
+        VkShaderModuleCreateInfo module_create_info;
+        module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_create_info.pNext = nullptr;
+        module_create_info.flags = 0;
+        module_create_info.codeSize = captured.spirv.size() * sizeof(uint32_t);
+        module_create_info.pCode = captured.spirv.data();
+
+        VkShaderModule module = VK_NULL_HANDLE;
+        check_device_result(vkCreateShaderModule(device.device, &module_create_info, nullptr, &module),
+                            "Unable to create shader module");
+
+        VkSpecializationInfo specialization;
+        specialization.mapEntryCount = static_cast<uint32_t>(captured.specialization_entries.size());
+        specialization.pMapEntries = captured.specialization_entries.data();
+        specialization.dataSize = captured.specialization_data.size();
+        specialization.pData = captured.specialization_data.data();
+
+        VkComputePipelineCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        create_info.stage.pNext = nullptr;
+        create_info.stage.flags = 0;
+        create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        create_info.stage.module = module;
+        create_info.stage.pName = captured.entry_point.c_str();
+        create_info.stage.pSpecializationInfo = &specialization;
+        create_info.layout = find(pipeline_layouts, captured.layout, "pipeline layout");
+        create_info.basePipelineHandle = VK_NULL_HANDLE;
+        create_info.basePipelineIndex = -1;
+
+        const auto result = vkCreateComputePipelines(device.device, VK_NULL_HANDLE, 1, &create_info, nullptr,
+                                                     &pipelines[captured.id]);
+        vkDestroyShaderModule(device.device, module, nullptr);
+        check_device_result(result, "Unable to create compute pipeline");
+    }
+}
+
+void Replay::create_descriptor_sets(const CaptureFile &capture) {
+    if (capture.descriptor_sets.empty()) {
+        return;
+    }
+
+    std::map<VkDescriptorType, uint32_t> descriptor_counts;
+    for (auto &set: capture.descriptor_sets) {
+        for (auto &layout: capture.set_layouts) {
+            if (layout.id != set.layout) {
+                continue;
+            }
+            for (auto &binding: layout.bindings) {
+                descriptor_counts[binding.type] += binding.count;
+            }
+        }
+    }
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (auto [type, count]: descriptor_counts) {
+        pool_sizes.push_back({type, std::max(count, 1u)});
+    }
+
+    VkDescriptorPoolCreateInfo pool_create_info;
+    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_create_info.pNext = nullptr;
+    pool_create_info.flags = 0;
+    pool_create_info.maxSets = static_cast<uint32_t>(capture.descriptor_sets.size());
+    pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_create_info.pPoolSizes = pool_sizes.data();
+    check_device_result(vkCreateDescriptorPool(device.device, &pool_create_info, nullptr, &descriptor_pool),
+                        "Unable to create descriptor pool");
+
+    for (auto &captured: capture.descriptor_sets) {
+        const auto layout = find(set_layouts, captured.layout, "descriptor set layout");
+
+        VkDescriptorSetAllocateInfo allocate_info;
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.pNext = nullptr;
+        allocate_info.descriptorPool = descriptor_pool;
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &layout;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        check_device_result(vkAllocateDescriptorSets(device.device, &allocate_info, &set),
+                            "Unable to allocate descriptor set");
+        descriptor_sets[captured.id] = set;
+
+        std::vector<VkDescriptorBufferInfo> buffer_infos;
+        buffer_infos.reserve(captured.writes.size());
+        std::vector<VkWriteDescriptorSet> writes;
+        for (auto &write: captured.writes) {
+            buffer_infos.push_back({find(buffers, write.buffer, "buffer").buffer, write.offset, write.range});
+
+            VkWriteDescriptorSet descriptor_write;
+            descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write.pNext = nullptr;
+            descriptor_write.dstSet = set;
+            descriptor_write.dstBinding = write.binding;
+            descriptor_write.dstArrayElement = write.array_element;
+            descriptor_write.descriptorCount = 1;
+            descriptor_write.descriptorType = write.type;
+            descriptor_write.pImageInfo = nullptr;
+            descriptor_write.pBufferInfo = &buffer_infos.back();
+            descriptor_write.pTexelBufferView = nullptr;
+            writes.push_back(descriptor_write);
+        }
+        vkUpdateDescriptorSets(device.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void Replay::record_command_buffers(const CaptureFile &capture) {
+    VkCommandBufferAllocateInfo allocate_info;
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.pNext = nullptr;
+    allocate_info.commandPool = command_pool;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = static_cast<uint32_t>(capture.command_buffers.size() + 2);
+
+    std::vector<VkCommandBuffer> allocated(allocate_info.commandBufferCount);
+    check_device_result(vkAllocateCommandBuffers(device.device, &allocate_info, allocated.data()),
+                        "Unable to allocate command buffers");
+    begin_command_buffer = allocated[0];
+    end_command_buffer = allocated[1];
+
+    VkCommandBufferBeginInfo begin_info;
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = nullptr;
+    begin_info.flags = 0;
+    begin_info.pInheritanceInfo = nullptr;
+
+    // Whatever the previous run left in flight must finish before the buffers are restored, and the restore before
+    // the frame starts.
+    BarrierBatch barriers(device);
+    vkBeginCommandBuffer(begin_command_buffer, &begin_info);
+    if (timer) {
+        timer->reset(begin_command_buffer);
+    }
+    barriers.memory_barrier(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, VK_ACCESS_2_MEMORY_WRITE_BIT_KHR,
+                            VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+                            VK_ACCESS_2_TRANSFER_READ_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+    barriers.flush(begin_command_buffer);
+    for (auto &[id, buffer]: buffers) {
+        VkBufferCopy region;
+        region.srcOffset = 0;
+        region.dstOffset = 0;
+        region.size = buffer.size;
+        vkCmdCopyBuffer(begin_command_buffer, buffer.initial, buffer.buffer, 1, &region);
+    }
+    barriers.memory_barrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+                            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+                            VK_ACCESS_2_MEMORY_READ_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR);
+    barriers.flush(begin_command_buffer);
+    if (timer) {
+        timer->timestamp(begin_command_buffer, 0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
+    check_device_result(vkEndCommandBuffer(begin_command_buffer), "Unable to record command buffer");
+
+    vkBeginCommandBuffer(end_command_buffer, &begin_info);
+    if (timer) {
+        timer->timestamp(end_command_buffer, 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    }
+    check_device_result(vkEndCommandBuffer(end_command_buffer), "Unable to record command buffer");
+
+    for (std::size_t i = 0; i < capture.command_buffers.size(); i++) {
+        auto command_buffer = allocated[i + 2];
+        vkBeginCommandBuffer(command_buffer, &begin_info);
+        record(command_buffer, capture.command_buffers[i]);
+        check_device_result(vkEndCommandBuffer(command_buffer), "Unable to record command buffer");
+        command_buffers[capture.command_buffers[i].id] = command_buffer;
+    }
+
+    VkCommandBufferSubmitInfoKHR submit_info;
+    submit_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+    submit_info.pNext = nullptr;
+    submit_info.deviceMask = 0;
+
+    submit_info.commandBuffer = begin_command_buffer;
+    submits.push_back({submit_info});
+    for (auto &captured: capture.submits) {
+        auto &submit = submits.emplace_back();
+        for (auto id: captured) {
+            submit_info.commandBuffer = find(command_buffers, id, "command buffer");
+            submit.push_back(submit_info);
+        }
+    }
+    submit_info.commandBuffer = end_command_buffer;
+    submits.push_back({submit_info});
+}
+
+void Replay::record(VkCommandBuffer command_buffer, const CapturedCommandBuffer &captured) {
+    // The captured command buffer was ordered against earlier ones by semaphores or barriers which are not replayed,
+    // and submissions run back to back here, so order it after everything before it.
+    BarrierBatch barriers(device);
+    barriers.memory_barrier(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, VK_ACCESS_2_MEMORY_WRITE_BIT_KHR,
+                            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+                            VK_ACCESS_2_MEMORY_READ_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR);
+    barriers.flush(command_buffer);
+
+    CaptureReader reader(captured.commands);
+    while (reader.remaining() > 0) {
+        switch (reader.read<CapturedCommand>()) {
+            case CapturedCommand::BindPipeline:
+                vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                  find(pipelines, reader.read<uint64_t>(), "pipeline"));
+                break;
+            case CapturedCommand::BindDescriptorSets: {
+                const auto layout = find(pipeline_layouts, reader.read<uint64_t>(), "pipeline layout");
+                const auto first_set = reader.read<uint32_t>();
+                std::vector<VkDescriptorSet> sets;
+                for (auto set_id: reader.read_array<uint64_t>()) {
+                    sets.push_back(find(descriptor_sets, set_id, "descriptor set"));
+                }
+                const auto dynamic_offsets = reader.read_array<uint32_t>();
+                vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, first_set,
+                                        static_cast<uint32_t>(sets.size()), sets.data(),
+                                        static_cast<uint32_t>(dynamic_offsets.size()), dynamic_offsets.data());
+                break;
+            }
+            case CapturedCommand::PushConstants: {
+                const auto layout = find(pipeline_layouts, reader.read<uint64_t>(), "pipeline layout");
+                const auto stages = reader.read<VkShaderStageFlags>();
+                const auto offset = reader.read<uint32_t>();
+                const auto values = reader.read_array<std::byte>();
+                vkCmdPushConstants(command_buffer, layout, stages, offset, static_cast<uint32_t>(values.size()),
+                                   values.data());
+                break;
+            }
+            case CapturedCommand::Dispatch: {
+                const auto x = reader.read<uint32_t>();
+                const auto y = reader.read<uint32_t>();
+                const auto z = reader.read<uint32_t>();
+                vkCmdDispatch(command_buffer, x, y, z);
+                break;
+            }
+            case CapturedCommand::DispatchIndirect: {
+                const auto buffer = find(buffers, reader.read<uint64_t>(), "buffer").buffer;
+                vkCmdDispatchIndirect(command_buffer, buffer, reader.read<VkDeviceSize>());
+                break;
+            }
+            case CapturedCommand::CopyBuffer: {
+                const auto source = find(buffers, reader.read<uint64_t>(), "buffer").buffer;
+                const auto destination = find(buffers, reader.read<uint64_t>(), "buffer").buffer;
+                const auto regions = reader.read_array<VkBufferCopy>();
+                vkCmdCopyBuffer(command_buffer, source, destination, static_cast<uint32_t>(regions.size()),
+                                regions.data());
+                break;
+            }
+            case CapturedCommand::FillBuffer: {
+                const auto buffer = find(buffers, reader.read<uint64_t>(), "buffer").buffer;
+                const auto offset = reader.read<VkDeviceSize>();
+                const auto size = reader.read<VkDeviceSize>();
+                vkCmdFillBuffer(command_buffer, buffer, offset, size, reader.read<uint32_t>());
+                break;
+            }
+            case CapturedCommand::UpdateBuffer: {
+                const auto buffer = find(buffers, reader.read<uint64_t>(), "buffer").buffer;
+                const auto offset = reader.read<VkDeviceSize>();
+                const auto values = reader.read_array<std::byte>();
+                vkCmdUpdateBuffer(command_buffer, buffer, offset, values.size(), values.data());
+                break;
+            }
+            case CapturedCommand::Barrier: {
+                const auto source_stages = reader.read<VkPipelineStageFlags2KHR>();
+                const auto source_access = reader.read<VkAccessFlags2KHR>();
+                const auto destination_stages = reader.read<VkPipelineStageFlags2KHR>();
+                const auto destination_access = reader.read<VkAccessFlags2KHR>();
+                barriers.memory_barrier(source_stages, source_access, destination_stages, destination_access);
+                barriers.flush(command_buffer);
+                break;
+            }
+            default:
+                throw std::runtime_error("Unable to replay capture: unknown command");
+        }
+    }
+}
+
+double Replay::run() {
+    std::vector<VkSubmitInfo2KHR> submit_infos;
+    for (auto &submit: submits) {
+        VkSubmitInfo2KHR submit_info;
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+        submit_info.pNext = nullptr;
+        submit_info.flags = 0;
+        submit_info.waitSemaphoreInfoCount = 0;
+        submit_info.pWaitSemaphoreInfos = nullptr;
+        submit_info.commandBufferInfoCount = static_cast<uint32_t>(submit.size());
+        submit_info.pCommandBufferInfos = submit.data();
+        submit_info.signalSemaphoreInfoCount = 0;
+        submit_info.pSignalSemaphoreInfos = nullptr;
+        submit_infos.push_back(submit_info);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    check_device_result(queue_submit2(device, queue, submit_infos, fence), "Unable to submit frame");
+    check_device_result(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX), "Unable to wait for frame");
+    const auto host_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    vkResetFences(device.device, 1, &fence);
+    return timer ? timer->elapsed(0, 1).value() : host_time;
+}
+
+static int replay(const std::filesystem::path &path, uint32_t iterations) {
+    const auto capture = read_capture_file(path);
+    std::cout << "Replaying " << path.string() << ": " << capture.buffers.size() << " buffers, "
+              << capture.pipelines.size() << " pipelines, " << capture.command_buffers.size()
+              << " command buffers in " << capture.submits.size() << " submits" << std::endl;
+
+    auto bootstrap = start_vulkan_bootstrap({}, {}, {}).get();
+    auto device = DeviceBuilder().request_performance_features().build(bootstrap.capabilities);
+    std::cout << "Device: " << device.capabilities->properties.deviceName << std::endl;
+
+    // StagingUploader restores on a graphics queue when there is one, and buffers are used without ownership transfers.
+    const auto *family = device.find_queue_family(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if (!family) {
+        family = device.find_queue_family(VK_QUEUE_COMPUTE_BIT);
+    }
+    if (!family) {
+        throw std::runtime_error("Unable to replay capture: the device has no compute queue");
+    }
+
+    const bool gpu_timed = GpuTimer::supported(device, *family);
+    std::vector<double> times;
+    {
+        Replay replay(device, *family, capture);
+        for (uint32_t i = 0; i < WARM_UP_ITERATIONS; i++) {
+            replay.run();
+        }
+        for (uint32_t i = 0; i < iterations; i++) {
+            times.push_back(replay.run() / 1e6);
+        }
+    }
+    destroy_logical_device(device);
+    vkDestroyInstance(bootstrap.instance, nullptr);
+
+    std::sort(times.begin(), times.end());
+    const auto mean = std::accumulate(times.begin(), times.end(), 0.0) / static_cast<double>(times.size());
+    std::cout << std::fixed << std::setprecision(3)
+              << iterations << " runs, " << (gpu_timed ? "GPU" : "host") << " timed:"
+              << std::endl
+              << "    Min:    " << times.front() << " ms" << std::endl
+              << "    Median: " << times[times.size() / 2] << " ms" << std::endl
+              << "    Mean:   " << mean << " ms" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: vulkan_replay <capture file> [iterations]" << std::endl;
+        return 2;
+    }
+    const auto iterations = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : DEFAULT_ITERATIONS;
+    if (iterations == 0) {
+        std::cerr << "Iterations must be a positive number" << std::endl;
+        return 2;
+    }
+
+    // Replay never presents, so it runs without a display, given GLFW 3.4's null platform.
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 4
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (glfwInit() != GLFW_TRUE) {
+        std::cerr << "Unable to initialise GLFW" << std::endl;
+        return 1;
+    }
+
+    int result;
+    try {
+        result = replay(argv[1], iterations);
+    } catch (const std::exception &exception) {
+        std::cerr << exception.what() << std::endl;
+        result = 1;
+    }
+    glfwTerminate();
+    return result;
+}
@@ -0,0 +1,240 @@
+#include "compute_skinning.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "device_address.hpp"
+
+ComputeSkinning::ComputeSkinning(const LogicalDevice &device, MemoryPool &pool, VkShaderModule shader,
+                                 const ComputeSkinningLimits &limits, uint32_t frames_in_flight,
+                                 uint32_t workgroup_size, VkPipelineCache cache)
+        : device(device), pool(pool), limits(limits), frames_in_flight(frames_in_flight),
+          workgroup_size(workgroup_size), barriers(device) {
+    if (!device.enabled_features.vulkan12.bufferDeviceAddress || !device.enabled_features.vulkan12.scalarBlockLayout) {
+        throw std::runtime_error("Compute skinning requires the bufferDeviceAddress and scalarBlockLayout features");
+    }
+    if (frames_in_flight == 0) {
+        throw std::runtime_error("Compute skinning needs at least one frame in flight");
+    }
+    const auto &device_limits = device.capabilities->properties.limits;
+    if (limits.instances_per_update > device_limits.maxComputeWorkGroupCount[1]) {
+        throw std::runtime_error("Compute skinning cannot dispatch that many instances per update");
+    }
+    if (workgroup_size == 0 || workgroup_size > device_limits.maxComputeWorkGroupSize[0]
+        || workgroup_size > device_limits.maxComputeWorkGroupInvocations) {
+        throw std::runtime_error("Compute skinning workgroups of " + std::to_string(workgroup_size)
+                                 + " invocations do not fit the device");
+    }
+
+    frame_size = VkDeviceSize(limits.instances_per_update) * sizeof(SkinningJob)
+                 + VkDeviceSize(limits.joints_per_update) * sizeof(JointTransform);
+
+    try {
+        constexpr VkBufferUsageFlags STORAGE = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                                               | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        source_buffer = create_buffer(VkDeviceSize(limits.source_vertices) * sizeof(SkinnedVertex),
+                                      STORAGE | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0, source_allocation);
+        output_buffer = create_buffer(VkDeviceSize(limits.output_vertices) * sizeof(SkinnedOutputVertex),
+                                      STORAGE | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      0, output_allocation);
+        // Poses change every frame, so they are written straight into memory the GPU reads.
+        frame_buffer = create_buffer(frame_size * frames_in_flight, STORAGE,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     frame_allocation);
+
+        VkPushConstantRange push_constant_range;
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(SkinningPushConstants);
+
+        VkPipelineLayoutCreateInfo layout_create_info;
+        layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_create_info.pNext = nullptr;
+        layout_create_info.flags = 0;
+        layout_create_info.setLayoutCount = 0;
+        layout_create_info.pSetLayouts = nullptr;
+        layout_create_info.pushConstantRangeCount = 1;
+        layout_create_info.pPushConstantRanges = &push_constant_range;
+        check_device_result(vkCreatePipelineLayout(device.device, &layout_create_info, nullptr, &pipeline_layout),
+                            "Unable to create skinning pipeline layout");
+
+        const VkSpecializationMapEntry specialization_entry = {0, 0, sizeof(uint32_t)};
+        VkSpecializationInfo specialization_info;
+        specialization_info.mapEntryCount = 1;
+        specialization_info.pMapEntries = &specialization_entry;
+        specialization_info.dataSize = sizeof(workgroup_size);
+        specialization_info.pData = &workgroup_size;
+
+        VkComputePipelineCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        create_info.stage.pNext = nullptr;
+        create_info.stage.flags = 0;
+        create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        create_info.stage.module = shader;
+        create_info.stage.pName = "main";
+        create_info.stage.pSpecializationInfo = &specialization_info;
+        create_info.layout = pipeline_layout;
+        create_info.basePipelineHandle = VK_NULL_HANDLE;
+        create_info.basePipelineIndex = -1;
+        check_device_result(vkCreateComputePipelines(device.device, cache, 1, &create_info, nullptr, &pipeline),
+                            "Unable to create skinning pipeline");
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+ComputeSkinning::~ComputeSkinning() {
+    destroy();
+}
+
+VkBuffer ComputeSkinning::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required,
+                                        MemoryAllocation &allocation) {
+    VkBufferCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.size = size;
+    create_info.usage = usage;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.queueFamilyIndexCount = 0;
+    create_info.pQueueFamilyIndices = nullptr;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    check_device_result(vkCreateBuffer(device.device, &create_info, nullptr, &buffer),
+                        "Unable to create skinning buffer");
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+    try {
+        // Memory the host writes takes the tuning profile's preference, e.g. device local with resizable BAR.
+        allocation = pool.allocate(requirements, required,
+                                   required ? device.tuning.dynamic_memory
+                                            : VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+        check_device_result(vkBindBufferMemory(device.device, buffer, allocation.memory, allocation.offset),
+                            "Unable to bind skinning memory");
+    } catch (...) {
+        vkDestroyBuffer(device.device, buffer, nullptr);
+        throw;
+    }
+    return buffer;
+}
+
+void ComputeSkinning::destroy() {
+    vkDestroyPipeline(device.device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
+    vkDestroyBuffer(device.device, frame_buffer, nullptr);
+    pool.free(frame_allocation);
+    vkDestroyBuffer(device.device, output_buffer, nullptr);
+    pool.free(output_allocation);
+    vkDestroyBuffer(device.device, source_buffer, nullptr);
+    pool.free(source_allocation);
+}
+
+uint32_t ComputeSkinning::add_mesh(StagingUploader &uploader, std::span<const SkinnedVertex> vertices,
+                                   uint32_t joint_count) {
+    if (vertices.size() > limits.source_vertices - source_vertices) {
+        throw std::runtime_error("Unable to add skinned mesh: the source vertices are used up");
+    }
+
+    uploader.upload(source_buffer, VkDeviceSize(source_vertices) * sizeof(SkinnedVertex), std::as_bytes(vertices));
+    meshes.push_back({source_vertices, static_cast<uint32_t>(vertices.size()), joint_count});
+    source_vertices += static_cast<uint32_t>(vertices.size());
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+uint32_t ComputeSkinning::add_instance(uint32_t mesh) {
+    const auto vertex_count = meshes.at(mesh).vertex_count;
+    if (vertex_count > limits.output_vertices - output_vertices) {
+        throw std::runtime_error("Unable to add skinned instance: the output vertices are used up");
+    }
+
+    instances.push_back({mesh, output_vertices});
+    output_vertices += vertex_count;
+    return static_cast<uint32_t>(instances.size() - 1);
+}
+
+void ComputeSkinning::update(VkCommandBuffer command_buffer, uint32_t frame, std::span<const SkinningPose> poses) {
+    if (frame >= frames_in_flight) {
+        throw std::runtime_error("Skinning frame " + std::to_string(frame) + " is not in flight");
+    }
+    if (poses.empty()) {
+        return;
+    }
+
+    // Passes of the previous frame may still be reading the vertices being overwritten, the previous update may still
+    // be writing them, and the bind poses of meshes added since the last update were written by the uploader's copies.
+    barriers.memory_barrier(VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR | VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR
+                            | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                            VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+                            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                            VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+    barriers.flush(command_buffer);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    dispatch(command_buffer, frame, poses, workgroup_size);
+
+    barriers.memory_barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+                            VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR,
+                            VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT_KHR);
+    barriers.flush(command_buffer);
+}
+
+void ComputeSkinning::dispatch(VkCommandBuffer command_buffer, uint32_t frame, std::span<const SkinningPose> poses,
+                               uint32_t group_width) {
+    if (poses.size() > limits.instances_per_update) {
+        throw std::runtime_error("Unable to skin " + std::to_string(poses.size()) + " instances in one update");
+    }
+
+    auto *frame_data = static_cast<std::byte *>(frame_allocation.mapped) + frame_size * frame;
+    auto *jobs = reinterpret_cast<SkinningJob *>(frame_data);
+    auto *joints = reinterpret_cast<JointTransform *>(frame_data + limits.instances_per_update * sizeof(SkinningJob));
+
+    uint32_t joint_count = 0;
+    uint32_t largest = 0;
+    for (std::size_t i = 0; i < poses.size(); i++) {
+        const auto &instance = instances.at(poses[i].instance);
+        const auto &mesh = meshes[instance.mesh];
+        if (poses[i].joints.size() != mesh.joint_count) {
+            throw std::runtime_error("Pose of skinned instance " + std::to_string(poses[i].instance) + " has "
+                                     + std::to_string(poses[i].joints.size()) + " joints, but its mesh has "
+                                     + std::to_string(mesh.joint_count));
+        }
+        if (mesh.joint_count > limits.joints_per_update - joint_count) {
+            throw std::runtime_error("Unable to skin the poses: the joints per update are used up");
+        }
+
+        jobs[i] = {mesh.first_source_vertex, instance.first_output_vertex, mesh.vertex_count, joint_count};
+        std::memcpy(joints + joint_count, poses[i].joints.data(), poses[i].joints.size_bytes());
+        joint_count += mesh.joint_count;
+        largest = std::max(largest, mesh.vertex_count);
+    }
+
+    SkinningPushConstants constants;
+    constants.source_vertices = buffer_device_address(device, source_buffer);
+    constants.output_vertices = buffer_device_address(device, output_buffer);
+    constants.jobs = buffer_device_address(device, frame_buffer) + frame_size * frame;
+    constants.joints = constants.jobs + limits.instances_per_update * sizeof(SkinningJob);
+
+    vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(command_buffer, (largest + group_width - 1) / group_width, static_cast<uint32_t>(poses.size()), 1);
+}
+
+TunableKernel ComputeSkinning::tunable_kernel(VkShaderModule shader, std::span<const SkinningPose> poses,
+                                              std::vector<VkExtent2D> workgroup_sizes) {
+    TunableKernel kernel;
+    kernel.name = "skinning";
+    kernel.shader = shader;
+    kernel.layout = pipeline_layout;
+    kernel.dimensions = 1;
+    kernel.workgroup_sizes = std::move(workgroup_sizes);
+    kernel.dispatch = [this, poses](VkCommandBuffer command_buffer, const KernelConfiguration &configuration) {
+        dispatch(command_buffer, 0, poses, configuration.workgroup_size.width);
+    };
+    return kernel;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "staging_uploader.hpp"
+#include "synchronization.hpp"
+#include "workgroup_tuner.hpp"
+
+/**
+ * A bind pose vertex, in scalar layout.
+ */
+struct SkinnedVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+    /// Four joint indices, 8 bits each with the first in the lowest bits.
+    uint32_t joints;
+    /// Four unorm8 joint weights, packed like joints.
+    uint32_t weights;
+};
+
+/**
+ * A vertex after skinning, in scalar layout, as passes drawing skinned meshes read it from the vertex buffer.
+ */
+struct SkinnedOutputVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+/**
+ * The rows of a joint's skinning matrix, which takes bind pose positions to the current pose.
+ */
+struct JointTransform {
+    float rows[3][4];
+};
+
+/**
+ * One instance to skin in a dispatch, as the skinning shader reads it.
+ */
+struct SkinningJob {
+    uint32_t first_source_vertex;
+    uint32_t first_output_vertex;
+    uint32_t vertex_count;
+    uint32_t first_joint;
+};
+
+struct SkinningPushConstants {
+    VkDeviceAddress source_vertices;
+    VkDeviceAddress output_vertices;
+    VkDeviceAddress jobs;
+    VkDeviceAddress joints;
+};
+
+static_assert(sizeof(SkinnedVertex) == 40 && sizeof(SkinnedOutputVertex) == 32 && sizeof(JointTransform) == 48,
+              "Shaders assume these sizes");
+
+/**
+ * The capacities of a ComputeSkinning.
+ */
+struct ComputeSkinningLimits {
+    /// The bind pose vertices of every mesh added.
+    uint32_t source_vertices = 1 << 20;
+    /// The skinned vertices of every instance added.
+    uint32_t output_vertices = 1 << 22;
+    /// The instances skinned by one update.
+    uint32_t instances_per_update = 1024;
+    /// The joint transforms of every instance skinned by one update.
+    uint32_t joints_per_update = 1 << 16;
+};
+
+/**
+ * The pose of an instance to skin in an update.
+ */
+struct SkinningPose {
+    uint32_t instance = 0;
+    /// One transform per joint of the instance's mesh.
+    std::span<const JointTransform> joints;
+};
+
+/**
+ * Skins every animated instance in one compute dispatch, writing the results into a shared vertex buffer. Depth,
+ * shadow and main passes all draw the same pre-skinned vertices, so skinning runs once per frame however many passes
+ * and shadow cascades draw an instance.
+ * The shader takes its workgroup width from specialization constant 0, as in layout(local_size_x_id = 0) in;, and
+ * reads SkinningPushConstants through buffer_reference pointers in scalar layout. Workgroup y handles SkinningJob y,
+ * each invocation x below its vertex_count transforming vertex x by the weighted sum of its joints' transforms, and
+ * writing the position, normal and unchanged uv.
+ * shaders/skinning.comp is a reference implementation, compiled by the build where glslangValidator is found.
+ */
+class ComputeSkinning {
+public:
+    static constexpr uint32_t DEFAULT_WORKGROUP_SIZE = 64;
+
+    /**
+     * @param device The device, which must have the bufferDeviceAddress and scalarBlockLayout features enabled.
+     * @param pool The pool the buffers are allocated from.
+     * @param shader The skinning shader, which may be destroyed once this returns.
+     * @param limits The capacities of the buffers.
+     * @param frames_in_flight The number of updates which may be executing at once, each getting its own poses.
+     * @param workgroup_size The workgroup width, e.g. as tuned through tunable_kernel().
+     * @param cache The pipeline cache, or VK_NULL_HANDLE.
+     */
+    ComputeSkinning(const LogicalDevice &device, MemoryPool &pool, VkShaderModule shader,
+                    const ComputeSkinningLimits &limits, uint32_t frames_in_flight,
+                    uint32_t workgroup_size = DEFAULT_WORKGROUP_SIZE, VkPipelineCache cache = VK_NULL_HANDLE);
+
+    ComputeSkinning(const ComputeSkinning &) = delete;
+
+    ComputeSkinning &operator=(const ComputeSkinning &) = delete;
+
+    /**
+     * Destroys the buffers and pipeline, which must no longer be in use.
+     */
+    ~ComputeSkinning();
+
+    /**
+     * Queues the upload of a mesh's bind pose. It may be skinned once the uploader is flushed, by updates recorded
+     * for the uploader's queue.
+     * @param uploader The uploader.
+     * @param vertices The bind pose vertices.
+     * @param joint_count The number of joints the mesh's vertices refer to.
+     * @return The index of the mesh.
+     * @throws std::runtime_error if the source vertices are used up.
+     */
+    uint32_t add_mesh(StagingUploader &uploader, std::span<const SkinnedVertex> vertices, uint32_t joint_count);
+
+    /**
+     * Reserves output vertices for an instance of a mesh, which keep their place in the vertex buffer.
+     * @return The index of the instance.
+     * @throws std::runtime_error if the output vertices are used up.
+     */
+    uint32_t add_instance(uint32_t mesh);
+
+    /**
+     * @return The index of an instance's first vertex in vertex_buffer(), to draw it with as the vertex offset.
+     */
+    uint32_t first_vertex(uint32_t instance) const { return instances[instance].first_output_vertex; }
+
+    /**
+     * @return The buffer of skinned vertices, of SkinnedOutputVertex, which may also be copied from.
+     */
+    VkBuffer vertex_buffer() const { return output_buffer; }
+
+    /**
+     * Records skinning the posed instances, after a barrier making the bind poses copied by the uploader visible to
+     * the shader, and ending with a barrier making their vertices visible to vertex input. Instances not posed keep
+     * the vertices of their last update.
+     * @param command_buffer The command buffer, for a queue with compute support.
+     * @param frame The frame in flight, below frames_in_flight. Its previous update must have completed.
+     * @param poses The instances to skin.
+     * @throws std::runtime_error if a pose does not match its mesh, or the poses exceed the per update limits.
+     */
+    void update(VkCommandBuffer command_buffer, uint32_t frame, std::span<const SkinningPose> poses);
+
+    /**
+     * Describes the skinning shader to a WorkgroupTuner, under the name "skinning". Each run skins the poses with the
+     * candidate's workgroup width, writing them into frame 0, which must not be in flight while tuning.
+     * @param shader The skinning shader, which must outlive the tuning.
+     * @param poses The poses each run skins, which must outlive the tuning.
+     * @param workgroup_sizes The candidates, e.g. WorkgroupTuner::seeded_workgroup_sizes() of the tuning profile.
+     */
+    TunableKernel tunable_kernel(VkShaderModule shader, std::span<const SkinningPose> poses,
+                                 std::vector<VkExtent2D> workgroup_sizes);
+
+private:
+    struct Mesh {
+        uint32_t first_source_vertex;
+        uint32_t vertex_count;
+        uint32_t joint_count;
+    };
+
+    struct Instance {
+        uint32_t mesh;
+        uint32_t first_output_vertex;
+    };
+
+    VkBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags required,
+                           MemoryAllocation &allocation);
+
+    /**
+     * Writes the jobs and joints of the poses into a frame, and records the dispatch skinning them with a skinning
+     * pipeline already bound.
+     */
+    void dispatch(VkCommandBuffer command_buffer, uint32_t frame, std::span<const SkinningPose> poses,
+                  uint32_t group_width);
+
+    void destroy();
+
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    ComputeSkinningLimits limits;
+    uint32_t frames_in_flight;
+    uint32_t workgroup_size;
+    VkBuffer source_buffer = VK_NULL_HANDLE;
+    MemoryAllocation source_allocation;
+    VkBuffer output_buffer = VK_NULL_HANDLE;
+    MemoryAllocation output_allocation;
+    /// The jobs and then the joint transforms of each frame in flight, host visible.
+    VkBuffer frame_buffer = VK_NULL_HANDLE;
+    MemoryAllocation frame_allocation;
+    VkDeviceSize frame_size = 0;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    uint32_t source_vertices = 0;
+    uint32_t output_vertices = 0;
+    BarrierBatch barriers;
+};
@@ -0,0 +1,127 @@
+#include "device_address.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+VkDeviceAddress buffer_device_address(const LogicalDevice &device, VkBuffer buffer) {
+    VkBufferDeviceAddressInfo address_info;
+    address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    address_info.pNext = nullptr;
+    address_info.buffer = buffer;
+    return vkGetBufferDeviceAddress(device.device, &address_info);
+}
+
+GpuRecord GpuHeapBuilder::add(std::span<const std::byte> bytes, VkDeviceSize alignment) {
+    GpuRecord record;
+    record.offset = (data.size() + alignment - 1) & ~(alignment - 1);
+    record.size = bytes.size();
+    data.resize(record.offset + record.size);
+    std::memcpy(data.data() + record.offset, bytes.data(), bytes.size());
+    return record;
+}
+
+void GpuHeapBuilder::link(GpuRecord from, VkDeviceSize field, GpuRecord to, VkDeviceSize to_offset) {
+    if (field + sizeof(VkDeviceAddress) > from.size || to_offset > to.size) {
+        throw std::runtime_error("Unable to link GPU records: the pointer lies outside a record");
+    }
+    links.push_back({from.offset + field, to.offset + to_offset});
+}
+
+GpuHeap::GpuHeap(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader,
+                 const GpuHeapBuilder &builder) : device(device), pool(pool) {
+    if (!device.enabled_features.vulkan12.bufferDeviceAddress) {
+        throw std::runtime_error("GPU heaps require the bufferDeviceAddress feature");
+    }
+    if (builder.data.empty()) {
+        throw std::runtime_error("Unable to create a GPU heap without records");
+    }
+
+    VkBufferCreateInfo buffer_create_info;
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.pNext = nullptr;
+    buffer_create_info.flags = 0;
+    buffer_create_info.size = builder.data.size();
+    buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                               | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_create_info.queueFamilyIndexCount = 0;
+    buffer_create_info.pQueueFamilyIndices = nullptr;
+
+    check_device_result(vkCreateBuffer(device.device, &buffer_create_info, nullptr, &heap_buffer),
+                        "Unable to create GPU heap buffer");
+
+    try {
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device.device, heap_buffer, &requirements);
+        allocation = pool.allocate(requirements, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        check_device_result(vkBindBufferMemory(device.device, heap_buffer, allocation.memory, allocation.offset),
+                            "Unable to bind GPU heap memory");
+    } catch (...) {
+        pool.free(allocation);
+        vkDestroyBuffer(device.device, heap_buffer, nullptr);
+        throw;
+    }
+    base_address = buffer_device_address(device, heap_buffer);
+
+    // Only now is it known where each record lives.
+    auto bytes = builder.data;
+    for (auto &link: builder.links) {
+        const VkDeviceAddress address = base_address + link.target;
+        std::memcpy(bytes.data() + link.field, &address, sizeof(address));
+    }
+    uploader.upload(heap_buffer, 0, bytes);
+}
+
+GpuHeap::~GpuHeap() {
+    vkDestroyBuffer(device.device, heap_buffer, nullptr);
+    pool.free(allocation);
+}
+
+SceneTables::SceneTables(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader,
+                         std::span<const GpuMaterial> materials, std::span<const SceneInstance> instances)
+        : heap(device, pool, uploader, build_heap(materials, instances)) {
+    constants.instances = heap.address(instance_table);
+    constants.materials = heap.address(material_table);
+    constants.instance_count = static_cast<uint32_t>(instances.size());
+    constants.material_count = static_cast<uint32_t>(materials.size());
+}
+
+GpuHeapBuilder SceneTables::build_heap(std::span<const GpuMaterial> materials,
+                                       std::span<const SceneInstance> instances) {
+    std::vector<GpuInstance> gpu_instances;
+    gpu_instances.reserve(instances.size());
+    for (auto &instance: instances) {
+        if (instance.material >= materials.size()) {
+            throw std::runtime_error("Scene instance uses material " + std::to_string(instance.material)
+                                     + ", which does not exist");
+        }
+        GpuInstance gpu_instance;
+        std::memcpy(gpu_instance.transform, instance.transform, sizeof(gpu_instance.transform));
+        gpu_instance.material = 0;
+        gpu_instance.object_data = instance.object_data;
+        gpu_instances.push_back(gpu_instance);
+    }
+
+    GpuHeapBuilder builder;
+    material_table = builder.add(materials);
+    instance_table = builder.add(std::span<const GpuInstance>(gpu_instances));
+    for (std::size_t i = 0; i < instances.size(); i++) {
+        builder.link(instance_table, i * sizeof(GpuInstance) + offsetof(GpuInstance, material), material_table,
+                     instances[i].material * sizeof(GpuMaterial));
+    }
+    return builder;
+}
+
+VkPushConstantRange SceneTables::push_constant_range(VkShaderStageFlags stages, uint32_t offset) {
+    VkPushConstantRange range;
+    range.stageFlags = stages;
+    range.offset = offset;
+    range.size = sizeof(ScenePushConstants);
+    return range;
+}
+
+void SceneTables::push(VkCommandBuffer command_buffer, VkPipelineLayout layout, VkShaderStageFlags stages,
+                       uint32_t offset) const {
+    vkCmdPushConstants(command_buffer, layout, stages, offset, sizeof(constants), &constants);
+}
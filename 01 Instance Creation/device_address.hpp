@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "staging_uploader.hpp"
+
+/**
+ * @return The device address of a buffer created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT.
+ */
+VkDeviceAddress buffer_device_address(const LogicalDevice &device, VkBuffer buffer);
+
+/**
+ * A record added to a GpuHeapBuilder, by its position in the heap.
+ */
+struct GpuRecord {
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
+
+/**
+ * Lays out records of GPU side data which point to each other, such as an instance table whose entries point into a
+ * material table. Pointer fields are filled in with device addresses once the heap is created, so records can be
+ * linked before anyone knows where they will live.
+ */
+class GpuHeapBuilder {
+public:
+    /**
+     * Appends a record.
+     * @param data The bytes of the record.
+     * @param alignment The alignment of the record, which must be a power of two. Shaders assume 16 unless they
+     *                  declare buffer_reference_align.
+     * @return The record.
+     */
+    GpuRecord add(std::span<const std::byte> data, VkDeviceSize alignment = 16);
+
+    template<typename T>
+    GpuRecord add(std::span<const T> records, VkDeviceSize alignment = 16) {
+        return add(std::as_bytes(records), alignment);
+    }
+
+    /**
+     * Makes a pointer field of one record point into another.
+     * @param from The record holding the pointer.
+     * @param field The offset of the VkDeviceAddress field in that record.
+     * @param to The record pointed to.
+     * @param to_offset The offset pointed to in that record.
+     */
+    void link(GpuRecord from, VkDeviceSize field, GpuRecord to, VkDeviceSize to_offset = 0);
+
+private:
+    friend class GpuHeap;
+
+    struct Link {
+        VkDeviceSize field;
+        VkDeviceSize target;
+    };
+
+    std::vector<std::byte> data;
+    std::vector<Link> links;
+};
+
+/**
+ * A device local buffer holding the records of a GpuHeapBuilder, which shaders read through buffer_reference pointers
+ * instead of descriptors.
+ */
+class GpuHeap {
+public:
+    /**
+     * Creates the buffer and queues the upload of the records, with their pointers filled in. The heap may be used
+     * once the uploader is flushed.
+     * @throws std::runtime_error if the bufferDeviceAddress feature is not enabled, or the builder has no records.
+     */
+    GpuHeap(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader, const GpuHeapBuilder &builder);
+
+    GpuHeap(const GpuHeap &) = delete;
+
+    GpuHeap &operator=(const GpuHeap &) = delete;
+
+    ~GpuHeap();
+
+    VkBuffer buffer() const { return heap_buffer; }
+
+    VkDeviceAddress address() const { return base_address; }
+
+    VkDeviceAddress address(GpuRecord record) const { return base_address + record.offset; }
+
+private:
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    VkBuffer heap_buffer = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+    VkDeviceAddress base_address = 0;
+};
+
+/**
+ * A material as shaders read it, in std430 layout.
+ */
+struct GpuMaterial {
+    float base_color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    float emissive[3] = {0.0f, 0.0f, 0.0f};
+    float metallic = 0.0f;
+    float roughness = 1.0f;
+    /// The index of the base colour texture in a bindless texture array.
+    uint32_t texture_index = 0;
+    uint32_t flags = 0;
+    uint32_t padding = 0;
+};
+
+/**
+ * An instance as shaders read it, in std430 layout.
+ */
+struct GpuInstance {
+    /// The rows of the object to world transform.
+    float transform[3][4];
+    /// Points to the instance's GpuMaterial.
+    VkDeviceAddress material;
+    /// Points to per object data, such as the object's vertices, or 0 for none.
+    VkDeviceAddress object_data;
+};
+
+static_assert(sizeof(GpuMaterial) == 48 && sizeof(GpuInstance) == 64, "Shaders assume these sizes");
+
+/**
+ * The push constants locating the scene tables, so that shaders need no descriptor bind to reach them.
+ */
+struct ScenePushConstants {
+    VkDeviceAddress instances = 0;
+    VkDeviceAddress materials = 0;
+    uint32_t instance_count = 0;
+    uint32_t material_count = 0;
+};
+
+/**
+ * An instance to put in SceneTables.
+ */
+struct SceneInstance {
+    float transform[3][4] = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+    /// The index of the instance's material.
+    uint32_t material = 0;
+    VkDeviceAddress object_data = 0;
+};
+
+/**
+ * The instance and material tables of a scene in one GpuHeap, with each instance pointing to its material. Shaders
+ * declare them as
+ *
+ *     struct Material { vec4 base_color; vec3 emissive; float metallic; float roughness; uint texture_index;
+ *                       uint flags; };
+ *     layout(buffer_reference, std430) readonly buffer MaterialRef { Material material; };
+ *     struct Instance { vec4 transform[3]; MaterialRef material; uint64_t object_data; };
+ *     layout(buffer_reference, std430) readonly buffer Instances { Instance instances[]; };
+ *     layout(push_constant) uniform Scene { Instances instances; uint64_t materials; uint instance_count;
+ *                                           uint material_count; } scene;
+ *
+ * and read an instance's material with scene.instances.instances[i].material.material, with no descriptor sets.
+ */
+class SceneTables {
+public:
+    /**
+     * Queues the upload of the tables. They may be used once the uploader is flushed.
+     * @throws std::runtime_error if an instance names a material which does not exist, or there are no materials and
+     *         no instances.
+     */
+    SceneTables(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader,
+                std::span<const GpuMaterial> materials, std::span<const SceneInstance> instances);
+
+    /**
+     * @return The push constant range pipeline layouts need for push.
+     */
+    static VkPushConstantRange push_constant_range(VkShaderStageFlags stages, uint32_t offset = 0);
+
+    const ScenePushConstants &push_constants() const { return constants; }
+
+    /**
+     * Records pushing the constants locating the tables.
+     */
+    void push(VkCommandBuffer command_buffer, VkPipelineLayout layout, VkShaderStageFlags stages,
+              uint32_t offset = 0) const;
+
+    VkBuffer buffer() const { return heap.buffer(); }
+
+private:
+    GpuHeapBuilder build_heap(std::span<const GpuMaterial> materials, std::span<const SceneInstance> instances);
+
+    GpuRecord material_table;
+    GpuRecord instance_table;
+    GpuHeap heap;
+    ScenePushConstants constants;
+};
@@ -0,0 +1,224 @@
+#include "device_recovery.hpp"
+
+#include <stdexcept>
+
+RecoverableDevice::RecoverableDevice(DeviceBuilder builder, const PhysicalDeviceCapabilities &capabilities,
+                                     std::optional<VkDeviceSize> staging_size)
+        : builder(std::move(builder)), capabilities(capabilities), staging_size(staging_size) {
+    create_device();
+}
+
+RecoverableDevice::~RecoverableDevice() {
+    // The device is missing if the last recovery failed to build it.
+    if (logical_device.device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(logical_device.device);
+    }
+    destroy_device();
+}
+
+void RecoverableDevice::create_device() {
+    logical_device = builder.build(capabilities);
+    try {
+        memory_pool = std::make_unique<MemoryPool>(logical_device);
+        uploader = std::make_unique<StagingUploader>(logical_device, *memory_pool,
+                                                     staging_size.value_or(logical_device.tuning.staging_size),
+                                                     logical_device.tuning.staging_memory);
+    } catch (...) {
+        destroy_device();
+        throw;
+    }
+}
+
+void RecoverableDevice::destroy_device() {
+    for (auto &resource: resources) {
+        release(resource);
+    }
+    uploader.reset();
+    memory_pool.reset();
+    destroy_logical_device(logical_device);
+}
+
+RecoverableDevice::ResourceId RecoverableDevice::add_resource(Resource resource) {
+    ResourceId id;
+    if (free_ids.empty()) {
+        id = resources.size();
+        resources.push_back(std::move(resource));
+    } else {
+        id = free_ids.back();
+        free_ids.pop_back();
+        resources[id] = std::move(resource);
+    }
+    instantiate(resources[id]);
+    return id;
+}
+
+RecoverableDevice::ResourceId RecoverableDevice::create_buffer(const BufferDescription &description,
+                                                               std::vector<std::byte> contents) {
+    Resource resource;
+    resource.description = description;
+    resource.contents = std::move(contents);
+    return add_resource(std::move(resource));
+}
+
+RecoverableDevice::ResourceId RecoverableDevice::create_buffer(const BufferDescription &description,
+                                                               ContentSource source) {
+    Resource resource;
+    resource.description = description;
+    resource.source = std::move(source);
+    return add_resource(std::move(resource));
+}
+
+RecoverableDevice::ResourceId RecoverableDevice::create_image(const ImageDescription &description,
+                                                              std::vector<std::byte> contents) {
+    Resource resource;
+    resource.description = description;
+    resource.contents = std::move(contents);
+    return add_resource(std::move(resource));
+}
+
+RecoverableDevice::ResourceId RecoverableDevice::create_image(const ImageDescription &description,
+                                                              ContentSource source) {
+    Resource resource;
+    resource.description = description;
+    resource.source = std::move(source);
+    return add_resource(std::move(resource));
+}
+
+void RecoverableDevice::instantiate(Resource &resource) {
+    // Sources are only asked for their contents while uploading, so their copies do not outlive the upload.
+    std::vector<std::byte> produced;
+    if (resource.source) {
+        produced = resource.source();
+    }
+    const auto &contents = resource.source ? produced : resource.contents;
+
+    VkMemoryRequirements requirements;
+    if (const auto *description = std::get_if<BufferDescription>(&resource.description)) {
+        VkBufferCreateInfo buffer_create_info;
+        buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_create_info.pNext = nullptr;
+        buffer_create_info.flags = 0;
+        buffer_create_info.size = description->size;
+        buffer_create_info.usage = description->usage | (contents.empty() ? 0 : VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        buffer_create_info.queueFamilyIndexCount = 0;
+        buffer_create_info.pQueueFamilyIndices = nullptr;
+
+        check_device_result(vkCreateBuffer(logical_device.device, &buffer_create_info, nullptr, &resource.buffer),
+                            "Unable to create buffer");
+        vkGetBufferMemoryRequirements(logical_device.device, resource.buffer, &requirements);
+        resource.memory = memory_pool->allocate(requirements, description->memory_properties);
+        check_device_result(vkBindBufferMemory(logical_device.device, resource.buffer, resource.memory.memory,
+                                               resource.memory.offset), "Unable to bind buffer memory");
+
+        if (!contents.empty()) {
+            uploader->upload(resource.buffer, 0, contents);
+        }
+    } else if (const auto *description = std::get_if<ImageDescription>(&resource.description)) {
+        VkImageCreateInfo image_create_info;
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.pNext = nullptr;
+        image_create_info.flags = 0;
+        image_create_info.imageType = description->type;
+        image_create_info.format = description->format;
+        image_create_info.extent = description->extent;
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = description->usage | (contents.empty() ? 0 : VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.queueFamilyIndexCount = 0;
+        image_create_info.pQueueFamilyIndices = nullptr;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        check_device_result(vkCreateImage(logical_device.device, &image_create_info, nullptr, &resource.image),
+                            "Unable to create image");
+        vkGetImageMemoryRequirements(logical_device.device, resource.image, &requirements);
+        resource.memory = memory_pool->allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        check_device_result(vkBindImageMemory(logical_device.device, resource.image, resource.memory.memory,
+                                              resource.memory.offset), "Unable to bind image memory");
+
+        if (!contents.empty()) {
+            uploader->upload(resource.image, description->extent, description->aspect, contents,
+                             description->layout);
+        }
+    }
+}
+
+void RecoverableDevice::release(Resource &resource) {
+    if (resource.buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(logical_device.device, resource.buffer, nullptr);
+        resource.buffer = VK_NULL_HANDLE;
+    }
+    if (resource.image != VK_NULL_HANDLE) {
+        vkDestroyImage(logical_device.device, resource.image, nullptr);
+        resource.image = VK_NULL_HANDLE;
+    }
+    // Resources are only bound to memory while the pool exists, so there is nothing to free without it.
+    if (memory_pool) {
+        memory_pool->free(resource.memory);
+    }
+    resource.memory = {};
+}
+
+void RecoverableDevice::destroy(ResourceId id) {
+    auto &resource = resources.at(id);
+    release(resource);
+    resource = {};
+    free_ids.push_back(id);
+}
+
+VkBuffer RecoverableDevice::buffer(ResourceId id) const {
+    return resources.at(id).buffer;
+}
+
+VkImage RecoverableDevice::image(ResourceId id) const {
+    return resources.at(id).image;
+}
+
+void RecoverableDevice::flush_uploads() {
+    uploader->flush();
+}
+
+void RecoverableDevice::add_listener(std::function<void()> lost, std::function<void()> recreated) {
+    listeners.push_back({std::move(lost), std::move(recreated)});
+}
+
+bool RecoverableDevice::recover_if_lost(VkResult result) {
+    if (result != VK_ERROR_DEVICE_LOST) {
+        return false;
+    }
+    recover();
+    return true;
+}
+
+void RecoverableDevice::recover() {
+    const auto start = std::chrono::steady_clock::now();
+
+    for (auto &listener: listeners) {
+        if (listener.lost) {
+            listener.lost();
+        }
+    }
+
+    // Destroying objects of a lost device is allowed, and waiting for it to idle returns immediately.
+    destroy_device();
+
+    // The instance and physical device are still valid, so the cached capabilities spare probing them again.
+    create_device();
+    device_generation++;
+
+    for (auto &resource: resources) {
+        instantiate(resource);
+    }
+    uploader->flush();
+
+    for (auto &listener: listeners) {
+        if (listener.recreated) {
+            listener.recreated();
+        }
+    }
+
+    recovery_duration = std::chrono::steady_clock::now() - start;
+}
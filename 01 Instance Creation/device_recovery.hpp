@@ -0,0 +1,191 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "staging_uploader.hpp"
+
+/**
+ * The parameters a buffer is re-created from.
+ */
+struct BufferDescription {
+    VkDeviceSize size = 0;
+    VkBufferUsageFlags usage = 0;
+    VkMemoryPropertyFlags memory_properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+};
+
+/**
+ * The parameters a single level, single layer image is re-created from.
+ */
+struct ImageDescription {
+    VkImageType type = VK_IMAGE_TYPE_2D;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D extent = {1, 1, 1};
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    /// The layout the image is left in once its contents are uploaded.
+    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+};
+
+/**
+ * Produces the contents of a resource again, e.g. by reading them back from disk, for resources too large to keep a
+ * CPU copy of.
+ */
+using ContentSource = std::function<std::vector<std::byte>()>;
+
+/**
+ * A logical device that survives VK_ERROR_DEVICE_LOST. Resources created through it are retained as descriptions
+ * with a CPU copy or a source of their contents, so that after a device loss the device can be rebuilt from the
+ * cached physical device capabilities (without probing again), and every resource re-created and re-uploaded in one
+ * batch.
+ * Resources are referred to by id, as their handles change when they are re-created. Objects that are not
+ * resources of this device (pipelines, command pools, ...) are re-created by listeners.
+ * Not thread safe: no other thread may use the device while it recovers.
+ */
+class RecoverableDevice {
+public:
+    using ResourceId = uint32_t;
+
+    /**
+     * Builds the device.
+     * @param builder The requirements of the device, kept to rebuild it.
+     * @param capabilities The physical device to build on, which must outlive this object.
+     * @param staging_size The size of the staging buffer used for uploads, or nothing for that of the device's tuning
+     *                     profile.
+     */
+    RecoverableDevice(DeviceBuilder builder, const PhysicalDeviceCapabilities &capabilities,
+                      std::optional<VkDeviceSize> staging_size = std::nullopt);
+
+    RecoverableDevice(const RecoverableDevice &) = delete;
+
+    RecoverableDevice &operator=(const RecoverableDevice &) = delete;
+
+    ~RecoverableDevice();
+
+    const LogicalDevice &device() const { return logical_device; }
+
+    MemoryPool &memory() { return *memory_pool; }
+
+    /**
+     * @return The number of times the device was rebuilt. Handles fetched in an earlier generation are invalid.
+     */
+    uint64_t generation() const { return device_generation; }
+
+    /**
+     * @return How long the last recovery took.
+     */
+    std::chrono::steady_clock::duration last_recovery_duration() const { return recovery_duration; }
+
+    /**
+     * Creates a buffer, keeping a CPU copy of its contents.
+     * @param description The parameters of the buffer. Transfer destination usage is added if there are contents.
+     * @param contents The contents of the buffer, or empty to leave it uninitialised.
+     * @return The id of the buffer.
+     */
+    ResourceId create_buffer(const BufferDescription &description, std::vector<std::byte> contents = {});
+
+    /**
+     * Creates a buffer whose contents are produced by a source, on creation and again on recovery.
+     */
+    ResourceId create_buffer(const BufferDescription &description, ContentSource source);
+
+    /**
+     * Creates an image, keeping a CPU copy of its contents.
+     * @param description The parameters of the image. Transfer destination usage is added if there are contents.
+     * @param contents The tightly packed texels of the image, or empty to leave it uninitialised.
+     * @return The id of the image.
+     */
+    ResourceId create_image(const ImageDescription &description, std::vector<std::byte> contents = {});
+
+    /**
+     * Creates an image whose contents are produced by a source, on creation and again on recovery.
+     */
+    ResourceId create_image(const ImageDescription &description, ContentSource source);
+
+    /**
+     * Destroys a resource. Its id may be reused.
+     */
+    void destroy(ResourceId id);
+
+    VkBuffer buffer(ResourceId id) const;
+
+    VkImage image(ResourceId id) const;
+
+    /**
+     * Waits for the contents of every created resource to be uploaded.
+     */
+    void flush_uploads();
+
+    /**
+     * Registers functions run around a recovery.
+     * @param lost Run after the device is lost, before it is destroyed, to destroy dependent objects.
+     * @param recreated Run once the device and its resources are re-created, to re-create dependent objects.
+     */
+    void add_listener(std::function<void()> lost, std::function<void()> recreated);
+
+    /**
+     * Recovers if a result reports a device loss.
+     * @return Whether the device was recovered.
+     */
+    bool recover_if_lost(VkResult result);
+
+    /**
+     * Destroys the device and every resource, then builds it again and re-creates and re-uploads every resource.
+     * If this throws, the device and the resources are left destroyed, and recover may be called again.
+     * @throws std::runtime_error if the physical device can no longer satisfy the builder.
+     */
+    void recover();
+
+private:
+    struct Resource {
+        std::variant<std::monostate, BufferDescription, ImageDescription> description;
+        std::vector<std::byte> contents;
+        ContentSource source;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImage image = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+    };
+
+    struct Listener {
+        std::function<void()> lost;
+        std::function<void()> recreated;
+    };
+
+    ResourceId add_resource(Resource resource);
+
+    /**
+     * Creates the handle of a resource, binds its memory and queues the upload of its contents.
+     */
+    void instantiate(Resource &resource);
+
+    void release(Resource &resource);
+
+    /**
+     * Builds the device, its memory pool and its uploader, destroying whatever was built if one of them fails.
+     */
+    void create_device();
+
+    /**
+     * Releases every resource and destroys the uploader, the memory pool and the device, any of which may be missing.
+     */
+    void destroy_device();
+
+    DeviceBuilder builder;
+    const PhysicalDeviceCapabilities &capabilities;
+    std::optional<VkDeviceSize> staging_size;
+    LogicalDevice logical_device;
+    std::unique_ptr<MemoryPool> memory_pool;
+    std::unique_ptr<StagingUploader> uploader;
+    std::vector<Resource> resources;
+    std::vector<ResourceId> free_ids;
+    std::vector<Listener> listeners;
+    uint64_t device_generation = 0;
+    std::chrono::steady_clock::duration recovery_duration{};
+};
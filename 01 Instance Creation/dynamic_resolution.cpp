@@ -0,0 +1,217 @@
+#include "dynamic_resolution.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+ResolutionController::ResolutionController(const DynamicResolutionSettings &settings)
+        : settings(settings), current_scale(settings.max_scale) {
+    if (settings.min_scale <= 0.0f || settings.min_scale > settings.max_scale || settings.target_frame_time_ms <= 0) {
+        throw std::runtime_error("Dynamic resolution needs 0 < min_scale <= max_scale and a positive target");
+    }
+}
+
+float ResolutionController::update(double gpu_time_ns) {
+    const auto target = settings.target_frame_time_ms * 1e6;
+    const auto error = (target - gpu_time_ns) / target;
+    const auto change = previous_error ? error - *previous_error : 0.0;
+    const auto previous_change = previous_error && earlier_error ? *previous_error - *earlier_error : 0.0;
+    earlier_error = previous_error;
+    previous_error = error;
+
+    const auto adjustment = settings.integral_gain * error + settings.proportional_gain * change
+                            + settings.derivative_gain * (change - previous_change);
+    // A spike can call for a reduction of more than the whole area, which would make the area negative.
+    const auto area = static_cast<double>(current_scale) * current_scale * std::max(1.0 + adjustment, 0.25);
+    current_scale = std::clamp(static_cast<float>(std::sqrt(area)), settings.min_scale, settings.max_scale);
+    return current_scale;
+}
+
+DynamicResolution::DynamicResolution(const LogicalDevice &device, const DeviceQueueFamily &family,
+                                     VkExtent2D native_extent, const DynamicResolutionSettings &settings,
+                                     uint32_t frames_in_flight)
+        : native_extent(native_extent), resolution_controller(settings), timed(frames_in_flight, false),
+          extent(native_extent) {
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        timers.push_back(std::make_unique<GpuTimer>(device, family, 2));
+    }
+}
+
+VkExtent2D DynamicResolution::begin_frame(VkCommandBuffer command_buffer, uint32_t frame) {
+    if (frame >= timers.size()) {
+        throw std::runtime_error("Dynamic resolution frame " + std::to_string(frame) + " is not in flight");
+    }
+
+    auto &timer = *timers[frame];
+    if (timed[frame]) {
+        // The frame's previous use has completed, so its timestamps are written unless the queries were unavailable.
+        frame_time = timer.elapsed(0, 1, false);
+        if (frame_time) {
+            resolution_controller.update(*frame_time);
+        }
+    }
+
+    // Even extents keep 2x2 pixel quads whole, which avoids shimmering as the scale moves.
+    const auto scaled = [&](uint32_t native) {
+        const auto pixels = static_cast<uint32_t>(std::lround(native * resolution_controller.scale())) & ~1u;
+        return std::clamp(pixels, std::min(native, 2u), native);
+    };
+    extent = {scaled(native_extent.width), scaled(native_extent.height)};
+
+    timer.reset(command_buffer);
+    timer.timestamp(command_buffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    return extent;
+}
+
+void DynamicResolution::end_frame(VkCommandBuffer command_buffer, uint32_t frame) {
+    timers.at(frame)->timestamp(command_buffer, 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    timed[frame] = true;
+}
+
+VkViewport DynamicResolution::viewport() const {
+    VkViewport viewport;
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    return viewport;
+}
+
+VkRect2D DynamicResolution::scissor() const {
+    return {{0, 0}, extent};
+}
+
+SpatialUpscaler::SpatialUpscaler(const LogicalDevice &device, ObjectCache &objects, VkShaderModule kernel,
+                                 uint32_t frames_in_flight, VkPipelineCache cache) : device(device) {
+    SamplerDescription sampler_description;
+    sampler_description.address_mode_u = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_description.address_mode_v = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_description.address_mode_w = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_description.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_description.max_lod = 0.0f;
+    sampler = objects.sampler(sampler_description);
+
+    DescriptorSetLayoutDescription set_layout_description;
+    set_layout_description.bindings.push_back({0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                               VK_SHADER_STAGE_COMPUTE_BIT, {sampler}});
+    set_layout_description.bindings.push_back({1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+                                               {}});
+    set_layout = objects.descriptor_set_layout(set_layout_description);
+
+    PipelineLayoutDescription pipeline_layout_description;
+    pipeline_layout_description.set_layouts = {set_layout};
+    pipeline_layout_description.push_constant_ranges = {
+            {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(UpscalePushConstants)}};
+    pipeline_layout = objects.pipeline_layout(pipeline_layout_description);
+
+    VkComputePipelineCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    create_info.stage.pNext = nullptr;
+    create_info.stage.flags = 0;
+    create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    create_info.stage.module = kernel;
+    create_info.stage.pName = "main";
+    create_info.stage.pSpecializationInfo = nullptr;
+    create_info.layout = pipeline_layout;
+    create_info.basePipelineHandle = VK_NULL_HANDLE;
+    create_info.basePipelineIndex = -1;
+    check_device_result(vkCreateComputePipelines(device.device, cache, 1, &create_info, nullptr, &pipeline),
+                        "Unable to create upscaling pipeline");
+
+    const std::array<VkDescriptorPoolSize, 2> pool_sizes = {{
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+    }};
+    VkDescriptorPoolCreateInfo pool_create_info;
+    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_create_info.pNext = nullptr;
+    pool_create_info.flags = 0;
+    pool_create_info.maxSets = 1;
+    pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_create_info.pPoolSizes = pool_sizes.data();
+    try {
+        for (uint32_t i = 0; i < frames_in_flight; i++) {
+            VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+            check_device_result(vkCreateDescriptorPool(device.device, &pool_create_info, nullptr, &descriptor_pool),
+                                "Unable to create upscaling descriptor pool");
+            descriptor_pools.push_back(descriptor_pool);
+        }
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+SpatialUpscaler::~SpatialUpscaler() {
+    destroy();
+}
+
+void SpatialUpscaler::destroy() {
+    for (auto descriptor_pool: descriptor_pools) {
+        vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
+    }
+    vkDestroyPipeline(device.device, pipeline, nullptr);
+    // The sampler and layouts belong to the object cache.
+}
+
+void SpatialUpscaler::record(VkCommandBuffer command_buffer, uint32_t frame, const DynamicResolution &resolution,
+                             VkImageView input, VkImageView output, float sharpness) {
+    if (frame >= descriptor_pools.size()) {
+        throw std::runtime_error("Upscaling frame " + std::to_string(frame) + " is not in flight");
+    }
+    check_device_result(vkResetDescriptorPool(device.device, descriptor_pools[frame], 0),
+                        "Unable to reset upscaling descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocate_info;
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.pNext = nullptr;
+    allocate_info.descriptorPool = descriptor_pools[frame];
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &set_layout;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    check_device_result(vkAllocateDescriptorSets(device.device, &allocate_info, &set),
+                        "Unable to allocate upscaling descriptor set");
+
+    const VkDescriptorImageInfo input_info = {sampler, input, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    const VkDescriptorImageInfo output_info = {VK_NULL_HANDLE, output, VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 2> writes;
+    for (uint32_t binding = 0; binding < writes.size(); binding++) {
+        writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[binding].pNext = nullptr;
+        writes[binding].dstSet = set;
+        writes[binding].dstBinding = binding;
+        writes[binding].dstArrayElement = 0;
+        writes[binding].descriptorCount = 1;
+        writes[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                                      : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[binding].pImageInfo = binding == 0 ? &input_info : &output_info;
+        writes[binding].pBufferInfo = nullptr;
+        writes[binding].pTexelBufferView = nullptr;
+    }
+    vkUpdateDescriptorSets(device.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    UpscalePushConstants constants;
+    constants.input_extent = resolution.render_extent();
+    constants.input_size = resolution.native();
+    constants.output_extent = resolution.native();
+    constants.uv_limit[0] = (static_cast<float>(constants.input_extent.width) - 0.5f)
+                            / static_cast<float>(constants.input_size.width);
+    constants.uv_limit[1] = (static_cast<float>(constants.input_extent.height) - 0.5f)
+                            / static_cast<float>(constants.input_size.height);
+    constants.sharpness = std::clamp(sharpness, 0.0f, 1.0f);
+    constants.padding = 0;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(command_buffer, (constants.output_extent.width + TILE_SIZE - 1) / TILE_SIZE,
+                  (constants.output_extent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "gpu_timer.hpp"
+#include "logical_device.hpp"
+#include "object_cache.hpp"
+
+/**
+ * How a ResolutionController holds the GPU frame time on target.
+ */
+struct DynamicResolutionSettings {
+    /// The GPU time per frame to hold, in milliseconds.
+    double target_frame_time_ms = 14.0;
+    /// The range of the render scale, the fraction of the native width and height rendered.
+    float min_scale = 0.5f;
+    float max_scale = 1.0f;
+    /// The gains of the controller, applied to the error as a fraction of the target.
+    double proportional_gain = 0.2;
+    double integral_gain = 0.5;
+    double derivative_gain = 0.05;
+};
+
+/**
+ * A PID controller of the render scale, in velocity form. GPU time is roughly proportional to the pixels rendered, so
+ * each frame the controller changes the rendered area, the square of the scale, by a fraction of itself: the integral
+ * gain times the error, plus the proportional gain times the change in error, plus the derivative gain times the
+ * change in that. The area itself is the integral, so there is no accumulator to wind up while the scale is pinned at
+ * a limit, and scaling the change by the area makes the loop gain independent of how expensive a pixel is.
+ * Errors are relative to the target, positive when there is time to spare.
+ */
+class ResolutionController {
+public:
+    explicit ResolutionController(const DynamicResolutionSettings &settings);
+
+    /**
+     * Feeds the GPU time of a frame to the controller.
+     * @param gpu_time_ns The GPU time of the frame, in nanoseconds.
+     * @return The scale to render the next frame at.
+     */
+    float update(double gpu_time_ns);
+
+    float scale() const { return current_scale; }
+
+private:
+    DynamicResolutionSettings settings;
+    float current_scale;
+    /// The errors of the last two frames, most recent first.
+    std::optional<double> previous_error;
+    std::optional<double> earlier_error;
+};
+
+/**
+ * Scales the resolution frames are rendered at to hold a GPU frame time, measured by timestamps around each frame's
+ * commands. Render targets keep their native size, and frames render into the top left render_extent() of them
+ * through viewport(), so changing the scale never recreates images. A SpatialUpscaler brings the result back to
+ * native size.
+ */
+class DynamicResolution {
+public:
+    /**
+     * @param device The device.
+     * @param family The queue family frames are recorded for. Must support timestamps.
+     * @param native_extent The extent of the render targets and of the output.
+     * @param settings How the controller holds the frame time.
+     * @param frames_in_flight The number of frames which may be executing at once, each getting its own queries.
+     */
+    DynamicResolution(const LogicalDevice &device, const DeviceQueueFamily &family, VkExtent2D native_extent,
+                      const DynamicResolutionSettings &settings, uint32_t frames_in_flight);
+
+    /**
+     * Feeds the time the frame's previous use took to the controller, then records the frame's start timestamp.
+     * Must be the first command of the frame.
+     * @param command_buffer The frame's first command buffer.
+     * @param frame The frame in flight. Its previous use must have completed.
+     * @return The extent to render the frame at.
+     */
+    VkExtent2D begin_frame(VkCommandBuffer command_buffer, uint32_t frame);
+
+    /**
+     * Records the frame's end timestamp. Must be the last command of the frame.
+     */
+    void end_frame(VkCommandBuffer command_buffer, uint32_t frame);
+
+    /**
+     * @return The extent the current frame renders at.
+     */
+    VkExtent2D render_extent() const { return extent; }
+
+    VkExtent2D native() const { return native_extent; }
+
+    /**
+     * @return The viewport covering render_extent().
+     */
+    VkViewport viewport() const;
+
+    /**
+     * @return The scissor covering render_extent().
+     */
+    VkRect2D scissor() const;
+
+    /**
+     * @return The most recent GPU frame time, in nanoseconds.
+     */
+    std::optional<double> last_frame_time() const { return frame_time; }
+
+    const ResolutionController &controller() const { return resolution_controller; }
+
+private:
+    VkExtent2D native_extent;
+    ResolutionController resolution_controller;
+    std::vector<std::unique_ptr<GpuTimer>> timers;
+    /// Whether each frame's timer has timestamps from a previous use.
+    std::vector<bool> timed;
+    VkExtent2D extent;
+    std::optional<double> frame_time;
+};
+
+/**
+ * The push constants of a SpatialUpscaler's kernel.
+ */
+struct UpscalePushConstants {
+    /// The region of the input rendered, from its top left.
+    VkExtent2D input_extent;
+    /// The size of the input image.
+    VkExtent2D input_size;
+    VkExtent2D output_extent;
+    /// The largest uv to sample the input at, (input_extent - 0.5) / input_size, the centre of the last texel rendered.
+    float uv_limit[2];
+    /// How much to sharpen, from 0 for none to 1.
+    float sharpness;
+    uint32_t padding;
+};
+
+/**
+ * Upscales the rendered region of a DynamicResolution frame to native size in one compute pass.
+ * The kernel, e.g. an edge adaptive upsampler followed by contrast adaptive sharpening, is a compute shader with
+ * local_size_x = local_size_y = TILE_SIZE, a combined image sampler input at binding 0 and a storage image output at
+ * binding 1 of set 0, and UpscalePushConstants. Each invocation writes one output pixel, sampling the input at
+ * uv = min((pixel + 0.5) / output_extent * input_extent / input_size, uv_limit), and clamping the uv of every
+ * neighbouring tap to uv_limit the same way. The sampler filters linearly, so without the clamp the texels beyond
+ * the rendered region, left over from frames rendered larger, bleed into the right and bottom edges.
+ * shaders/upscale.comp is a reference implementation, compiled by the build where glslangValidator is found. It
+ * declares the output without a format, so it needs the shaderStorageImageWriteWithoutFormat feature.
+ */
+class SpatialUpscaler {
+public:
+    static constexpr uint32_t TILE_SIZE = 16;
+
+    /**
+     * @param device The device.
+     * @param objects The cache the sampler and layouts come from.
+     * @param kernel The upscaling kernel, which may be destroyed once this returns.
+     * @param frames_in_flight The number of upscales which may be executing at once.
+     * @param cache The pipeline cache, or VK_NULL_HANDLE.
+     */
+    SpatialUpscaler(const LogicalDevice &device, ObjectCache &objects, VkShaderModule kernel,
+                    uint32_t frames_in_flight, VkPipelineCache cache = VK_NULL_HANDLE);
+
+    SpatialUpscaler(const SpatialUpscaler &) = delete;
+
+    SpatialUpscaler &operator=(const SpatialUpscaler &) = delete;
+
+    /**
+     * Destroys the pipeline and descriptor pools, which must no longer be in use.
+     */
+    ~SpatialUpscaler();
+
+    /**
+     * Records the upscale. The output is written by a compute shader, so readers of it need a barrier after.
+     * @param command_buffer The command buffer, for a queue with compute support.
+     * @param frame The frame in flight. Its previous upscale must have completed.
+     * @param resolution The dynamic resolution the input was rendered with.
+     * @param input The input, of the native extent, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+     * @param output The output, of the native extent, in VK_IMAGE_LAYOUT_GENERAL.
+     * @param sharpness How much to sharpen, from 0 for none to 1.
+     */
+    void record(VkCommandBuffer command_buffer, uint32_t frame, const DynamicResolution &resolution,
+                VkImageView input, VkImageView output, float sharpness = 0.2f);
+
+private:
+    void destroy();
+
+    const LogicalDevice &device;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> descriptor_pools;
+};
@@ -0,0 +1,175 @@
+#include "extension_index.hpp"
+
+#include <stdexcept>
+
+uint64_t ExtensionIndex::hash(std::string_view name) {
+    // FNV-1a
+    uint64_t result = 0xcbf29ce484222325;
+    for (char c: name) {
+        result ^= static_cast<unsigned char>(c);
+        result *= 0x100000001b3;
+    }
+    return result;
+}
+
+std::string_view ExtensionIndex::name(const Entry &entry) const {
+    return {names.data() + entry.name_offset, entry.name_length};
+}
+
+uint32_t ExtensionIndex::find(std::string_view name, uint64_t name_hash) const {
+    if (slots.empty()) {
+        return EMPTY_SLOT;
+    }
+
+    const auto mask = slots.size() - 1;
+    for (auto slot = name_hash & mask;; slot = (slot + 1) & mask) {
+        const auto id = slots[slot];
+        if (id == EMPTY_SLOT) {
+            return EMPTY_SLOT;
+        }
+        if (entries[id].hash == name_hash && this->name(entries[id]) == name) {
+            return id;
+        }
+    }
+}
+
+void ExtensionIndex::grow() {
+    // Keep the load factor at or below one half, so probe sequences stay short.
+    slots.assign(slots.empty() ? 64 : slots.size() * 2, EMPTY_SLOT);
+    const auto mask = slots.size() - 1;
+    for (uint32_t id = 0; id < entries.size(); id++) {
+        auto slot = entries[id].hash & mask;
+        while (slots[slot] != EMPTY_SLOT) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+}
+
+void ExtensionIndex::insert(std::string_view name, uint32_t spec_version) {
+    const auto name_hash = hash(name);
+    if (find(name, name_hash) != EMPTY_SLOT) {
+        return;
+    }
+
+    if ((entries.size() + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    Entry entry;
+    entry.hash = name_hash;
+    entry.name_offset = names.size();
+    entry.name_length = name.size();
+    entry.spec_version = spec_version;
+    entry.enabled = false;
+    names.append(name);
+    names.push_back('\0');
+
+    const auto mask = slots.size() - 1;
+    auto slot = name_hash & mask;
+    while (slots[slot] != EMPTY_SLOT) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = entries.size();
+    entries.push_back(entry);
+}
+
+bool ExtensionIndex::supported(std::string_view name) const {
+    return find(name, hash(name)) != EMPTY_SLOT;
+}
+
+bool ExtensionIndex::enabled(std::string_view name) const {
+    const auto id = find(name, hash(name));
+    return id != EMPTY_SLOT && entries[id].enabled;
+}
+
+bool ExtensionIndex::enable(std::string_view name) {
+    const auto id = find(name, hash(name));
+    if (id == EMPTY_SLOT || entries[id].enabled) {
+        return false;
+    }
+    entries[id].enabled = true;
+    enabled_order.push_back(id);
+    return true;
+}
+
+uint32_t ExtensionIndex::spec_version(std::string_view name) const {
+    const auto id = find(name, hash(name));
+    return id == EMPTY_SLOT ? 0 : entries[id].spec_version;
+}
+
+std::vector<const char *> ExtensionIndex::enabled_names() const {
+    std::vector<const char *> result;
+    result.reserve(enabled_order.size());
+    for (auto id: enabled_order) {
+        result.push_back(names.data() + entries[id].name_offset);
+    }
+    return result;
+}
+
+std::vector<const char *> ExtensionIndex::supported_names() const {
+    std::vector<const char *> result;
+    result.reserve(entries.size());
+    for (auto &entry: entries) {
+        result.push_back(names.data() + entry.name_offset);
+    }
+    return result;
+}
+
+namespace {
+    /**
+     * Runs a two-call vulkan enumeration. The count can grow between the calls when a layer or driver is installed
+     * meanwhile, in which case the second call returns VK_INCOMPLETE and the enumeration is repeated.
+     */
+    template<typename T, typename Enumerate>
+    std::vector<T> enumerate(Enumerate &&enumerate_items, const char *error) {
+        std::vector<T> items;
+        VkResult result;
+        do {
+            uint32_t count = 0;
+            if (enumerate_items(&count, nullptr) != VK_SUCCESS) {
+                throw std::runtime_error(error);
+            }
+            items.resize(count);
+            result = enumerate_items(&count, items.data());
+            items.resize(count);
+        } while (result == VK_INCOMPLETE);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error(error);
+        }
+        return items;
+    }
+}
+
+InstanceAvailability probe_instance_availability() {
+    InstanceAvailability availability;
+
+    const auto layers = enumerate<VkLayerProperties>([](uint32_t *count, VkLayerProperties *properties) {
+        return vkEnumerateInstanceLayerProperties(count, properties);
+    }, "Unable to enumerate vulkan instance layers");
+    for (auto &layer: layers) {
+        availability.layers.insert(layer.layerName, layer.specVersion);
+    }
+
+    const auto extensions = enumerate<VkExtensionProperties>([](uint32_t *count, VkExtensionProperties *properties) {
+        return vkEnumerateInstanceExtensionProperties(nullptr, count, properties);
+    }, "Unable to enumerate vulkan instance extensions");
+    for (auto &extension: extensions) {
+        availability.extensions.insert(extension.extensionName, extension.specVersion);
+    }
+
+    return availability;
+}
+
+ExtensionIndex probe_device_extensions(VkPhysicalDevice physical_device) {
+    const auto extensions = enumerate<VkExtensionProperties>(
+        [physical_device](uint32_t *count, VkExtensionProperties *properties) {
+            return vkEnumerateDeviceExtensionProperties(physical_device, nullptr, count, properties);
+        }, "Unable to enumerate vulkan device extensions");
+
+    ExtensionIndex index;
+    for (auto &extension: extensions) {
+        index.insert(extension.extensionName, extension.specVersion);
+    }
+    return index;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+/**
+ * A set of interned extension or layer names, tracking whether each is supported and whether it has been enabled.
+ * Lookups go through an open addressing hash table, so "supported?" and "already enabled?" are O(1) and never compare
+ * more than one string in the common case.
+ * Names are interned into one contiguous buffer. The pointers handed out stay valid until the index is modified by an
+ * insert, copied or moved.
+ */
+class ExtensionIndex {
+public:
+    /**
+     * Adds a supported name to the index. Inserting a name twice keeps a single entry.
+     * @param name The extension or layer name.
+     * @param spec_version The specification version reported for the name.
+     */
+    void insert(std::string_view name, uint32_t spec_version);
+
+    /**
+     * @return Whether the name is supported.
+     */
+    bool supported(std::string_view name) const;
+
+    /**
+     * @return Whether the name has been enabled.
+     */
+    bool enabled(std::string_view name) const;
+
+    /**
+     * Marks a supported name as enabled.
+     * @param name The extension or layer name.
+     * @return False if the name is unsupported or was already enabled.
+     */
+    bool enable(std::string_view name);
+
+    /**
+     * @return The specification version of a supported name, or 0 if it is unsupported.
+     */
+    uint32_t spec_version(std::string_view name) const;
+
+    /**
+     * @return The interned names of every enabled entry, in the order they were enabled.
+     */
+    std::vector<const char *> enabled_names() const;
+
+    /**
+     * @return The interned names of every supported entry.
+     */
+    std::vector<const char *> supported_names() const;
+
+    /**
+     * @return The number of supported names.
+     */
+    std::size_t size() const { return entries.size(); }
+
+private:
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    struct Entry {
+        uint64_t hash;
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t spec_version;
+        bool enabled;
+    };
+
+    static uint64_t hash(std::string_view name);
+
+    std::string_view name(const Entry &entry) const;
+
+    uint32_t find(std::string_view name, uint64_t name_hash) const;
+
+    void grow();
+
+    std::string names;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> enabled_order;
+};
+
+/**
+ * The layers and extensions the vulkan loader reports as available for instance creation.
+ */
+struct InstanceAvailability {
+    ExtensionIndex layers;
+    ExtensionIndex extensions;
+};
+
+/**
+ * Queries the instance layers and extensions available on this host, once.
+ * @return The available layers and extensions, none of them enabled.
+ */
+InstanceAvailability probe_instance_availability();
+
+/**
+ * Builds the extension index of a physical device.
+ * @param physical_device The device to query.
+ * @return The extensions the device supports, none of them enabled.
+ */
+ExtensionIndex probe_device_extensions(VkPhysicalDevice physical_device);
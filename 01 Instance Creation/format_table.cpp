@@ -0,0 +1,81 @@
+#include "format_table.hpp"
+
+/**
+ * Depth formats in order of preference. 32-bit float depth is native on every desktop vendor, whereas packed 24-bit
+ * depth is emulated on some.
+ */
+static constexpr std::array<VkFormat, 3> DEPTH_FORMATS = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D16_UNORM,
+};
+
+static constexpr std::array<VkFormat, 3> DEPTH_STENCIL_FORMATS = {
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
+        VK_FORMAT_D24_UNORM_S8_UINT,
+        VK_FORMAT_D16_UNORM_S8_UINT,
+};
+
+static const VkFormatProperties EMPTY_FORMAT_PROPERTIES = {};
+
+std::optional<uint32_t> FormatTable::index(VkFormat format) {
+    if (format >= VK_FORMAT_UNDEFINED && format < static_cast<VkFormat>(VULKAN_1_0_FORMAT_COUNT)) {
+        return static_cast<uint32_t>(format);
+    }
+    if (format >= VK_FORMAT_G8B8G8R8_422_UNORM && format <= VK_FORMAT_G16_B16_R16_3PLANE_444_UNORM) {
+        return VULKAN_1_0_FORMAT_COUNT + static_cast<uint32_t>(format - VK_FORMAT_G8B8G8R8_422_UNORM);
+    }
+    return std::nullopt;
+}
+
+void FormatTable::probe(VkPhysicalDevice physical_device, uint32_t api_version, const ExtensionIndex &extensions) {
+    for (uint32_t i = 1; i < VULKAN_1_0_FORMAT_COUNT; i++) {
+        vkGetPhysicalDeviceFormatProperties(physical_device, static_cast<VkFormat>(i), &table[i]);
+    }
+    const bool ycbcr = api_version >= VK_API_VERSION_1_1 ||
+                       extensions.supported(VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME);
+    for (uint32_t i = 0; ycbcr && i < VULKAN_1_1_FORMAT_COUNT; i++) {
+        vkGetPhysicalDeviceFormatProperties(physical_device, static_cast<VkFormat>(VK_FORMAT_G8B8G8R8_422_UNORM + i),
+                                            &table[VULKAN_1_0_FORMAT_COUNT + i]);
+    }
+
+    best_depth = first_supported(DEPTH_FORMATS, VK_IMAGE_TILING_OPTIMAL,
+                                 VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT).value_or(VK_FORMAT_UNDEFINED);
+    best_depth_stencil = first_supported(DEPTH_STENCIL_FORMATS, VK_IMAGE_TILING_OPTIMAL,
+                                         VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT).value_or(VK_FORMAT_UNDEFINED);
+}
+
+const VkFormatProperties &FormatTable::properties(VkFormat format) const {
+    auto i = index(format);
+    return i ? table[*i] : EMPTY_FORMAT_PROPERTIES;
+}
+
+bool FormatTable::supports(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) const {
+    auto &format_properties = properties(format);
+    auto supported = tiling == VK_IMAGE_TILING_LINEAR ? format_properties.linearTilingFeatures
+                                                      : format_properties.optimalTilingFeatures;
+    return (supported & features) == features;
+}
+
+bool FormatTable::supports_buffer(VkFormat format, VkFormatFeatureFlags features) const {
+    return (properties(format).bufferFeatures & features) == features;
+}
+
+bool FormatTable::supports_storage_image(VkFormat format, VkImageTiling tiling) const {
+    return supports(format, tiling, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+}
+
+bool FormatTable::supports_linear_blit(VkFormat format) const {
+    return supports(format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                                     VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+}
+
+std::optional<VkFormat> FormatTable::first_supported(std::span<const VkFormat> candidates, VkImageTiling tiling,
+                                                     VkFormatFeatureFlags features) const {
+    for (auto format: candidates) {
+        if (supports(format, tiling, features)) {
+            return format;
+        }
+    }
+    return std::nullopt;
+}
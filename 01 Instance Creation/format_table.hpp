@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <span>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include "extension_index.hpp"
+
+/**
+ * The vkGetPhysicalDeviceFormatProperties results of a physical device for every core format, probed once so that
+ * resource creation can pick formats without going back to the driver.
+ */
+class FormatTable {
+public:
+    /// Formats from VK_FORMAT_UNDEFINED to VK_FORMAT_ASTC_12x12_SRGB_BLOCK, which are numbered contiguously.
+    static constexpr uint32_t VULKAN_1_0_FORMAT_COUNT = VK_FORMAT_ASTC_12x12_SRGB_BLOCK + 1;
+    /// The YCbCr formats promoted to core in vulkan 1.1, numbered contiguously from VK_FORMAT_G8B8G8R8_422_UNORM.
+    static constexpr uint32_t VULKAN_1_1_FORMAT_COUNT = VK_FORMAT_G16_B16_R16_3PLANE_444_UNORM -
+                                                        VK_FORMAT_G8B8G8R8_422_UNORM + 1;
+
+    /**
+     * Probes the properties of every core format. The YCbCr formats are only probed on devices supporting vulkan 1.1 or
+     * VK_KHR_sampler_ycbcr_conversion, as querying them is invalid elsewhere, and are left empty otherwise.
+     * @param physical_device The device to probe.
+     * @param api_version The vulkan version of the device.
+     * @param extensions The extensions of the device.
+     */
+    void probe(VkPhysicalDevice physical_device, uint32_t api_version, const ExtensionIndex &extensions);
+
+    /**
+     * @param format A vulkan format.
+     * @return The properties of the format, or empty properties for formats outside of the table.
+     */
+    const VkFormatProperties &properties(VkFormat format) const;
+
+    /**
+     * @param format A vulkan format.
+     * @param tiling The tiling of the image.
+     * @param features The features the format must support with the tiling.
+     * @return Whether the format supports every feature with the tiling.
+     */
+    bool supports(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) const;
+
+    /**
+     * @param format A vulkan format.
+     * @param features The features the format must support in buffers.
+     * @return Whether the format supports every feature in buffers.
+     */
+    bool supports_buffer(VkFormat format, VkFormatFeatureFlags features) const;
+
+    /**
+     * @return Whether images of the format can be bound as storage images.
+     */
+    bool supports_storage_image(VkFormat format, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL) const;
+
+    /**
+     * @return Whether optimally tiled images of the format can be blitted to and from with linear filtering.
+     */
+    bool supports_linear_blit(VkFormat format) const;
+
+    /**
+     * @param candidates Formats in order of preference.
+     * @param tiling The tiling of the image.
+     * @param features The features the format must support with the tiling.
+     * @return The first candidate supporting every feature, if any.
+     */
+    std::optional<VkFormat> first_supported(std::span<const VkFormat> candidates, VkImageTiling tiling,
+                                            VkFormatFeatureFlags features) const;
+
+    /**
+     * @param stencil Whether the format must have a stencil aspect.
+     * @return The best optimally tiled depth attachment format, or VK_FORMAT_UNDEFINED if there is none.
+     */
+    VkFormat best_depth_format(bool stencil = false) const { return stencil ? best_depth_stencil : best_depth; }
+
+private:
+    /**
+     * @return The index of a format in the table, or nothing for formats outside of it.
+     */
+    static std::optional<uint32_t> index(VkFormat format);
+
+    std::array<VkFormatProperties, VULKAN_1_0_FORMAT_COUNT + VULKAN_1_1_FORMAT_COUNT> table = {};
+    VkFormat best_depth = VK_FORMAT_UNDEFINED;
+    VkFormat best_depth_stencil = VK_FORMAT_UNDEFINED;
+};
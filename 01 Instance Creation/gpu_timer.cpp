@@ -0,0 +1,63 @@
+#include "gpu_timer.hpp"
+
+#include <stdexcept>
+
+GpuTimer::GpuTimer(const LogicalDevice &device, const DeviceQueueFamily &family, uint32_t query_count)
+        : device(device), count(query_count),
+          host_reset(!(family.properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+    if (!supported(device, family)) {
+        throw std::runtime_error("Unable to time a queue family without timestamps");
+    }
+    const auto valid_bits = family.properties.timestampValidBits;
+    valid_mask = valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    create_info.queryCount = query_count;
+    create_info.pipelineStatistics = 0;
+
+    check_device_result(vkCreateQueryPool(device.device, &create_info, nullptr, &query_pool),
+                        "Unable to create timestamp query pool");
+}
+
+GpuTimer::~GpuTimer() {
+    vkDestroyQueryPool(device.device, query_pool, nullptr);
+}
+
+bool GpuTimer::supported(const LogicalDevice &device, const DeviceQueueFamily &family) {
+    const bool resettable = (family.properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+                            || device.enabled_features.vulkan12.hostQueryReset;
+    return resettable && family.properties.timestampValidBits > 0
+           && device.capabilities->properties.limits.timestampPeriod > 0.0f;
+}
+
+void GpuTimer::reset(VkCommandBuffer command_buffer) {
+    if (host_reset) {
+        vkResetQueryPool(device.device, query_pool, 0, count);
+    } else {
+        vkCmdResetQueryPool(command_buffer, query_pool, 0, count);
+    }
+}
+
+void GpuTimer::timestamp(VkCommandBuffer command_buffer, uint32_t query, VkPipelineStageFlagBits stage) {
+    vkCmdWriteTimestamp(command_buffer, stage, query_pool, query);
+}
+
+std::optional<double> GpuTimer::elapsed(uint32_t begin, uint32_t end, bool wait) const {
+    uint64_t begin_ticks = 0;
+    uint64_t end_ticks = 0;
+    const VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | (wait ? VK_QUERY_RESULT_WAIT_BIT : 0);
+    for (auto [query, ticks]: {std::pair{begin, &begin_ticks}, std::pair{end, &end_ticks}}) {
+        auto result = vkGetQueryPoolResults(device.device, query_pool, query, 1, sizeof(uint64_t), ticks,
+                                            sizeof(uint64_t), flags);
+        if (result == VK_NOT_READY) {
+            return std::nullopt;
+        }
+        check_device_result(result, "Unable to read timestamps");
+    }
+    return static_cast<double>((end_ticks - begin_ticks) & valid_mask)
+           * device.capabilities->properties.limits.timestampPeriod;
+}
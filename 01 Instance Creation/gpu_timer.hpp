@@ -0,0 +1,62 @@
+#pragma once
+
+#include <optional>
+
+#include "logical_device.hpp"
+
+/**
+ * A pool of timestamp queries for one queue family, read back in nanoseconds using the device's timestampPeriod.
+ */
+class GpuTimer {
+public:
+    /**
+     * @param device The device to create the queries on.
+     * @param family The queue family the timestamps are written on. Must support timestamps.
+     * @param query_count The number of timestamps.
+     */
+    GpuTimer(const LogicalDevice &device, const DeviceQueueFamily &family, uint32_t query_count);
+
+    GpuTimer(const GpuTimer &) = delete;
+
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    ~GpuTimer();
+
+    /**
+     * @return Whether a queue family of a device can write timestamps. Transfer only families cannot reset queries in a
+     *         command buffer, so they also need hostQueryReset.
+     */
+    static bool supported(const LogicalDevice &device, const DeviceQueueFamily &family);
+
+    /**
+     * Resets every query, which must precede writing them again. The reset is recorded in the command buffer, or on
+     * transfer only families done right away from the host, so previous submissions must have completed.
+     */
+    void reset(VkCommandBuffer command_buffer);
+
+    /**
+     * Records a timestamp, written once every previous command has reached a stage.
+     * @param query The index of the query.
+     * @param stage The pipeline stage.
+     */
+    void timestamp(VkCommandBuffer command_buffer, uint32_t query, VkPipelineStageFlagBits stage);
+
+    /**
+     * Gets the time between two timestamps of a submitted command buffer.
+     * @param begin The query of the first timestamp.
+     * @param end The query of the second timestamp.
+     * @param wait Whether to wait for the timestamps to be written.
+     * @return The elapsed time in nanoseconds, or nothing if the timestamps are not written yet.
+     */
+    std::optional<double> elapsed(uint32_t begin, uint32_t end, bool wait = true) const;
+
+    uint32_t query_count() const { return count; }
+
+private:
+    const LogicalDevice &device;
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    uint32_t count;
+    bool host_reset;
+    /// The bits of a timestamp the queue family writes, as they wrap around.
+    uint64_t valid_mask;
+};
@@ -0,0 +1,276 @@
+#include "host_copy.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+
+#include "vulkan_reflection.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HOST_COPY_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define HOST_COPY_TARGET(features)
+#else
+#define HOST_COPY_TARGET(features) __attribute__((target(features)))
+#endif
+#else
+#define HOST_COPY_X86 0
+#endif
+
+/// Timed runs of each strategy, of which the fastest counts.
+static constexpr uint32_t MEASUREMENTS = 3;
+
+#if HOST_COPY_X86
+
+static bool cpu_supports_avx(bool avx2) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    // The OS must save the AVX registers on context switches as well as the CPU having them.
+    const bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (!avx || !avx2) {
+        return avx;
+    }
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return avx2 ? __builtin_cpu_supports("avx2") : __builtin_cpu_supports("avx");
+#endif
+}
+
+/**
+ * Copies up to the first 32 byte boundary of an address with memcpy.
+ * @return The number of bytes copied.
+ */
+static std::size_t copy_until_aligned(std::uintptr_t address, void *destination, const void *source,
+                                      std::size_t size) {
+    const auto head = std::min<std::size_t>((32 - address % 32) % 32, size);
+    std::memcpy(destination, source, head);
+    return head;
+}
+
+HOST_COPY_TARGET("avx")
+static void copy_non_temporal_stores(void *destination, const void *source, std::size_t size) {
+    auto *out = static_cast<std::byte *>(destination);
+    const auto *in = static_cast<const std::byte *>(source);
+    const auto head = copy_until_aligned(reinterpret_cast<std::uintptr_t>(out), out, in, size);
+    out += head;
+    in += head;
+    size -= head;
+
+    // Four registers per iteration fill two whole cache lines before the write-combining buffer is flushed.
+    for (; size >= 128; size -= 128, in += 128, out += 128) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+        const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 32));
+        const auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 64));
+        const auto d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(out), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(out + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(out + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(out + 96), d);
+    }
+    for (; size >= 32; size -= 32, in += 32, out += 32) {
+        _mm256_stream_si256(reinterpret_cast<__m256i *>(out),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in)));
+    }
+    // Non-temporal stores are weakly ordered, so fence before the GPU can be told the data is there.
+    _mm_sfence();
+    std::memcpy(out, in, size);
+}
+
+HOST_COPY_TARGET("avx2")
+static void copy_streaming_loads(void *destination, const void *source, std::size_t size) {
+    auto *out = static_cast<std::byte *>(destination);
+    const auto *in = static_cast<const std::byte *>(source);
+    const auto head = copy_until_aligned(reinterpret_cast<std::uintptr_t>(in), out, in, size);
+    out += head;
+    in += head;
+    size -= head;
+
+    // Streaming loads are weakly ordered like non-temporal stores, so order them after earlier accesses.
+    _mm_mfence();
+    // They only bypass the cache on write-combined memory, where each fetches a whole line into a buffer which the
+    // following loads of the same line hit, so read two full lines per iteration.
+    for (; size >= 128; size -= 128, in += 128, out += 128) {
+        auto *input = reinterpret_cast<__m256i *>(const_cast<std::byte *>(in));
+        const auto a = _mm256_stream_load_si256(input);
+        const auto b = _mm256_stream_load_si256(input + 1);
+        const auto c = _mm256_stream_load_si256(input + 2);
+        const auto d = _mm256_stream_load_si256(input + 3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32), b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 64), c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 96), d);
+    }
+    for (; size >= 32; size -= 32, in += 32, out += 32) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                            _mm256_stream_load_si256(reinterpret_cast<__m256i *>(const_cast<std::byte *>(in))));
+    }
+    std::memcpy(out, in, size);
+}
+
+#endif
+
+static void copy_memcpy(void *destination, const void *source, std::size_t size) {
+    std::memcpy(destination, source, size);
+}
+
+bool host_copy_supported(HostCopyStrategy strategy) {
+    switch (strategy) {
+        case HostCopyStrategy::Memcpy:
+            return true;
+#if HOST_COPY_X86
+        case HostCopyStrategy::NonTemporalStores:
+            return cpu_supports_avx(false);
+        case HostCopyStrategy::StreamingLoads:
+            return cpu_supports_avx(true);
+#endif
+        default:
+            return false;
+    }
+}
+
+HostCopyFunction host_copy_function(HostCopyStrategy strategy) {
+    if (!host_copy_supported(strategy)) {
+        throw std::runtime_error("Host copy strategy is not supported by this CPU");
+    }
+    switch (strategy) {
+#if HOST_COPY_X86
+        case HostCopyStrategy::NonTemporalStores:
+            return copy_non_temporal_stores;
+        case HostCopyStrategy::StreamingLoads:
+            return copy_streaming_loads;
+#endif
+        default:
+            return copy_memcpy;
+    }
+}
+
+std::string_view host_copy_strategy_to_string(HostCopyStrategy strategy) {
+    switch (strategy) {
+        case HostCopyStrategy::Memcpy:
+            return "memcpy";
+        case HostCopyStrategy::NonTemporalStores:
+            return "Non-Temporal Stores";
+        case HostCopyStrategy::StreamingLoads:
+            return "Streaming Loads";
+    }
+    return "Unknown";
+}
+
+/**
+ * Times copies with every supported strategy of a set.
+ * @return The bandwidth of each strategy in bytes per second, 0 for those not timed.
+ */
+static std::array<double, HOST_COPY_STRATEGIES.size()>
+measure_host_copies(std::span<const HostCopyStrategy> strategies, void *destination, const void *source,
+                    std::size_t size) {
+    std::array<double, HOST_COPY_STRATEGIES.size()> bandwidth = {};
+    for (auto strategy: strategies) {
+        if (!host_copy_supported(strategy)) {
+            continue;
+        }
+        const auto copy = host_copy_function(strategy);
+        // The first copy faults the pages in, so it is not timed.
+        copy(destination, source, size);
+        auto time = std::numeric_limits<double>::infinity();
+        for (uint32_t i = 0; i < MEASUREMENTS; i++) {
+            const auto start = std::chrono::steady_clock::now();
+            copy(destination, source, size);
+            time = std::min(time, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        bandwidth[static_cast<std::size_t>(strategy)] = time > 0.0 ? static_cast<double>(size) / time : 0.0;
+    }
+    return bandwidth;
+}
+
+std::array<double, HOST_COPY_STRATEGIES.size()> measure_host_writes(void *mapped, std::size_t size) {
+    const std::vector<std::byte> source(size, std::byte(0x5a));
+    return measure_host_copies(HOST_WRITE_STRATEGIES, mapped, source.data(), size);
+}
+
+std::array<double, HOST_COPY_STRATEGIES.size()> measure_host_reads(const void *mapped, std::size_t size) {
+    std::vector<std::byte> destination(size);
+    return measure_host_copies(HOST_READ_STRATEGIES, destination.data(), mapped, size);
+}
+
+HostCopyStrategy fastest_host_copy(const std::array<double, HOST_COPY_STRATEGIES.size()> &bandwidth) {
+    const auto fastest = std::max_element(bandwidth.begin(), bandwidth.end());
+    return HOST_COPY_STRATEGIES[fastest - bandwidth.begin()];
+}
+
+std::vector<HostMemoryBandwidth> benchmark_host_memory(const LogicalDevice &device, VkDeviceSize size) {
+    std::vector<HostMemoryBandwidth> results;
+    const auto &memory_properties = device.capabilities->memory_properties;
+    for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+        if (!(memory_properties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+            continue;
+        }
+
+        VkMemoryAllocateInfo allocate_info;
+        allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocate_info.pNext = nullptr;
+        allocate_info.allocationSize = size;
+        allocate_info.memoryTypeIndex = type;
+
+        // The host visible window into device memory is only 256 MiB without resizable BAR, and may be full.
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        if (vkAllocateMemory(device.device, &allocate_info, nullptr, &memory) != VK_SUCCESS) {
+            continue;
+        }
+        void *mapped = nullptr;
+        if (vkMapMemory(device.device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            vkFreeMemory(device.device, memory, nullptr);
+            throw std::runtime_error("Unable to map device memory");
+        }
+
+        HostMemoryBandwidth bandwidth;
+        bandwidth.memory_type_index = type;
+        bandwidth.write = measure_host_writes(mapped, size);
+        bandwidth.read = measure_host_reads(mapped, size);
+        results.push_back(bandwidth);
+
+        vkUnmapMemory(device.device, memory);
+        vkFreeMemory(device.device, memory, nullptr);
+    }
+    return results;
+}
+
+std::string host_memory_bandwidth_to_string(const LogicalDevice &device, const HostMemoryBandwidth &bandwidth) {
+    const auto &type = device.capabilities->memory_properties.memoryTypes[bandwidth.memory_type_index];
+
+    std::stringstream str;
+    str << std::fixed << std::setprecision(2);
+    str << "    [Memory Type " << bandwidth.memory_type_index << "]";
+    for (auto flag: vk_reflection::flag_names<VkMemoryPropertyFlagBits>(type.propertyFlags)) {
+        str << " " << flag;
+    }
+    str << std::endl;
+    for (auto strategy: HOST_COPY_STRATEGIES) {
+        const auto index = static_cast<std::size_t>(strategy);
+        if (bandwidth.write[index] == 0.0 && bandwidth.read[index] == 0.0) {
+            continue;
+        }
+        str << "        " << std::left << std::setw(21) << host_copy_strategy_to_string(strategy) << std::right;
+        if (bandwidth.write[index] != 0.0) {
+            str << "Write " << bandwidth.write[index] / 1e9 << " GB/s" << (bandwidth.read[index] != 0.0 ? ", " : "");
+        }
+        if (bandwidth.read[index] != 0.0) {
+            str << "Read " << bandwidth.read[index] / 1e9 << " GB/s";
+        }
+        str << std::endl;
+    }
+    str << "        Fastest Write:       " << host_copy_strategy_to_string(fastest_host_copy(bandwidth.write))
+        << std::endl
+        << "        Fastest Read:        " << host_copy_strategy_to_string(fastest_host_copy(bandwidth.read))
+        << std::endl << std::endl;
+    return str.str();
+}
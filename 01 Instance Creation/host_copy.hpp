@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "logical_device.hpp"
+
+/**
+ * A way of copying between system memory and mapped device memory. Write-combined memory (host visible but not
+ * cached) is only fast when written in whole, sequential cache lines, and uncached reads from it are slow unless done
+ * with streaming loads, so which is fastest depends on the memory type.
+ */
+enum class HostCopyStrategy {
+    /// std::memcpy.
+    Memcpy,
+    /// AVX non-temporal stores, which bypass the cache and fill whole write-combining buffers.
+    NonTemporalStores,
+    /// AVX2 streaming loads, which read write-combined memory a cache line at a time.
+    StreamingLoads,
+};
+
+inline constexpr std::array<HostCopyStrategy, 3> HOST_COPY_STRATEGIES = {
+        HostCopyStrategy::Memcpy, HostCopyStrategy::NonTemporalStores, HostCopyStrategy::StreamingLoads};
+
+/// The strategies for writing into mapped memory. Streaming loads only speed up reads from it.
+inline constexpr std::array<HostCopyStrategy, 2> HOST_WRITE_STRATEGIES = {
+        HostCopyStrategy::Memcpy, HostCopyStrategy::NonTemporalStores};
+
+/// The strategies for reading from mapped memory. Non-temporal stores only speed up writes into it.
+inline constexpr std::array<HostCopyStrategy, 2> HOST_READ_STRATEGIES = {
+        HostCopyStrategy::Memcpy, HostCopyStrategy::StreamingLoads};
+
+using HostCopyFunction = void (*)(void *destination, const void *source, std::size_t size);
+
+/**
+ * @return Whether the CPU can run a strategy. Memcpy is always supported.
+ */
+bool host_copy_supported(HostCopyStrategy strategy);
+
+/**
+ * @param strategy A supported strategy.
+ * @return The function copying with the strategy.
+ */
+HostCopyFunction host_copy_function(HostCopyStrategy strategy);
+
+std::string_view host_copy_strategy_to_string(HostCopyStrategy strategy);
+
+/**
+ * Measures how fast each supported write strategy writes into a range of mapped memory.
+ * @param mapped The mapped memory, which is overwritten.
+ * @param size The number of bytes to write each run.
+ * @return The write bandwidth of each strategy in bytes per second, indexed by strategy. 0 for unsupported ones and
+ *         those not in HOST_WRITE_STRATEGIES.
+ */
+std::array<double, HOST_COPY_STRATEGIES.size()> measure_host_writes(void *mapped, std::size_t size);
+
+/**
+ * Measures how fast each supported read strategy reads from a range of mapped memory.
+ * @param mapped The mapped memory.
+ * @param size The number of bytes to read each run.
+ * @return The read bandwidth of each strategy in bytes per second, indexed by strategy. 0 for unsupported ones and
+ *         those not in HOST_READ_STRATEGIES.
+ */
+std::array<double, HOST_COPY_STRATEGIES.size()> measure_host_reads(const void *mapped, std::size_t size);
+
+/**
+ * @param bandwidth Bandwidths indexed by strategy, as returned by measure_host_writes or measure_host_reads.
+ * @return The strategy with the highest bandwidth, among those measured.
+ */
+HostCopyStrategy fastest_host_copy(const std::array<double, HOST_COPY_STRATEGIES.size()> &bandwidth);
+
+/**
+ * The CPU bandwidth of a host visible memory type with each copy strategy, in bytes per second.
+ */
+struct HostMemoryBandwidth {
+    uint32_t memory_type_index = 0;
+    std::array<double, HOST_COPY_STRATEGIES.size()> write = {};
+    std::array<double, HOST_COPY_STRATEGIES.size()> read = {};
+};
+
+/**
+ * Measures CPU write and read bandwidth of every host visible memory type of a device with every supported strategy.
+ * Memory types whose heap cannot fit the test allocation are left out.
+ * @param device The device to benchmark.
+ * @param size The size of the mapped allocation written and read, in bytes.
+ * @return The bandwidth of each memory type.
+ */
+std::vector<HostMemoryBandwidth> benchmark_host_memory(const LogicalDevice &device,
+                                                       VkDeviceSize size = VkDeviceSize(16) << 20);
+
+/**
+ * Formats the bandwidth of a memory type for the device report.
+ */
+std::string host_memory_bandwidth_to_string(const LogicalDevice &device, const HostMemoryBandwidth &bandwidth);
@@ -0,0 +1,85 @@
+#include "immediate_commands.hpp"
+
+#include <stdexcept>
+
+#include "synchronization.hpp"
+
+ImmediateCommands::ImmediateCommands(const LogicalDevice &device, const DeviceQueueFamily &family)
+        : device(device), family(family) {
+    VkCommandPoolCreateInfo command_pool_create_info;
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.pNext = nullptr;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                                     VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    command_pool_create_info.queueFamilyIndex = family.index;
+
+    if (vkCreateCommandPool(device.device, &command_pool_create_info, nullptr, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create immediate command pool");
+    }
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info;
+    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.pNext = nullptr;
+    command_buffer_allocate_info.commandPool = command_pool;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_allocate_info.commandBufferCount = 1;
+
+    VkFenceCreateInfo fence_create_info;
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.pNext = nullptr;
+    fence_create_info.flags = 0;
+
+    if (vkAllocateCommandBuffers(device.device, &command_buffer_allocate_info, &command_buffer) != VK_SUCCESS
+        || vkCreateFence(device.device, &fence_create_info, nullptr, &fence) != VK_SUCCESS) {
+        vkDestroyCommandPool(device.device, command_pool, nullptr);
+        throw std::runtime_error("Unable to create immediate command buffer");
+    }
+}
+
+ImmediateCommands::~ImmediateCommands() {
+    vkDestroyFence(device.device, fence, nullptr);
+    vkDestroyCommandPool(device.device, command_pool, nullptr);
+}
+
+VkCommandBuffer ImmediateCommands::begin() {
+    VkCommandBufferBeginInfo begin_info;
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = nullptr;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = nullptr;
+
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to begin immediate command buffer");
+    }
+    return command_buffer;
+}
+
+void ImmediateCommands::submit_and_wait() {
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to end immediate command buffer");
+    }
+
+    VkCommandBufferSubmitInfoKHR command_buffer_info;
+    command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+    command_buffer_info.pNext = nullptr;
+    command_buffer_info.commandBuffer = command_buffer;
+    command_buffer_info.deviceMask = 0;
+
+    VkSubmitInfo2KHR submit_info;
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+    submit_info.pNext = nullptr;
+    submit_info.flags = 0;
+    submit_info.waitSemaphoreInfoCount = 0;
+    submit_info.pWaitSemaphoreInfos = nullptr;
+    submit_info.commandBufferInfoCount = 1;
+    submit_info.pCommandBufferInfos = &command_buffer_info;
+    submit_info.signalSemaphoreInfoCount = 0;
+    submit_info.pSignalSemaphoreInfos = nullptr;
+
+    check_device_result(queue_submit2(device, family.queues.front(), {&submit_info, 1}, fence),
+                        "Unable to submit immediate commands");
+    check_device_result(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX),
+                        "Unable to wait for immediate commands");
+    vkResetFences(device.device, 1, &fence);
+    vkResetCommandBuffer(command_buffer, 0);
+}
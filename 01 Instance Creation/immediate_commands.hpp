@@ -0,0 +1,46 @@
+#pragma once
+
+#include "logical_device.hpp"
+
+/**
+ * Records and runs one command buffer at a time on a queue, waiting for each to complete. Meant for setup work and
+ * measurements, not for per frame work.
+ */
+class ImmediateCommands {
+public:
+    /**
+     * @param device The device to run commands on.
+     * @param family The queue family to run commands on. Its first queue is used.
+     */
+    ImmediateCommands(const LogicalDevice &device, const DeviceQueueFamily &family);
+
+    ImmediateCommands(const ImmediateCommands &) = delete;
+
+    ImmediateCommands &operator=(const ImmediateCommands &) = delete;
+
+    ~ImmediateCommands();
+
+    /**
+     * Records commands, submits them and waits for them to complete.
+     * @param record Called with the command buffer, already begun.
+     */
+    template<typename Function>
+    void run(Function &&record) {
+        auto command_buffer = begin();
+        record(command_buffer);
+        submit_and_wait();
+    }
+
+    const DeviceQueueFamily &queue_family() const { return family; }
+
+private:
+    VkCommandBuffer begin();
+
+    void submit_and_wait();
+
+    const LogicalDevice &device;
+    const DeviceQueueFamily &family;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+};
@@ -0,0 +1,341 @@
+#include "logger.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#if __has_include(<syslog.h>)
+#include <syslog.h>
+#endif
+
+std::string_view log_level_to_string(LogLevel level) {
+    switch (level) {
+        case LogLevel::Trace:
+            return "trace";
+        case LogLevel::Debug:
+            return "debug";
+        case LogLevel::Info:
+            return "info";
+        case LogLevel::Warning:
+            return "warning";
+        case LogLevel::Error:
+            return "error";
+    }
+    return "unknown";
+}
+
+void ConsoleSink::write(const std::vector<LogRecord> &records) {
+    std::string out;
+    std::string err;
+    for (auto &record: records) {
+        if (record.level >= LogLevel::Warning) {
+            err += log_level_to_string(record.level);
+            err += ": ";
+            err += record.text;
+            err += '\n';
+        } else {
+            out += record.text;
+            out += '\n';
+        }
+    }
+
+    // One write and flush per batch, rather than per line.
+    if (!out.empty()) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
+    if (!err.empty()) {
+        std::fwrite(err.data(), 1, err.size(), stderr);
+        std::fflush(stderr);
+    }
+}
+
+FileSink::FileSink(const std::filesystem::path &path) : file(path, std::ios::app) {
+    if (!file) {
+        throw std::runtime_error("Unable to open log file " + path.string());
+    }
+}
+
+void FileSink::write(const std::vector<LogRecord> &records) {
+    for (auto &record: records) {
+        const auto seconds = std::chrono::duration<double>(record.time).count();
+        file << std::format("[{:12.6f}] {:<7} {}\n", seconds, log_level_to_string(record.level), record.text);
+    }
+    file.flush();
+}
+
+SyslogSink::SyslogSink(std::string identity) : identity(std::move(identity)) {
+#if __has_include(<syslog.h>)
+    openlog(this->identity.c_str(), LOG_PID, LOG_USER);
+#else
+    throw std::runtime_error("Unable to log to the system log, which this platform does not have");
+#endif
+}
+
+SyslogSink::~SyslogSink() {
+#if __has_include(<syslog.h>)
+    closelog();
+#endif
+}
+
+void SyslogSink::write(const std::vector<LogRecord> &records) {
+#if __has_include(<syslog.h>)
+    for (auto &record: records) {
+        int priority = LOG_DEBUG;
+        switch (record.level) {
+            case LogLevel::Trace:
+            case LogLevel::Debug:
+                priority = LOG_DEBUG;
+                break;
+            case LogLevel::Info:
+                priority = LOG_INFO;
+                break;
+            case LogLevel::Warning:
+                priority = LOG_WARNING;
+                break;
+            case LogLevel::Error:
+                priority = LOG_ERR;
+                break;
+        }
+        syslog(priority, "%.*s", static_cast<int>(record.text.size()), record.text.data());
+    }
+#else
+    static_cast<void>(records);
+#endif
+}
+
+/**
+ * A ring of records written by one thread and read by the logger's thread. Records are a header slot followed by
+ * their text, padded to a whole slot, and never wrap: when one does not fit before the end of the ring, a skip
+ * header fills the rest and the record starts at the beginning.
+ */
+class Logger::Ring {
+public:
+    explicit Ring(std::size_t size) : slots(std::bit_floor(std::max<std::size_t>(size / sizeof(Header), 4))) {}
+
+    /**
+     * Writes a record, unless the ring is too full. Only called by the owning thread.
+     * @return Whether the record was written.
+     */
+    bool push(std::chrono::nanoseconds time, LogLevel level, std::string_view text) {
+        // Records may take up to half the ring, so that one always fits once the ring is drained.
+        const auto length = std::min(text.size(), (slots.size() / 2 - 1) * sizeof(Header));
+        const uint64_t needed = 1 + slots_for(length);
+
+        const auto position = head.load(std::memory_order_relaxed);
+        const auto offset = position & (slots.size() - 1);
+        const auto skipped = slots.size() - offset < needed ? slots.size() - offset : 0;
+        if (position + skipped + needed - tail.load(std::memory_order_acquire) > slots.size()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (skipped) {
+            slots[offset].level = SKIP;
+        }
+        auto &header = slots[(position + skipped) & (slots.size() - 1)];
+        header.time = time.count();
+        header.length = static_cast<uint32_t>(length);
+        header.level = static_cast<uint8_t>(level);
+        std::memcpy(&header + 1, text.data(), length);
+        head.store(position + skipped + needed, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Reads every record written so far. Only called by the logger's thread.
+     */
+    template<typename Function>
+    void pop_all(Function &&function) {
+        auto position = tail.load(std::memory_order_relaxed);
+        const auto end = head.load(std::memory_order_acquire);
+        while (position < end) {
+            const auto offset = position & (slots.size() - 1);
+            const auto &header = slots[offset];
+            if (header.level == SKIP) {
+                position += slots.size() - offset;
+                continue;
+            }
+            function(std::chrono::nanoseconds(header.time), static_cast<LogLevel>(header.level),
+                     std::string_view(reinterpret_cast<const char *>(&header + 1), header.length));
+            position += 1 + slots_for(header.length);
+        }
+        tail.store(position, std::memory_order_release);
+    }
+
+    bool empty() const { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire); }
+
+    /// The number of records dropped since the logger's thread last looked.
+    std::atomic<uint64_t> dropped = 0;
+    /// Set once the owning thread has exited, so the ring can go once it is empty.
+    std::atomic<bool> abandoned = false;
+
+private:
+    struct Header {
+        int64_t time;
+        uint32_t length;
+        uint8_t level;
+        uint8_t padding[3];
+    };
+
+    static_assert(sizeof(Header) == 16);
+
+    static constexpr uint8_t SKIP = 0xFF;
+
+    static uint64_t slots_for(std::size_t length) { return (length + sizeof(Header) - 1) / sizeof(Header); }
+
+    std::vector<Header> slots;
+    // On separate cache lines, as each is written by a different thread.
+    alignas(64) std::atomic<uint64_t> head = 0;
+    alignas(64) std::atomic<uint64_t> tail = 0;
+};
+
+namespace {
+    std::atomic<uint64_t> next_logger_id = 0;
+}
+
+Logger::Logger(std::size_t buffer_size, std::chrono::milliseconds flush_interval)
+        : id(next_logger_id.fetch_add(1, std::memory_order_relaxed)), buffer_size(buffer_size),
+          flush_interval(flush_interval) {
+    thread = std::thread([this] { run(); });
+}
+
+Logger::~Logger() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+Logger &Logger::global() {
+    static const auto logger = [] {
+        auto logger = std::make_unique<Logger>();
+        logger->add_sink(std::make_unique<ConsoleSink>());
+        return logger;
+    }();
+    return *logger;
+}
+
+void Logger::add_sink(std::unique_ptr<LogSink> sink) {
+    std::lock_guard lock(sinks_mutex);
+    sinks.push_back(std::move(sink));
+}
+
+void Logger::flush() {
+    std::unique_lock lock(mutex);
+    if (stopping) {
+        return;
+    }
+    const auto request = ++flush_requests;
+    wake.notify_one();
+    flushed.wait(lock, [&] { return flushes_done >= request; });
+}
+
+void Logger::push(LogLevel level, std::string_view text) {
+    if (text.ends_with('\n')) {
+        text.remove_suffix(1);
+    }
+    const auto time = std::chrono::steady_clock::now() - start;
+    if (thread_ring().push(time, level, text) && level >= LogLevel::Warning) {
+        urgent.store(true, std::memory_order_relaxed);
+        // Taking the mutex between setting the flag and notifying means the logger's thread is either about to check
+        // the flag or already waiting.
+        {
+            std::lock_guard lock(mutex);
+        }
+        wake.notify_one();
+    }
+}
+
+Logger::Ring &Logger::thread_ring() {
+    struct ThreadRings {
+        std::vector<std::pair<uint64_t, std::shared_ptr<Ring>>> rings;
+
+        ~ThreadRings() {
+            for (auto &[logger, ring]: rings) {
+                ring->abandoned.store(true, std::memory_order_release);
+            }
+        }
+    };
+    thread_local ThreadRings thread_rings;
+
+    for (auto &[logger, ring]: thread_rings.rings) {
+        if (logger == id) {
+            return *ring;
+        }
+    }
+
+    // A thread's first record for this logger is the only one which takes a lock.
+    auto ring = std::make_shared<Ring>(buffer_size);
+    {
+        std::lock_guard lock(rings_mutex);
+        rings.push_back(ring);
+    }
+    thread_rings.rings.emplace_back(id, ring);
+    return *ring;
+}
+
+void Logger::run() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        wake.wait_for(lock, flush_interval, [&] {
+            return stopping || flushes_done != flush_requests || urgent.load(std::memory_order_relaxed);
+        });
+        // Cleared before draining, so a record pushed from here on sets it again.
+        urgent.store(false, std::memory_order_relaxed);
+        const auto requested = flush_requests;
+        const auto stop = stopping;
+        lock.unlock();
+
+        auto records = drain();
+        if (!records.empty()) {
+            std::lock_guard sinks_lock(sinks_mutex);
+            for (auto &sink: sinks) {
+                try {
+                    sink->write(records);
+                } catch (const std::exception &exception) {
+                    std::fprintf(stderr, "Unable to write log records: %s\n", exception.what());
+                }
+            }
+        }
+
+        lock.lock();
+        flushes_done = requested;
+        flushed.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+std::vector<LogRecord> Logger::drain() {
+    std::vector<std::shared_ptr<Ring>> current;
+    {
+        std::lock_guard lock(rings_mutex);
+        current = rings;
+    }
+
+    std::vector<LogRecord> records;
+    for (auto &ring: current) {
+        ring->pop_all([&](std::chrono::nanoseconds time, LogLevel level, std::string_view text) {
+            records.push_back({time, level, std::string(text)});
+        });
+        if (const auto dropped = ring->dropped.exchange(0, std::memory_order_relaxed)) {
+            records.push_back({std::chrono::steady_clock::now() - start, LogLevel::Warning,
+                               std::format("{} log records were dropped as a thread's buffer was full", dropped)});
+        }
+    }
+    // Each ring is in order, but threads interleave.
+    std::stable_sort(records.begin(), records.end(), [](auto &a, auto &b) { return a.time < b.time; });
+
+    // Checking abandoned first means any record pushed before the thread exited is seen by empty().
+    std::lock_guard lock(rings_mutex);
+    std::erase_if(rings, [](auto &ring) {
+        return ring->abandoned.load(std::memory_order_acquire) && ring->empty();
+    });
+    return records;
+}
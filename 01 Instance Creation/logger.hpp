@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * The lowest level compiled in, from 0 (trace) to 4 (error). Log statements below it compile to nothing, arguments
+ * included. Debug by default, as with the CMake option.
+ */
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL 1
+#endif
+
+enum class LogLevel {
+    Trace,
+    Debug,
+    Info,
+    Warning,
+    Error,
+};
+
+/**
+ * @return Whether log statements at a level are compiled in.
+ */
+constexpr bool log_level_compiled_in(LogLevel level) {
+    return static_cast<int>(level) >= LOGGER_MIN_LEVEL;
+}
+
+std::string_view log_level_to_string(LogLevel level);
+
+/**
+ * A log record as sinks receive it.
+ */
+struct LogRecord {
+    /// The time since the logger started.
+    std::chrono::nanoseconds time;
+    LogLevel level;
+    std::string text;
+};
+
+/**
+ * Somewhere log records go. Sinks are only called from the logger's thread, a batch at a time, so they may block.
+ */
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+
+    /**
+     * Writes a batch of records, in the order they were logged.
+     */
+    virtual void write(const std::vector<LogRecord> &records) = 0;
+};
+
+/**
+ * Writes records as bare text, as a command line program would print it: info and below to stdout, and warnings and
+ * errors to stderr with their level.
+ */
+class ConsoleSink : public LogSink {
+public:
+    void write(const std::vector<LogRecord> &records) override;
+};
+
+/**
+ * Appends records to a file, with their time and level.
+ */
+class FileSink : public LogSink {
+public:
+    /**
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    explicit FileSink(const std::filesystem::path &path);
+
+    void write(const std::vector<LogRecord> &records) override;
+
+private:
+    std::ofstream file;
+};
+
+/**
+ * Sends records to the system log, where there is one.
+ */
+class SyslogSink : public LogSink {
+public:
+    /**
+     * @param identity The name records are logged under.
+     * @throws std::runtime_error if the platform has no system log.
+     */
+    explicit SyslogSink(std::string identity);
+
+    ~SyslogSink() override;
+
+    void write(const std::vector<LogRecord> &records) override;
+
+private:
+    /// openlog keeps the pointer, so the name must outlive the sink.
+    std::string identity;
+};
+
+/**
+ * An asynchronous logger. Logging formats a record into a buffer owned by the calling thread, which the logger's
+ * thread drains and writes to the sinks in batches, so logging never waits for a sink. Buffers are single producer,
+ * single consumer rings. When a thread logs faster than the sinks keep up and its ring fills, its records are dropped
+ * rather than blocking it, and the number dropped is logged once there is room.
+ * Records are written every flush interval, or straight away for warnings and errors. Waking the logger's thread for
+ * those is the only time logging takes a lock.
+ */
+class Logger {
+public:
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = std::size_t(64) << 10;
+
+    /**
+     * Starts the logger's thread, with no sinks.
+     * @param buffer_size The size of each thread's ring, a power of two.
+     * @param flush_interval How often records are written.
+     */
+    explicit Logger(std::size_t buffer_size = DEFAULT_BUFFER_SIZE,
+                    std::chrono::milliseconds flush_interval = std::chrono::milliseconds(5));
+
+    Logger(const Logger &) = delete;
+
+    Logger &operator=(const Logger &) = delete;
+
+    /**
+     * Writes every record logged, then joins the logger's thread.
+     */
+    ~Logger();
+
+    /**
+     * @return The logger the LOGGER_ macros use, which starts out writing to a ConsoleSink.
+     */
+    static Logger &global();
+
+    void add_sink(std::unique_ptr<LogSink> sink);
+
+    /**
+     * Sets the lowest level logged at run time, on top of LOGGER_MIN_LEVEL.
+     */
+    void set_level(LogLevel level) { minimum_level.store(level, std::memory_order_relaxed); }
+
+    bool enabled(LogLevel level) const { return level >= minimum_level.load(std::memory_order_relaxed); }
+
+    /**
+     * Logs a record, formatted with std::format. A trailing newline is dropped, as sinks end every record with one.
+     */
+    template<typename... Args>
+    void log(LogLevel level, std::format_string<Args...> format, Args &&...args) {
+        thread_local std::string text;
+        text.clear();
+        std::format_to(std::back_inserter(text), format, std::forward<Args>(args)...);
+        push(level, text);
+    }
+
+    /**
+     * Waits until every record logged before the call is written, e.g. before the program exits abnormally.
+     */
+    void flush();
+
+private:
+    class Ring;
+
+    void push(LogLevel level, std::string_view text);
+
+    Ring &thread_ring();
+
+    void run();
+
+    /**
+     * Moves every record out of the rings, in the order they were logged.
+     * @return The records.
+     */
+    std::vector<LogRecord> drain();
+
+    /// Identifies the logger's rings among a thread's, as an address may be reused by a later logger.
+    const uint64_t id;
+    const std::size_t buffer_size;
+    const std::chrono::milliseconds flush_interval;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<LogLevel> minimum_level = LogLevel::Trace;
+
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    std::mutex sinks_mutex;
+    std::vector<std::unique_ptr<LogSink>> sinks;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    uint64_t flush_requests = 0;
+    uint64_t flushes_done = 0;
+    /// Set when a warning or error is logged, so the logger's thread writes it without waiting for the interval.
+    std::atomic<bool> urgent = false;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#define LOGGER_AT(level, ...)                                                                                         \
+    do {                                                                                                              \
+        if constexpr (log_level_compiled_in(level)) {                                                                 \
+            auto &logger_at_logger = Logger::global();                                                                \
+            if (logger_at_logger.enabled(level)) {                                                                    \
+                logger_at_logger.log(level, __VA_ARGS__);                                                             \
+            }                                                                                                         \
+        }                                                                                                             \
+    } while (false)
+
+#define LOGGER_TRACE(...) LOGGER_AT(LogLevel::Trace, __VA_ARGS__)
+#define LOGGER_DEBUG(...) LOGGER_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOGGER_INFO(...) LOGGER_AT(LogLevel::Info, __VA_ARGS__)
+#define LOGGER_WARNING(...) LOGGER_AT(LogLevel::Warning, __VA_ARGS__)
+#define LOGGER_ERROR(...) LOGGER_AT(LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,273 @@
+#include "logical_device.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * Physical devices must enable VK_KHR_portability_subset whenever they advertise it.
+ */
+static constexpr const char *PORTABILITY_SUBSET_EXTENSION = "VK_KHR_portability_subset";
+
+/**
+ * Ranks a physical device type for selection, higher is better.
+ */
+static int physical_device_type_rank(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void check_device_result(VkResult result, const char *message) {
+    if (result == VK_ERROR_DEVICE_LOST) {
+        throw DeviceLostError(message);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(message);
+    }
+}
+
+bool LogicalDevice::synchronization2() const {
+    return enabled_features.synchronization2.synchronization2 && functions.vkCmdPipelineBarrier2KHR
+           && functions.vkQueueSubmit2KHR;
+}
+
+bool LogicalDevice::graphics_pipeline_library() const {
+    return enabled_features.graphics_pipeline_library.graphicsPipelineLibrary
+           && extension_enabled(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+}
+
+bool LogicalDevice::extension_enabled(std::string_view name) const {
+    return extensions.enabled(name);
+}
+
+const DeviceQueueFamily *LogicalDevice::find_queue_family(VkQueueFlags required) const {
+    const DeviceQueueFamily *best = nullptr;
+    for (auto &family: queue_families) {
+        if ((family.properties.queueFlags & required) != required) {
+            continue;
+        }
+        if (best == nullptr ||
+            std::popcount(family.properties.queueFlags) < std::popcount(best->properties.queueFlags)) {
+            best = &family;
+        }
+    }
+    return best;
+}
+
+const DeviceQueueFamily *LogicalDevice::compute_queue_family() const {
+    if (!tuning.async_compute) {
+        if (const auto *family = find_queue_family(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
+            return family;
+        }
+    }
+    return find_queue_family(VK_QUEUE_COMPUTE_BIT);
+}
+
+DeviceBuilder &DeviceBuilder::require_extension(const char *name) {
+    required_extensions.push_back(name);
+    return *this;
+}
+
+DeviceBuilder &DeviceBuilder::request_extension(const char *name) {
+    requested_extensions.push_back(name);
+    return *this;
+}
+
+DeviceBuilder &DeviceBuilder::request_performance_features() {
+    request_feature(&VkPhysicalDeviceFeatures::multiDrawIndirect);
+    request_feature(&VkPhysicalDeviceFeatures::drawIndirectFirstInstance);
+    request_feature(&VkPhysicalDeviceFeatures::samplerAnisotropy);
+    request_feature(&VkPhysicalDeviceFeatures::shaderInt16);
+    request_feature(&VkPhysicalDeviceFeatures::shaderInt64);
+
+    request_feature(&VkPhysicalDeviceVulkan11Features::shaderDrawParameters);
+    request_feature(&VkPhysicalDeviceVulkan11Features::storageBuffer16BitAccess);
+
+    request_feature(&VkPhysicalDeviceVulkan12Features::timelineSemaphore);
+    request_feature(&VkPhysicalDeviceVulkan12Features::bufferDeviceAddress);
+    request_feature(&VkPhysicalDeviceVulkan12Features::hostQueryReset);
+    request_feature(&VkPhysicalDeviceVulkan12Features::drawIndirectCount);
+    request_feature(&VkPhysicalDeviceVulkan12Features::scalarBlockLayout);
+    request_feature(&VkPhysicalDeviceVulkan12Features::uniformBufferStandardLayout);
+    request_feature(&VkPhysicalDeviceVulkan12Features::imagelessFramebuffer);
+    request_feature(&VkPhysicalDeviceVulkan12Features::separateDepthStencilLayouts);
+    request_feature(&VkPhysicalDeviceVulkan12Features::shaderFloat16);
+    request_feature(&VkPhysicalDeviceVulkan12Features::shaderInt8);
+    request_feature(&VkPhysicalDeviceVulkan12Features::storageBuffer8BitAccess);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorIndexing);
+    request_feature(&VkPhysicalDeviceVulkan12Features::runtimeDescriptorArray);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorBindingPartiallyBound);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorBindingVariableDescriptorCount);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorBindingUpdateUnusedWhilePending);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorBindingSampledImageUpdateAfterBind);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorBindingStorageImageUpdateAfterBind);
+    request_feature(&VkPhysicalDeviceVulkan12Features::descriptorBindingStorageBufferUpdateAfterBind);
+    request_feature(&VkPhysicalDeviceVulkan12Features::shaderSampledImageArrayNonUniformIndexing);
+    request_feature(&VkPhysicalDeviceVulkan12Features::shaderStorageBufferArrayNonUniformIndexing);
+
+    request_extension("VK_EXT_memory_budget");
+
+    request_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    request_feature(&VkPhysicalDeviceSynchronization2FeaturesKHR::synchronization2);
+
+    request_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    request_extension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+    request_feature(&VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT::graphicsPipelineLibrary);
+
+    return *this;
+}
+
+DeviceBuilder &DeviceBuilder::request_sparse_residency() {
+    request_feature(&VkPhysicalDeviceFeatures::sparseBinding);
+    request_feature(&VkPhysicalDeviceFeatures::sparseResidencyBuffer);
+    request_feature(&VkPhysicalDeviceFeatures::sparseResidencyImage2D);
+    return *this;
+}
+
+DeviceBuilder &DeviceBuilder::use_tuning_profiles(TuningProfiles profiles) {
+    tuning_profiles = std::move(profiles);
+    return *this;
+}
+
+std::optional<std::string>
+DeviceBuilder::unsupported_requirement(const PhysicalDeviceCapabilities &capabilities) const {
+    for (auto &extension: required_extensions) {
+        if (!capabilities.supports_extension(extension)) {
+            return std::string("Required device extension ") + extension + " is not supported";
+        }
+    }
+
+    if (!capabilities.features.contains(required_features)) {
+        return "A required device feature is not supported";
+    }
+
+    return std::nullopt;
+}
+
+LogicalDevice DeviceBuilder::build(const std::vector<PhysicalDeviceCapabilities> &candidates) const {
+    const PhysicalDeviceCapabilities *best = nullptr;
+    std::string reasons;
+
+    for (auto &candidate: candidates) {
+        if (auto reason = unsupported_requirement(candidate)) {
+            reasons += std::string("\n    ") + candidate.properties.deviceName + ": " + *reason;
+            continue;
+        }
+
+        if (best == nullptr) {
+            best = &candidate;
+            continue;
+        }
+
+        auto rank = physical_device_type_rank(candidate.properties.deviceType);
+        auto best_rank = physical_device_type_rank(best->properties.deviceType);
+        if (rank > best_rank || (rank == best_rank && candidate.device_local_memory() > best->device_local_memory())) {
+            best = &candidate;
+        }
+    }
+
+    if (best == nullptr) {
+        throw std::runtime_error("No suitable vulkan device found" + reasons);
+    }
+
+    return build(*best);
+}
+
+LogicalDevice DeviceBuilder::build(const PhysicalDeviceCapabilities &capabilities) const {
+    if (auto reason = unsupported_requirement(capabilities)) {
+        throw std::runtime_error(*reason);
+    }
+
+    LogicalDevice device;
+    device.capabilities = &capabilities;
+    device.tuning = tuning_profiles.select(capabilities.properties);
+
+    // Enable the required features, plus every requested one the device supports.
+    device.enabled_features = requested_features;
+    device.enabled_features.intersect(capabilities.features);
+    device.enabled_features.merge(required_features);
+
+    // Enabling through the index drops duplicates and unsupported requested extensions.
+    device.extensions = capabilities.extensions;
+    for (auto &extension: required_extensions) {
+        device.extensions.enable(extension);
+    }
+    for (auto &extension: requested_extensions) {
+        device.extensions.enable(extension);
+    }
+    device.extensions.enable(PORTABILITY_SUBSET_EXTENSION);
+    const auto extensions = device.extensions.enabled_names();
+
+    // Create every queue of every family, so that work can be spread across them later.
+    uint32_t max_queue_count = 0;
+    for (auto &family: capabilities.queue_families) {
+        max_queue_count = std::max(max_queue_count, family.queueCount);
+    }
+    std::vector<float> queue_priorities(max_queue_count, 1.0f);
+
+    std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
+    for (uint32_t i = 0; i < capabilities.queue_families.size(); i++) {
+        auto &queue_create_info = queue_create_infos.emplace_back();
+        queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_create_info.pNext = nullptr;
+        queue_create_info.flags = 0;
+        queue_create_info.queueFamilyIndex = i;
+        queue_create_info.queueCount = capabilities.queue_families[i].queueCount;
+        queue_create_info.pQueuePriorities = queue_priorities.data();
+    }
+
+    VkDeviceCreateInfo device_create_info;
+    device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_create_info.pNext = device.enabled_features.chain(capabilities.properties.apiVersion, device.extensions,
+                                                             false);
+    device_create_info.flags = 0;
+    device_create_info.queueCreateInfoCount = queue_create_infos.size();
+    device_create_info.pQueueCreateInfos = queue_create_infos.data();
+    device_create_info.enabledLayerCount = 0;
+    device_create_info.ppEnabledLayerNames = nullptr;
+    device_create_info.enabledExtensionCount = extensions.size();
+    device_create_info.ppEnabledExtensionNames = extensions.data();
+    device_create_info.pEnabledFeatures = nullptr;
+
+    if (vkCreateDevice(capabilities.physical_device, &device_create_info, nullptr, &device.device) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create vulkan device");
+    }
+
+    if (device.extensions.enabled(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+        device.functions.vkCmdPipelineBarrier2KHR = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+                vkGetDeviceProcAddr(device.device, "vkCmdPipelineBarrier2KHR"));
+        device.functions.vkQueueSubmit2KHR = reinterpret_cast<PFN_vkQueueSubmit2KHR>(
+                vkGetDeviceProcAddr(device.device, "vkQueueSubmit2KHR"));
+    }
+
+    for (uint32_t i = 0; i < capabilities.queue_families.size(); i++) {
+        auto &family = device.queue_families.emplace_back();
+        family.index = i;
+        family.properties = capabilities.queue_families[i];
+        family.queues.resize(family.properties.queueCount);
+        for (uint32_t queue = 0; queue < family.properties.queueCount; queue++) {
+            vkGetDeviceQueue(device.device, i, queue, &family.queues[queue]);
+        }
+    }
+
+    return device;
+}
+
+void destroy_logical_device(LogicalDevice &device) {
+    if (device.device != VK_NULL_HANDLE) {
+        vkDestroyDevice(device.device, nullptr);
+        device.device = VK_NULL_HANDLE;
+    }
+    device.queue_families.clear();
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "physical_device_capabilities.hpp"
+#include "tuning_profile.hpp"
+
+/**
+ * Thrown when a vulkan call reports VK_ERROR_DEVICE_LOST, so that callers able to recover can tell it apart from
+ * other failures.
+ */
+class DeviceLostError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Throws if a vulkan call failed.
+ * @param result The result of the call.
+ * @param message The message of the exception.
+ * @throws DeviceLostError if the result is VK_ERROR_DEVICE_LOST, std::runtime_error for any other failure.
+ */
+void check_device_result(VkResult result, const char *message);
+
+/**
+ * A queue family of a logical device, along with every queue created from it.
+ */
+struct DeviceQueueFamily {
+    uint32_t index = 0;
+    VkQueueFamilyProperties properties = {};
+    std::vector<VkQueue> queues;
+};
+
+/**
+ * Device level functions of extensions, which the loader does not export. They are null unless their extension is
+ * enabled.
+ */
+struct DeviceExtensionFunctions {
+    PFN_vkCmdPipelineBarrier2KHR vkCmdPipelineBarrier2KHR = nullptr;
+    PFN_vkQueueSubmit2KHR vkQueueSubmit2KHR = nullptr;
+};
+
+/**
+ * A created vulkan device, recording exactly which features and extensions were enabled so that fast paths can check
+ * for them without going back to the driver.
+ */
+struct LogicalDevice {
+    VkDevice device = VK_NULL_HANDLE;
+    const PhysicalDeviceCapabilities *capabilities = nullptr;
+    DeviceFeatures enabled_features;
+    ExtensionIndex extensions;
+    std::vector<DeviceQueueFamily> queue_families;
+    DeviceExtensionFunctions functions;
+    /// The tuning profile of the physical device, which systems created on the device take their defaults from.
+    TuningProfile tuning;
+
+    /**
+     * @return Whether VK_KHR_synchronization2 is enabled, so barriers and submits can use its commands.
+     */
+    bool synchronization2() const;
+
+    /**
+     * @return Whether VK_EXT_graphics_pipeline_library is enabled, so pipelines can be linked from libraries.
+     */
+    bool graphics_pipeline_library() const;
+
+    /**
+     * @param name The name of a device extension.
+     * @return Whether the extension was enabled on this device.
+     */
+    bool extension_enabled(std::string_view name) const;
+
+    /**
+     * Finds the queue family best matching a set of capabilities. Families with the fewest extra capabilities are
+     * preferred, so asking for transfer finds a dedicated transfer family when there is one.
+     * @param required The queue capabilities the family must have.
+     * @return The family, if any has the required capabilities.
+     */
+    const DeviceQueueFamily *find_queue_family(VkQueueFlags required) const;
+
+    /**
+     * Finds the queue family compute work is submitted to. With async compute in the tuning profile, that is the
+     * compute family with the fewest extra capabilities, so that it overlaps graphics work. Otherwise it is a graphics
+     * family, or any compute family if none has graphics.
+     * @return The family, if any supports compute.
+     */
+    const DeviceQueueFamily *compute_queue_family() const;
+};
+
+/**
+ * Negotiates device features and extensions against the capabilities of each physical device, and creates a logical
+ * device on the most capable suitable one.
+ * Required features and extensions must be supported for a device to be selected. Requested ones are enabled
+ * whenever the selected device supports them.
+ */
+class DeviceBuilder {
+public:
+    /**
+     * @param name A device extension which must be supported.
+     */
+    DeviceBuilder &require_extension(const char *name);
+
+    /**
+     * @param name A device extension to enable if supported.
+     */
+    DeviceBuilder &request_extension(const char *name);
+
+    /**
+     * @param feature A pointer to the member of a feature structure which must be supported,
+     *                e.g. &VkPhysicalDeviceVulkan12Features::timelineSemaphore.
+     */
+    template<typename Struct>
+    DeviceBuilder &require_feature(VkBool32 Struct::*feature) {
+        required_features.get<Struct>().*feature = VK_TRUE;
+        return *this;
+    }
+
+    /**
+     * @param feature A pointer to the member of a feature structure to enable if supported.
+     */
+    template<typename Struct>
+    DeviceBuilder &request_feature(VkBool32 Struct::*feature) {
+        requested_features.get<Struct>().*feature = VK_TRUE;
+        return *this;
+    }
+
+    /**
+     * Requests every feature and extension which lets the renderer take a faster path when present, such as
+     * timeline semaphores, descriptor indexing and buffer device addresses.
+     */
+    DeviceBuilder &request_performance_features();
+
+    /**
+     * Requests the features used by SparseBuffer and SparseImage.
+     */
+    DeviceBuilder &request_sparse_residency();
+
+    /**
+     * Sets the tuning profiles the profile of the device is selected from, instead of the built-in presets.
+     */
+    DeviceBuilder &use_tuning_profiles(TuningProfiles profiles);
+
+    /**
+     * Checks a device against the requirements.
+     * @param capabilities The probed capabilities of the device.
+     * @return A description of the first unsupported requirement, or nothing if the device is suitable.
+     */
+    std::optional<std::string> unsupported_requirement(const PhysicalDeviceCapabilities &capabilities) const;
+
+    /**
+     * Creates a logical device on the best suitable physical device. Discrete GPUs are preferred over integrated,
+     * virtual and CPU devices, then devices with more device local memory.
+     * @param candidates The probed capabilities of each physical device. Must outlive the returned device.
+     * @return The created device.
+     */
+    LogicalDevice build(const std::vector<PhysicalDeviceCapabilities> &candidates) const;
+
+    /**
+     * Creates a logical device on a specific physical device.
+     * @param capabilities The probed capabilities of the device. Must outlive the returned device.
+     * @return The created device.
+     */
+    LogicalDevice build(const PhysicalDeviceCapabilities &capabilities) const;
+
+private:
+    std::vector<const char *> required_extensions;
+    std::vector<const char *> requested_extensions;
+    DeviceFeatures required_features;
+    DeviceFeatures requested_features;
+    TuningProfiles tuning_profiles;
+};
+
+/**
+ * Destroys a logical device. Every object created from the device must already be destroyed.
+ * @param device The device to destroy.
+ */
+void destroy_logical_device(LogicalDevice &device);
@@ -1,249 +1,151 @@
-#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <utility>
 #include <vector>
-#include <sstream>
-#include <bitset>
-#include <algorithm>
 
 #define GLFW_INCLUDE_VULKAN
 
 #include <GLFW/glfw3.h>
 
-/**
- * Loads a vulkan function from an instance. Creates the variable in which to store the function pointer in-place.
- * @param INSTANCE The vulkan instance to load the function from (may be NULL/nullptr for certain function names).
- * @param NAME     The name of the function to load and the name of the variable which will keep the function pointer.
- */
-#define LOAD_VK_FN(INSTANCE, NAME) glfwGetInstanceProcAddress(instance, #NAME);
-
-/**
- * Gets the string version of version.
- * @param version The vulkan version number.
- * @return A string representation of vulkan.
- */
-std::string vulkan_api_version_to_string(uint32_t version) {
-    std::stringstream stream;
-    stream << VK_VERSION_MAJOR(version) << "."
-           << VK_VERSION_MINOR(version) << "."
-           << VK_VERSION_PATCH(version) <<
-           " (Variant: " << VK_API_VERSION_VARIANT(version) << ")";
-    return stream.str();
-}
-
-/**
- * Gets the string of a physical device type.
- * @param type The vulkan physical device type.
- * @return The string version of type.
- */
-std::string vulkan_physical_device_type_to_string(VkPhysicalDeviceType type) {
-    switch (type) {
-        case VK_PHYSICAL_DEVICE_TYPE_OTHER:
-            return "Other";
-        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-            return "Integrated GPU";
-        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-            return "Discrete GPU";
-        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
-            return "Virtual GPU";
-        case VK_PHYSICAL_DEVICE_TYPE_CPU:
-            return "CPU";
-        default:
-            std::cerr << "Invalid Physical Device Type" << std::endl;
-            std::exit(-1);
-    }
-}
+#include "extension_index.hpp"
+#include "host_copy.hpp"
+#include "logger.hpp"
+#include "logical_device.hpp"
+#include "pipeline_cache.hpp"
+#include "queue_benchmark.hpp"
+#include "tuning_profile.hpp"
+#include "vulkan_bootstrap.hpp"
+#include "vulkan_reflection.hpp"
+#include "worker_pool.hpp"
 
-/**
- * Initialises vulkan instance object.
- * If not already specified, adds the necessary GLFW extensions for surface display.
- * @param layers The names of the layers to load in the instance.
- * @param extensions The names of the extensions to load in the instance.
- * @return An initialised vulkan instance.
- */
-VkInstance initialise_vulkan(std::vector<const char *> layers, std::vector<const char *> extensions) {
-    VkInstance instance = VK_NULL_HANDLE;
-    VkInstanceCreateInfo instance_create_info;
-    VkApplicationInfo instance_application_info;
-
-    uint32_t glfw_required_extension_count = 0;
-    const char **glfw_required_extensions = glfwGetRequiredInstanceExtensions(&glfw_required_extension_count);
-
-    for (int i = 0; i < glfw_required_extension_count; i++) {
-        if (std::count(extensions.begin(), extensions.end(), glfw_required_extensions[i]) == 0) {
-            extensions.push_back(glfw_required_extensions[i]);
-        }
-    }
 
-#ifndef NDEBUG
-    layers.push_back("VK_LAYER_KHRONOS_validation");
-#endif
-
-    LOAD_VK_FN(nullptr, vkCreateInstance)
-    LOAD_VK_FN(nullptr, vkDestroyInstance);
-
-    instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    instance_create_info.pNext = nullptr;
-    instance_create_info.flags = 0;
-    instance_create_info.pApplicationInfo = &instance_application_info;
-    instance_create_info.enabledLayerCount = layers.size();
-    instance_create_info.ppEnabledLayerNames = layers.data();
-    instance_create_info.enabledExtensionCount = extensions.size();
-    instance_create_info.ppEnabledExtensionNames = extensions.data();
-    instance_application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    instance_application_info.pNext = nullptr;
-    instance_application_info.pApplicationName = "LearnVulkan";
-    instance_application_info.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
-    instance_application_info.pEngineName = "LearnVulkanEngine";
-    instance_application_info.engineVersion = VK_MAKE_VERSION(0, 1, 0);
-    instance_application_info.apiVersion = VK_API_VERSION_1_2;
-
-    if (vkCreateInstance(&instance_create_info, nullptr, &instance) != VK_SUCCESS) {
-        throw std::runtime_error("Unable to create vulkan instance");
+int main() {
+    if (glfwInit() != GLFW_TRUE) {
+        LOGGER_ERROR("Failed to initialise GLFW. Aborting with code -1");
+        Logger::global().flush();
+        throw std::runtime_error("Unable to load GLFW3");
     }
 
-    return instance;
-}
+    // Instance creation and device probing only need GLFW, so they run while the tuning profiles are loaded. Everything
+    // else in startup needs the device.
+    const char *pipeline_cache_file = std::getenv("VULKAN_PIPELINE_CACHE");
+    const std::filesystem::path pipeline_cache_path = pipeline_cache_file ? pipeline_cache_file : "pipeline_cache.bin";
+    auto bootstrap_future = start_vulkan_bootstrap({}, {}, pipeline_cache_path);
 
-/**
- * Loads needed vulkan functions.
- * @param instance The instance from which to load vulkan functions.
- */
-void load_vulkan_functions(VkInstance instance) {
-    LOAD_VK_FN(instance, vkEnumerateInstanceVersion)
-    LOAD_VK_FN(instance, vkEnumeratePhysicalDevices)
-    LOAD_VK_FN(instance, vkGetPhysicalDeviceProperties)
-    LOAD_VK_FN(instance, vkGetPhysicalDeviceQueueFamilyProperties)
-}
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-/**
- * Enumerates and vectorises all vulkan physical devices.
- * @param instance The vulkan instance with which the devices are associated.
- * @return A vector array of vulkan devices.
- */
-std::vector<VkPhysicalDevice> get_physical_devices(VkInstance instance) {
-    uint32_t device_count = 0;
-    if (vkEnumeratePhysicalDevices(instance, &device_count, nullptr) != VK_SUCCESS) {
-        throw std::runtime_error("Unable to enumerate physical vulkan devices");
+    TuningProfiles tuning_profiles;
+    if (const char *tuning_file = std::getenv("VULKAN_TUNING_PROFILES")) {
+        tuning_profiles.load(tuning_file);
     }
 
-    std::vector<VkPhysicalDevice> devices = {};
-    devices.resize(device_count);
-    if (vkEnumeratePhysicalDevices(instance, &device_count, devices.data()) != VK_SUCCESS) {
-        throw std::runtime_error("Unable to enumerate physical vulkan devices");
+    const auto wait_start = std::chrono::steady_clock::now();
+    VulkanBootstrap bootstrap;
+    try {
+        bootstrap = bootstrap_future.get();
+    } catch (const std::exception &exception) {
+        LOGGER_ERROR("{}. Aborting with code: -1", exception.what());
+        Logger::global().flush();
+        glfwTerminate();
+        throw;
     }
+    const auto waited = std::chrono::steady_clock::now() - wait_start;
+    auto instance = bootstrap.instance;
 
-    return devices;
-}
+    using milliseconds = std::chrono::duration<double, std::milli>;
+    LOGGER_INFO("Vulkan bootstrapped in {:.3f} ms, startup waited {:.3f} ms for it",
+                milliseconds(bootstrap.duration).count(), milliseconds(waited).count());
+    LOGGER_INFO("Vulkan API Version found: {}", vulkan_api_version_to_string(bootstrap.instance_version));
+    LOGGER_INFO("");
+
+    // The bootstrap probed every device already, so nothing here goes back to the driver.
+    auto &physical_devices = bootstrap.capabilities;
+    LOGGER_INFO("Found {} physical vulkan devices", physical_devices.size());
 
-/**
- * Returns the properties of an array of vulkan physical devices.
- * @param physical_devices The devices of which properties should be queried.
- * @return A array of physical device properties. In the same order as the physical device array given.
- */
-std::vector<VkPhysicalDeviceProperties>
-get_physical_device_properties(const std::vector<VkPhysicalDevice> &physical_devices) {
-    std::vector<VkPhysicalDeviceProperties> physical_device_properties;
+    LOGGER_INFO("");
     for (auto &physical_device: physical_devices) {
-        auto &properties = physical_device_properties.emplace_back();
-        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        auto &properties = physical_device.properties;
+        LOGGER_INFO("Found Device: {}", properties.deviceName);
+        LOGGER_INFO("    Type:                    {}", vulkan_physical_device_type_to_string(properties.deviceType));
+        LOGGER_INFO("    Supports Vulkan Version: {}", vulkan_api_version_to_string(properties.apiVersion));
     }
 
-    return physical_device_properties;
-}
+    LOGGER_INFO("");
+    for (auto &physical_device: physical_devices) {
+        LOGGER_INFO("Found {} queue families for device {}", physical_device.queue_families.size(),
+                    physical_device.properties.deviceName);
 
-std::vector<std::vector<VkQueueFamilyProperties>>
-get_physical_device_queue_family_properties(const std::vector<VkPhysicalDevice> &physical_devices) {
-    std::vector<std::vector<VkQueueFamilyProperties>> physical_device_queue_family_properties;
-    for (int i = 0; i < physical_devices.size(); i++) {
-        // Get queue family count
-        uint32_t queue_family_count = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &queue_family_count, nullptr);
-        // Read queue family properties
-        std::vector<VkQueueFamilyProperties> queue_properties;
-        queue_properties.resize(queue_family_count);
-        vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &queue_family_count, queue_properties.data());
-        physical_device_queue_family_properties.push_back(queue_properties);
+        for (unsigned int queue_family_idx = 0; queue_family_idx < physical_device.queue_families.size();
+             queue_family_idx++) {
+            LOGGER_INFO("{}", queue_family_properties_to_string(queue_family_idx,
+                                                                 physical_device.queue_families[queue_family_idx]));
+        }
     }
 
-    return physical_device_queue_family_properties;
-}
-
-/**
- * Return a human-readable string describing an instance of a VkQueueFamilyProperties object.
- * @param index The queue index of the queue.
- * @param properties The properties obect to be printed.
- * @return The string describing the object.
- */
-std::string queue_family_properties_to_string(unsigned int index, VkQueueFamilyProperties properties) {
-    std::stringstream str;
-    str << "    [Queue " << index << "]" << std::endl
-        << "        Queue Count: " << properties.queueCount << std::endl
-        << "        Queue Capabilities: " << std::endl
-        << "            Graphics:       "
-        << ((properties.queueFlags & VK_QUEUE_GRAPHICS_BIT) ? "True" : "False") << std::endl
-        << "            Compute:        "
-        << ((properties.queueFlags & VK_QUEUE_COMPUTE_BIT) ? "True" : "False") << std::endl
-        << "            Transfer:       "
-        << ((properties.queueFlags & VK_QUEUE_TRANSFER_BIT) ? "True" : "False") << std::endl
-        << "            Sparse Binding: "
-        << ((properties.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) ? "True" : "False") << std::endl
-        << "            Protected:      "
-        << ((properties.queueFlags & VK_QUEUE_PROTECTED_BIT) ? "True" : "False") << std::endl
-        << std::endl;
-    return str.str();
-}
-
-int main() {
-    if (glfwInit() != GLFW_TRUE) {
-        std::cerr << "Failed to initialise GLFW. Aborting with code -1" << std::endl;
-        throw std::runtime_error("Unable to load GLFW3");
+    LOGGER_INFO("");
+    auto device = DeviceBuilder()
+            .request_performance_features()
+            .use_tuning_profiles(std::move(tuning_profiles))
+            .build(bootstrap.capabilities);
+    auto pipeline_cache = create_pipeline_cache(device, bootstrap.pipeline_cache_data);
+    LOGGER_INFO("Created logical device on {}", device.capabilities->properties.deviceName);
+    LOGGER_INFO("    Timeline Semaphores:   {}",
+                device.enabled_features.vulkan12.timelineSemaphore ? "Enabled" : "Disabled");
+    LOGGER_INFO("    Descriptor Indexing:   {}",
+                device.enabled_features.vulkan12.descriptorIndexing ? "Enabled" : "Disabled");
+    LOGGER_INFO("    Buffer Device Address: {}",
+                device.enabled_features.vulkan12.bufferDeviceAddress ? "Enabled" : "Disabled");
+    LOGGER_INFO("    Depth Format:          {}",
+                vk_reflection::enum_name_or(device.capabilities->formats.best_depth_format(), "None"));
+    LOGGER_INFO("    Enabled Extensions:");
+    for (auto &extension: device.extensions.enabled_names()) {
+        LOGGER_INFO("        {}", extension);
     }
 
-    if (!glfwVulkanSupported()) {
-        std::cerr << "Vulkan is not supported. Aborting with code: -1" << std::endl;
-        glfwTerminate();
-        throw std::runtime_error("Vulkan is not supported on this host");
+    LOGGER_INFO("    Pipeline Cache:        {}",
+                pipeline_cache_compatible(bootstrap.pipeline_cache_data, device.capabilities->properties)
+                ? "Loaded" : "Empty");
+
+    // The systems created on the device take their defaults from its tuning profile.
+    const auto &tuning = device.tuning;
+    LOGGER_INFO("    Tuning Profile:        {}", tuning.name);
+    LOGGER_INFO("        Workgroup Size:    {}, {}x{}", tuning.workgroup_size_1d, tuning.workgroup_size_2d.width,
+                tuning.workgroup_size_2d.height);
+    LOGGER_INFO("        Barrier Strategy:  {}", barrier_strategy_to_string(tuning.barrier_strategy));
+    LOGGER_INFO("        Staging Size:      {} MiB", tuning.staging_size >> 20);
+    LOGGER_INFO("        Async Compute:     {}", tuning.async_compute ? "Enabled" : "Disabled");
+    if (const auto *compute_family = device.compute_queue_family()) {
+        LOGGER_INFO("        Compute Queue:     Family {}", compute_family->index);
     }
-
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-
-    auto instance = initialise_vulkan({}, {});
-    load_vulkan_functions(instance);
-
-    uint32_t instance_version = 0;
-    vkEnumerateInstanceVersion(&instance_version);
-    std::cout << "Vulkan API Version found: " << vulkan_api_version_to_string(instance_version) << std::endl;
-    std::cout << std::endl;
-
-    auto physical_devices = get_physical_devices(instance);
-    std::cout << "Found " << physical_devices.size() << " physical vulkan devices" << std::endl;
-
-    std::cout << std::endl;
-    auto physical_device_properties = get_physical_device_properties(physical_devices);
-    for (auto &properties: physical_device_properties) {
-        std::cout << "Found Device: " << properties.deviceName << std::endl
-                  << "    Type:                    " << vulkan_physical_device_type_to_string(properties.deviceType)
-                  << std::endl
-                  << "    Supports Vulkan Version: " << vulkan_api_version_to_string(properties.apiVersion)
-                  << std::endl;
+    LOGGER_INFO("        Frames In Flight:  {}", tuning.frames_in_flight);
+    LOGGER_INFO("        Worker Threads:    {}",
+                tuning.worker_threads ? tuning.worker_threads : WorkerPool::default_thread_count());
+
+    // Measuring every queue and memory type takes a while, so it only runs when asked for.
+    if (std::getenv("VULKAN_BENCHMARK_QUEUES")) {
+        LOGGER_INFO("");
+        LOGGER_INFO("Benchmarking queue families of {}", device.capabilities->properties.deviceName);
+        for (auto &benchmark: benchmark_queue_families(device)) {
+            LOGGER_INFO("{}", queue_family_benchmark_to_string(device, benchmark));
+        }
     }
 
-    std::cout << std::endl;
-    auto physical_device_queue_family_properties = get_physical_device_queue_family_properties(physical_devices);
-    for (int device_idx = 0; device_idx < physical_devices.size(); device_idx++) {
-        std::cout << "Found " << physical_device_queue_family_properties[device_idx].size()
-                  << " queue families for device "
-                  << physical_device_properties[device_idx].deviceName << std::endl;
-
-        auto queue_family_count = physical_device_queue_family_properties[device_idx].size();
-        for (int queue_family_idx = 0; queue_family_idx < queue_family_count; queue_family_idx++) {
-            auto &queue_family = physical_device_queue_family_properties[device_idx][queue_family_idx];
-            std::cout << queue_family_properties_to_string(queue_family_idx, queue_family);
+    if (std::getenv("VULKAN_BENCHMARK_HOST_MEMORY")) {
+        LOGGER_INFO("");
+        LOGGER_INFO("Benchmarking host visible memory of {}", device.capabilities->properties.deviceName);
+        for (auto &bandwidth: benchmark_host_memory(device)) {
+            LOGGER_INFO("{}", host_memory_bandwidth_to_string(device, bandwidth));
         }
     }
 
+    save_pipeline_cache(device, pipeline_cache, pipeline_cache_path);
+    vkDestroyPipelineCache(device.device, pipeline_cache, nullptr);
+    destroy_logical_device(device);
     vkDestroyInstance(instance, nullptr);
 
     glfwTerminate();
 
+    Logger::global().flush();
     return 0;
 }
@@ -0,0 +1,172 @@
+#include "memory_pool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+MemoryPool::MemoryPool(const LogicalDevice &device, VkDeviceSize budget, VkDeviceSize block_size)
+        : device(device), budget(budget), block_size(block_size) {}
+
+MemoryPool::~MemoryPool() {
+    for (auto &block: blocks) {
+        vkFreeMemory(device.device, block.memory, nullptr);
+    }
+    for (auto memory: dedicated) {
+        vkFreeMemory(device.device, memory, nullptr);
+    }
+}
+
+VkDeviceMemory MemoryPool::allocate_memory(uint32_t memory_type_index, VkDeviceSize size, void **mapped) {
+    if (budget != UNLIMITED && reserved_bytes + size > budget) {
+        throw std::runtime_error("Memory pool budget exceeded");
+    }
+
+    // Buffers may only be created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT if their memory was allocated with
+    // the device address flag. Blocks are shared between resources, so every block gets it.
+    VkMemoryAllocateFlagsInfo flags_info;
+    flags_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    flags_info.pNext = nullptr;
+    flags_info.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    flags_info.deviceMask = 0;
+
+    VkMemoryAllocateInfo allocate_info;
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.pNext = device.enabled_features.vulkan12.bufferDeviceAddress ? &flags_info : nullptr;
+    allocate_info.allocationSize = size;
+    allocate_info.memoryTypeIndex = memory_type_index;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(device.device, &allocate_info, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to allocate device memory");
+    }
+
+    *mapped = nullptr;
+    auto flags = device.capabilities->memory_properties.memoryTypes[memory_type_index].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device.device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+            vkFreeMemory(device.device, memory, nullptr);
+            throw std::runtime_error("Unable to map device memory");
+        }
+    }
+
+    reserved_bytes += size;
+    return memory;
+}
+
+MemoryAllocation MemoryPool::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags required,
+                                      VkMemoryPropertyFlags preferred) {
+    auto memory_type_index = device.capabilities->find_memory_type(requirements.memoryTypeBits, required, preferred);
+    if (!memory_type_index) {
+        throw std::runtime_error("No memory type satisfies the allocation");
+    }
+
+    // Linear and optimal resources may share a block, so keep every allocation on its own granularity page.
+    const auto alignment = std::max(requirements.alignment,
+                                    device.capabilities->properties.limits.bufferImageGranularity);
+
+    std::lock_guard lock(mutex);
+
+    MemoryAllocation allocation;
+    allocation.memory_type_index = *memory_type_index;
+    allocation.size = requirements.size;
+
+    if (requirements.size > block_size) {
+        allocation.memory = allocate_memory(*memory_type_index, requirements.size, &allocation.mapped);
+        allocation.block = MemoryAllocation::DEDICATED;
+        dedicated.insert(allocation.memory);
+        used_bytes += allocation.size;
+        return allocation;
+    }
+
+    for (uint32_t i = 0; i <= blocks.size(); i++) {
+        if (i == blocks.size()) {
+            // A budget smaller than a block still fits allocations, in a block of what is left of it. reserved_bytes
+            // never exceeds the budget, so this is block_size without one.
+            const auto size = std::max(requirements.size, std::min(block_size, budget - reserved_bytes));
+            void *mapped = nullptr;
+            auto memory = allocate_memory(*memory_type_index, size, &mapped);
+            blocks.push_back({memory, *memory_type_index, size, mapped, {{0, size}}});
+        }
+
+        auto &block = blocks[i];
+        if (block.memory_type_index != *memory_type_index) {
+            continue;
+        }
+
+        // First fit.
+        for (auto range = block.free_ranges.begin(); range != block.free_ranges.end(); ++range) {
+            const auto [range_offset, range_size] = *range;
+            const auto offset = align_up(range_offset, alignment);
+            if (offset + requirements.size > range_offset + range_size) {
+                continue;
+            }
+
+            block.free_ranges.erase(range);
+            if (offset > range_offset) {
+                block.free_ranges.emplace(range_offset, offset - range_offset);
+            }
+            if (offset + requirements.size < range_offset + range_size) {
+                block.free_ranges.emplace(offset + requirements.size,
+                                          range_offset + range_size - offset - requirements.size);
+            }
+
+            allocation.memory = block.memory;
+            allocation.offset = offset;
+            allocation.mapped = block.mapped ? static_cast<std::byte *>(block.mapped) + offset : nullptr;
+            allocation.block = i;
+            used_bytes += allocation.size;
+            return allocation;
+        }
+    }
+
+    throw std::logic_error("Unreachable: a new block always fits the allocation");
+}
+
+void MemoryPool::free(const MemoryAllocation &allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard lock(mutex);
+    used_bytes -= allocation.size;
+
+    if (allocation.block == MemoryAllocation::DEDICATED) {
+        dedicated.erase(allocation.memory);
+        vkFreeMemory(device.device, allocation.memory, nullptr);
+        reserved_bytes -= allocation.size;
+        return;
+    }
+
+    // Insert the range and merge it with its neighbours.
+    auto &ranges = blocks[allocation.block].free_ranges;
+    auto offset = allocation.offset;
+    auto size = allocation.size;
+
+    auto next = ranges.lower_bound(offset);
+    if (next != ranges.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            size += previous->second;
+            ranges.erase(previous);
+        }
+    }
+    if (next != ranges.end() && offset + size == next->first) {
+        size += next->second;
+        ranges.erase(next);
+    }
+    ranges.emplace(offset, size);
+}
+
+VkDeviceSize MemoryPool::used() const {
+    std::lock_guard lock(mutex);
+    return used_bytes;
+}
+
+VkDeviceSize MemoryPool::reserved() const {
+    std::lock_guard lock(mutex);
+    return reserved_bytes;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "logical_device.hpp"
+
+/**
+ * A range of device memory handed out by a MemoryPool.
+ */
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    /// The host address of the allocation if its memory type is host visible, otherwise nullptr.
+    void *mapped = nullptr;
+    uint32_t memory_type_index = 0;
+    /// The block the allocation was carved from, or DEDICATED if it owns its memory.
+    uint32_t block = 0;
+
+    static constexpr uint32_t DEDICATED = UINT32_MAX;
+};
+
+/**
+ * Sub-allocates resources from large device memory blocks, keeping the number of vkAllocateMemory calls (which are
+ * slow and limited by maxMemoryAllocationCount) low. Host visible blocks are persistently mapped.
+ * Allocations larger than a block get dedicated memory. The total memory reserved by the pool can be capped by a
+ * budget, in which case the last block takes only what is left of it. When the bufferDeviceAddress feature is
+ * enabled, all memory is allocated with the device address flag, so that buffers with
+ * VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT can be bound to it. All methods are thread safe.
+ */
+class MemoryPool {
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = VkDeviceSize(64) << 20;
+    static constexpr VkDeviceSize UNLIMITED = ~VkDeviceSize(0);
+
+    /**
+     * @param device The device to allocate from.
+     * @param budget The most memory the pool may reserve, in bytes.
+     * @param block_size The size of each memory block.
+     */
+    explicit MemoryPool(const LogicalDevice &device, VkDeviceSize budget = UNLIMITED,
+                        VkDeviceSize block_size = DEFAULT_BLOCK_SIZE);
+
+    MemoryPool(const MemoryPool &) = delete;
+
+    MemoryPool &operator=(const MemoryPool &) = delete;
+
+    /**
+     * Frees every block and dedicated allocation. Resources bound to memory from the pool must already be destroyed.
+     */
+    ~MemoryPool();
+
+    /**
+     * Allocates memory for a resource.
+     * @param requirements The memory requirements of the resource.
+     * @param required The properties the memory type must have.
+     * @param preferred Properties to prefer when several memory types qualify.
+     * @return The allocation.
+     * @throws std::runtime_error if the allocation does not fit in what is left of the budget.
+     */
+    MemoryAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags required,
+                              VkMemoryPropertyFlags preferred = 0);
+
+    /**
+     * Returns an allocation to the pool.
+     */
+    void free(const MemoryAllocation &allocation);
+
+    /**
+     * @return The bytes currently handed out.
+     */
+    VkDeviceSize used() const;
+
+    /**
+     * @return The bytes of device memory reserved by the pool, which count towards the budget.
+     */
+    VkDeviceSize reserved() const;
+
+private:
+    struct Block {
+        VkDeviceMemory memory;
+        uint32_t memory_type_index;
+        VkDeviceSize size;
+        void *mapped;
+        /// Free ranges keyed by offset, with their sizes.
+        std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+    };
+
+    VkDeviceMemory allocate_memory(uint32_t memory_type_index, VkDeviceSize size, void **mapped);
+
+    const LogicalDevice &device;
+    VkDeviceSize budget;
+    VkDeviceSize block_size;
+    VkDeviceSize used_bytes = 0;
+    VkDeviceSize reserved_bytes = 0;
+    std::vector<Block> blocks;
+    std::set<VkDeviceMemory> dedicated;
+    mutable std::mutex mutex;
+};
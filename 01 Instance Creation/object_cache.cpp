@@ -0,0 +1,280 @@
+#include "object_cache.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * Appends the bytes of trivially copyable values to a key.
+ */
+template<typename T>
+static void append_key(std::string &key, const T &value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<typename T>
+static void append_key(std::string &key, const std::vector<T> &values) {
+    append_key(key, values.size());
+    key.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+/**
+ * Appends a float such that equal values give equal bytes, as -0.0 and 0.0 would not.
+ */
+static void append_float_key(std::string &key, float value) {
+    append_key(key, value + 0.0f);
+}
+
+static void append_attachment_key(std::string &key, const AttachmentDescription &attachment) {
+    append_key(key, attachment.format);
+    append_key(key, attachment.samples);
+    append_key(key, attachment.load_op);
+    append_key(key, attachment.store_op);
+    append_key(key, attachment.initial_layout);
+    append_key(key, attachment.final_layout);
+}
+
+static bool uses_border(const SamplerDescription &description) {
+    return description.address_mode_u == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER
+           || description.address_mode_v == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER
+           || description.address_mode_w == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+}
+
+ObjectCache::ObjectCache(const LogicalDevice &device) : device(device) {}
+
+ObjectCache::~ObjectCache() {
+    render_passes.for_each([&](VkRenderPass render_pass) {
+        vkDestroyRenderPass(device.device, render_pass, nullptr);
+    });
+    pipeline_layouts.for_each([&](VkPipelineLayout layout) {
+        vkDestroyPipelineLayout(device.device, layout, nullptr);
+    });
+    // Set layouts may hold immutable samplers, so they go first.
+    set_layouts.for_each([&](VkDescriptorSetLayout layout) {
+        vkDestroyDescriptorSetLayout(device.device, layout, nullptr);
+    });
+    samplers.for_each([&](VkSampler sampler) {
+        vkDestroySampler(device.device, sampler, nullptr);
+    });
+}
+
+VkSampler ObjectCache::sampler(const SamplerDescription &description) {
+    // Normalise state the sampler ignores, so that it does not tell otherwise equal samplers apart.
+    auto normalised = description;
+    const auto &limits = device.capabilities->properties.limits;
+    normalised.max_anisotropy = device.enabled_features.core.features.samplerAnisotropy
+                                ? std::clamp(description.max_anisotropy, 1.0f, limits.maxSamplerAnisotropy) : 1.0f;
+    if (!uses_border(normalised)) {
+        normalised.border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    }
+
+    std::string key;
+    append_key(key, normalised.mag_filter);
+    append_key(key, normalised.min_filter);
+    append_key(key, normalised.mipmap_mode);
+    append_key(key, normalised.address_mode_u);
+    append_key(key, normalised.address_mode_v);
+    append_key(key, normalised.address_mode_w);
+    append_float_key(key, normalised.mip_lod_bias);
+    append_float_key(key, normalised.max_anisotropy);
+    append_key(key, normalised.compare_op.value_or(VK_COMPARE_OP_MAX_ENUM));
+    append_float_key(key, normalised.min_lod);
+    append_float_key(key, normalised.max_lod);
+    append_key(key, normalised.border_color);
+    append_key(key, normalised.unnormalized_coordinates);
+
+    return samplers.get(key, [&] {
+        // Creation is serialised by the cache, so the count needs no lock of its own.
+        if (created_samplers >= limits.maxSamplerAllocationCount) {
+            throw std::runtime_error("Unable to create sampler: the device's sampler limit is reached");
+        }
+
+        VkSamplerCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.magFilter = normalised.mag_filter;
+        create_info.minFilter = normalised.min_filter;
+        create_info.mipmapMode = normalised.mipmap_mode;
+        create_info.addressModeU = normalised.address_mode_u;
+        create_info.addressModeV = normalised.address_mode_v;
+        create_info.addressModeW = normalised.address_mode_w;
+        create_info.mipLodBias = normalised.mip_lod_bias;
+        create_info.anisotropyEnable = normalised.max_anisotropy > 1.0f;
+        create_info.maxAnisotropy = normalised.max_anisotropy;
+        create_info.compareEnable = normalised.compare_op.has_value();
+        create_info.compareOp = normalised.compare_op.value_or(VK_COMPARE_OP_NEVER);
+        create_info.minLod = normalised.min_lod;
+        create_info.maxLod = normalised.max_lod;
+        create_info.borderColor = normalised.border_color;
+        create_info.unnormalizedCoordinates = normalised.unnormalized_coordinates;
+
+        VkSampler sampler = VK_NULL_HANDLE;
+        check_device_result(vkCreateSampler(device.device, &create_info, nullptr, &sampler),
+                            "Unable to create sampler");
+        created_samplers++;
+        return sampler;
+    });
+}
+
+VkDescriptorSetLayout ObjectCache::descriptor_set_layout(const DescriptorSetLayoutDescription &description) {
+    // The order bindings are listed in does not matter to the layout.
+    auto bindings = description.bindings;
+    std::sort(bindings.begin(), bindings.end(), [](auto &a, auto &b) { return a.binding < b.binding; });
+
+    std::string key;
+    for (auto &binding: bindings) {
+        append_key(key, binding.binding);
+        append_key(key, binding.type);
+        append_key(key, binding.count);
+        append_key(key, binding.stages);
+        append_key(key, binding.immutable_samplers);
+    }
+
+    return set_layouts.get(key, [&] {
+        std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
+        for (auto &binding: bindings) {
+            VkDescriptorSetLayoutBinding layout_binding;
+            layout_binding.binding = binding.binding;
+            layout_binding.descriptorType = binding.type;
+            layout_binding.descriptorCount = binding.count;
+            layout_binding.stageFlags = binding.stages;
+            layout_binding.pImmutableSamplers = binding.immutable_samplers.empty() ? nullptr
+                                                                                   : binding.immutable_samplers.data();
+            layout_bindings.push_back(layout_binding);
+        }
+
+        VkDescriptorSetLayoutCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.bindingCount = static_cast<uint32_t>(layout_bindings.size());
+        create_info.pBindings = layout_bindings.data();
+
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        check_device_result(vkCreateDescriptorSetLayout(device.device, &create_info, nullptr, &layout),
+                            "Unable to create descriptor set layout");
+        return layout;
+    });
+}
+
+VkPipelineLayout ObjectCache::pipeline_layout(const PipelineLayoutDescription &description) {
+    std::string key;
+    append_key(key, description.set_layouts);
+    append_key(key, description.push_constant_ranges);
+
+    return pipeline_layouts.get(key, [&] {
+        VkPipelineLayoutCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.setLayoutCount = static_cast<uint32_t>(description.set_layouts.size());
+        create_info.pSetLayouts = description.set_layouts.data();
+        create_info.pushConstantRangeCount = static_cast<uint32_t>(description.push_constant_ranges.size());
+        create_info.pPushConstantRanges = description.push_constant_ranges.data();
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        check_device_result(vkCreatePipelineLayout(device.device, &create_info, nullptr, &layout),
+                            "Unable to create pipeline layout");
+        return layout;
+    });
+}
+
+VkRenderPass ObjectCache::render_pass(const RenderPassDescription &description) {
+    std::string key;
+    append_key(key, description.color_attachments.size());
+    for (auto &attachment: description.color_attachments) {
+        append_attachment_key(key, attachment);
+    }
+    append_key(key, description.depth_attachment.has_value());
+    if (description.depth_attachment) {
+        append_attachment_key(key, *description.depth_attachment);
+    }
+
+    return render_passes.get(key, [&] {
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<VkAttachmentReference> color_references;
+        const auto add_attachment = [&](const AttachmentDescription &attachment) {
+            VkAttachmentDescription attachment_description;
+            attachment_description.flags = 0;
+            attachment_description.format = attachment.format;
+            attachment_description.samples = attachment.samples;
+            attachment_description.loadOp = attachment.load_op;
+            attachment_description.storeOp = attachment.store_op;
+            attachment_description.stencilLoadOp = attachment.load_op;
+            attachment_description.stencilStoreOp = attachment.store_op;
+            attachment_description.initialLayout = attachment.initial_layout;
+            attachment_description.finalLayout = attachment.final_layout;
+            attachments.push_back(attachment_description);
+            return static_cast<uint32_t>(attachments.size() - 1);
+        };
+        for (auto &attachment: description.color_attachments) {
+            color_references.push_back({add_attachment(attachment), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        }
+        VkAttachmentReference depth_reference;
+        if (description.depth_attachment) {
+            depth_reference = {add_attachment(*description.depth_attachment),
+                               VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        }
+
+        VkSubpassDescription subpass;
+        subpass.flags = 0;
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.inputAttachmentCount = 0;
+        subpass.pInputAttachments = nullptr;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(color_references.size());
+        subpass.pColorAttachments = color_references.data();
+        subpass.pResolveAttachments = nullptr;
+        subpass.pDepthStencilAttachment = description.depth_attachment ? &depth_reference : nullptr;
+        subpass.preserveAttachmentCount = 0;
+        subpass.pPreserveAttachments = nullptr;
+
+        // Attachment writes of an earlier pass must finish before this one loads or clears the attachments.
+        VkSubpassDependency dependency;
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                                  | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                                  | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependency.dependencyFlags = 0;
+
+        VkRenderPassCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+        create_info.pAttachments = attachments.data();
+        create_info.subpassCount = 1;
+        create_info.pSubpasses = &subpass;
+        create_info.dependencyCount = 1;
+        create_info.pDependencies = &dependency;
+
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        check_device_result(vkCreateRenderPass(device.device, &create_info, nullptr, &render_pass),
+                            "Unable to create render pass");
+        return render_pass;
+    });
+}
+
+VkRenderPass ObjectCache::compatible_render_pass(const RenderPassDescription &description) {
+    // Compatibility only depends on attachment formats and sample counts, so fix everything else.
+    const auto canonical = [](AttachmentDescription attachment, VkImageLayout layout) {
+        attachment.load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.store_op = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachment.final_layout = layout;
+        return attachment;
+    };
+
+    RenderPassDescription compatible;
+    for (auto &attachment: description.color_attachments) {
+        compatible.color_attachments.push_back(canonical(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+    }
+    if (description.depth_attachment) {
+        compatible.depth_attachment = canonical(*description.depth_attachment,
+                                                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    }
+    return render_pass(compatible);
+}
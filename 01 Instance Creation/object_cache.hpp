@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "logical_device.hpp"
+
+/**
+ * A hash table from keys to vulkan handles which is only ever added to, read without locking. Readers probe the
+ * current table through atomic slots, while writers serialise on a mutex, publishing each entry with a release store
+ * once it is complete. A full table is copied into one twice its size, which replaces it atomically. Replaced tables
+ * may still be probed by readers, so they are kept until the cache is destroyed, which costs at most as much memory
+ * as the current table.
+ */
+template<typename Handle>
+class HandleCache {
+public:
+    HandleCache() {
+        tables.push_back(std::make_unique<Table>(INITIAL_CAPACITY));
+        table.store(tables.back().get(), std::memory_order_release);
+    }
+
+    HandleCache(const HandleCache &) = delete;
+
+    HandleCache &operator=(const HandleCache &) = delete;
+
+    /**
+     * Looks up a key without locking.
+     * @return The handle cached under the key, or VK_NULL_HANDLE.
+     */
+    Handle find(std::string_view key) const {
+        return find(key, std::hash<std::string_view>{}(key));
+    }
+
+    /**
+     * Gets the handle cached under a key, creating it if there is none. Creation is serialised, so a handle is never
+     * created twice.
+     * @param key The key.
+     * @param create Creates the handle, called at most once per key.
+     * @return The handle.
+     */
+    template<typename Create>
+    Handle get(std::string_view key, Create &&create) {
+        const auto hash = std::hash<std::string_view>{}(key);
+        if (auto handle = find(key, hash); handle != VK_NULL_HANDLE) {
+            return handle;
+        }
+
+        std::lock_guard lock(mutex);
+        if (auto handle = find(key, hash); handle != VK_NULL_HANDLE) {
+            return handle;
+        }
+        entries.push_back(std::make_unique<Entry>(Entry{hash, std::string(key), create()}));
+        insert(entries.back().get());
+        return entries.back()->handle;
+    }
+
+    /**
+     * Calls a function with every cached handle.
+     */
+    template<typename Function>
+    void for_each(Function &&function) const {
+        std::lock_guard lock(mutex);
+        for (auto &entry: entries) {
+            function(entry->handle);
+        }
+    }
+
+    std::size_t size() const {
+        std::lock_guard lock(mutex);
+        return entries.size();
+    }
+
+private:
+    static constexpr std::size_t INITIAL_CAPACITY = 64;
+
+    struct Entry {
+        std::size_t hash;
+        std::string key;
+        Handle handle;
+    };
+
+    /**
+     * An open addressing table with linear probing, whose capacity is a power of two.
+     */
+    struct Table {
+        explicit Table(std::size_t capacity)
+                : mask(capacity - 1), slots(std::make_unique<std::atomic<const Entry *>[]>(capacity)) {}
+
+        std::size_t mask;
+        std::unique_ptr<std::atomic<const Entry *>[]> slots;
+    };
+
+    Handle find(std::string_view key, std::size_t hash) const {
+        const auto *current = table.load(std::memory_order_acquire);
+        // Tables are never more than half full, so probing always reaches an empty slot.
+        for (auto slot = hash & current->mask;; slot = (slot + 1) & current->mask) {
+            const auto *entry = current->slots[slot].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return VK_NULL_HANDLE;
+            }
+            if (entry->hash == hash && entry->key == key) {
+                return entry->handle;
+            }
+        }
+    }
+
+    /**
+     * Adds an entry, growing the table first if it would become more than half full. Requires mutex to be held.
+     */
+    void insert(const Entry *entry) {
+        auto *current = tables.back().get();
+        if (entries.size() * 2 > current->mask + 1) {
+            tables.push_back(std::make_unique<Table>((current->mask + 1) * 2));
+            current = tables.back().get();
+            for (auto &existing: entries) {
+                if (existing.get() != entry) {
+                    place(*current, existing.get());
+                }
+            }
+            place(*current, entry);
+            table.store(current, std::memory_order_release);
+            return;
+        }
+        place(*current, entry);
+    }
+
+    static void place(Table &target, const Entry *entry) {
+        auto slot = entry->hash & target.mask;
+        while (target.slots[slot].load(std::memory_order_relaxed) != nullptr) {
+            slot = (slot + 1) & target.mask;
+        }
+        target.slots[slot].store(entry, std::memory_order_release);
+    }
+
+    std::atomic<const Table *> table;
+    /// Every table created, the last being the current one.
+    std::vector<std::unique_ptr<Table>> tables;
+    std::vector<std::unique_ptr<Entry>> entries;
+    mutable std::mutex mutex;
+};
+
+/**
+ * The state of a sampler.
+ */
+struct SamplerDescription {
+    VkFilter mag_filter = VK_FILTER_LINEAR;
+    VkFilter min_filter = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode address_mode_u = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode address_mode_v = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    VkSamplerAddressMode address_mode_w = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    float mip_lod_bias = 0.0f;
+    /// The maximum anisotropy, or 1 for none. Clamped to what the device supports, and to 1 without the
+    /// samplerAnisotropy feature.
+    float max_anisotropy = 1.0f;
+    /// The comparison of a depth comparison sampler, if it is one.
+    std::optional<VkCompareOp> compare_op;
+    float min_lod = 0.0f;
+    float max_lod = VK_LOD_CLAMP_NONE;
+    /// Only used by the clamp to border address mode.
+    VkBorderColor border_color = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    bool unnormalized_coordinates = false;
+};
+
+/**
+ * A binding of a descriptor set layout.
+ */
+struct DescriptorBindingDescription {
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    uint32_t count = 1;
+    VkShaderStageFlags stages = VK_SHADER_STAGE_ALL;
+    /// The immutable samplers of sampler bindings, one per descriptor, or empty for none. Take them from the same
+    /// ObjectCache, so that equal samplers are the same handle.
+    std::vector<VkSampler> immutable_samplers;
+};
+
+struct DescriptorSetLayoutDescription {
+    std::vector<DescriptorBindingDescription> bindings;
+};
+
+struct PipelineLayoutDescription {
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    std::vector<VkPushConstantRange> push_constant_ranges;
+};
+
+/**
+ * An attachment of a render pass.
+ */
+struct AttachmentDescription {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    VkAttachmentStoreOp store_op = VK_ATTACHMENT_STORE_OP_STORE;
+    VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+};
+
+/**
+ * A render pass of one subpass drawing to colour attachments and an optional depth attachment.
+ */
+struct RenderPassDescription {
+    std::vector<AttachmentDescription> color_attachments;
+    std::optional<AttachmentDescription> depth_attachment;
+};
+
+/**
+ * Hash-consed immutable objects: describing the same sampler, layout or render pass twice gives back the same handle,
+ * created once. Descriptions are normalised before they are compared, so state the object ignores, such as the border
+ * colour of a sampler which never clamps to the border, does not create duplicates. Reusing handles also lets caches
+ * keyed by them, such as PipelineLibrary's, share more.
+ * Lookups of objects created before do not lock, so they are cheap enough to make per draw. Objects live until the
+ * cache is destroyed.
+ */
+class ObjectCache {
+public:
+    explicit ObjectCache(const LogicalDevice &device);
+
+    ObjectCache(const ObjectCache &) = delete;
+
+    ObjectCache &operator=(const ObjectCache &) = delete;
+
+    /**
+     * Destroys every object. They must no longer be in use.
+     */
+    ~ObjectCache();
+
+    /**
+     * @throws std::runtime_error if creating the sampler would exceed the device's maxSamplerAllocationCount.
+     */
+    VkSampler sampler(const SamplerDescription &description);
+
+    VkDescriptorSetLayout descriptor_set_layout(const DescriptorSetLayoutDescription &description);
+
+    VkPipelineLayout pipeline_layout(const PipelineLayoutDescription &description);
+
+    VkRenderPass render_pass(const RenderPassDescription &description);
+
+    /**
+     * Gets a render pass compatible with a description, one per set of attachment formats and sample counts. Vulkan
+     * lets pipelines and framebuffers created with a render pass be used with any compatible one, so creating them all
+     * with this pass shares them between render passes which only differ in load and store operations or layouts.
+     */
+    VkRenderPass compatible_render_pass(const RenderPassDescription &description);
+
+    std::size_t sampler_count() const { return samplers.size(); }
+
+private:
+    const LogicalDevice &device;
+    HandleCache<VkSampler> samplers;
+    uint32_t created_samplers = 0;
+    HandleCache<VkDescriptorSetLayout> set_layouts;
+    HandleCache<VkPipelineLayout> pipeline_layouts;
+    HandleCache<VkRenderPass> render_passes;
+};
@@ -0,0 +1,230 @@
+#include "particle_system.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "device_address.hpp"
+
+static constexpr VkShaderStageFlags PUSH_CONSTANT_STAGES = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_ALL_GRAPHICS;
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t group_count(uint32_t invocations) {
+    return (invocations + ParticleSystem::WORKGROUP_SIZE - 1) / ParticleSystem::WORKGROUP_SIZE;
+}
+
+ParticleSystem::ParticleSystem(const LogicalDevice &device, const DeviceQueueFamily &family, MemoryPool &pool,
+                               StagingUploader &uploader, const ParticleShaders &shaders, uint32_t capacity,
+                               VkPipelineCache cache)
+        : device(device), pool(pool), particle_capacity(capacity), sort_size(std::bit_ceil(std::max(capacity, 2u))),
+          barriers(device) {
+    if (!device.enabled_features.vulkan12.bufferDeviceAddress) {
+        throw std::runtime_error("Particle systems require the bufferDeviceAddress feature");
+    }
+    if (!(family.properties.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        throw std::runtime_error("Unable to update particles on a queue family without compute");
+    }
+    if (capacity == 0) {
+        throw std::runtime_error("Unable to create a particle system without capacity");
+    }
+
+    // Indirect commands are read by dispatches too, so only the vertex shader stage needs graphics.
+    const bool graphics = family.properties.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+    draw_stages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR
+                  | (graphics ? VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR : VK_PIPELINE_STAGE_2_NONE_KHR);
+    draw_access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR
+                  | (graphics ? VK_ACCESS_2_SHADER_READ_BIT_KHR : VK_ACCESS_2_NONE_KHR);
+
+    // Every buffer is a range of one allocation.
+    const auto particles_offset = VkDeviceSize(0);
+    const auto dead_list_offset = align_up(particles_offset + VkDeviceSize(capacity) * sizeof(GpuParticle), 16);
+    const auto alive_offset = align_up(dead_list_offset + VkDeviceSize(capacity) * sizeof(uint32_t), 16);
+    const auto alive_size = align_up(VkDeviceSize(capacity) * sizeof(uint32_t), 16);
+    draw_order_offset = alive_offset + 2 * alive_size;
+    counters_offset = draw_order_offset + VkDeviceSize(sort_size) * 2 * sizeof(uint32_t);
+
+    try {
+        VkBufferCreateInfo buffer_create_info;
+        buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_create_info.pNext = nullptr;
+        buffer_create_info.flags = 0;
+        buffer_create_info.size = counters_offset + sizeof(ParticleCounters);
+        buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                   | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                                   | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        buffer_create_info.queueFamilyIndexCount = 0;
+        buffer_create_info.pQueueFamilyIndices = nullptr;
+        check_device_result(vkCreateBuffer(device.device, &buffer_create_info, nullptr, &buffer),
+                            "Unable to create particle buffer");
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+        allocation = pool.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        check_device_result(vkBindBufferMemory(device.device, buffer, allocation.memory, allocation.offset),
+                            "Unable to bind particle memory");
+
+        VkPushConstantRange push_constant_range;
+        push_constant_range.stageFlags = PUSH_CONSTANT_STAGES;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(ParticlePushConstants);
+
+        VkPipelineLayoutCreateInfo layout_create_info;
+        layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_create_info.pNext = nullptr;
+        layout_create_info.flags = 0;
+        layout_create_info.setLayoutCount = 0;
+        layout_create_info.pSetLayouts = nullptr;
+        layout_create_info.pushConstantRangeCount = 1;
+        layout_create_info.pPushConstantRanges = &push_constant_range;
+        check_device_result(vkCreatePipelineLayout(device.device, &layout_create_info, nullptr, &pipeline_layout),
+                            "Unable to create particle pipeline layout");
+
+        emit_pipeline = create_pipeline(shaders.emit, cache);
+        prepare_pipeline = create_pipeline(shaders.prepare, cache);
+        simulate_pipeline = create_pipeline(shaders.simulate, cache);
+        sort_pipeline = create_pipeline(shaders.sort, cache);
+    } catch (...) {
+        destroy();
+        throw;
+    }
+
+    const auto base = buffer_device_address(device, buffer);
+    constants.particles = base + particles_offset;
+    constants.dead_list = base + dead_list_offset;
+    constants.alive_in = base + alive_offset;
+    constants.alive_out = base + alive_offset + alive_size;
+    constants.draw_order = base + draw_order_offset;
+    constants.counters = base + counters_offset;
+    constants.capacity = capacity;
+    constants.sort_size = sort_size;
+
+    // Every slot starts out dead.
+    std::vector<uint32_t> dead_list(capacity);
+    std::iota(dead_list.begin(), dead_list.end(), 0u);
+    uploader.upload(buffer, dead_list_offset, std::as_bytes(std::span(dead_list)));
+
+    ParticleCounters counters;
+    std::memset(&counters, 0, sizeof(counters));
+    counters.dead_count = capacity;
+    counters.simulate = {0, 1, 1};
+    counters.draw = {6, 0, 0, 0};
+    uploader.upload(buffer, counters_offset, std::as_bytes(std::span(&counters, 1)));
+}
+
+ParticleSystem::~ParticleSystem() {
+    destroy();
+}
+
+VkPipeline ParticleSystem::create_pipeline(VkShaderModule shader, VkPipelineCache cache) const {
+    VkComputePipelineCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    create_info.stage.pNext = nullptr;
+    create_info.stage.flags = 0;
+    create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    create_info.stage.module = shader;
+    create_info.stage.pName = "main";
+    create_info.stage.pSpecializationInfo = nullptr;
+    create_info.layout = pipeline_layout;
+    create_info.basePipelineHandle = VK_NULL_HANDLE;
+    create_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    check_device_result(vkCreateComputePipelines(device.device, cache, 1, &create_info, nullptr, &pipeline),
+                        "Unable to create particle pipeline");
+    return pipeline;
+}
+
+void ParticleSystem::destroy() {
+    vkDestroyPipeline(device.device, sort_pipeline, nullptr);
+    vkDestroyPipeline(device.device, simulate_pipeline, nullptr);
+    vkDestroyPipeline(device.device, prepare_pipeline, nullptr);
+    vkDestroyPipeline(device.device, emit_pipeline, nullptr);
+    vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
+    vkDestroyBuffer(device.device, buffer, nullptr);
+    pool.free(allocation);
+}
+
+void ParticleSystem::dispatch(VkCommandBuffer command_buffer, VkPipeline pipeline, uint32_t groups) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdPushConstants(command_buffer, pipeline_layout, PUSH_CONSTANT_STAGES, 0, sizeof(constants), &constants);
+    vkCmdDispatch(command_buffer, groups, 1, 1);
+}
+
+void ParticleSystem::barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags2KHR destination_stages,
+                             VkAccessFlags2KHR destination_access) {
+    barriers.memory_barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                            VK_ACCESS_2_SHADER_WRITE_BIT_KHR, destination_stages, destination_access);
+    barriers.flush(command_buffer);
+}
+
+void ParticleSystem::update(VkCommandBuffer command_buffer, const ParticleFrame &frame) {
+    constexpr auto COMPUTE = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+    constexpr auto COMPUTE_ACCESS = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+
+    std::memcpy(constants.emitter_position, frame.emitter_position, sizeof(constants.emitter_position));
+    std::memcpy(constants.camera_position, frame.camera_position, sizeof(constants.camera_position));
+    constants.delta_time = frame.delta_time;
+    constants.emit_count = std::min(frame.emit_count, particle_capacity);
+    constants.seed++;
+
+    // The previous draw must be done with the draw order and indirect command before they are rewritten, and the
+    // writes of the previous update and of the initial upload or any copy must be visible.
+    barriers.memory_barrier(draw_stages | COMPUTE | VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+                            VK_ACCESS_2_SHADER_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, COMPUTE,
+                            COMPUTE_ACCESS);
+    barriers.flush(command_buffer);
+
+    if (constants.emit_count > 0) {
+        dispatch(command_buffer, emit_pipeline, group_count(constants.emit_count));
+        barrier(command_buffer, COMPUTE, COMPUTE_ACCESS);
+    }
+
+    constants.phase = 0;
+    dispatch(command_buffer, prepare_pipeline, 1);
+    barrier(command_buffer, COMPUTE | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+            COMPUTE_ACCESS | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR);
+
+    // Simulate only runs over the particles alive, which the CPU does not know.
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, simulate_pipeline);
+    vkCmdPushConstants(command_buffer, pipeline_layout, PUSH_CONSTANT_STAGES, 0, sizeof(constants), &constants);
+    vkCmdDispatchIndirect(command_buffer, buffer, counters_offset + offsetof(ParticleCounters, simulate));
+    barrier(command_buffer, COMPUTE, COMPUTE_ACCESS);
+
+    constants.phase = 1;
+    dispatch(command_buffer, prepare_pipeline, 1);
+
+    if (frame.sort) {
+        // Bitonic sort over every slot, as the number of steps cannot depend on the alive count.
+        for (uint32_t k = 2; k <= sort_size; k *= 2) {
+            for (uint32_t j = k / 2; j > 0; j /= 2) {
+                barrier(command_buffer, COMPUTE, COMPUTE_ACCESS);
+                constants.sort_k = k;
+                constants.sort_j = j;
+                dispatch(command_buffer, sort_pipeline, group_count(sort_size / 2));
+            }
+        }
+    }
+
+    barrier(command_buffer, draw_stages, draw_access);
+
+    // The survivors are read next update.
+    std::swap(constants.alive_in, constants.alive_out);
+    constants.alive_in_index ^= 1;
+}
+
+void ParticleSystem::draw(VkCommandBuffer command_buffer) const {
+    vkCmdPushConstants(command_buffer, pipeline_layout, PUSH_CONSTANT_STAGES, 0, sizeof(constants), &constants);
+    vkCmdDrawIndirect(command_buffer, buffer, counters_offset + offsetof(ParticleCounters, draw), 1,
+                      sizeof(VkDrawIndirectCommand));
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "staging_uploader.hpp"
+#include "synchronization.hpp"
+
+/**
+ * A particle as shaders store it, in std430 layout.
+ */
+struct GpuParticle {
+    /// xyz is the position, w the age in seconds.
+    float position_age[4];
+    /// xyz is the velocity, w the lifetime in seconds.
+    float velocity_lifetime[4];
+    float color[4];
+};
+
+/**
+ * The counters and indirect commands of a particle system, as shaders see them in std430 layout.
+ */
+struct ParticleCounters {
+    /// The number of entries in the dead list.
+    uint32_t dead_count;
+    /// The number of entries in each alive list.
+    uint32_t alive_count[2];
+    uint32_t padding;
+    /// Dispatches the simulate shader over the alive list being read.
+    VkDispatchIndirectCommand simulate;
+    uint32_t padding_2;
+    /// Draws one instance per surviving particle.
+    VkDrawIndirectCommand draw;
+};
+
+static_assert(sizeof(GpuParticle) == 48 && sizeof(ParticleCounters) == 48, "Shaders assume these sizes");
+
+/**
+ * The push constants of every particle shader, including the render pipeline's.
+ */
+struct ParticlePushConstants {
+    /// The device addresses of the particle system's buffers.
+    VkDeviceAddress particles;
+    VkDeviceAddress dead_list;
+    /// The alive list read this update, which emit appends to.
+    VkDeviceAddress alive_in;
+    /// The alive list simulate compacts survivors into.
+    VkDeviceAddress alive_out;
+    /// uvec2(sort key, particle index) per survivor, sorted back to front. The render pipeline draws instance i with
+    /// particle draw_order[i].y.
+    VkDeviceAddress draw_order;
+    VkDeviceAddress counters;
+    float emitter_position[3];
+    float delta_time;
+    float camera_position[3];
+    uint32_t emit_count;
+    uint32_t seed;
+    uint32_t capacity;
+    /// The index in ParticleCounters::alive_count of alive_in.
+    uint32_t alive_in_index;
+    /// Which half of the prepare shader to run, 0 or 1.
+    uint32_t phase;
+    /// The power of two number of draw_order entries sorted, and the stage of the bitonic sort to run.
+    uint32_t sort_size;
+    uint32_t sort_k;
+    uint32_t sort_j;
+    uint32_t padding;
+};
+
+static_assert(sizeof(ParticlePushConstants) <= 128, "Push constants must fit the minimum maxPushConstantsSize");
+
+/**
+ * The compute shaders of a particle system, which all use local_size_x = ParticleSystem::WORKGROUP_SIZE and read
+ * ParticlePushConstants through buffer_reference pointers:
+ *
+ * - emit: each of emit_count invocations pops a slot off the dead list with an atomic decrement of dead_count,
+ *   giving up if it was empty, writes a new particle at emitter_position there, and appends the slot to alive_in.
+ * - prepare: a single invocation. Phase 0 writes the simulate dispatch for alive_count[alive_in_index] and clears
+ *   the other alive count. Phase 1 writes draw.instanceCount from the other alive count.
+ * - simulate: each invocation below alive_count[alive_in_index] ages and moves its particle. Dead particles push
+ *   their slot back onto the dead list, and survivors are appended to alive_out, along with their entry in
+ *   draw_order, keyed by ~floatBitsToUint(distance to camera_position) so that ascending order is back to front.
+ * - sort: one step of a bitonic sort of the first sort_size entries of draw_order, with each of sort_size / 2
+ *   invocations ordering one pair of entries sort_j apart, ascending or descending by their block of sort_k.
+ *   Entries past the alive count sort as UINT_MAX.
+ *
+ * shaders/particle_*.comp are reference implementations, compiled by the build where glslangValidator is found.
+ */
+struct ParticleShaders {
+    VkShaderModule emit = VK_NULL_HANDLE;
+    VkShaderModule prepare = VK_NULL_HANDLE;
+    VkShaderModule simulate = VK_NULL_HANDLE;
+    VkShaderModule sort = VK_NULL_HANDLE;
+};
+
+/**
+ * The per update inputs of a particle system.
+ */
+struct ParticleFrame {
+    float delta_time = 0.0f;
+    uint32_t emit_count = 0;
+    float emitter_position[3] = {0.0f, 0.0f, 0.0f};
+    float camera_position[3] = {0.0f, 0.0f, 0.0f};
+    /// Sorting is only needed for blending which depends on order.
+    bool sort = true;
+};
+
+/**
+ * Particles living entirely on the GPU. Each update emits, simulates and compacts the particles in compute shaders,
+ * sorts the survivors back to front, and writes an indirect draw sized by their count, so the CPU never reads or
+ * uploads particle data after creation.
+ * Free slots are kept on a dead list, and live ones on two alive lists which simulate alternates between, so that
+ * compaction needs no separate pass.
+ */
+class ParticleSystem {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    /**
+     * Creates the buffers and pipelines, and queues the upload of the initial dead list. The system may be updated
+     * once the uploader is flushed.
+     * @param device The device, which must have the bufferDeviceAddress feature enabled.
+     * @param family The queue family updates are recorded for, which must support compute. Updates only wait on and
+     *               make their results visible to the vertex shaders of draws if it also supports graphics. Otherwise
+     *               the draw is on another queue, which waits on a semaphore for them.
+     * @param pool The pool the buffers are allocated from.
+     * @param uploader The uploader of the initial state.
+     * @param shaders The compute shaders, which may be destroyed once this returns.
+     * @param capacity The most particles alive at once.
+     * @param cache The pipeline cache, or VK_NULL_HANDLE.
+     */
+    ParticleSystem(const LogicalDevice &device, const DeviceQueueFamily &family, MemoryPool &pool,
+                   StagingUploader &uploader, const ParticleShaders &shaders, uint32_t capacity,
+                   VkPipelineCache cache = VK_NULL_HANDLE);
+
+    ParticleSystem(const ParticleSystem &) = delete;
+
+    ParticleSystem &operator=(const ParticleSystem &) = delete;
+
+    /**
+     * Destroys the buffers and pipelines, which must no longer be in use.
+     */
+    ~ParticleSystem();
+
+    /**
+     * Records an update of the particles on a queue of the family given on creation, ending with a barrier making the
+     * results visible to draw.
+     */
+    void update(VkCommandBuffer command_buffer, const ParticleFrame &frame);
+
+    /**
+     * Records the indirect draw of the particles made by the last update. A graphics pipeline created with layout()
+     * must be bound, and must draw each instance as a quad of six vertices.
+     */
+    void draw(VkCommandBuffer command_buffer) const;
+
+    /**
+     * @return The layout the render pipeline must be created with, which is push constants only.
+     */
+    VkPipelineLayout layout() const { return pipeline_layout; }
+
+    uint32_t capacity() const { return particle_capacity; }
+
+    /**
+     * @return The range of the buffer holding the ParticleCounters, which may be copied from, e.g. to read them back.
+     */
+    VkDescriptorBufferInfo counters() const { return {buffer, counters_offset, sizeof(ParticleCounters)}; }
+
+    /**
+     * @return The range of the buffer holding the draw order written by the last update, which may be copied from.
+     */
+    VkDescriptorBufferInfo draw_order() const {
+        return {buffer, draw_order_offset, VkDeviceSize(sort_size) * 2 * sizeof(uint32_t)};
+    }
+
+private:
+    VkPipeline create_pipeline(VkShaderModule shader, VkPipelineCache cache) const;
+
+    void destroy();
+
+    void dispatch(VkCommandBuffer command_buffer, VkPipeline pipeline, uint32_t group_count);
+
+    /**
+     * Records a barrier between compute writes and what follows.
+     */
+    void barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags2KHR destination_stages,
+                 VkAccessFlags2KHR destination_access);
+
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    uint32_t particle_capacity;
+    uint32_t sort_size;
+    /// The stages and accesses of draws on the update queue, which exclude vertex shaders on compute only queues.
+    VkPipelineStageFlags2KHR draw_stages;
+    VkAccessFlags2KHR draw_access;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+    VkDeviceSize draw_order_offset = 0;
+    VkDeviceSize counters_offset = 0;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline emit_pipeline = VK_NULL_HANDLE;
+    VkPipeline prepare_pipeline = VK_NULL_HANDLE;
+    VkPipeline simulate_pipeline = VK_NULL_HANDLE;
+    VkPipeline sort_pipeline = VK_NULL_HANDLE;
+    ParticlePushConstants constants = {};
+    BarrierBatch barriers;
+};
@@ -0,0 +1,113 @@
+#include "physical_device_capabilities.hpp"
+
+VkPhysicalDeviceFeatures2 *DeviceFeatures::chain(uint32_t api_version, const ExtensionIndex &extensions,
+                                                 bool probing) {
+    core.pNext = nullptr;
+    vulkan11.pNext = nullptr;
+    vulkan12.pNext = nullptr;
+    synchronization2.pNext = nullptr;
+    graphics_pipeline_library.pNext = nullptr;
+
+    void **tail = &core.pNext;
+    auto append = [&](auto &features) {
+        *tail = &features;
+        tail = &features.pNext;
+    };
+    auto usable = [&](std::string_view extension) {
+        return probing ? extensions.supported(extension) : extensions.enabled(extension);
+    };
+
+    // The per-version feature structures may only be chained for devices that support vulkan 1.2.
+    if (api_version >= VK_API_VERSION_1_2) {
+        append(vulkan11);
+        append(vulkan12);
+    }
+    if (usable(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+        append(synchronization2);
+    }
+    if (usable(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+        append(graphics_pipeline_library);
+    }
+
+    return &core;
+}
+
+bool DeviceFeatures::contains(const DeviceFeatures &other) const {
+    bool result = true;
+    const_cast<DeviceFeatures *>(this)->for_each_feature(other, [&](VkBool32 &mine, VkBool32 theirs) {
+        if (theirs && !mine) {
+            result = false;
+        }
+    });
+    return result;
+}
+
+void DeviceFeatures::merge(const DeviceFeatures &other) {
+    for_each_feature(other, [](VkBool32 &mine, VkBool32 theirs) {
+        mine = mine || theirs ? VK_TRUE : VK_FALSE;
+    });
+}
+
+void DeviceFeatures::intersect(const DeviceFeatures &other) {
+    for_each_feature(other, [](VkBool32 &mine, VkBool32 theirs) {
+        mine = mine && theirs ? VK_TRUE : VK_FALSE;
+    });
+}
+
+bool PhysicalDeviceCapabilities::supports_extension(std::string_view name) const {
+    return extensions.supported(name);
+}
+
+VkDeviceSize PhysicalDeviceCapabilities::device_local_memory() const {
+    VkDeviceSize size = 0;
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            size += memory_properties.memoryHeaps[i].size;
+        }
+    }
+    return size;
+}
+
+std::optional<uint32_t> PhysicalDeviceCapabilities::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required,
+                                                                     VkMemoryPropertyFlags preferred) const {
+    std::optional<uint32_t> fallback;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        auto flags = memory_properties.memoryTypes[i].propertyFlags;
+        if (!(type_bits & (1u << i)) || (flags & required) != required) {
+            continue;
+        }
+        if ((flags & preferred) == preferred) {
+            return i;
+        }
+        if (!fallback) {
+            fallback = i;
+        }
+    }
+    return fallback;
+}
+
+std::vector<PhysicalDeviceCapabilities>
+probe_physical_device_capabilities(const std::vector<VkPhysicalDevice> &physical_devices) {
+    std::vector<PhysicalDeviceCapabilities> capabilities;
+    capabilities.reserve(physical_devices.size());
+
+    for (auto &physical_device: physical_devices) {
+        auto &device = capabilities.emplace_back();
+        device.physical_device = physical_device;
+        vkGetPhysicalDeviceProperties(physical_device, &device.properties);
+        vkGetPhysicalDeviceMemoryProperties(physical_device, &device.memory_properties);
+
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+        device.queue_families.resize(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, device.queue_families.data());
+
+        // Extension feature structures are only chained for supported extensions, so probe those first.
+        device.extensions = probe_device_extensions(physical_device);
+        vkGetPhysicalDeviceFeatures2(physical_device,
+                                     device.features.chain(device.properties.apiVersion, device.extensions, true));
+        device.formats.probe(physical_device, device.properties.apiVersion, device.extensions);
+    }
+
+    return capabilities;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include "extension_index.hpp"
+#include "format_table.hpp"
+#include "vulkan_reflection_tables.hpp"
+
+/**
+ * The feature structures known to the device builder, chained together for vkGetPhysicalDeviceFeatures2 and
+ * vkCreateDevice.
+ */
+struct DeviceFeatures {
+    VkPhysicalDeviceFeatures2 core = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    VkPhysicalDeviceVulkan11Features vulkan11 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+    VkPhysicalDeviceVulkan12Features vulkan12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2 = {
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR};
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library = {
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+
+    /**
+     * Links the feature structures usable with a device into a pNext chain.
+     * @param api_version The vulkan version supported by the device.
+     * @param extensions The extensions of the device. The structure of an extension is chained if it is enabled, or
+     *                   when probing if it is supported.
+     * @param probing Whether the chain is used to query the supported features.
+     * @return The head of the chain.
+     */
+    VkPhysicalDeviceFeatures2 *chain(uint32_t api_version, const ExtensionIndex &extensions, bool probing);
+
+    /**
+     * Gets the structure holding a feature, given the structure type of a pointer to its member.
+     */
+    template<typename Struct>
+    Struct &get() {
+        if constexpr (std::is_same_v<Struct, VkPhysicalDeviceFeatures>) {
+            return core.features;
+        } else if constexpr (std::is_same_v<Struct, VkPhysicalDeviceVulkan11Features>) {
+            return vulkan11;
+        } else if constexpr (std::is_same_v<Struct, VkPhysicalDeviceVulkan12Features>) {
+            return vulkan12;
+        } else if constexpr (std::is_same_v<Struct, VkPhysicalDeviceSynchronization2FeaturesKHR>) {
+            return synchronization2;
+        } else {
+            static_assert(std::is_same_v<Struct, VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>,
+                          "Unknown feature structure");
+            return graphics_pipeline_library;
+        }
+    }
+
+    template<typename Struct>
+    const Struct &get() const { return const_cast<DeviceFeatures *>(this)->get<Struct>(); }
+
+    /**
+     * Calls a function with each VkBool32 member of every feature structure, and the same member of another feature
+     * set. The members come from the registry, so nothing is assumed about the structures' layout.
+     * @param other The other feature set, visited in lockstep.
+     * @param function Called as function(VkBool32 &mine, VkBool32 theirs).
+     */
+    template<typename Function>
+    void for_each_feature(const DeviceFeatures &other, Function &&function) {
+        for_each_member(core.features, other.core.features, function);
+        for_each_member(vulkan11, other.vulkan11, function);
+        for_each_member(vulkan12, other.vulkan12, function);
+        for_each_member(synchronization2, other.synchronization2, function);
+        for_each_member(graphics_pipeline_library, other.graphics_pipeline_library, function);
+    }
+
+    /**
+     * @return Whether every feature enabled in other is also enabled here.
+     */
+    bool contains(const DeviceFeatures &other) const;
+
+    /**
+     * Enables every feature that is enabled in other.
+     */
+    void merge(const DeviceFeatures &other);
+
+    /**
+     * Disables every feature that is not enabled in other.
+     */
+    void intersect(const DeviceFeatures &other);
+
+private:
+    template<typename Struct, typename Function>
+    static void for_each_member(Struct &mine, const Struct &theirs, Function &function) {
+        for (auto member: vk_reflection::FeatureTraits<Struct>::members) {
+            function(mine.*member, theirs.*member);
+        }
+    }
+};
+
+/**
+ * Everything probed from a physical device once at startup, so that device selection and creation never go back to
+ * the driver.
+ */
+struct PhysicalDeviceCapabilities {
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties = {};
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    std::vector<VkQueueFamilyProperties> queue_families;
+    ExtensionIndex extensions;
+    DeviceFeatures features;
+    FormatTable formats;
+
+    /**
+     * @param name The name of a device extension.
+     * @return Whether the device supports the extension.
+     */
+    bool supports_extension(std::string_view name) const;
+
+    /**
+     * @return The total size of the device local memory heaps.
+     */
+    VkDeviceSize device_local_memory() const;
+
+    /**
+     * Finds a memory type for a resource.
+     * @param type_bits The memoryTypeBits of the resource's memory requirements.
+     * @param required The properties the memory type must have.
+     * @param preferred Properties to prefer when several memory types qualify.
+     * @return The index of the memory type, if any qualifies.
+     */
+    std::optional<uint32_t> find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required,
+                                             VkMemoryPropertyFlags preferred = 0) const;
+};
+
+/**
+ * Probes the properties, features, extensions, formats, queue families and memory of a set of physical devices.
+ * @param physical_devices The devices to probe, as returned by get_physical_devices.
+ * @return The capabilities of each device, in the same order as the physical device array given.
+ */
+std::vector<PhysicalDeviceCapabilities>
+probe_physical_device_capabilities(const std::vector<VkPhysicalDevice> &physical_devices);
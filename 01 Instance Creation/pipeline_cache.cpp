@@ -0,0 +1,71 @@
+#include "pipeline_cache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+std::vector<std::byte> read_pipeline_cache_file(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return {};
+    }
+
+    std::vector<std::byte> data(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error("Unable to read pipeline cache file " + path.string());
+    }
+    return data;
+}
+
+bool pipeline_cache_compatible(std::span<const std::byte> data, const VkPhysicalDeviceProperties &properties) {
+    // The header is VkPipelineCacheHeaderVersionOne: size, version, vendor id, device id, then the cache UUID.
+    uint32_t header[4];
+    if (data.size() < sizeof(header) + VK_UUID_SIZE) {
+        return false;
+    }
+    std::memcpy(header, data.data(), sizeof(header));
+    return header[0] >= sizeof(header) + VK_UUID_SIZE
+           && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+           && header[2] == properties.vendorID
+           && header[3] == properties.deviceID
+           && std::memcmp(data.data() + sizeof(header), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache create_pipeline_cache(const LogicalDevice &device, std::span<const std::byte> data) {
+    if (!pipeline_cache_compatible(data, device.capabilities->properties)) {
+        data = {};
+    }
+
+    VkPipelineCacheCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.initialDataSize = data.size();
+    create_info.pInitialData = data.data();
+
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    check_device_result(vkCreatePipelineCache(device.device, &create_info, nullptr, &cache),
+                        "Unable to create pipeline cache");
+    return cache;
+}
+
+void save_pipeline_cache(const LogicalDevice &device, VkPipelineCache cache, const std::filesystem::path &path) {
+    std::size_t size = 0;
+    check_device_result(vkGetPipelineCacheData(device.device, cache, &size, nullptr),
+                        "Unable to get pipeline cache data");
+    std::vector<std::byte> data(size);
+    check_device_result(vkGetPipelineCacheData(device.device, cache, &size, data.data()),
+                        "Unable to get pipeline cache data");
+
+    // Written aside and renamed, so that a crash mid-write never leaves a truncated cache behind.
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("Unable to write pipeline cache file " + temporary.string());
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
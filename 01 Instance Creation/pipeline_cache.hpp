@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include "logical_device.hpp"
+
+/**
+ * Reads a pipeline cache saved by save_pipeline_cache. Needs no device, so it can run before one is created.
+ * @param path The file to read.
+ * @return The contents of the file, or nothing if it does not exist.
+ * @throws std::runtime_error if the file exists but cannot be read.
+ */
+std::vector<std::byte> read_pipeline_cache_file(const std::filesystem::path &path);
+
+/**
+ * Checks that pipeline cache data was saved by the same device and driver, from its header.
+ * @param data The saved pipeline cache.
+ * @param properties The properties of the device the cache would be used with.
+ * @return Whether the driver can use the data.
+ */
+bool pipeline_cache_compatible(std::span<const std::byte> data, const VkPhysicalDeviceProperties &properties);
+
+/**
+ * Creates a pipeline cache, seeded with saved data if it came from the same device and driver.
+ * @param device The device to create the cache on.
+ * @param data The saved pipeline cache, possibly empty. Incompatible data is ignored.
+ * @return The pipeline cache.
+ */
+VkPipelineCache create_pipeline_cache(const LogicalDevice &device, std::span<const std::byte> data);
+
+/**
+ * Writes the contents of a pipeline cache to a file, replacing it.
+ * @param device The device the cache was created on.
+ * @param cache The pipeline cache.
+ * @param path The file to write.
+ */
+void save_pipeline_cache(const LogicalDevice &device, VkPipelineCache cache, const std::filesystem::path &path);
@@ -0,0 +1,384 @@
+#include "pipeline_library.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+#include "logger.hpp"
+
+static constexpr VkGraphicsPipelineLibraryFlagsEXT ALL_PARTS =
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT
+        | VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT
+        | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT
+        | VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+
+/**
+ * Appends the bytes of trivially copyable values to a key.
+ */
+template<typename T>
+static void append_key(std::string &key, const T &value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<typename T>
+static void append_key(std::string &key, const std::vector<T> &values) {
+    append_key(key, values.size());
+    key.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+PipelineLibrary::PipelineLibrary(const LogicalDevice &device, WorkerPool &workers, VkPipelineCache cache)
+        : device(device), workers(workers), cache(cache) {}
+
+PipelineLibrary::~PipelineLibrary() {
+    // Optimisations take the mutex when they finish, so wait for them without holding it.
+    for (auto &optimization: optimizations) {
+        optimization.wait();
+    }
+
+    // Every compile has finished, as get() no longer runs, and failed ones were removed.
+    for (auto &[key, future]: pipelines) {
+        const auto pipeline = future.get();
+        if (pipeline->fast_linked != VK_NULL_HANDLE && pipeline->fast_linked != pipeline->handle()) {
+            vkDestroyPipeline(device.device, pipeline->fast_linked, nullptr);
+        }
+        vkDestroyPipeline(device.device, pipeline->handle(), nullptr);
+    }
+    for (auto pipeline: retired) {
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+    }
+    for (auto pipeline: retiring) {
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+    }
+    for (auto &part_libraries: libraries) {
+        for (auto &[key, library]: part_libraries) {
+            vkDestroyPipeline(device.device, library.get(), nullptr);
+        }
+    }
+}
+
+std::string PipelineLibrary::part_key(const GraphicsPipelineDescription &description, Part part) {
+    std::string key;
+    switch (part) {
+        case VERTEX_INPUT:
+            append_key(key, description.vertex_bindings);
+            append_key(key, description.vertex_attributes);
+            append_key(key, description.topology);
+            break;
+        case PRE_RASTERIZATION:
+            append_key(key, description.vertex_shader);
+            append_key(key, description.polygon_mode);
+            append_key(key, description.cull_mode);
+            append_key(key, description.front_face);
+            append_key(key, description.layout);
+            append_key(key, description.render_pass);
+            append_key(key, description.subpass);
+            break;
+        case FRAGMENT_SHADER:
+            append_key(key, description.fragment_shader);
+            append_key(key, description.depth_test);
+            append_key(key, description.depth_write);
+            append_key(key, description.depth_compare);
+            append_key(key, description.samples);
+            append_key(key, description.layout);
+            append_key(key, description.render_pass);
+            append_key(key, description.subpass);
+            break;
+        case FRAGMENT_OUTPUT:
+            append_key(key, description.color_attachment_count);
+            append_key(key, description.blend);
+            append_key(key, description.samples);
+            append_key(key, description.render_pass);
+            append_key(key, description.subpass);
+            break;
+        case PART_COUNT:
+            break;
+    }
+    return key;
+}
+
+VkPipeline PipelineLibrary::create(const GraphicsPipelineDescription &description,
+                                   VkGraphicsPipelineLibraryFlagsEXT parts, bool library) const {
+    VkPipelineVertexInputStateCreateInfo vertex_input_state;
+    vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_state.pNext = nullptr;
+    vertex_input_state.flags = 0;
+    vertex_input_state.vertexBindingDescriptionCount = description.vertex_bindings.size();
+    vertex_input_state.pVertexBindingDescriptions = description.vertex_bindings.data();
+    vertex_input_state.vertexAttributeDescriptionCount = description.vertex_attributes.size();
+    vertex_input_state.pVertexAttributeDescriptions = description.vertex_attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_state;
+    input_assembly_state.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_state.pNext = nullptr;
+    input_assembly_state.flags = 0;
+    input_assembly_state.topology = description.topology;
+    input_assembly_state.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineShaderStageCreateInfo stages[2];
+    uint32_t stage_count = 0;
+    auto add_stage = [&](VkShaderStageFlagBits stage, VkShaderModule module) {
+        auto &stage_create_info = stages[stage_count++];
+        stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage_create_info.pNext = nullptr;
+        stage_create_info.flags = 0;
+        stage_create_info.stage = stage;
+        stage_create_info.module = module;
+        stage_create_info.pName = "main";
+        stage_create_info.pSpecializationInfo = nullptr;
+    };
+    if (parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT) {
+        add_stage(VK_SHADER_STAGE_VERTEX_BIT, description.vertex_shader);
+    }
+    if (parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT) {
+        add_stage(VK_SHADER_STAGE_FRAGMENT_BIT, description.fragment_shader);
+    }
+
+    VkPipelineViewportStateCreateInfo viewport_state;
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.pNext = nullptr;
+    viewport_state.flags = 0;
+    viewport_state.viewportCount = 1;
+    viewport_state.pViewports = nullptr;
+    viewport_state.scissorCount = 1;
+    viewport_state.pScissors = nullptr;
+
+    VkPipelineRasterizationStateCreateInfo rasterization_state;
+    rasterization_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization_state.pNext = nullptr;
+    rasterization_state.flags = 0;
+    rasterization_state.depthClampEnable = VK_FALSE;
+    rasterization_state.rasterizerDiscardEnable = VK_FALSE;
+    rasterization_state.polygonMode = description.polygon_mode;
+    rasterization_state.cullMode = description.cull_mode;
+    rasterization_state.frontFace = description.front_face;
+    rasterization_state.depthBiasEnable = VK_FALSE;
+    rasterization_state.depthBiasConstantFactor = 0.0f;
+    rasterization_state.depthBiasClamp = 0.0f;
+    rasterization_state.depthBiasSlopeFactor = 0.0f;
+    rasterization_state.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample_state;
+    multisample_state.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_state.pNext = nullptr;
+    multisample_state.flags = 0;
+    multisample_state.rasterizationSamples = description.samples;
+    multisample_state.sampleShadingEnable = VK_FALSE;
+    multisample_state.minSampleShading = 0.0f;
+    multisample_state.pSampleMask = nullptr;
+    multisample_state.alphaToCoverageEnable = VK_FALSE;
+    multisample_state.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_state;
+    depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_state.pNext = nullptr;
+    depth_stencil_state.flags = 0;
+    depth_stencil_state.depthTestEnable = description.depth_test;
+    depth_stencil_state.depthWriteEnable = description.depth_write;
+    depth_stencil_state.depthCompareOp = description.depth_compare;
+    depth_stencil_state.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil_state.stencilTestEnable = VK_FALSE;
+    depth_stencil_state.front = {};
+    depth_stencil_state.back = {};
+    depth_stencil_state.minDepthBounds = 0.0f;
+    depth_stencil_state.maxDepthBounds = 1.0f;
+
+    VkPipelineColorBlendAttachmentState blend_attachment;
+    blend_attachment.blendEnable = description.blend;
+    blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
+                                      | VK_COLOR_COMPONENT_A_BIT;
+    std::vector<VkPipelineColorBlendAttachmentState> blend_attachments(description.color_attachment_count,
+                                                                       blend_attachment);
+
+    VkPipelineColorBlendStateCreateInfo color_blend_state;
+    color_blend_state.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend_state.pNext = nullptr;
+    color_blend_state.flags = 0;
+    color_blend_state.logicOpEnable = VK_FALSE;
+    color_blend_state.logicOp = VK_LOGIC_OP_COPY;
+    color_blend_state.attachmentCount = blend_attachments.size();
+    color_blend_state.pAttachments = blend_attachments.data();
+    color_blend_state.blendConstants[0] = 0.0f;
+    color_blend_state.blendConstants[1] = 0.0f;
+    color_blend_state.blendConstants[2] = 0.0f;
+    color_blend_state.blendConstants[3] = 0.0f;
+
+    const VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state;
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.pNext = nullptr;
+    dynamic_state.flags = 0;
+    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.pDynamicStates = dynamic_states;
+
+    VkGraphicsPipelineLibraryCreateInfoEXT library_create_info;
+    library_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    library_create_info.pNext = nullptr;
+    library_create_info.flags = parts;
+
+    const bool vertex_input = parts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+    const bool pre_rasterization = parts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+    const bool fragment_shader = parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+    const bool fragment_output = parts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info;
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.pNext = library ? &library_create_info : nullptr;
+    pipeline_create_info.flags = library ? VK_PIPELINE_CREATE_LIBRARY_BIT_KHR
+                                           | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT : 0;
+    pipeline_create_info.stageCount = stage_count;
+    pipeline_create_info.pStages = stages;
+    pipeline_create_info.pVertexInputState = vertex_input ? &vertex_input_state : nullptr;
+    pipeline_create_info.pInputAssemblyState = vertex_input ? &input_assembly_state : nullptr;
+    pipeline_create_info.pTessellationState = nullptr;
+    pipeline_create_info.pViewportState = pre_rasterization ? &viewport_state : nullptr;
+    pipeline_create_info.pRasterizationState = pre_rasterization ? &rasterization_state : nullptr;
+    pipeline_create_info.pMultisampleState = fragment_shader || fragment_output ? &multisample_state : nullptr;
+    pipeline_create_info.pDepthStencilState = fragment_shader ? &depth_stencil_state : nullptr;
+    pipeline_create_info.pColorBlendState = fragment_output ? &color_blend_state : nullptr;
+    pipeline_create_info.pDynamicState = pre_rasterization ? &dynamic_state : nullptr;
+    pipeline_create_info.layout = pre_rasterization || fragment_shader ? description.layout : VK_NULL_HANDLE;
+    pipeline_create_info.renderPass = description.render_pass;
+    pipeline_create_info.subpass = description.subpass;
+    pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_create_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(device.device, cache, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create graphics pipeline");
+    }
+    return pipeline;
+}
+
+VkPipeline PipelineLibrary::library_part(const GraphicsPipelineDescription &description, Part part) {
+    auto key = part_key(description, part);
+    auto &part_libraries = libraries[part];
+    std::unique_lock lock(mutex);
+    if (auto found = part_libraries.find(key); found != part_libraries.end()) {
+        auto library = found->second;
+        lock.unlock();
+        return library.get();
+    }
+    std::promise<VkPipeline> promise;
+    part_libraries.emplace(key, promise.get_future().share());
+    lock.unlock();
+
+    try {
+        // The library flag bits follow the order of the parts.
+        auto library = create(description, VkGraphicsPipelineLibraryFlagsEXT(1) << part, true);
+        promise.set_value(library);
+        return library;
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard relock(mutex);
+        part_libraries.erase(key);
+        throw;
+    }
+}
+
+VkPipeline PipelineLibrary::link(const VkPipeline (&parts)[PART_COUNT], VkPipelineLayout layout, bool optimize) const {
+    VkPipelineLibraryCreateInfoKHR library_info;
+    library_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    library_info.pNext = nullptr;
+    library_info.libraryCount = PART_COUNT;
+    library_info.pLibraries = parts;
+
+    VkGraphicsPipelineCreateInfo pipeline_create_info = {};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_create_info.pNext = &library_info;
+    pipeline_create_info.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+    pipeline_create_info.layout = layout;
+    pipeline_create_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateGraphicsPipelines(device.device, cache, 1, &pipeline_create_info, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to link graphics pipeline");
+    }
+    return pipeline;
+}
+
+std::shared_ptr<GraphicsPipeline> PipelineLibrary::get(const GraphicsPipelineDescription &description) {
+    std::string key;
+    for (uint32_t part = 0; part < PART_COUNT; part++) {
+        auto part_bytes = part_key(description, Part(part));
+        append_key(key, part_bytes.size());
+        key += part_bytes;
+    }
+
+    std::unique_lock lock(mutex);
+    if (auto found = pipelines.find(key); found != pipelines.end()) {
+        auto pipeline = found->second;
+        lock.unlock();
+        return pipeline.get();
+    }
+    std::promise<std::shared_ptr<GraphicsPipeline>> promise;
+    pipelines.emplace(key, promise.get_future().share());
+    lock.unlock();
+
+    try {
+        auto pipeline = compile(description);
+        promise.set_value(pipeline);
+        return pipeline;
+    } catch (...) {
+        // Waiting callers get the exception, and the next get() compiles again.
+        promise.set_exception(std::current_exception());
+        std::lock_guard relock(mutex);
+        pipelines.erase(key);
+        throw;
+    }
+}
+
+std::shared_ptr<GraphicsPipeline> PipelineLibrary::compile(const GraphicsPipelineDescription &description) {
+    auto pipeline = std::make_shared<GraphicsPipeline>();
+    if (!device.graphics_pipeline_library()) {
+        pipeline->current = create(description, ALL_PARTS, false);
+        pipeline->is_optimized = true;
+        return pipeline;
+    }
+
+    VkPipeline parts[PART_COUNT];
+    for (uint32_t part = 0; part < PART_COUNT; part++) {
+        parts[part] = library_part(description, Part(part));
+    }
+    pipeline->fast_linked = link(parts, description.layout, false);
+    pipeline->current = pipeline->fast_linked;
+
+    std::lock_guard lock(mutex);
+    optimizations.push_back(workers.submit([this, pipeline, parts, layout = description.layout] {
+        auto optimized = link(parts, layout, true);
+        std::lock_guard lock(mutex);
+        pipeline->current.store(optimized, std::memory_order_release);
+        pipeline->is_optimized.store(true, std::memory_order_release);
+        // The fast-linked pipeline may still be in flight, so it is destroyed later.
+        retired.push_back(pipeline->fast_linked);
+        pipeline->fast_linked = VK_NULL_HANDLE;
+    }));
+    return pipeline;
+}
+
+void PipelineLibrary::destroy_retired() {
+    std::lock_guard lock(mutex);
+    // Pipelines retired since the previous call may have been bound after it, so they wait for the next call.
+    for (auto pipeline: retiring) {
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+    }
+    retiring = std::move(retired);
+    retired.clear();
+
+    std::erase_if(optimizations, [](auto &optimization) {
+        if (optimization.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        // A failed optimisation leaves the fast-linked pipeline in use, which still works, so it is only reported.
+        try {
+            optimization.get();
+        } catch (const std::exception &exception) {
+            LOGGER_WARNING("Unable to optimise a pipeline, keeping the fast-linked one: {}", exception.what());
+        }
+        return true;
+    });
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "worker_pool.hpp"
+
+/**
+ * The state of a graphics pipeline, grouped by the four parts a pipeline library is built from. Viewport and scissor
+ * are always dynamic.
+ */
+struct GraphicsPipelineDescription {
+    // Vertex input interface.
+    std::vector<VkVertexInputBindingDescription> vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    // Pre-rasterization shaders.
+    VkShaderModule vertex_shader = VK_NULL_HANDLE;
+    VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    // Fragment shader.
+    VkShaderModule fragment_shader = VK_NULL_HANDLE;
+    bool depth_test = true;
+    bool depth_write = true;
+    VkCompareOp depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+    // Fragment output interface.
+    uint32_t color_attachment_count = 1;
+    bool blend = false;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+    // Shared by every part but the vertex input interface.
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+};
+
+/**
+ * A graphics pipeline which starts out fast-linked from libraries and is swapped for a link time optimised pipeline
+ * once that finishes compiling in the background.
+ */
+class GraphicsPipeline {
+public:
+    /**
+     * @return The best pipeline available right now. Fetch it whenever binding, as it changes once optimised.
+     */
+    VkPipeline handle() const { return current.load(std::memory_order_acquire); }
+
+    /**
+     * @return Whether the optimised pipeline has been swapped in.
+     */
+    bool optimized() const { return is_optimized.load(std::memory_order_acquire); }
+
+private:
+    friend class PipelineLibrary;
+
+    std::atomic<VkPipeline> current = VK_NULL_HANDLE;
+    std::atomic<bool> is_optimized = false;
+    /// The fast-linked pipeline, kept until the optimised one replaces it and it is retired.
+    VkPipeline fast_linked = VK_NULL_HANDLE;
+};
+
+/**
+ * Creates graphics pipelines with VK_EXT_graphics_pipeline_library when the device enabled it. The vertex input,
+ * pre-rasterization, fragment shader and fragment output parts of a pipeline are compiled once each as libraries and
+ * shared between every pipeline using the same part, so a new permutation only costs a fast link at first use. A link
+ * time optimised pipeline is then compiled on a worker thread and swapped in.
+ * Without the extension, pipelines are compiled whole when first requested.
+ * All methods are thread safe. Compiles run outside the lock, so getting a pipeline that is already compiled never
+ * waits on another thread's compile. Threads asking for a pipeline or library still compiling wait for it rather than
+ * compiling it again.
+ */
+class PipelineLibrary {
+public:
+    /**
+     * @param device The device to create pipelines on.
+     * @param workers The pool running optimised compiles. Must outlive this object.
+     * @param cache A pipeline cache used by every compile, or VK_NULL_HANDLE.
+     */
+    PipelineLibrary(const LogicalDevice &device, WorkerPool &workers, VkPipelineCache cache = VK_NULL_HANDLE);
+
+    PipelineLibrary(const PipelineLibrary &) = delete;
+
+    PipelineLibrary &operator=(const PipelineLibrary &) = delete;
+
+    /**
+     * Waits for background compiles, then destroys every pipeline. The pipelines must no longer be in use.
+     */
+    ~PipelineLibrary();
+
+    /**
+     * Gets the pipeline for a description, linking it on first use. If the link fails, every caller waiting on it
+     * gets the exception, and the next get() tries again.
+     * @return The pipeline, shared by every caller asking for the same description.
+     */
+    std::shared_ptr<GraphicsPipeline> get(const GraphicsPipelineDescription &description);
+
+    /**
+     * Destroys the fast-linked pipelines replaced by optimised ones. Call once per frame, once the GPU no longer uses
+     * pipelines bound before the previous call, e.g. after waiting for the fence of the oldest frame in flight.
+     * Optimisations which failed since the previous call are logged, and their pipelines stay fast-linked.
+     */
+    void destroy_retired();
+
+private:
+    /**
+     * The parts a graphics pipeline library is built from, in the order of VkGraphicsPipelineLibraryFlagBitsEXT.
+     */
+    enum Part {
+        VERTEX_INPUT,
+        PRE_RASTERIZATION,
+        FRAGMENT_SHADER,
+        FRAGMENT_OUTPUT,
+        PART_COUNT,
+    };
+
+    /**
+     * @return The bytes of the description's state that a part depends on, identifying the part.
+     */
+    static std::string part_key(const GraphicsPipelineDescription &description, Part part);
+
+    /**
+     * Creates a pipeline from a description. Parts are included if set in the library flags, and the pipeline is a
+     * library if library is set.
+     */
+    VkPipeline create(const GraphicsPipelineDescription &description, VkGraphicsPipelineLibraryFlagsEXT parts,
+                      bool library) const;
+
+    /**
+     * @return The library for a part of a description, created if needed. Takes mutex only to look the part up.
+     */
+    VkPipeline library_part(const GraphicsPipelineDescription &description, Part part);
+
+    /**
+     * Compiles a pipeline, fast-linking it from libraries and queueing its optimisation if the device supports them.
+     * Takes mutex only to look libraries up and to queue the optimisation.
+     */
+    std::shared_ptr<GraphicsPipeline> compile(const GraphicsPipelineDescription &description);
+
+    /**
+     * Links libraries into a complete pipeline.
+     */
+    VkPipeline link(const VkPipeline (&libraries)[PART_COUNT], VkPipelineLayout layout, bool optimize) const;
+
+    const LogicalDevice &device;
+    WorkerPool &workers;
+    VkPipelineCache cache;
+
+    /// Guards the maps and lists below, and is never held during a compile.
+    std::mutex mutex;
+    /// Libraries and pipelines by key, as futures set by the thread compiling them.
+    std::unordered_map<std::string, std::shared_future<VkPipeline>> libraries[PART_COUNT];
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<GraphicsPipeline>>> pipelines;
+    /// Fast-linked pipelines replaced since the last call to destroy_retired, and those replaced before it.
+    std::vector<VkPipeline> retired;
+    std::vector<VkPipeline> retiring;
+    std::vector<std::future<void>> optimizations;
+};
@@ -0,0 +1,319 @@
+#include "post_process.hpp"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+std::vector<FusedPostPass> plan_post_process(std::span<const PostEffect> effects, uint32_t blur_radius) {
+    std::vector<FusedPostPass> passes;
+    uint32_t prefix_length = 0;
+    uint32_t suffix_length = 0;
+    const auto start_pass = [&] {
+        passes.emplace_back();
+        prefix_length = 0;
+        suffix_length = 0;
+    };
+    const auto append = [](uint32_t &sequence, uint32_t &length, PostEffect effect) {
+        sequence |= (static_cast<uint32_t>(effect) + 1) << (4 * length);
+        length++;
+    };
+
+    for (auto effect: effects) {
+        if (passes.empty()) {
+            start_pass();
+        }
+
+        if (is_per_pixel(effect)) {
+            if (!passes.back().filter && prefix_length == FusedPostPass::MAX_SEQUENCE_LENGTH) {
+                start_pass();
+            }
+            if (passes.back().filter && suffix_length == FusedPostPass::MAX_SEQUENCE_LENGTH) {
+                start_pass();
+            }
+            if (passes.back().filter) {
+                append(passes.back().suffix, suffix_length, effect);
+            } else {
+                append(passes.back().prefix, prefix_length, effect);
+            }
+            continue;
+        }
+
+        // A pass reads its input once, so a second filter needs the first one's output written out.
+        if (passes.back().filter) {
+            start_pass();
+        }
+        passes.back().filter = effect;
+        passes.back().radius = effect == PostEffect::Blur ? blur_radius : 1;
+    }
+    return passes;
+}
+
+PostProcessChain::PostProcessChain(const LogicalDevice &device, MemoryPool &pool, ObjectCache &objects,
+                                   VkShaderModule kernel, PostProcessChainDescription description,
+                                   uint32_t frames_in_flight, VkPipelineCache cache)
+        : device(device), pool(pool), description(std::move(description)), barriers(device) {
+    fused_passes = plan_post_process(this->description.effects, this->description.blur_radius);
+    if (fused_passes.empty()) {
+        throw std::runtime_error("Unable to create a post-processing chain without effects");
+    }
+    if (frames_in_flight == 0) {
+        throw std::runtime_error("Post-processing needs at least one frame in flight");
+    }
+
+    const auto shared_memory = device.capabilities->properties.limits.maxComputeSharedMemorySize;
+    for (auto &pass: fused_passes) {
+        const auto tile = TILE_SIZE * pass.scale() + 2 * pass.radius;
+        if (tile * tile * 2 * sizeof(uint32_t) > shared_memory) {
+            throw std::runtime_error("The tile of a post-processing filter of radius " + std::to_string(pass.radius)
+                                     + " does not fit in shared memory");
+        }
+    }
+
+    SamplerDescription sampler_description;
+    sampler_description.address_mode_u = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_description.address_mode_v = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_description.address_mode_w = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_description.mipmap_mode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_description.max_lod = 0.0f;
+    sampler = objects.sampler(sampler_description);
+
+    DescriptorSetLayoutDescription set_layout_description;
+    set_layout_description.bindings.push_back({0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                               VK_SHADER_STAGE_COMPUTE_BIT, {sampler}});
+    set_layout_description.bindings.push_back({1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+                                               {}});
+    set_layout = objects.descriptor_set_layout(set_layout_description);
+
+    PipelineLayoutDescription pipeline_layout_description;
+    pipeline_layout_description.set_layouts = {set_layout};
+    pipeline_layout_description.push_constant_ranges = {
+            {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PostProcessPushConstants)}};
+    pipeline_layout = objects.pipeline_layout(pipeline_layout_description);
+
+    try {
+        for (auto &pass: fused_passes) {
+            const std::array<uint32_t, 4> constants = {
+                    pass.prefix, pass.filter ? static_cast<uint32_t>(*pass.filter) + 1 : 0, pass.radius, pass.suffix};
+            std::array<VkSpecializationMapEntry, 4> entries;
+            for (uint32_t i = 0; i < entries.size(); i++) {
+                entries[i] = {i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t)};
+            }
+
+            VkSpecializationInfo specialization_info;
+            specialization_info.mapEntryCount = static_cast<uint32_t>(entries.size());
+            specialization_info.pMapEntries = entries.data();
+            specialization_info.dataSize = sizeof(constants);
+            specialization_info.pData = constants.data();
+
+            VkComputePipelineCreateInfo create_info;
+            create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            create_info.pNext = nullptr;
+            create_info.flags = 0;
+            create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            create_info.stage.pNext = nullptr;
+            create_info.stage.flags = 0;
+            create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            create_info.stage.module = kernel;
+            create_info.stage.pName = "main";
+            create_info.stage.pSpecializationInfo = &specialization_info;
+            create_info.layout = pipeline_layout;
+            create_info.basePipelineHandle = VK_NULL_HANDLE;
+            create_info.basePipelineIndex = -1;
+
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            check_device_result(vkCreateComputePipelines(device.device, cache, 1, &create_info, nullptr, &pipeline),
+                                "Unable to create post-processing pipeline");
+            pipelines.push_back(pipeline);
+        }
+
+        intermediates.resize(fused_passes.size() - 1);
+        for (std::size_t i = 0; i < intermediates.size(); i++) {
+            create_intermediate(pass_output_extent(i), intermediates[i]);
+        }
+
+        const auto pass_count = static_cast<uint32_t>(fused_passes.size());
+        const std::array<VkDescriptorPoolSize, 2> pool_sizes = {{
+                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pass_count},
+                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pass_count},
+        }};
+        VkDescriptorPoolCreateInfo pool_create_info;
+        pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_create_info.pNext = nullptr;
+        pool_create_info.flags = 0;
+        pool_create_info.maxSets = pass_count;
+        pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_create_info.pPoolSizes = pool_sizes.data();
+        for (uint32_t i = 0; i < frames_in_flight; i++) {
+            VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+            check_device_result(vkCreateDescriptorPool(device.device, &pool_create_info, nullptr, &descriptor_pool),
+                                "Unable to create post-processing descriptor pool");
+            descriptor_pools.push_back(descriptor_pool);
+        }
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+PostProcessChain::~PostProcessChain() {
+    destroy();
+}
+
+void PostProcessChain::destroy() {
+    for (auto descriptor_pool: descriptor_pools) {
+        vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
+    }
+    for (auto &intermediate: intermediates) {
+        vkDestroyImageView(device.device, intermediate.view, nullptr);
+        vkDestroyImage(device.device, intermediate.image, nullptr);
+        pool.free(intermediate.allocation);
+    }
+    for (auto pipeline: pipelines) {
+        vkDestroyPipeline(device.device, pipeline, nullptr);
+    }
+    // The sampler and layouts belong to the object cache.
+}
+
+VkExtent2D PostProcessChain::pass_output_extent(std::size_t pass) const {
+    auto extent = description.extent;
+    for (std::size_t i = 0; i <= pass; i++) {
+        const auto scale = fused_passes[i].scale();
+        extent = {(extent.width + scale - 1) / scale, (extent.height + scale - 1) / scale};
+    }
+    return extent;
+}
+
+VkExtent2D PostProcessChain::output_extent() const {
+    return pass_output_extent(fused_passes.size() - 1);
+}
+
+void PostProcessChain::create_intermediate(VkExtent2D extent, Intermediate &intermediate) {
+    VkImageCreateInfo image_create_info;
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.pNext = nullptr;
+    image_create_info.flags = 0;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = description.intermediate_format;
+    image_create_info.extent = {extent.width, extent.height, 1};
+    image_create_info.mipLevels = 1;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.queueFamilyIndexCount = 0;
+    image_create_info.pQueueFamilyIndices = nullptr;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    check_device_result(vkCreateImage(device.device, &image_create_info, nullptr, &intermediate.image),
+                        "Unable to create post-processing image");
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device.device, intermediate.image, &requirements);
+    intermediate.allocation = pool.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    check_device_result(vkBindImageMemory(device.device, intermediate.image, intermediate.allocation.memory,
+                                          intermediate.allocation.offset), "Unable to bind image memory");
+
+    VkImageViewCreateInfo view_create_info;
+    view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_create_info.pNext = nullptr;
+    view_create_info.flags = 0;
+    view_create_info.image = intermediate.image;
+    view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_create_info.format = description.intermediate_format;
+    view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                                   VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+    view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    check_device_result(vkCreateImageView(device.device, &view_create_info, nullptr, &intermediate.view),
+                        "Unable to create post-processing image view");
+}
+
+void PostProcessChain::record(VkCommandBuffer command_buffer, uint32_t frame, VkImageView input, VkImageView output,
+                              const PostProcessSettings &settings) {
+    if (frame >= descriptor_pools.size()) {
+        throw std::runtime_error("Post-processing frame " + std::to_string(frame) + " is not in flight");
+    }
+    check_device_result(vkResetDescriptorPool(device.device, descriptor_pools[frame], 0),
+                        "Unable to reset post-processing descriptor pool");
+
+    PostProcessPushConstants constants;
+    std::memcpy(constants.color_matrix, settings.color_matrix, sizeof(constants.color_matrix));
+    constants.exposure = settings.exposure;
+    constants.vignette_strength = settings.vignette_strength;
+    constants.grain_intensity = settings.grain_intensity;
+    constants.sharpen_amount = settings.sharpen_amount;
+    constants.blur_sigma = settings.blur_sigma;
+    constants.seed = settings.seed;
+
+    // Intermediates stay in the general layout, in which passes both write and sample them.
+    if (!intermediates_initialised) {
+        for (auto &intermediate: intermediates) {
+            barriers.image_barrier(intermediate.image, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+                                   VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                                   VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR,
+                                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+        }
+        intermediates_initialised = true;
+    } else if (!intermediates.empty()) {
+        // The previous chain may still be sampling the intermediates about to be overwritten, or writing them.
+        barriers.memory_barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+                                VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+    }
+    barriers.flush(command_buffer);
+
+    auto input_extent = description.extent;
+    for (std::size_t i = 0; i < fused_passes.size(); i++) {
+        const bool last = i + 1 == fused_passes.size();
+        const auto output_extent = pass_output_extent(i);
+
+        VkDescriptorSetAllocateInfo allocate_info;
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.pNext = nullptr;
+        allocate_info.descriptorPool = descriptor_pools[frame];
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &set_layout;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        check_device_result(vkAllocateDescriptorSets(device.device, &allocate_info, &set),
+                            "Unable to allocate post-processing descriptor set");
+
+        const VkDescriptorImageInfo input_info = {
+                sampler, i == 0 ? input : intermediates[i - 1].view,
+                i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL};
+        const VkDescriptorImageInfo output_info = {
+                VK_NULL_HANDLE, last ? output : intermediates[i].view, VK_IMAGE_LAYOUT_GENERAL};
+        std::array<VkWriteDescriptorSet, 2> writes;
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].pNext = nullptr;
+            writes[binding].dstSet = set;
+            writes[binding].dstBinding = binding;
+            writes[binding].dstArrayElement = 0;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                                          : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[binding].pImageInfo = binding == 0 ? &input_info : &output_info;
+            writes[binding].pBufferInfo = nullptr;
+            writes[binding].pTexelBufferView = nullptr;
+        }
+        vkUpdateDescriptorSets(device.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        constants.input_extent = input_extent;
+        constants.output_extent = output_extent;
+
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[i]);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &set, 0,
+                                nullptr);
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                           &constants);
+        vkCmdDispatch(command_buffer, (output_extent.width + TILE_SIZE - 1) / TILE_SIZE,
+                      (output_extent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+        if (!last) {
+            barriers.memory_barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+                                    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR);
+            barriers.flush(command_buffer);
+        }
+        input_extent = output_extent;
+    }
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "object_cache.hpp"
+#include "synchronization.hpp"
+
+/**
+ * A full screen effect. Per pixel effects only depend on the pixel's own value and position, so any number of them
+ * fuse into one pass. Neighbourhood effects read the pixels around each output pixel.
+ */
+enum class PostEffect : uint32_t {
+    // Per pixel.
+    Tonemap,
+    ColorGrade,
+    Vignette,
+    FilmGrain,
+    // Neighbourhood.
+    Sharpen,
+    Blur,
+    /// A filtered 2x downsample, as the first step of bloom. Passes after it run at half resolution.
+    Downsample,
+};
+
+/**
+ * @return Whether an effect only depends on the pixel it outputs.
+ */
+constexpr bool is_per_pixel(PostEffect effect) {
+    return effect <= PostEffect::FilmGrain;
+}
+
+/**
+ * One compute dispatch of a post-processing chain: per pixel effects applied to the input as it is read, at most one
+ * neighbourhood filter, and per pixel effects applied to its result before it is written. Sequences of per pixel
+ * effects are packed 4 bits per effect, first effect lowest, each stored as its PostEffect plus one, with 0 ending
+ * the sequence.
+ */
+struct FusedPostPass {
+    static constexpr uint32_t MAX_SEQUENCE_LENGTH = 8;
+
+    uint32_t prefix = 0;
+    std::optional<PostEffect> filter;
+    /// The number of input pixels the filter reads on each side of the pixel it outputs.
+    uint32_t radius = 0;
+    uint32_t suffix = 0;
+
+    /**
+     * @return The number of input pixels per output pixel along each axis.
+     */
+    uint32_t scale() const { return filter == PostEffect::Downsample ? 2 : 1; }
+};
+
+/**
+ * Fuses a chain of effects into as few passes as possible. Each neighbourhood filter starts a new pass, taking the
+ * per pixel effects before it as its prefix, unless the previous pass has no filter yet.
+ * @param effects The effects, in the order they apply.
+ * @param blur_radius The radius of the Blur kernel.
+ * @return The passes.
+ */
+std::vector<FusedPostPass> plan_post_process(std::span<const PostEffect> effects, uint32_t blur_radius);
+
+/**
+ * The parameters of the effects, which may change every frame.
+ */
+struct PostProcessSettings {
+    float exposure = 1.0f;
+    /// The colour grade, applied as rgb = color_matrix * vec4(rgb, 1).
+    float color_matrix[3][4] = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+    float vignette_strength = 0.3f;
+    float grain_intensity = 0.05f;
+    float sharpen_amount = 0.5f;
+    float blur_sigma = 2.0f;
+    /// Seeds the film grain, e.g. with the frame number.
+    uint32_t seed = 0;
+};
+
+/**
+ * The push constants of every pass.
+ */
+struct PostProcessPushConstants {
+    float color_matrix[3][4];
+    float exposure;
+    float vignette_strength;
+    float grain_intensity;
+    float sharpen_amount;
+    float blur_sigma;
+    uint32_t seed;
+    /// The extents of the pass's input and output.
+    VkExtent2D input_extent;
+    VkExtent2D output_extent;
+};
+
+static_assert(sizeof(PostProcessPushConstants) <= 128, "Push constants must fit the minimum maxPushConstantsSize");
+
+struct PostProcessChainDescription {
+    std::vector<PostEffect> effects;
+    uint32_t blur_radius = 4;
+    /// The extent of the chain's input.
+    VkExtent2D extent = {0, 0};
+    /// The format of the images between passes.
+    VkFormat intermediate_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+};
+
+/**
+ * Runs a chain of full screen effects with as few passes over the image as possible, each pass being one compute
+ * dispatch of a kernel specialised for the effects it fuses. Separate passes would each read and write the whole
+ * image, which at 4K costs far more bandwidth than the effects cost arithmetic.
+ * Each workgroup outputs a TILE_SIZE x TILE_SIZE tile. Before a neighbourhood filter it loads the input pixels the
+ * tile needs, including a halo of the filter's radius, into shared memory, so each input pixel is read from memory
+ * once however many outputs use it.
+ *
+ * The kernel is a compute shader with local_size_x = local_size_y = TILE_SIZE, a combined image sampler input at
+ * binding 0 and a storage image output at binding 1 of set 0, PostProcessPushConstants, and specialization constants
+ * 0 (the prefix), 1 (the filter as its PostEffect plus one, or 0 for none), 2 (the radius) and 3 (the suffix) of a
+ * FusedPostPass. Shared memory holds tiles of (TILE_SIZE * scale + 2 * radius)^2 pixels, packed with packHalf2x16.
+ * shaders/post_process.comp is a reference implementation, compiled by the build where glslangValidator is found. It
+ * declares the output without a format, so it needs the shaderStorageImageWriteWithoutFormat feature.
+ */
+class PostProcessChain {
+public:
+    static constexpr uint32_t TILE_SIZE = 16;
+
+    /**
+     * Plans the passes and creates their pipelines and intermediate images.
+     * @param device The device.
+     * @param pool The pool the intermediate images are allocated from.
+     * @param objects The cache the sampler and layouts come from.
+     * @param kernel The post-processing kernel, which may be destroyed once this returns.
+     * @param description The effects and the images they run on.
+     * @param frames_in_flight The number of chains which may be executing at once.
+     * @param cache The pipeline cache, or VK_NULL_HANDLE.
+     * @throws std::runtime_error if there are no effects, or a filter's tile does not fit in shared memory.
+     */
+    PostProcessChain(const LogicalDevice &device, MemoryPool &pool, ObjectCache &objects, VkShaderModule kernel,
+                     PostProcessChainDescription description, uint32_t frames_in_flight,
+                     VkPipelineCache cache = VK_NULL_HANDLE);
+
+    PostProcessChain(const PostProcessChain &) = delete;
+
+    PostProcessChain &operator=(const PostProcessChain &) = delete;
+
+    /**
+     * Destroys the images, pipelines and descriptor pools, which must no longer be in use.
+     */
+    ~PostProcessChain();
+
+    /**
+     * Records the chain. The output is written by compute shaders, so readers of it need a barrier after.
+     * @param command_buffer The command buffer, for a queue with compute support.
+     * @param frame The frame in flight, below frames_in_flight. Its previous chain must have completed.
+     * @param input The input, of the description's extent, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+     * @param output The output, of output_extent(), in VK_IMAGE_LAYOUT_GENERAL.
+     * @param settings The parameters of the effects.
+     */
+    void record(VkCommandBuffer command_buffer, uint32_t frame, VkImageView input, VkImageView output,
+                const PostProcessSettings &settings);
+
+    /**
+     * @return The extent of the output, which downsampling makes smaller than the input.
+     */
+    VkExtent2D output_extent() const;
+
+    /**
+     * @return The passes the effects were fused into, one dispatch each.
+     */
+    const std::vector<FusedPostPass> &passes() const { return fused_passes; }
+
+private:
+    struct Intermediate {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        MemoryAllocation allocation;
+    };
+
+    VkExtent2D pass_output_extent(std::size_t pass) const;
+
+    void create_intermediate(VkExtent2D extent, Intermediate &intermediate);
+
+    void destroy();
+
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    PostProcessChainDescription description;
+    std::vector<FusedPostPass> fused_passes;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    std::vector<VkPipeline> pipelines;
+    /// The output of every pass but the last.
+    std::vector<Intermediate> intermediates;
+    bool intermediates_initialised = false;
+    std::vector<VkDescriptorPool> descriptor_pools;
+    BarrierBatch barriers;
+};
@@ -0,0 +1,277 @@
+#include "queue_benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <utility>
+
+#include "gpu_timer.hpp"
+#include "immediate_commands.hpp"
+#include "synchronization.hpp"
+#include "vulkan_reflection.hpp"
+
+/// Timed runs of each copy, of which the fastest counts.
+static constexpr uint32_t COPY_MEASUREMENTS = 3;
+/// Empty submissions per queue, of which the median counts.
+static constexpr uint32_t SUBMIT_MEASUREMENTS = 64;
+
+/**
+ * A buffer with its own memory of one memory type, so that the memory type measured is exactly the one asked for.
+ * Both are destroyed with the object, so that a failing measurement does not leak them.
+ */
+struct BenchmarkBuffer {
+    explicit BenchmarkBuffer(VkDevice device) : device(device) {}
+
+    BenchmarkBuffer(BenchmarkBuffer &&other) noexcept
+            : device(other.device), buffer(std::exchange(other.buffer, VK_NULL_HANDLE)),
+              memory(std::exchange(other.memory, VK_NULL_HANDLE)) {}
+
+    BenchmarkBuffer(const BenchmarkBuffer &) = delete;
+
+    BenchmarkBuffer &operator=(const BenchmarkBuffer &) = delete;
+
+    ~BenchmarkBuffer() {
+        vkDestroyBuffer(device, buffer, nullptr);
+        vkFreeMemory(device, memory, nullptr);
+    }
+
+    VkDevice device;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+};
+
+/**
+ * @return The buffer, or nothing if buffers cannot live in the memory type or its heap has no room left.
+ */
+static std::optional<BenchmarkBuffer> create_benchmark_buffer(const LogicalDevice &device, VkDeviceSize size,
+                                                              uint32_t memory_type_index) {
+    VkBufferCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.size = size;
+    create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.queueFamilyIndexCount = 0;
+    create_info.pQueueFamilyIndices = nullptr;
+
+    BenchmarkBuffer buffer(device.device);
+    if (vkCreateBuffer(device.device, &create_info, nullptr, &buffer.buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create benchmark buffer");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, buffer.buffer, &requirements);
+    if (!(requirements.memoryTypeBits & (1u << memory_type_index))) {
+        return std::nullopt;
+    }
+
+    VkMemoryAllocateInfo allocate_info;
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.pNext = nullptr;
+    allocate_info.allocationSize = requirements.size;
+    allocate_info.memoryTypeIndex = memory_type_index;
+
+    // Small heaps, such as the host visible part of device memory without resizable BAR, may not fit the buffer.
+    if (vkAllocateMemory(device.device, &allocate_info, nullptr, &buffer.memory) != VK_SUCCESS) {
+        return std::nullopt;
+    }
+    check_device_result(vkBindBufferMemory(device.device, buffer.buffer, buffer.memory, 0),
+                        "Unable to bind benchmark buffer memory");
+    return buffer;
+}
+
+/**
+ * Times copies between two buffers on a queue family.
+ * @return The bandwidth in bytes per second.
+ */
+static double measure_copy(ImmediateCommands &commands, GpuTimer *timer, VkBuffer source, VkBuffer destination,
+                           VkDeviceSize size) {
+    VkBufferCopy region;
+    region.srcOffset = 0;
+    region.dstOffset = 0;
+    region.size = size;
+
+    // The first copy faults in pages and wakes up the copy engine, so it is not timed.
+    commands.run([&](VkCommandBuffer command_buffer) {
+        vkCmdCopyBuffer(command_buffer, source, destination, 1, &region);
+    });
+
+    auto time = std::numeric_limits<double>::infinity();
+    for (uint32_t i = 0; i < COPY_MEASUREMENTS; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        commands.run([&](VkCommandBuffer command_buffer) {
+            if (timer) {
+                timer->reset(command_buffer);
+                timer->timestamp(command_buffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            }
+            vkCmdCopyBuffer(command_buffer, source, destination, 1, &region);
+            if (timer) {
+                timer->timestamp(command_buffer, 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+            }
+        });
+        const auto measured = timer ? timer->elapsed(0, 1).value()
+                                    : std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start).count();
+        time = std::min(time, measured);
+    }
+    return time > 0.0 ? static_cast<double>(size) * 1e9 / time : 0.0;
+}
+
+/**
+ * Times empty submissions to a queue, from the submit call until the host sees the fence signalled.
+ * @return The median round trip in microseconds.
+ */
+static double measure_submit_latency(const LogicalDevice &device, VkQueue queue, VkFence fence) {
+    VkSubmitInfo2KHR submit_info;
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+    submit_info.pNext = nullptr;
+    submit_info.flags = 0;
+    submit_info.waitSemaphoreInfoCount = 0;
+    submit_info.pWaitSemaphoreInfos = nullptr;
+    submit_info.commandBufferInfoCount = 0;
+    submit_info.pCommandBufferInfos = nullptr;
+    submit_info.signalSemaphoreInfoCount = 0;
+    submit_info.pSignalSemaphoreInfos = nullptr;
+
+    std::vector<double> latencies;
+    latencies.reserve(SUBMIT_MEASUREMENTS);
+    for (uint32_t i = 0; i < SUBMIT_MEASUREMENTS; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        check_device_result(queue_submit2(device, queue, {&submit_info, 1}, fence), "Unable to submit to queue");
+        check_device_result(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX),
+                            "Unable to wait for submission");
+        const auto latency = std::chrono::steady_clock::now() - start;
+        latencies.push_back(std::chrono::duration<double, std::micro>(latency).count());
+        vkResetFences(device.device, 1, &fence);
+    }
+
+    std::nth_element(latencies.begin(), latencies.begin() + latencies.size() / 2, latencies.end());
+    return latencies[latencies.size() / 2];
+}
+
+static QueueFamilyBenchmark benchmark_queue_family(const LogicalDevice &device, const DeviceQueueFamily &family,
+                                                   const BenchmarkBuffer &staging, VkDeviceSize copy_size,
+                                                   VkFence fence) {
+    QueueFamilyBenchmark benchmark;
+    benchmark.family_index = family.index;
+
+    for (auto queue: family.queues) {
+        benchmark.submit_latency.push_back(measure_submit_latency(device, queue, fence));
+    }
+
+    // Graphics and compute families copy without reporting transfer support. Others, such as video families, cannot.
+    if (!(family.properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT))) {
+        return benchmark;
+    }
+
+    ImmediateCommands commands(device, family);
+    std::optional<GpuTimer> timer;
+    if (GpuTimer::supported(device, family)) {
+        timer.emplace(device, family, 2);
+    }
+    benchmark.gpu_timed = timer.has_value();
+    auto *timer_pointer = timer ? &*timer : nullptr;
+
+    const auto &memory_properties = device.capabilities->memory_properties;
+    for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+        auto source = create_benchmark_buffer(device, copy_size, type);
+        if (!source) {
+            continue;
+        }
+
+        MemoryTypeBandwidth bandwidth;
+        bandwidth.memory_type_index = type;
+        bandwidth.host_to_device = measure_copy(commands, timer_pointer, staging.buffer, source->buffer, copy_size);
+        bandwidth.device_to_host = measure_copy(commands, timer_pointer, source->buffer, staging.buffer, copy_size);
+        if (auto destination = create_benchmark_buffer(device, copy_size, type)) {
+            bandwidth.device_to_device = measure_copy(commands, timer_pointer, source->buffer, destination->buffer,
+                                                      copy_size);
+        }
+        benchmark.bandwidth.push_back(bandwidth);
+    }
+    return benchmark;
+}
+
+std::vector<QueueFamilyBenchmark> benchmark_queue_families(const LogicalDevice &device, VkDeviceSize copy_size) {
+    // Cached host memory is what reads back fastest, and where the CPU would read downloads from.
+    VkBufferCreateInfo probe_info;
+    probe_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    probe_info.pNext = nullptr;
+    probe_info.flags = 0;
+    probe_info.size = copy_size;
+    probe_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    probe_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    probe_info.queueFamilyIndexCount = 0;
+    probe_info.pQueueFamilyIndices = nullptr;
+
+    VkBuffer probe = VK_NULL_HANDLE;
+    if (vkCreateBuffer(device.device, &probe_info, nullptr, &probe) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create benchmark buffer");
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, probe, &requirements);
+    vkDestroyBuffer(device.device, probe, nullptr);
+
+    const auto staging_type = device.capabilities->find_memory_type(
+            requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    const auto staging = staging_type ? create_benchmark_buffer(device, copy_size, *staging_type) : std::nullopt;
+    if (!staging) {
+        throw std::runtime_error("Unable to allocate host visible memory for the queue benchmark");
+    }
+
+    VkFenceCreateInfo fence_create_info;
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.pNext = nullptr;
+    fence_create_info.flags = 0;
+
+    VkFence fence = VK_NULL_HANDLE;
+    if (vkCreateFence(device.device, &fence_create_info, nullptr, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create benchmark fence");
+    }
+
+    std::vector<QueueFamilyBenchmark> benchmarks;
+    try {
+        for (auto &family: device.queue_families) {
+            benchmarks.push_back(benchmark_queue_family(device, family, *staging, copy_size, fence));
+        }
+    } catch (...) {
+        vkDestroyFence(device.device, fence, nullptr);
+        throw;
+    }
+
+    vkDestroyFence(device.device, fence, nullptr);
+    return benchmarks;
+}
+
+std::string queue_family_benchmark_to_string(const LogicalDevice &device, const QueueFamilyBenchmark &benchmark) {
+    const auto gigabytes = [](double bytes_per_second) { return bytes_per_second / 1e9; };
+
+    std::stringstream str;
+    str << std::fixed << std::setprecision(2);
+    str << "    [Queue " << benchmark.family_index << "]" << std::endl
+        << "        Copy Bandwidth (GB/s, " << (benchmark.gpu_timed ? "GPU" : "host") << " timed):" << std::endl;
+    for (auto &bandwidth: benchmark.bandwidth) {
+        const auto &type = device.capabilities->memory_properties.memoryTypes[bandwidth.memory_type_index];
+        str << "            Memory Type " << bandwidth.memory_type_index << " (Heap " << type.heapIndex << "):";
+        for (auto flag: vk_reflection::flag_names<VkMemoryPropertyFlagBits>(type.propertyFlags)) {
+            str << " " << flag;
+        }
+        str << std::endl
+            << "                Host To Device:   " << gigabytes(bandwidth.host_to_device) << std::endl
+            << "                Device To Host:   " << gigabytes(bandwidth.device_to_host) << std::endl
+            << "                Device To Device: " << gigabytes(bandwidth.device_to_device) << std::endl;
+    }
+    if (benchmark.bandwidth.empty()) {
+        str << "            None" << std::endl;
+    }
+    str << "        Submit Latency (us):" << std::endl;
+    for (uint32_t queue = 0; queue < benchmark.submit_latency.size(); queue++) {
+        str << "            Queue " << queue << ": " << benchmark.submit_latency[queue] << std::endl;
+    }
+    return str.str();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "logical_device.hpp"
+
+/**
+ * The copy bandwidth of a queue family to and from buffers in one memory type, in bytes per second. Directions the
+ * memory type could not be measured in are 0.
+ */
+struct MemoryTypeBandwidth {
+    uint32_t memory_type_index = 0;
+    /// From a host visible staging buffer into the memory type.
+    double host_to_device = 0.0;
+    /// From the memory type into a host visible staging buffer.
+    double device_to_host = 0.0;
+    /// Between two buffers in the memory type.
+    double device_to_device = 0.0;
+};
+
+/**
+ * How fast a queue family of a device moves data, and how long a submission to each of its queues takes.
+ */
+struct QueueFamilyBenchmark {
+    uint32_t family_index = 0;
+    /// Whether the copies were timed with timestamps rather than on the host, which includes submission overhead.
+    bool gpu_timed = false;
+    std::vector<MemoryTypeBandwidth> bandwidth;
+    /// The median round trip of an empty submission to each queue of the family, from submit to fence, in
+    /// microseconds.
+    std::vector<double> submit_latency;
+};
+
+/**
+ * Measures buffer copy bandwidth on every queue family of a device, between a host visible staging buffer and every
+ * memory type buffers can live in, along with the submission latency of every queue. This allocates up to three
+ * buffers of copy_size at a time and keeps every queue busy, so it is meant to be run on demand rather than at every
+ * startup.
+ * @param device The device to benchmark.
+ * @param copy_size The size of each copy, in bytes.
+ * @return The measurements of each queue family, in queue family order.
+ */
+std::vector<QueueFamilyBenchmark> benchmark_queue_families(const LogicalDevice &device,
+                                                           VkDeviceSize copy_size = VkDeviceSize(64) << 20);
+
+/**
+ * Formats the measurements of a queue family for the device report.
+ * @param device The benchmarked device.
+ * @param benchmark The measurements.
+ * @return The measurements, one memory type and one queue per line.
+ */
+std::string queue_family_benchmark_to_string(const LogicalDevice &device, const QueueFamilyBenchmark &benchmark);
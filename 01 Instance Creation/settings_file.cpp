@@ -0,0 +1,45 @@
+#include "settings_file.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+std::string_view trim(std::string_view text) {
+    const auto first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool read_settings_file(const std::filesystem::path &path, std::string_view description,
+                        const std::function<void(std::string_view name)> &section,
+                        const std::function<bool(std::string_view key, std::string_view value)> &setting) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    bool in_section = false;
+    std::string line;
+    for (uint32_t line_number = 1; std::getline(file, line); line_number++) {
+        auto text = trim(std::string_view(line).substr(0, line.find('#')));
+        if (text.empty()) {
+            continue;
+        }
+
+        if (text.front() == '[' && text.back() == ']') {
+            section(trim(text.substr(1, text.size() - 2)));
+            in_section = true;
+            continue;
+        }
+
+        const auto separator = text.find('=');
+        if (!in_section || separator == std::string_view::npos
+            || !setting(trim(text.substr(0, separator)), trim(text.substr(separator + 1)))) {
+            throw std::runtime_error("Unable to parse line " + std::to_string(line_number) + " of "
+                                     + std::string(description) + " " + path.string());
+        }
+    }
+    return true;
+}
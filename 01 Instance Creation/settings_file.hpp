@@ -0,0 +1,25 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string_view>
+
+/**
+ * @return The text without leading and trailing spaces, tabs and carriage returns.
+ */
+std::string_view trim(std::string_view text);
+
+/**
+ * Reads a settings file made of sections, each starting with a [name] line and followed by key = value lines. '#'
+ * starts a comment, and blank lines are skipped. Names, keys and values are trimmed.
+ * @param path The file to read.
+ * @param description What the file is, for error messages, e.g. "tuning profile file".
+ * @param section Called with the name of each section.
+ * @param setting Called with the key and value of each setting in the current section.
+ * @return Whether the file could be opened.
+ * @throws std::runtime_error naming the line if a setting has no '=', comes before any section, or setting returns
+ *         false for it.
+ */
+bool read_settings_file(const std::filesystem::path &path, std::string_view description,
+                        const std::function<void(std::string_view name)> &section,
+                        const std::function<bool(std::string_view key, std::string_view value)> &setting);
@@ -0,0 +1,263 @@
+#include "shader_permutations.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+#include "settings_file.hpp"
+
+/**
+ * @return The names of the keywords enabled in a mask.
+ */
+static std::vector<std::string> enabled_keywords(const ShaderPermutations &shader, ShaderKeywordMask mask) {
+    std::vector<std::string> keywords;
+    for (std::size_t i = 0; i < shader.keywords.size(); i++) {
+        if (mask & (ShaderKeywordMask(1) << i)) {
+            keywords.push_back(shader.keywords[i]);
+        }
+    }
+    return keywords;
+}
+
+ShaderCompiler precompiled_shader_compiler(std::filesystem::path directory) {
+    return [directory = std::move(directory)](const ShaderPermutations &shader,
+                                              const std::vector<std::string> &keywords) {
+        auto file_name = shader.name;
+        for (auto &keyword: keywords) {
+            file_name += "." + keyword;
+        }
+        const auto path = directory / (file_name + ".spv");
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            throw std::runtime_error("Unable to open shader variant " + path.string());
+        }
+        const auto size = static_cast<std::size_t>(file.tellg());
+        if (size == 0 || size % sizeof(uint32_t) != 0) {
+            throw std::runtime_error(path.string() + " is not SPIR-V");
+        }
+        std::vector<uint32_t> spirv(size / sizeof(uint32_t));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char *>(spirv.data()), static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("Unable to read shader variant " + path.string());
+        }
+        return spirv;
+    };
+}
+
+ShaderPermutationManager::ShaderPermutationManager(const LogicalDevice &device, WorkerPool &workers,
+                                                   ShaderCompiler compiler, std::filesystem::path usage_log_path,
+                                                   VkPipelineCache cache)
+        : device(device), workers(workers), compiler(std::move(compiler)), usage_log_path(std::move(usage_log_path)),
+          cache(cache) {
+    load();
+}
+
+ShaderPermutationManager::~ShaderPermutationManager() {
+    // Compiles never take the mutex, and nothing can queue more once the manager is being destroyed.
+    for (auto &[name, shader]: shaders) {
+        for (auto &[mask, variant]: shader.variants) {
+            variant->compiled.wait();
+            vkDestroyPipeline(device.device, variant->compute_pipeline, nullptr);
+            vkDestroyShaderModule(device.device, variant->shader_module, nullptr);
+        }
+    }
+}
+
+void ShaderPermutationManager::register_shader(ShaderPermutations shader) {
+    if (shader.keywords.size() > ShaderPermutations::MAX_KEYWORDS) {
+        throw std::runtime_error("Shader " + shader.name + " has more keywords than a ShaderKeywordMask holds");
+    }
+    std::lock_guard lock(mutex);
+    if (shaders.contains(shader.name)) {
+        throw std::runtime_error("Shader " + shader.name + " is already registered");
+    }
+    auto name = shader.name;
+    shaders.emplace(std::move(name), Shader{std::move(shader), {}, {}});
+}
+
+ShaderKeywordMask ShaderPermutationManager::keyword_mask(std::string_view shader,
+                                                         std::span<const std::string_view> keywords) const {
+    std::lock_guard lock(mutex);
+    auto registered = shaders.find(shader);
+    if (registered == shaders.end()) {
+        throw std::runtime_error("Shader " + std::string(shader) + " is not registered");
+    }
+
+    const auto &declared = registered->second.description.keywords;
+    ShaderKeywordMask mask = 0;
+    for (auto keyword: keywords) {
+        auto position = std::find(declared.begin(), declared.end(), keyword);
+        if (position == declared.end()) {
+            throw std::runtime_error("Shader " + std::string(shader) + " has no keyword " + std::string(keyword));
+        }
+        mask |= ShaderKeywordMask(1) << (position - declared.begin());
+    }
+    return mask;
+}
+
+std::shared_ptr<ShaderVariant> ShaderPermutationManager::get(std::string_view shader, ShaderKeywordMask keywords) {
+    std::lock_guard lock(mutex);
+    auto registered = shaders.find(shader);
+    if (registered == shaders.end()) {
+        throw std::runtime_error("Shader " + std::string(shader) + " is not registered");
+    }
+    // Bits beyond the declared keywords would compile a variant identical to another, under a different mask.
+    const auto declared = registered->second.description.keywords.size();
+    if (declared < ShaderPermutations::MAX_KEYWORDS && (keywords >> declared) != 0) {
+        throw std::runtime_error("Shader " + std::string(shader) + " has no keyword for some bits of the mask");
+    }
+    registered->second.used.insert(keywords);
+    return variant(registered->second, keywords);
+}
+
+std::shared_ptr<ShaderVariant> ShaderPermutationManager::variant(Shader &shader, ShaderKeywordMask keywords) {
+    auto &variant = shader.variants[keywords];
+    if (!variant) {
+        variant = std::make_shared<ShaderVariant>();
+        variant->mask = keywords;
+        // Registered shaders are never removed, so the description outlives the compile.
+        variant->compiled = workers.submit([this, description = &shader.description, variant] {
+            compile(*description, *variant);
+        }).share();
+    }
+    return variant;
+}
+
+void ShaderPermutationManager::compile(const ShaderPermutations &shader, ShaderVariant &variant) const {
+    const auto spirv = compiler(shader, enabled_keywords(shader, variant.mask));
+
+    VkShaderModuleCreateInfo module_create_info;
+    module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_create_info.pNext = nullptr;
+    module_create_info.flags = 0;
+    module_create_info.codeSize = spirv.size() * sizeof(uint32_t);
+    module_create_info.pCode = spirv.data();
+
+    VkShaderModule module = VK_NULL_HANDLE;
+    if (vkCreateShaderModule(device.device, &module_create_info, nullptr, &module) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create shader module for a variant of " + shader.name);
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (shader.stage == VK_SHADER_STAGE_COMPUTE_BIT && shader.layout != VK_NULL_HANDLE) {
+        VkComputePipelineCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        create_info.stage.pNext = nullptr;
+        create_info.stage.flags = 0;
+        create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        create_info.stage.module = module;
+        create_info.stage.pName = shader.entry_point.c_str();
+        create_info.stage.pSpecializationInfo = nullptr;
+        create_info.layout = shader.layout;
+        create_info.basePipelineHandle = VK_NULL_HANDLE;
+        create_info.basePipelineIndex = -1;
+
+        if (vkCreateComputePipelines(device.device, cache, 1, &create_info, nullptr, &pipeline) != VK_SUCCESS) {
+            vkDestroyShaderModule(device.device, module, nullptr);
+            throw std::runtime_error("Unable to create compute pipeline for a variant of " + shader.name);
+        }
+    }
+
+    variant.shader_module = module;
+    variant.compute_pipeline = pipeline;
+    variant.is_ready.store(true, std::memory_order_release);
+}
+
+uint32_t ShaderPermutationManager::prewarm(uint32_t max_variants) {
+    std::lock_guard lock(mutex);
+
+    // Variants by the number of runs which used them, skipping those of keywords a shader no longer declares.
+    std::vector<std::tuple<uint32_t, Shader *, ShaderKeywordMask>> candidates;
+    for (auto &[name, variants]: usage) {
+        auto registered = shaders.find(name);
+        if (registered == shaders.end()) {
+            continue;
+        }
+        const auto &declared = registered->second.description.keywords;
+        for (auto &[keywords, runs]: variants) {
+            ShaderKeywordMask mask = 0;
+            bool declares_all = true;
+            for (auto &keyword: keywords) {
+                auto position = std::find(declared.begin(), declared.end(), keyword);
+                declares_all = declares_all && position != declared.end();
+                mask |= position == declared.end() ? 0 : ShaderKeywordMask(1) << (position - declared.begin());
+            }
+            if (declares_all && !registered->second.variants.contains(mask)) {
+                candidates.emplace_back(runs, &registered->second, mask);
+            }
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) {
+        return std::get<0>(a) > std::get<0>(b);
+    });
+
+    const auto count = static_cast<uint32_t>(std::min<std::size_t>(candidates.size(), max_variants));
+    for (uint32_t i = 0; i < count; i++) {
+        variant(*std::get<1>(candidates[i]), std::get<2>(candidates[i]));
+    }
+    return count;
+}
+
+void ShaderPermutationManager::load() {
+    std::map<std::vector<std::string>, uint32_t> *section = nullptr;
+    read_settings_file(usage_log_path, "shader usage log", [&](std::string_view name) {
+        section = &usage[std::string(name)];
+    }, [&](std::string_view key, std::string_view value) {
+        uint32_t runs = 0;
+        if (value.empty()
+            || std::from_chars(value.data(), value.data() + value.size(), runs).ptr != value.data() + value.size()) {
+            return false;
+        }
+
+        std::vector<std::string> keywords;
+        std::istringstream names{std::string(key)};
+        for (std::string keyword; names >> keyword;) {
+            if (keyword != "-") {
+                keywords.push_back(std::move(keyword));
+            }
+        }
+        (*section)[std::move(keywords)] = runs;
+        return true;
+    });
+}
+
+void ShaderPermutationManager::save_usage_log() const {
+    std::lock_guard lock(mutex);
+    auto runs = usage;
+    for (auto &[name, shader]: shaders) {
+        for (auto mask: shader.used) {
+            runs[name][enabled_keywords(shader.description, mask)]++;
+        }
+    }
+
+    // Written aside and renamed, so that a crash mid-write never loses the usage of earlier runs.
+    auto temporary = usage_log_path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << "# Shader variants and the number of runs which used them, pre-warmed at startup" << std::endl;
+        for (auto &[name, variants]: runs) {
+            file << "[" << name << "]" << std::endl;
+            for (auto &[keywords, count]: variants) {
+                if (keywords.empty()) {
+                    file << "-";
+                }
+                for (std::size_t i = 0; i < keywords.size(); i++) {
+                    file << (i > 0 ? " " : "") << keywords[i];
+                }
+                file << " = " << count << std::endl;
+            }
+        }
+        if (!file) {
+            throw std::runtime_error("Unable to write shader usage log " + temporary.string());
+        }
+    }
+    std::filesystem::rename(temporary, usage_log_path);
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "worker_pool.hpp"
+
+/**
+ * The keywords enabled in a shader variant, one bit per keyword in the order the shader declares them.
+ */
+using ShaderKeywordMask = uint64_t;
+
+/**
+ * A shader with variants selected by keywords, such as a material shader with optional normal mapping and skinning.
+ * Each combination of keywords is a separate variant, so there are 2^keywords of them, of which an application only
+ * ever uses a few.
+ */
+struct ShaderPermutations {
+    static constexpr std::size_t MAX_KEYWORDS = 64;
+
+    std::string name;
+    std::vector<std::string> keywords;
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    /// The layout the pipeline of each variant is created with, for compute shaders. Variants of other stages only get
+    /// a shader module, to build graphics pipelines from with PipelineLibrary.
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    std::string entry_point = "main";
+};
+
+/**
+ * Produces the SPIR-V of a variant, e.g. by running a GLSL compiler with each enabled keyword defined, or by loading a
+ * precompiled file. Called on worker threads.
+ * @param shader The shader.
+ * @param keywords The enabled keywords, in the order the shader declares them.
+ * @return The SPIR-V words.
+ * @throws std::runtime_error if the variant cannot be compiled.
+ */
+using ShaderCompiler = std::function<std::vector<uint32_t>(const ShaderPermutations &shader,
+                                                           const std::vector<std::string> &keywords)>;
+
+/**
+ * Loads variants compiled offline, named after the shader and its enabled keywords in declaration order, e.g.
+ * directory/material.NORMAL_MAP.SKINNED.spv, or directory/material.spv with none enabled.
+ * @param directory The directory holding the SPIR-V files.
+ */
+ShaderCompiler precompiled_shader_compiler(std::filesystem::path directory);
+
+/**
+ * A variant of a shader, compiled in the background. Its module and pipeline are null until it is ready.
+ */
+class ShaderVariant {
+public:
+    /**
+     * @return Whether the variant has finished compiling. Callers not wanting to stall skip drawing with it, or draw
+     *         with a fallback, until it is.
+     */
+    bool ready() const { return is_ready.load(std::memory_order_acquire); }
+
+    /**
+     * Waits for the variant to finish compiling.
+     * @throws std::runtime_error if it failed to compile.
+     */
+    void wait() const { compiled.get(); }
+
+    VkShaderModule module() const { return ready() ? shader_module : VK_NULL_HANDLE; }
+
+    /**
+     * @return The compute pipeline of the variant, or VK_NULL_HANDLE for other stages.
+     */
+    VkPipeline pipeline() const { return ready() ? compute_pipeline : VK_NULL_HANDLE; }
+
+    ShaderKeywordMask keywords() const { return mask; }
+
+private:
+    friend class ShaderPermutationManager;
+
+    ShaderKeywordMask mask = 0;
+    std::atomic<bool> is_ready = false;
+    VkShaderModule shader_module = VK_NULL_HANDLE;
+    VkPipeline compute_pipeline = VK_NULL_HANDLE;
+    std::shared_future<void> compiled;
+};
+
+/**
+ * Compiles shader variants on demand instead of every permutation up front. The first request for a variant queues
+ * its compilation on a worker thread and returns straight away, so first use never stalls the render thread.
+ * The variants used in each run are recorded in a usage log. At the next startup, prewarm queues the variants earlier
+ * runs used, most used first, so that they are usually ready before they are first requested.
+ * The usage log keeps one [shader] section per shader, with KEYWORD KEYWORD = runs lines, and - for no keywords.
+ * All methods are thread safe.
+ */
+class ShaderPermutationManager {
+public:
+    /**
+     * Loads the usage log.
+     * @param device The device to create shader modules and pipelines on.
+     * @param workers The pool compiling variants. Must outlive this object.
+     * @param compiler Produces the SPIR-V of variants.
+     * @param usage_log_path The usage log, which need not exist.
+     * @param cache The pipeline cache compute pipelines are created with, or VK_NULL_HANDLE.
+     * @throws std::runtime_error if the usage log exists but cannot be parsed.
+     */
+    ShaderPermutationManager(const LogicalDevice &device, WorkerPool &workers, ShaderCompiler compiler,
+                             std::filesystem::path usage_log_path, VkPipelineCache cache = VK_NULL_HANDLE);
+
+    ShaderPermutationManager(const ShaderPermutationManager &) = delete;
+
+    ShaderPermutationManager &operator=(const ShaderPermutationManager &) = delete;
+
+    /**
+     * Waits for queued compiles, then destroys every variant. The variants must no longer be in use.
+     */
+    ~ShaderPermutationManager();
+
+    /**
+     * Registers a shader. Shaders must be registered before their variants are requested or pre-warmed.
+     * @throws std::runtime_error if the shader is already registered or has more than MAX_KEYWORDS keywords.
+     */
+    void register_shader(ShaderPermutations shader);
+
+    /**
+     * @param shader The name of a registered shader.
+     * @param keywords The keywords to enable.
+     * @return The mask enabling the keywords.
+     * @throws std::runtime_error if the shader is not registered or does not declare one of the keywords.
+     */
+    ShaderKeywordMask keyword_mask(std::string_view shader, std::span<const std::string_view> keywords) const;
+
+    /**
+     * Gets a variant, queuing its compilation if this is its first request, and records that this run used it.
+     * @param shader The name of a registered shader.
+     * @param keywords The enabled keywords.
+     * @return The variant, which may not be ready yet.
+     * @throws std::runtime_error if the shader is not registered or the mask has bits beyond its keywords.
+     */
+    std::shared_ptr<ShaderVariant> get(std::string_view shader, ShaderKeywordMask keywords);
+
+    /**
+     * Queues the compilation of variants of registered shaders which earlier runs used, most used first. Does not
+     * count as using them.
+     * @param max_variants The most variants to queue.
+     * @return The number of variants queued.
+     */
+    uint32_t prewarm(uint32_t max_variants = UINT32_MAX);
+
+    /**
+     * Writes the usage log, counting this run for every variant it used. Call once per run, e.g. at shutdown.
+     */
+    void save_usage_log() const;
+
+private:
+    struct Shader {
+        ShaderPermutations description;
+        std::map<ShaderKeywordMask, std::shared_ptr<ShaderVariant>> variants;
+        /// The variants requested in this run.
+        std::set<ShaderKeywordMask> used;
+    };
+
+    /**
+     * @return The variant, created and queued if it does not exist. Requires mutex to be held.
+     */
+    std::shared_ptr<ShaderVariant> variant(Shader &shader, ShaderKeywordMask keywords);
+
+    void compile(const ShaderPermutations &shader, ShaderVariant &variant) const;
+
+    void load();
+
+    const LogicalDevice &device;
+    WorkerPool &workers;
+    ShaderCompiler compiler;
+    std::filesystem::path usage_log_path;
+    VkPipelineCache cache;
+
+    mutable std::mutex mutex;
+    std::map<std::string, Shader, std::less<>> shaders;
+    /// The runs which used each variant as loaded, per shader name and then per enabled keywords. Keywords are kept
+    /// by name, so that the log survives shaders declaring keywords in another order.
+    std::map<std::string, std::map<std::vector<std::string>, uint32_t>, std::less<>> usage;
+};
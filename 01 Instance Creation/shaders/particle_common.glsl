@@ -0,0 +1,60 @@
+// The buffers and push constants shared by the particle shaders, as particle_system.hpp lays them out.
+
+#extension GL_EXT_buffer_reference : require
+
+#define WORKGROUP_SIZE 64
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+struct Particle {
+    // xyz is the position, w the age in seconds.
+    vec4 position_age;
+    // xyz is the velocity, w the lifetime in seconds.
+    vec4 velocity_lifetime;
+    vec4 color;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer Particles {
+    Particle particles[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer Indices {
+    uint indices[];
+};
+
+// uvec2(sort key, particle index) per survivor.
+layout(buffer_reference, std430, buffer_reference_align = 8) buffer DrawOrder {
+    uvec2 entries[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) buffer Counters {
+    // Signed, so that popping the empty dead list goes below zero rather than wrapping.
+    int dead_count;
+    uint alive_count[2];
+    uint padding;
+    // VkDispatchIndirectCommand
+    uint simulate[3];
+    uint padding_2;
+    // VkDrawIndirectCommand
+    uint draw[4];
+};
+
+layout(push_constant, std430) uniform PushConstants {
+    Particles particles;
+    Indices dead_list;
+    Indices alive_in;
+    Indices alive_out;
+    DrawOrder draw_order;
+    Counters counters;
+    vec3 emitter_position;
+    float delta_time;
+    vec3 camera_position;
+    uint emit_count;
+    uint seed;
+    uint capacity;
+    uint alive_in_index;
+    uint phase;
+    uint sort_size;
+    uint sort_k;
+    uint sort_j;
+} constants;
@@ -0,0 +1,151 @@
+#include "shared_context.hpp"
+
+#include <algorithm>
+
+#include "vulkan_bootstrap.hpp"
+
+FairQueue::Turn::Turn(FairQueue &owner, uint32_t tenant) : owner(owner), tenant(tenant) {
+    std::unique_lock lock(owner.mutex);
+    if (!owner.held.contains(tenant)) {
+        auto least = std::ranges::min_element(owner.held, {}, [](const auto &entry) { return entry.second; });
+        owner.held[tenant] = least == owner.held.end() ? std::chrono::nanoseconds(0) : least->second;
+    }
+    const auto ticket = owner.next_ticket++;
+    owner.waiters.emplace(ticket, tenant);
+    owner.turn_changed.wait(lock, [&] { return !owner.busy && owner.next_waiter() == ticket; });
+    owner.waiters.erase(ticket);
+    owner.busy = true;
+    start = std::chrono::steady_clock::now();
+}
+
+FairQueue::Turn::~Turn() {
+    {
+        std::lock_guard lock(owner.mutex);
+        owner.held[tenant] += std::chrono::steady_clock::now() - start;
+        owner.busy = false;
+    }
+    owner.turn_changed.notify_all();
+}
+
+uint64_t FairQueue::next_waiter() const {
+    auto next = std::ranges::min_element(waiters, {}, [&](const auto &waiter) {
+        return std::pair(held.at(waiter.second), waiter.first);
+    });
+    return next->first;
+}
+
+VkResult FairQueue::submit(uint32_t tenant, std::span<const VkSubmitInfo2KHR> submits, VkFence fence) {
+    return with_queue(tenant, [&](VkQueue queue) {
+        return queue_submit2(device, queue, submits, fence);
+    });
+}
+
+VkResult FairQueue::wait_idle(uint32_t tenant) {
+    return with_queue(tenant, [](VkQueue queue) {
+        return vkQueueWaitIdle(queue);
+    });
+}
+
+std::chrono::nanoseconds FairQueue::held_time(uint32_t tenant) const {
+    std::lock_guard lock(mutex);
+    auto time = held.find(tenant);
+    return time == held.end() ? std::chrono::nanoseconds(0) : time->second;
+}
+
+void FairQueue::remove_tenant(uint32_t tenant) {
+    std::lock_guard lock(mutex);
+    held.erase(tenant);
+}
+
+std::optional<DeviceBuilder> &SharedVulkanContext::builder() {
+    static std::optional<DeviceBuilder> builder;
+    return builder;
+}
+
+void SharedVulkanContext::configure(DeviceBuilder device_builder) {
+    builder() = std::move(device_builder);
+}
+
+SharedVulkanContext &SharedVulkanContext::get() {
+    // Initialisation of function statics is thread safe, so concurrent first users wait for one creation.
+    static SharedVulkanContext context;
+    return context;
+}
+
+SharedVulkanContext::SharedVulkanContext() {
+    availability = probe_instance_availability();
+    vulkan_instance = initialise_vulkan(availability, {}, {});
+    // The destructor does not run when the constructor throws, and get() tries again on its next call, so a failure
+    // must not leak the instance.
+    try {
+        load_vulkan_functions(vulkan_instance);
+
+        capabilities = probe_physical_device_capabilities(get_physical_devices(vulkan_instance));
+        if (!builder()) {
+            builder().emplace().request_performance_features();
+        }
+        logical_device = builder()->build(capabilities);
+
+        for (auto &family: logical_device.queue_families) {
+            auto &family_queues = queues.emplace_back();
+            for (auto queue: family.queues) {
+                family_queues.push_back(std::make_unique<FairQueue>(logical_device, queue));
+            }
+        }
+    } catch (...) {
+        if (logical_device.device != VK_NULL_HANDLE) {
+            destroy_logical_device(logical_device);
+        }
+        vkDestroyInstance(vulkan_instance, nullptr);
+        throw;
+    }
+}
+
+SharedVulkanContext::~SharedVulkanContext() {
+    vkDeviceWaitIdle(logical_device.device);
+    destroy_logical_device(logical_device);
+    vkDestroyInstance(vulkan_instance, nullptr);
+}
+
+std::unique_ptr<TenantSession> SharedVulkanContext::open_session(VkDeviceSize memory_budget) {
+    return std::make_unique<TenantSession>(*this, next_tenant_id++, memory_budget);
+}
+
+TenantSession::TenantSession(SharedVulkanContext &context, uint32_t id, VkDeviceSize memory_budget)
+        : context(context), tenant_id(id), memory_pool(context.device(), memory_budget),
+          command_pools(context.device().queue_families.size(), VK_NULL_HANDLE) {}
+
+TenantSession::~TenantSession() {
+    for (auto &family: device().queue_families) {
+        queue(family).remove_tenant(tenant_id);
+    }
+    for (auto pool: command_pools) {
+        if (pool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device().device, pool, nullptr);
+        }
+    }
+}
+
+VkCommandPool TenantSession::command_pool(const DeviceQueueFamily &family) {
+    auto &pool = command_pools[family.index];
+    if (pool == VK_NULL_HANDLE) {
+        VkCommandPoolCreateInfo command_pool_create_info;
+        command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        command_pool_create_info.pNext = nullptr;
+        command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        command_pool_create_info.queueFamilyIndex = family.index;
+
+        check_device_result(vkCreateCommandPool(device().device, &command_pool_create_info, nullptr, &pool),
+                            "Unable to create tenant command pool");
+    }
+    return pool;
+}
+
+FairQueue &TenantSession::queue(const DeviceQueueFamily &family) {
+    return context.queue(family.index, tenant_id % family.queues.size());
+}
+
+void TenantSession::submit(const DeviceQueueFamily &family, std::span<const VkSubmitInfo2KHR> submits,
+                           VkFence fence) {
+    check_device_result(queue(family).submit(tenant_id, submits, fence), "Unable to submit tenant work");
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "extension_index.hpp"
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "synchronization.hpp"
+
+/**
+ * A queue time sliced between the tenants sharing it. Whenever the queue is free, the waiting tenant which has held it
+ * for the least time gets the next turn, so that each tenant gets a like share of the queue's time however long its
+ * turns are, and one submitting large batches or waiting for idle cannot starve the others.
+ * Vulkan cannot preempt work once it is submitted, so the time sliced is the time tenants hold the queue to submit and
+ * wait on it, not the GPU's execution time.
+ */
+class FairQueue {
+public:
+    FairQueue(const LogicalDevice &device, VkQueue queue) : device(device), queue(queue) {}
+
+    /**
+     * Waits for the tenant's turn, then submits.
+     */
+    VkResult submit(uint32_t tenant, std::span<const VkSubmitInfo2KHR> submits, VkFence fence);
+
+    /**
+     * Waits for the tenant's turn, then waits for the queue to become idle.
+     */
+    VkResult wait_idle(uint32_t tenant);
+
+    /**
+     * Runs a function with exclusive access to the queue once it is the tenant's turn, charging the tenant for the
+     * time it takes.
+     */
+    template<typename Function>
+    auto with_queue(uint32_t tenant, Function &&function) {
+        Turn turn(*this, tenant);
+        return function(queue);
+    }
+
+    /**
+     * @return The time a tenant has been charged for holding the queue, which starts from the least of the other
+     *         tenants' when it first waits, so that new tenants do not take every turn until they catch up.
+     */
+    std::chrono::nanoseconds held_time(uint32_t tenant) const;
+
+    /**
+     * Forgets a tenant which no longer uses the queue.
+     */
+    void remove_tenant(uint32_t tenant);
+
+private:
+    /**
+     * Holds a turn on the queue for its lifetime.
+     */
+    class Turn {
+    public:
+        Turn(FairQueue &owner, uint32_t tenant);
+
+        ~Turn();
+
+    private:
+        FairQueue &owner;
+        uint32_t tenant;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * @return The ticket of the waiter to go next: the one whose tenant has held the queue least, then the earliest.
+     */
+    uint64_t next_waiter() const;
+
+    const LogicalDevice &device;
+    VkQueue queue;
+    mutable std::mutex mutex;
+    std::condition_variable turn_changed;
+    bool busy = false;
+    uint64_t next_ticket = 0;
+    /// The tenant of each waiting caller, by ticket.
+    std::map<uint64_t, uint32_t> waiters;
+    std::map<uint32_t, std::chrono::nanoseconds> held;
+};
+
+class TenantSession;
+
+/**
+ * The process-wide vulkan context of a server. The instance and logical device are created once, on first use, and
+ * shared by every tenant (job or session) of the process through a TenantSession.
+ */
+class SharedVulkanContext {
+public:
+    /**
+     * Sets the device requirements of the shared device. Must be called before the first call to get.
+     */
+    static void configure(DeviceBuilder builder);
+
+    /**
+     * @return The shared context, created on the first call. Thread safe.
+     */
+    static SharedVulkanContext &get();
+
+    SharedVulkanContext(const SharedVulkanContext &) = delete;
+
+    SharedVulkanContext &operator=(const SharedVulkanContext &) = delete;
+
+    ~SharedVulkanContext();
+
+    /**
+     * Opens a session for a tenant, with its own command pools and memory pool.
+     * @param memory_budget The most device memory the tenant may reserve.
+     */
+    std::unique_ptr<TenantSession> open_session(VkDeviceSize memory_budget = MemoryPool::UNLIMITED);
+
+    VkInstance instance() const { return vulkan_instance; }
+
+    const LogicalDevice &device() const { return logical_device; }
+
+    /**
+     * @return The shared queue with the given index in a family.
+     */
+    FairQueue &queue(uint32_t family_index, uint32_t queue_index) { return *queues[family_index][queue_index]; }
+
+private:
+    SharedVulkanContext();
+
+    static std::optional<DeviceBuilder> &builder();
+
+    InstanceAvailability availability;
+    VkInstance vulkan_instance = VK_NULL_HANDLE;
+    std::vector<PhysicalDeviceCapabilities> capabilities;
+    LogicalDevice logical_device;
+    std::vector<std::vector<std::unique_ptr<FairQueue>>> queues;
+    std::atomic<uint32_t> next_tenant_id = 0;
+};
+
+/**
+ * A tenant's view of the shared context. Command pools are per tenant, so recording never contends with other
+ * tenants. A session must only be used by one thread at a time, and its submitted work must be complete before it is
+ * closed.
+ */
+class TenantSession {
+public:
+    TenantSession(SharedVulkanContext &context, uint32_t id, VkDeviceSize memory_budget);
+
+    TenantSession(const TenantSession &) = delete;
+
+    TenantSession &operator=(const TenantSession &) = delete;
+
+    ~TenantSession();
+
+    uint32_t id() const { return tenant_id; }
+
+    const LogicalDevice &device() const { return context.device(); }
+
+    /**
+     * @return The tenant's command pool for a queue family, created on first use.
+     */
+    VkCommandPool command_pool(const DeviceQueueFamily &family);
+
+    /**
+     * @return The tenant's memory pool, which is limited to the session's memory budget.
+     */
+    MemoryPool &memory() { return memory_pool; }
+
+    /**
+     * Submits to the tenant's queue in a family. Tenants are spread across the queues of a family, and tenants sharing
+     * a queue take turns, see FairQueue.
+     * @throws DeviceLostError if the device was lost, std::runtime_error if the submission failed otherwise.
+     */
+    void submit(const DeviceQueueFamily &family, std::span<const VkSubmitInfo2KHR> submits,
+                VkFence fence = VK_NULL_HANDLE);
+
+    /**
+     * @return The shared queue this tenant submits to in a family.
+     */
+    FairQueue &queue(const DeviceQueueFamily &family);
+
+private:
+    SharedVulkanContext &context;
+    uint32_t tenant_id;
+    MemoryPool memory_pool;
+    std::vector<VkCommandPool> command_pools;
+};
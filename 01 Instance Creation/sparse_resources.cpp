@@ -0,0 +1,325 @@
+#include "sparse_resources.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+SparsePagePool::SparsePagePool(const LogicalDevice &device, uint32_t memory_type_index, VkDeviceSize page_size,
+                               uint32_t pages_per_chunk)
+        : device(device), memory_type_index(memory_type_index), size(page_size), pages_per_chunk(pages_per_chunk) {}
+
+SparsePagePool::~SparsePagePool() {
+    for (auto chunk: chunks) {
+        vkFreeMemory(device.device, chunk, nullptr);
+    }
+}
+
+SparsePage SparsePagePool::acquire() {
+    if (free_pages.empty()) {
+        VkMemoryAllocateInfo allocate_info;
+        allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocate_info.pNext = nullptr;
+        allocate_info.allocationSize = size * pages_per_chunk;
+        allocate_info.memoryTypeIndex = memory_type_index;
+
+        VkDeviceMemory chunk = VK_NULL_HANDLE;
+        if (vkAllocateMemory(device.device, &allocate_info, nullptr, &chunk) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to allocate sparse page memory");
+        }
+        chunks.push_back(chunk);
+        allocated_pages += pages_per_chunk;
+
+        // Push in reverse so pages are handed out in address order.
+        for (uint32_t i = pages_per_chunk; i > 0; i--) {
+            free_pages.push_back({chunk, (i - 1) * size});
+        }
+    }
+
+    auto page = free_pages.back();
+    free_pages.pop_back();
+    return page;
+}
+
+void SparsePagePool::release(SparsePage page) {
+    free_pages.push_back(page);
+}
+
+template<typename Handle, typename Bind>
+void SparseBindBatch::add(std::vector<ResourceBinds<Handle, Bind>> &resources, Handle resource, const Bind &bind) {
+    // Binds usually arrive grouped by resource, so only the last entry needs checking.
+    if (resources.empty() || resources.back().resource != resource) {
+        resources.push_back({resource, {}});
+    }
+    resources.back().binds.push_back(bind);
+}
+
+void SparseBindBatch::bind_buffer(VkBuffer buffer, const VkSparseMemoryBind &bind) {
+    add(buffer_binds, buffer, bind);
+}
+
+void SparseBindBatch::bind_image_opaque(VkImage image, const VkSparseMemoryBind &bind) {
+    add(image_opaque_binds, image, bind);
+}
+
+void SparseBindBatch::bind_image(VkImage image, const VkSparseImageMemoryBind &bind) {
+    add(image_binds, image, bind);
+}
+
+bool SparseBindBatch::empty() const {
+    return buffer_binds.empty() && image_opaque_binds.empty() && image_binds.empty();
+}
+
+void SparseBindBatch::flush(VkQueue queue, const std::vector<VkSemaphore> &wait_semaphores,
+                            const std::vector<VkSemaphore> &signal_semaphores, VkFence fence) {
+    if (empty() && wait_semaphores.empty() && signal_semaphores.empty() && fence == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::vector<VkSparseBufferMemoryBindInfo> buffer_infos;
+    for (auto &resource: buffer_binds) {
+        buffer_infos.push_back({resource.resource, static_cast<uint32_t>(resource.binds.size()),
+                                resource.binds.data()});
+    }
+    std::vector<VkSparseImageOpaqueMemoryBindInfo> image_opaque_infos;
+    for (auto &resource: image_opaque_binds) {
+        image_opaque_infos.push_back({resource.resource, static_cast<uint32_t>(resource.binds.size()),
+                                      resource.binds.data()});
+    }
+    std::vector<VkSparseImageMemoryBindInfo> image_infos;
+    for (auto &resource: image_binds) {
+        image_infos.push_back({resource.resource, static_cast<uint32_t>(resource.binds.size()),
+                               resource.binds.data()});
+    }
+
+    VkBindSparseInfo bind_info;
+    bind_info.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+    bind_info.pNext = nullptr;
+    bind_info.waitSemaphoreCount = wait_semaphores.size();
+    bind_info.pWaitSemaphores = wait_semaphores.data();
+    bind_info.bufferBindCount = buffer_infos.size();
+    bind_info.pBufferBinds = buffer_infos.data();
+    bind_info.imageOpaqueBindCount = image_opaque_infos.size();
+    bind_info.pImageOpaqueBinds = image_opaque_infos.data();
+    bind_info.imageBindCount = image_infos.size();
+    bind_info.pImageBinds = image_infos.data();
+    bind_info.signalSemaphoreCount = signal_semaphores.size();
+    bind_info.pSignalSemaphores = signal_semaphores.data();
+
+    if (vkQueueBindSparse(queue, 1, &bind_info, fence) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to bind sparse memory");
+    }
+
+    buffer_binds.clear();
+    image_opaque_binds.clear();
+    image_binds.clear();
+}
+
+SparseBuffer::SparseBuffer(const LogicalDevice &device, VkDeviceSize size, VkBufferUsageFlags usage)
+        : device(device) {
+    auto &features = device.enabled_features.core.features;
+    if (!features.sparseBinding || !features.sparseResidencyBuffer) {
+        throw std::runtime_error("Sparse buffers require the sparseBinding and sparseResidencyBuffer features");
+    }
+
+    VkBufferCreateInfo buffer_create_info;
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.pNext = nullptr;
+    buffer_create_info.flags = VK_BUFFER_CREATE_SPARSE_BINDING_BIT | VK_BUFFER_CREATE_SPARSE_RESIDENCY_BIT;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = usage;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_create_info.queueFamilyIndexCount = 0;
+    buffer_create_info.pQueueFamilyIndices = nullptr;
+
+    if (vkCreateBuffer(device.device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create sparse buffer");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+    auto memory_type = device.capabilities->find_memory_type(requirements.memoryTypeBits,
+                                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (!memory_type) {
+        vkDestroyBuffer(device.device, buffer, nullptr);
+        throw std::runtime_error("No device local memory type for sparse buffer");
+    }
+
+    // For sparse resources the alignment is the sparse block size.
+    pool.emplace(device, *memory_type, requirements.alignment);
+    page_table.resize((requirements.size + requirements.alignment - 1) / requirements.alignment);
+}
+
+SparseBuffer::~SparseBuffer() {
+    vkDestroyBuffer(device.device, buffer, nullptr);
+}
+
+void SparseBuffer::commit(VkDeviceSize offset, VkDeviceSize size, SparseBindBatch &batch) {
+    const auto first = offset / pool->page_size();
+    const auto last = std::min<VkDeviceSize>((offset + size + pool->page_size() - 1) / pool->page_size(),
+                                             page_table.size());
+    for (auto i = first; i < last; i++) {
+        if (page_table[i]) {
+            continue;
+        }
+        page_table[i] = pool->acquire();
+        batch.bind_buffer(buffer, {i * pool->page_size(), pool->page_size(), page_table[i]->memory,
+                                   page_table[i]->offset, 0});
+    }
+}
+
+void SparseBuffer::evict(VkDeviceSize offset, VkDeviceSize size, SparseBindBatch &batch) {
+    const auto first = offset / pool->page_size();
+    const auto last = std::min<VkDeviceSize>((offset + size + pool->page_size() - 1) / pool->page_size(),
+                                             page_table.size());
+    for (auto i = first; i < last; i++) {
+        if (!page_table[i]) {
+            continue;
+        }
+        pool->release(*page_table[i]);
+        page_table[i].reset();
+        batch.bind_buffer(buffer, {i * pool->page_size(), pool->page_size(), VK_NULL_HANDLE, 0, 0});
+    }
+}
+
+SparseImage::SparseImage(const LogicalDevice &device, VkFormat format, VkExtent2D extent, uint32_t mip_levels,
+                         VkImageUsageFlags usage, SparseBindBatch &batch)
+        : device(device), extent(extent) {
+    auto &features = device.enabled_features.core.features;
+    if (!features.sparseBinding || !features.sparseResidencyImage2D) {
+        throw std::runtime_error("Sparse images require the sparseBinding and sparseResidencyImage2D features");
+    }
+
+    VkImageCreateInfo image_create_info;
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.pNext = nullptr;
+    image_create_info.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = format;
+    image_create_info.extent = {extent.width, extent.height, 1};
+    image_create_info.mipLevels = mip_levels;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = usage;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.queueFamilyIndexCount = 0;
+    image_create_info.pQueueFamilyIndices = nullptr;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device.device, &image_create_info, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create sparse image");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device.device, image, &requirements);
+    auto memory_type = device.capabilities->find_memory_type(requirements.memoryTypeBits,
+                                                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    uint32_t sparse_requirement_count = 0;
+    vkGetImageSparseMemoryRequirements(device.device, image, &sparse_requirement_count, nullptr);
+    std::vector<VkSparseImageMemoryRequirements> sparse_requirements(sparse_requirement_count);
+    vkGetImageSparseMemoryRequirements(device.device, image, &sparse_requirement_count, sparse_requirements.data());
+
+    auto color = std::find_if(sparse_requirements.begin(), sparse_requirements.end(), [](auto &requirement) {
+        return requirement.formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT;
+    });
+    if (!memory_type || color == sparse_requirements.end()) {
+        vkDestroyImage(device.device, image, nullptr);
+        throw std::runtime_error("Sparse residency is not supported for this image");
+    }
+
+    granularity = color->formatProperties.imageGranularity;
+    mip_tail_first_lod = std::min(color->imageMipTailFirstLod, mip_levels);
+    pool.emplace(device, *memory_type, requirements.alignment);
+
+    for (uint32_t level = 0; level < mip_tail_first_lod; level++) {
+        auto count = tile_count(level);
+        page_tables.emplace_back(count.width * count.height);
+    }
+
+    // The mip tail, and the metadata aspect if the implementation has one, are bound opaquely and kept resident.
+    for (auto &requirement: sparse_requirements) {
+        const bool metadata = requirement.formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT;
+        if (!metadata && &requirement != &*color) {
+            continue;
+        }
+        if (!metadata && requirement.imageMipTailFirstLod >= mip_levels) {
+            continue;
+        }
+        for (VkDeviceSize offset = 0; offset < requirement.imageMipTailSize; offset += pool->page_size()) {
+            auto page = pool->acquire();
+            mip_tail_pages.push_back(page);
+            batch.bind_image_opaque(image, {requirement.imageMipTailOffset + offset, pool->page_size(), page.memory,
+                                            page.offset,
+                                            metadata ? VkSparseMemoryBindFlags(VK_SPARSE_MEMORY_BIND_METADATA_BIT)
+                                                     : VkSparseMemoryBindFlags(0)});
+        }
+    }
+}
+
+SparseImage::~SparseImage() {
+    vkDestroyImage(device.device, image, nullptr);
+}
+
+VkExtent2D SparseImage::tile_count(uint32_t mip_level) const {
+    auto width = std::max(extent.width >> mip_level, 1u);
+    auto height = std::max(extent.height >> mip_level, 1u);
+    return {(width + granularity.width - 1) / granularity.width, (height + granularity.height - 1) / granularity.height};
+}
+
+std::optional<SparsePage> &SparseImage::tile(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y) {
+    if (mip_level >= mip_tail_first_lod) {
+        throw std::out_of_range("Tiles in the mip tail cannot be committed or evicted individually");
+    }
+    auto count = tile_count(mip_level);
+    if (tile_x >= count.width || tile_y >= count.height) {
+        throw std::out_of_range("Sparse image tile out of range");
+    }
+    return page_tables[mip_level][tile_y * count.width + tile_x];
+}
+
+VkSparseImageMemoryBind SparseImage::tile_bind(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y) const {
+    auto width = std::max(extent.width >> mip_level, 1u);
+    auto height = std::max(extent.height >> mip_level, 1u);
+    auto x = tile_x * granularity.width;
+    auto y = tile_y * granularity.height;
+
+    // Edge tiles are clamped to the edge of the mip level.
+    VkSparseImageMemoryBind bind;
+    bind.subresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip_level, 0};
+    bind.offset = {static_cast<int32_t>(x), static_cast<int32_t>(y), 0};
+    bind.extent = {std::min(granularity.width, width - x), std::min(granularity.height, height - y), 1};
+    bind.memory = VK_NULL_HANDLE;
+    bind.memoryOffset = 0;
+    bind.flags = 0;
+    return bind;
+}
+
+void SparseImage::commit_tile(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y, SparseBindBatch &batch) {
+    auto &page = tile(mip_level, tile_x, tile_y);
+    if (page) {
+        return;
+    }
+    page = pool->acquire();
+
+    auto bind = tile_bind(mip_level, tile_x, tile_y);
+    bind.memory = page->memory;
+    bind.memoryOffset = page->offset;
+    batch.bind_image(image, bind);
+}
+
+void SparseImage::evict_tile(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y, SparseBindBatch &batch) {
+    auto &page = tile(mip_level, tile_x, tile_y);
+    if (!page) {
+        return;
+    }
+    pool->release(*page);
+    page.reset();
+    batch.bind_image(image, tile_bind(mip_level, tile_x, tile_y));
+}
+
+bool SparseImage::resident(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y) const {
+    if (mip_level >= mip_tail_first_lod) {
+        return true;
+    }
+    return const_cast<SparseImage *>(this)->tile(mip_level, tile_x, tile_y).has_value();
+}
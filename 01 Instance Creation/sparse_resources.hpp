@@ -0,0 +1,236 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "logical_device.hpp"
+
+/**
+ * A page of device memory which can be bound into a sparse resource.
+ */
+struct SparsePage {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+};
+
+/**
+ * Hands out fixed size pages of device memory, allocating them a chunk at a time so that committing a page rarely
+ * allocates.
+ */
+class SparsePagePool {
+public:
+    /**
+     * @param device The device to allocate from.
+     * @param memory_type_index The memory type of every page.
+     * @param page_size The size of a page, which is the sparse block size of the resources using the pool.
+     * @param pages_per_chunk The number of pages allocated at once.
+     */
+    SparsePagePool(const LogicalDevice &device, uint32_t memory_type_index, VkDeviceSize page_size,
+                   uint32_t pages_per_chunk = 64);
+
+    SparsePagePool(const SparsePagePool &) = delete;
+
+    SparsePagePool &operator=(const SparsePagePool &) = delete;
+
+    ~SparsePagePool();
+
+    /**
+     * @return A free page, allocating a new chunk if every page is in use.
+     */
+    SparsePage acquire();
+
+    /**
+     * Returns a page to the pool. The page may be handed out again by the next acquire.
+     */
+    void release(SparsePage page);
+
+    VkDeviceSize page_size() const { return size; }
+
+    /**
+     * @return The number of pages currently handed out.
+     */
+    std::size_t resident_pages() const { return allocated_pages - free_pages.size(); }
+
+private:
+    const LogicalDevice &device;
+    uint32_t memory_type_index;
+    VkDeviceSize size;
+    uint32_t pages_per_chunk;
+    std::size_t allocated_pages = 0;
+    std::vector<VkDeviceMemory> chunks;
+    std::vector<SparsePage> free_pages;
+};
+
+/**
+ * Accumulates sparse memory binds for any number of resources, and submits them all in a single vkQueueBindSparse.
+ */
+class SparseBindBatch {
+public:
+    /**
+     * Queues a bind of a buffer range to memory, or an unbind if bind.memory is VK_NULL_HANDLE.
+     */
+    void bind_buffer(VkBuffer buffer, const VkSparseMemoryBind &bind);
+
+    /**
+     * Queues an opaque bind of an image range, used for mip tails and metadata.
+     */
+    void bind_image_opaque(VkImage image, const VkSparseMemoryBind &bind);
+
+    /**
+     * Queues a bind of an image region to memory, or an unbind if bind.memory is VK_NULL_HANDLE.
+     */
+    void bind_image(VkImage image, const VkSparseImageMemoryBind &bind);
+
+    /**
+     * @return Whether there are no binds waiting to be submitted.
+     */
+    bool empty() const;
+
+    /**
+     * Submits every queued bind in a single batch, then clears the batch.
+     * @param queue A queue from a family with VK_QUEUE_SPARSE_BINDING_BIT.
+     * @param wait_semaphores Semaphores to wait on before binding, e.g. the end of the frame that last used an evicted
+     *                        page.
+     * @param signal_semaphores Semaphores signalled once the binds have executed.
+     * @param fence A fence signalled once the binds have executed, may be VK_NULL_HANDLE.
+     */
+    void flush(VkQueue queue, const std::vector<VkSemaphore> &wait_semaphores = {},
+               const std::vector<VkSemaphore> &signal_semaphores = {}, VkFence fence = VK_NULL_HANDLE);
+
+private:
+    template<typename Handle, typename Bind>
+    struct ResourceBinds {
+        Handle resource;
+        std::vector<Bind> binds;
+    };
+
+    template<typename Handle, typename Bind>
+    static void add(std::vector<ResourceBinds<Handle, Bind>> &resources, Handle resource, const Bind &bind);
+
+    std::vector<ResourceBinds<VkBuffer, VkSparseMemoryBind>> buffer_binds;
+    std::vector<ResourceBinds<VkImage, VkSparseMemoryBind>> image_opaque_binds;
+    std::vector<ResourceBinds<VkImage, VkSparseImageMemoryBind>> image_binds;
+};
+
+/**
+ * A sparsely resident buffer, of which only the committed pages are backed by memory.
+ * Requires the sparseBinding and sparseResidencyBuffer features.
+ */
+class SparseBuffer {
+public:
+    /**
+     * @param device The device to create the buffer on.
+     * @param size The virtual size of the buffer.
+     * @param usage The usage of the buffer.
+     */
+    SparseBuffer(const LogicalDevice &device, VkDeviceSize size, VkBufferUsageFlags usage);
+
+    SparseBuffer(const SparseBuffer &) = delete;
+
+    SparseBuffer &operator=(const SparseBuffer &) = delete;
+
+    ~SparseBuffer();
+
+    /**
+     * Queues binds backing every page overlapping a byte range. Pages which are already resident are skipped.
+     */
+    void commit(VkDeviceSize offset, VkDeviceSize size, SparseBindBatch &batch);
+
+    /**
+     * Queues unbinds of every page overlapping a byte range, returning their memory to the pool. The GPU must be done
+     * with the range by the time the batch executes.
+     */
+    void evict(VkDeviceSize offset, VkDeviceSize size, SparseBindBatch &batch);
+
+    /**
+     * @return Whether the page containing an offset is resident.
+     */
+    bool resident(VkDeviceSize offset) const { return page_table[offset / pool->page_size()].has_value(); }
+
+    VkBuffer handle() const { return buffer; }
+
+    VkDeviceSize page_size() const { return pool->page_size(); }
+
+private:
+    const LogicalDevice &device;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    std::optional<SparsePagePool> pool;
+    std::vector<std::optional<SparsePage>> page_table;
+};
+
+/**
+ * A sparsely resident 2D image, such as a virtual texture or a terrain heightmap, of which only the committed tiles
+ * are backed by memory. The mip tail, the levels smaller than a tile, is always resident.
+ * Requires the sparseBinding and sparseResidencyImage2D features.
+ */
+class SparseImage {
+public:
+    /**
+     * @param device The device to create the image on.
+     * @param format The format of the image.
+     * @param extent The virtual size of the image.
+     * @param mip_levels The number of mip levels.
+     * @param usage The usage of the image.
+     * @param batch The batch receiving the binds of the mip tail.
+     */
+    SparseImage(const LogicalDevice &device, VkFormat format, VkExtent2D extent, uint32_t mip_levels,
+                VkImageUsageFlags usage, SparseBindBatch &batch);
+
+    SparseImage(const SparseImage &) = delete;
+
+    SparseImage &operator=(const SparseImage &) = delete;
+
+    ~SparseImage();
+
+    /**
+     * Queues a bind backing a tile, unless it is already resident.
+     * @param mip_level The mip level of the tile, which must be before the mip tail.
+     * @param tile_x The column of the tile, in units of the tile width.
+     * @param tile_y The row of the tile, in units of the tile height.
+     */
+    void commit_tile(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y, SparseBindBatch &batch);
+
+    /**
+     * Queues an unbind of a tile, returning its memory to the pool. The GPU must be done with the tile by the time
+     * the batch executes.
+     */
+    void evict_tile(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y, SparseBindBatch &batch);
+
+    /**
+     * @return Whether a tile is resident. Tiles in the mip tail are always resident.
+     */
+    bool resident(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y) const;
+
+    /**
+     * @return The size of a tile in texels.
+     */
+    VkExtent3D tile_extent() const { return granularity; }
+
+    /**
+     * @return The number of tile columns and rows of a mip level.
+     */
+    VkExtent2D tile_count(uint32_t mip_level) const;
+
+    /**
+     * @return The first mip level stored in the mip tail.
+     */
+    uint32_t mip_tail_first_level() const { return mip_tail_first_lod; }
+
+    VkImage handle() const { return image; }
+
+private:
+    std::optional<SparsePage> &tile(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y);
+
+    VkSparseImageMemoryBind tile_bind(uint32_t mip_level, uint32_t tile_x, uint32_t tile_y) const;
+
+    const LogicalDevice &device;
+    VkImage image = VK_NULL_HANDLE;
+    VkExtent2D extent;
+    VkExtent3D granularity = {};
+    uint32_t mip_tail_first_lod = 0;
+    std::optional<SparsePagePool> pool;
+    /// One page table per mip level before the mip tail, in row-major tile order.
+    std::vector<std::vector<std::optional<SparsePage>>> page_tables;
+    /// The pages backing the mip tail and metadata, in bind order.
+    std::vector<SparsePage> mip_tail_pages;
+};
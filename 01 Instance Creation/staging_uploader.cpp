@@ -0,0 +1,238 @@
+#include "staging_uploader.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+StagingUploader::StagingUploader(const LogicalDevice &device, MemoryPool &pool)
+        : StagingUploader(device, pool, device.tuning.staging_size, device.tuning.staging_memory) {}
+
+StagingUploader::StagingUploader(const LogicalDevice &device, MemoryPool &pool, VkDeviceSize staging_size,
+                                 VkMemoryPropertyFlags preferred_memory)
+        : device(device), pool(pool), staging_size(staging_size), barriers(device) {
+    const auto *family = device.find_queue_family(VK_QUEUE_GRAPHICS_BIT);
+    if (!family) {
+        family = device.find_queue_family(VK_QUEUE_COMPUTE_BIT);
+    }
+    if (!family) {
+        throw std::runtime_error("Unable to find a queue family for uploads");
+    }
+    queue = family->queues.front();
+
+    VkBufferCreateInfo buffer_create_info;
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.pNext = nullptr;
+    buffer_create_info.flags = 0;
+    buffer_create_info.size = staging_size;
+    buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_create_info.queueFamilyIndexCount = 0;
+    buffer_create_info.pQueueFamilyIndices = nullptr;
+
+    if (vkCreateBuffer(device.device, &buffer_create_info, nullptr, &staging_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create staging buffer");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device.device, staging_buffer, &requirements);
+    staging_memory = pool.allocate(requirements,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                   preferred_memory);
+    vkBindBufferMemory(device.device, staging_buffer, staging_memory.memory, staging_memory.offset);
+
+    // Staging memory is often write-combined, where the wrong way of writing is several times slower, so measure
+    // rather than guess. A few MiB is enough to get past the CPU caches.
+    const auto measured_size = static_cast<std::size_t>(std::min(staging_size, VkDeviceSize(4) << 20));
+    strategy = fastest_host_copy(measure_host_writes(staging_memory.mapped, measured_size));
+    copy = host_copy_function(strategy);
+
+    VkCommandPoolCreateInfo command_pool_create_info;
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.pNext = nullptr;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                                     VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    command_pool_create_info.queueFamilyIndex = family->index;
+
+    if (vkCreateCommandPool(device.device, &command_pool_create_info, nullptr, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create upload command pool");
+    }
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info;
+    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.pNext = nullptr;
+    command_buffer_allocate_info.commandPool = command_pool;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_allocate_info.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device.device, &command_buffer_allocate_info, &command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to allocate upload command buffer");
+    }
+
+    VkFenceCreateInfo fence_create_info;
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.pNext = nullptr;
+    fence_create_info.flags = 0;
+
+    if (vkCreateFence(device.device, &fence_create_info, nullptr, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create upload fence");
+    }
+}
+
+StagingUploader::~StagingUploader() {
+    vkDestroyFence(device.device, fence, nullptr);
+    vkDestroyCommandPool(device.device, command_pool, nullptr);
+    vkDestroyBuffer(device.device, staging_buffer, nullptr);
+    pool.free(staging_memory);
+}
+
+VkCommandBuffer StagingUploader::recording() {
+    if (!recording_commands) {
+        VkCommandBufferBeginInfo begin_info;
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.pNext = nullptr;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin_info.pInheritanceInfo = nullptr;
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to begin upload command buffer");
+        }
+        recording_commands = true;
+    }
+    return command_buffer;
+}
+
+VkDeviceSize StagingUploader::reserve(VkDeviceSize size, VkDeviceSize alignment) {
+    auto offset = (cursor + alignment - 1) / alignment * alignment;
+    if (offset + size > staging_size) {
+        flush();
+        offset = 0;
+    }
+    cursor = offset + size;
+    return offset;
+}
+
+void StagingUploader::upload(VkBuffer buffer, VkDeviceSize offset, std::span<const std::byte> data) {
+    while (!data.empty()) {
+        const auto chunk_size = std::min<VkDeviceSize>(data.size(), staging_size);
+        const auto staging_offset = reserve(chunk_size, 16);
+        copy(static_cast<std::byte *>(staging_memory.mapped) + staging_offset, data.data(), chunk_size);
+
+        VkBufferCopy region;
+        region.srcOffset = staging_offset;
+        region.dstOffset = offset;
+        region.size = chunk_size;
+        vkCmdCopyBuffer(recording(), staging_buffer, buffer, 1, &region);
+
+        offset += chunk_size;
+        data = data.subspan(chunk_size);
+    }
+}
+
+void StagingUploader::transition(VkImage image, VkImageAspectFlags aspect, VkImageLayout from, VkImageLayout to) {
+    VkImageSubresourceRange range;
+    range.aspectMask = aspect;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    if (to == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        barriers.image_barrier(image, range, from, to, VK_PIPELINE_STAGE_2_NONE_KHR, 0, VK_PIPELINE_STAGE_2_COPY_BIT_KHR,
+                               VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+    } else {
+        // The image may be used by anything once uploaded, and the fence wait orders it before later submissions.
+        barriers.image_barrier(image, range, from, to, VK_PIPELINE_STAGE_2_COPY_BIT_KHR,
+                               VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_PIPELINE_STAGE_2_NONE_KHR, 0);
+    }
+}
+
+VkCommandBuffer StagingUploader::flush_barriers() {
+    auto command_buffer = recording();
+    barriers.flush(command_buffer);
+    return command_buffer;
+}
+
+void StagingUploader::upload(VkImage image, VkExtent3D extent, VkImageAspectFlags aspect,
+                             std::span<const std::byte> data, VkImageLayout final_layout) {
+    const VkDeviceSize rows = VkDeviceSize(extent.height) * extent.depth;
+    const VkDeviceSize row_size = rows ? data.size() / rows : 0;
+    if (row_size == 0 || row_size * rows != data.size() || row_size % extent.width != 0) {
+        throw std::runtime_error("Image upload data does not match the image extent");
+    }
+    // Copy offsets into images must be a multiple of the texel size, which may be 3, 6, 12 or 24 bytes, and of 4
+    // for depth and stencil aspects.
+    const auto alignment = std::lcm(row_size / extent.width, VkDeviceSize(4));
+    if (row_size > staging_size) {
+        throw std::runtime_error("Image row is larger than the staging buffer");
+    }
+
+    transition(image, aspect, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    // Copy as many whole rows as fit in the staging buffer at a time. Rows of different slices are not contiguous in
+    // the image, so a chunk never crosses a slice.
+    for (uint32_t z = 0; z < extent.depth; z++) {
+        uint32_t y = 0;
+        while (y < extent.height) {
+            const auto row_count = static_cast<uint32_t>(
+                    std::min<VkDeviceSize>(extent.height - y, staging_size / row_size));
+            const auto chunk_size = row_count * row_size;
+            const auto staging_offset = reserve(chunk_size, alignment);
+            const auto source = data.subspan((VkDeviceSize(z) * extent.height + y) * row_size, chunk_size);
+            copy(static_cast<std::byte *>(staging_memory.mapped) + staging_offset, source.data(), chunk_size);
+
+            VkBufferImageCopy region;
+            region.bufferOffset = staging_offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = aspect;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, static_cast<int32_t>(y), static_cast<int32_t>(z)};
+            region.imageExtent = {extent.width, row_count, 1};
+            vkCmdCopyBufferToImage(flush_barriers(), staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                                   &region);
+
+            y += row_count;
+        }
+    }
+
+    transition(image, aspect, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, final_layout);
+}
+
+void StagingUploader::flush() {
+    if (!recording_commands && barriers.empty()) {
+        cursor = 0;
+        return;
+    }
+    barriers.flush(recording());
+    recording_commands = false;
+    cursor = 0;
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to end upload command buffer");
+    }
+
+    VkCommandBufferSubmitInfoKHR command_buffer_info;
+    command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+    command_buffer_info.pNext = nullptr;
+    command_buffer_info.commandBuffer = command_buffer;
+    command_buffer_info.deviceMask = 0;
+
+    VkSubmitInfo2KHR submit_info;
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+    submit_info.pNext = nullptr;
+    submit_info.flags = 0;
+    submit_info.waitSemaphoreInfoCount = 0;
+    submit_info.pWaitSemaphoreInfos = nullptr;
+    submit_info.commandBufferInfoCount = 1;
+    submit_info.pCommandBufferInfos = &command_buffer_info;
+    submit_info.signalSemaphoreInfoCount = 0;
+    submit_info.pSignalSemaphoreInfos = nullptr;
+
+    check_device_result(queue_submit2(device, queue, {&submit_info, 1}, fence), "Unable to submit uploads");
+    check_device_result(vkWaitForFences(device.device, 1, &fence, VK_TRUE, UINT64_MAX),
+                        "Unable to wait for uploads");
+    vkResetFences(device.device, 1, &fence);
+    vkResetCommandBuffer(command_buffer, 0);
+}
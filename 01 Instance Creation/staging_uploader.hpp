@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "host_copy.hpp"
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "synchronization.hpp"
+
+/**
+ * Uploads data to device local buffers and images through a fixed size staging buffer. Copies are batched into one
+ * command buffer, which is submitted whenever the staging buffer fills up or flush is called.
+ * Data is written into the staging buffer with whichever of HOST_WRITE_STRATEGIES measured fastest on its memory when
+ * the uploader was created.
+ * Uploads go through a graphics (or else compute) queue, so that resources need no queue family ownership transfer
+ * before their first use.
+ */
+class StagingUploader {
+public:
+    /**
+     * Sizes the staging buffer and chooses its memory by the device's tuning profile.
+     * @param device The device owning the destination resources.
+     * @param pool The pool the staging buffer is allocated from.
+     */
+    StagingUploader(const LogicalDevice &device, MemoryPool &pool);
+
+    /**
+     * @param device The device owning the destination resources.
+     * @param pool The pool the staging buffer is allocated from.
+     * @param staging_size The size of the staging buffer.
+     * @param preferred_memory Memory properties to prefer for the staging buffer, on top of host visible and coherent.
+     */
+    StagingUploader(const LogicalDevice &device, MemoryPool &pool, VkDeviceSize staging_size,
+                    VkMemoryPropertyFlags preferred_memory = 0);
+
+    StagingUploader(const StagingUploader &) = delete;
+
+    StagingUploader &operator=(const StagingUploader &) = delete;
+
+    ~StagingUploader();
+
+    /**
+     * Queues a copy into a buffer, which must have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+     * @param buffer The destination buffer.
+     * @param offset The offset in the buffer.
+     * @param data The bytes to copy.
+     */
+    void upload(VkBuffer buffer, VkDeviceSize offset, std::span<const std::byte> data);
+
+    /**
+     * Queues a copy into the first mip level and layer of an image, which must have been created with
+     * VK_IMAGE_USAGE_TRANSFER_DST_BIT. The previous contents of the image are discarded.
+     * @param image The destination image.
+     * @param extent The extent of the image.
+     * @param aspect The aspect of the image to copy to.
+     * @param data The tightly packed texels of the image, of an uncompressed format.
+     * @param final_layout The layout the image is left in.
+     */
+    void upload(VkImage image, VkExtent3D extent, VkImageAspectFlags aspect, std::span<const std::byte> data,
+                VkImageLayout final_layout);
+
+    /**
+     * Submits every queued copy and waits for them to complete.
+     */
+    void flush();
+
+    /**
+     * @return The strategy data is written into the staging buffer with.
+     */
+    HostCopyStrategy copy_strategy() const { return strategy; }
+
+private:
+    /**
+     * Reserves space in the staging buffer, flushing first if it is full.
+     * @param alignment The alignment of the offset, which need not be a power of two.
+     * @return The offset of the reserved space.
+     */
+    VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment);
+
+    /**
+     * @return The command buffer receiving copies, begun if it was not already.
+     */
+    VkCommandBuffer recording();
+
+    void transition(VkImage image, VkImageAspectFlags aspect, VkImageLayout from, VkImageLayout to);
+
+    /**
+     * Records the pending barriers before the next copy.
+     */
+    VkCommandBuffer flush_barriers();
+
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    VkDeviceSize staging_size;
+    VkBuffer staging_buffer = VK_NULL_HANDLE;
+    MemoryAllocation staging_memory;
+    HostCopyStrategy strategy = HostCopyStrategy::Memcpy;
+    HostCopyFunction copy = nullptr;
+    VkDeviceSize cursor = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    BarrierBatch barriers;
+    bool recording_commands = false;
+};
@@ -0,0 +1,373 @@
+#include "synchronization.hpp"
+
+/**
+ * @return The legacy access flags covering a set of synchronization2 accesses. The legacy flags share their values
+ *         with the low 32 bits of the synchronization2 flags.
+ */
+static VkAccessFlags legacy_access(VkAccessFlags2KHR access) {
+    auto legacy = static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+    if (access & (VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR | VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR)) {
+        legacy |= VK_ACCESS_SHADER_READ_BIT;
+    }
+    if (access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR) {
+        legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    return legacy;
+}
+
+/**
+ * @return The legacy stage flags covering a set of synchronization2 stages. The legacy flags share their values with
+ *         the low 32 bits of the synchronization2 flags.
+ */
+static VkPipelineStageFlags legacy_stages(const LogicalDevice &device, VkPipelineStageFlags2KHR stages,
+                                          bool source) {
+    auto legacy = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+    if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT_KHR | VK_PIPELINE_STAGE_2_RESOLVE_BIT_KHR
+                  | VK_PIPELINE_STAGE_2_BLIT_BIT_KHR | VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR)) {
+        legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+    if (stages & (VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT_KHR | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR)) {
+        legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT_KHR) {
+        // Tessellation and geometry stages may only be named when their features are enabled.
+        legacy |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+        if (device.enabled_features.core.features.tessellationShader) {
+            legacy |= VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT
+                      | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT;
+        }
+        if (device.enabled_features.core.features.geometryShader) {
+            legacy |= VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT;
+        }
+    }
+    if (legacy == 0) {
+        legacy = source ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    }
+    return legacy;
+}
+
+BarrierBatch::BarrierBatch(const LogicalDevice &device) : BarrierBatch(device, device.tuning.barrier_strategy) {}
+
+BarrierBatch::BarrierBatch(const LogicalDevice &device, BarrierStrategy strategy)
+        : device(device), strategy(strategy) {}
+
+void BarrierBatch::memory_barrier(VkPipelineStageFlags2KHR source_stages, VkAccessFlags2KHR source_access,
+                                  VkPipelineStageFlags2KHR destination_stages, VkAccessFlags2KHR destination_access) {
+    auto &barrier = memory_barriers.emplace_back();
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+    barrier.pNext = nullptr;
+    barrier.srcStageMask = source_stages;
+    barrier.srcAccessMask = source_access;
+    barrier.dstStageMask = destination_stages;
+    barrier.dstAccessMask = destination_access;
+}
+
+void BarrierBatch::buffer_barrier(VkBuffer buffer, VkPipelineStageFlags2KHR source_stages,
+                                  VkAccessFlags2KHR source_access, VkPipelineStageFlags2KHR destination_stages,
+                                  VkAccessFlags2KHR destination_access, VkDeviceSize offset, VkDeviceSize size) {
+    auto &barrier = buffer_barriers.emplace_back();
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+    barrier.pNext = nullptr;
+    barrier.srcStageMask = source_stages;
+    barrier.srcAccessMask = source_access;
+    barrier.dstStageMask = destination_stages;
+    barrier.dstAccessMask = destination_access;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+}
+
+void BarrierBatch::image_barrier(VkImage image, const VkImageSubresourceRange &range, VkImageLayout old_layout,
+                                 VkImageLayout new_layout, VkPipelineStageFlags2KHR source_stages,
+                                 VkAccessFlags2KHR source_access, VkPipelineStageFlags2KHR destination_stages,
+                                 VkAccessFlags2KHR destination_access) {
+    auto &barrier = image_barriers.emplace_back();
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+    barrier.pNext = nullptr;
+    barrier.srcStageMask = source_stages;
+    barrier.srcAccessMask = source_access;
+    barrier.dstStageMask = destination_stages;
+    barrier.dstAccessMask = destination_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+}
+
+bool BarrierBatch::empty() const {
+    return memory_barriers.empty() && buffer_barriers.empty() && image_barriers.empty();
+}
+
+void BarrierBatch::flush(VkCommandBuffer command_buffer) {
+    if (empty()) {
+        return;
+    }
+
+    switch (strategy) {
+        case BarrierStrategy::Batched:
+            record(command_buffer, memory_barriers, buffer_barriers, image_barriers);
+            break;
+
+        case BarrierStrategy::Precise:
+            for (auto &barrier: memory_barriers) {
+                record(command_buffer, {&barrier, 1}, {}, {});
+            }
+            for (auto &barrier: buffer_barriers) {
+                record(command_buffer, {}, {&barrier, 1}, {});
+            }
+            for (auto &barrier: image_barriers) {
+                record(command_buffer, {}, {}, {&barrier, 1});
+            }
+            break;
+
+        case BarrierStrategy::Global: {
+            VkMemoryBarrier2KHR global;
+            global.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+            global.pNext = nullptr;
+            global.srcStageMask = 0;
+            global.srcAccessMask = 0;
+            global.dstStageMask = 0;
+            global.dstAccessMask = 0;
+
+            auto fold = [&](const auto &barrier) {
+                global.srcStageMask |= barrier.srcStageMask;
+                global.srcAccessMask |= barrier.srcAccessMask;
+                global.dstStageMask |= barrier.dstStageMask;
+                global.dstAccessMask |= barrier.dstAccessMask;
+            };
+            for (auto &barrier: memory_barriers) {
+                fold(barrier);
+            }
+            for (auto &barrier: buffer_barriers) {
+                fold(barrier);
+            }
+
+            // Layout transitions still need image barriers.
+            std::vector<VkImageMemoryBarrier2KHR> transitions;
+            for (auto &barrier: image_barriers) {
+                if (barrier.oldLayout == barrier.newLayout) {
+                    fold(barrier);
+                } else {
+                    transitions.push_back(barrier);
+                }
+            }
+
+            const bool has_global = global.srcStageMask || global.dstStageMask;
+            record(command_buffer, {&global, has_global ? 1u : 0u}, {}, transitions);
+            break;
+        }
+    }
+
+    memory_barriers.clear();
+    buffer_barriers.clear();
+    image_barriers.clear();
+}
+
+void BarrierBatch::record(VkCommandBuffer command_buffer, std::span<const VkMemoryBarrier2KHR> memory,
+                          std::span<const VkBufferMemoryBarrier2KHR> buffers,
+                          std::span<const VkImageMemoryBarrier2KHR> images) const {
+    if (memory.empty() && buffers.empty() && images.empty()) {
+        return;
+    }
+    if (!device.synchronization2()) {
+        record_legacy(command_buffer, memory, buffers, images);
+        return;
+    }
+
+    VkDependencyInfoKHR dependency_info;
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+    dependency_info.pNext = nullptr;
+    dependency_info.dependencyFlags = 0;
+    dependency_info.memoryBarrierCount = memory.size();
+    dependency_info.pMemoryBarriers = memory.data();
+    dependency_info.bufferMemoryBarrierCount = buffers.size();
+    dependency_info.pBufferMemoryBarriers = buffers.data();
+    dependency_info.imageMemoryBarrierCount = images.size();
+    dependency_info.pImageMemoryBarriers = images.data();
+
+    device.functions.vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+}
+
+void BarrierBatch::record_legacy(VkCommandBuffer command_buffer, std::span<const VkMemoryBarrier2KHR> memory,
+                                 std::span<const VkBufferMemoryBarrier2KHR> buffers,
+                                 std::span<const VkImageMemoryBarrier2KHR> images) const {
+    // Legacy barriers share one pair of stage masks across every barrier of the command.
+    VkPipelineStageFlags2KHR source_stages = 0;
+    VkPipelineStageFlags2KHR destination_stages = 0;
+
+    std::vector<VkMemoryBarrier> legacy_memory;
+    legacy_memory.reserve(memory.size());
+    for (auto &barrier: memory) {
+        source_stages |= barrier.srcStageMask;
+        destination_stages |= barrier.dstStageMask;
+
+        auto &legacy = legacy_memory.emplace_back();
+        legacy.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        legacy.pNext = nullptr;
+        legacy.srcAccessMask = legacy_access(barrier.srcAccessMask);
+        legacy.dstAccessMask = legacy_access(barrier.dstAccessMask);
+    }
+
+    std::vector<VkBufferMemoryBarrier> legacy_buffers;
+    legacy_buffers.reserve(buffers.size());
+    for (auto &barrier: buffers) {
+        source_stages |= barrier.srcStageMask;
+        destination_stages |= barrier.dstStageMask;
+
+        auto &legacy = legacy_buffers.emplace_back();
+        legacy.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        legacy.pNext = nullptr;
+        legacy.srcAccessMask = legacy_access(barrier.srcAccessMask);
+        legacy.dstAccessMask = legacy_access(barrier.dstAccessMask);
+        legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+        legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+        legacy.buffer = barrier.buffer;
+        legacy.offset = barrier.offset;
+        legacy.size = barrier.size;
+    }
+
+    std::vector<VkImageMemoryBarrier> legacy_images;
+    legacy_images.reserve(images.size());
+    for (auto &barrier: images) {
+        source_stages |= barrier.srcStageMask;
+        destination_stages |= barrier.dstStageMask;
+
+        auto &legacy = legacy_images.emplace_back();
+        legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        legacy.pNext = nullptr;
+        legacy.srcAccessMask = legacy_access(barrier.srcAccessMask);
+        legacy.dstAccessMask = legacy_access(barrier.dstAccessMask);
+        legacy.oldLayout = barrier.oldLayout;
+        legacy.newLayout = barrier.newLayout;
+        legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+        legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+        legacy.image = barrier.image;
+        legacy.subresourceRange = barrier.subresourceRange;
+    }
+
+    vkCmdPipelineBarrier(command_buffer, legacy_stages(device, source_stages, true),
+                         legacy_stages(device, destination_stages, false), 0,
+                         legacy_memory.size(), legacy_memory.data(),
+                         legacy_buffers.size(), legacy_buffers.data(),
+                         legacy_images.size(), legacy_images.data());
+}
+
+std::optional<ResourceStateTracker::Dependency>
+ResourceStateTracker::record_access(State &state, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access,
+                                    bool transition) {
+    const auto writes = access & WRITE_ACCESS_MASK;
+    std::optional<Dependency> dependency;
+
+    if (writes || transition) {
+        // Writes and layout transitions wait for every earlier access. Earlier reads only need an execution
+        // dependency, as there is nothing of theirs to make visible.
+        const auto source_stages = state.write_stages | state.read_stages;
+        if (source_stages || transition) {
+            dependency = Dependency{source_stages, state.write_access};
+        }
+        state.write_stages = stages;
+        state.write_access = writes;
+        state.visible_stages = stages;
+        state.visible_access = access;
+        state.read_stages = writes ? 0 : stages;
+    } else {
+        if (state.write_stages && ((stages & ~state.visible_stages) || (access & ~state.visible_access))) {
+            dependency = Dependency{state.write_stages, state.write_access};
+            state.visible_stages |= stages;
+            state.visible_access |= access;
+        }
+        state.read_stages |= stages;
+    }
+
+    return dependency;
+}
+
+void ResourceStateTracker::use(VkBuffer buffer, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access) {
+    if (auto dependency = record_access(states[key(buffer)], stages, access, false)) {
+        batch.buffer_barrier(buffer, dependency->source_stages, dependency->source_access, stages, access);
+    }
+}
+
+void ResourceStateTracker::use(VkImage image, VkImageAspectFlags aspect, VkImageLayout layout,
+                               VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access) {
+    auto &state = states[key(image)];
+    const auto old_layout = state.layout;
+    if (auto dependency = record_access(state, stages, access, old_layout != layout)) {
+        VkImageSubresourceRange range;
+        range.aspectMask = aspect;
+        range.baseMipLevel = 0;
+        range.levelCount = VK_REMAINING_MIP_LEVELS;
+        range.baseArrayLayer = 0;
+        range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        batch.image_barrier(image, range, old_layout, layout, dependency->source_stages, dependency->source_access,
+                            stages, access);
+    }
+    state.layout = layout;
+}
+
+VkResult queue_submit2(const LogicalDevice &device, VkQueue queue, std::span<const VkSubmitInfo2KHR> submits,
+                       VkFence fence) {
+    if (device.synchronization2()) {
+        return device.functions.vkQueueSubmit2KHR(queue, submits.size(), submits.data(), fence);
+    }
+
+    struct LegacySubmit {
+        std::vector<VkSemaphore> wait_semaphores;
+        std::vector<VkPipelineStageFlags> wait_stages;
+        std::vector<uint64_t> wait_values;
+        std::vector<VkCommandBuffer> command_buffers;
+        std::vector<VkSemaphore> signal_semaphores;
+        std::vector<uint64_t> signal_values;
+        VkTimelineSemaphoreSubmitInfo timeline_info;
+    };
+
+    // Sized up front, as the submit infos point into each element.
+    std::vector<LegacySubmit> legacy_submits(submits.size());
+    std::vector<VkSubmitInfo> submit_infos(submits.size());
+    const bool timeline = device.enabled_features.vulkan12.timelineSemaphore;
+
+    for (std::size_t i = 0; i < submits.size(); i++) {
+        auto &submit = submits[i];
+        auto &legacy = legacy_submits[i];
+
+        for (uint32_t j = 0; j < submit.waitSemaphoreInfoCount; j++) {
+            auto &wait = submit.pWaitSemaphoreInfos[j];
+            legacy.wait_semaphores.push_back(wait.semaphore);
+            legacy.wait_values.push_back(wait.value);
+
+            // Waits are destination scopes, so an empty mask becomes BOTTOM_OF_PIPE, which waits for nothing.
+            legacy.wait_stages.push_back(legacy_stages(device, wait.stageMask, false));
+        }
+        for (uint32_t j = 0; j < submit.commandBufferInfoCount; j++) {
+            legacy.command_buffers.push_back(submit.pCommandBufferInfos[j].commandBuffer);
+        }
+        for (uint32_t j = 0; j < submit.signalSemaphoreInfoCount; j++) {
+            legacy.signal_semaphores.push_back(submit.pSignalSemaphoreInfos[j].semaphore);
+            legacy.signal_values.push_back(submit.pSignalSemaphoreInfos[j].value);
+        }
+
+        legacy.timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        legacy.timeline_info.pNext = nullptr;
+        legacy.timeline_info.waitSemaphoreValueCount = legacy.wait_values.size();
+        legacy.timeline_info.pWaitSemaphoreValues = legacy.wait_values.data();
+        legacy.timeline_info.signalSemaphoreValueCount = legacy.signal_values.size();
+        legacy.timeline_info.pSignalSemaphoreValues = legacy.signal_values.data();
+
+        auto &submit_info = submit_infos[i];
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = timeline ? &legacy.timeline_info : nullptr;
+        submit_info.waitSemaphoreCount = legacy.wait_semaphores.size();
+        submit_info.pWaitSemaphores = legacy.wait_semaphores.data();
+        submit_info.pWaitDstStageMask = legacy.wait_stages.data();
+        submit_info.commandBufferCount = legacy.command_buffers.size();
+        submit_info.pCommandBuffers = legacy.command_buffers.data();
+        submit_info.signalSemaphoreCount = legacy.signal_semaphores.size();
+        submit_info.pSignalSemaphores = legacy.signal_semaphores.data();
+    }
+
+    return vkQueueSubmit(queue, submit_infos.size(), submit_infos.data(), fence);
+}
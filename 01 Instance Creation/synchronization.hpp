@@ -0,0 +1,153 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "tuning_profile.hpp"
+
+/**
+ * Access flags which write memory. Accesses outside of this mask only read.
+ */
+constexpr VkAccessFlags2KHR WRITE_ACCESS_MASK = VK_ACCESS_2_SHADER_WRITE_BIT_KHR
+                                                | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR
+                                                | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR
+                                                | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR
+                                                | VK_ACCESS_2_HOST_WRITE_BIT_KHR
+                                                | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR
+                                                | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR;
+
+/**
+ * Collects pipeline barriers and records them together at the next point of use, with VK_KHR_synchronization2 when
+ * the device enabled it and the equivalent legacy barriers otherwise.
+ * How barriers are recorded follows the barrier strategy of the device's tuning profile: Batched records every barrier
+ * with one command, Precise with one command per barrier, and Global folds every barrier that does not transition an
+ * image layout into a single memory barrier.
+ */
+class BarrierBatch {
+public:
+    /**
+     * Records barriers with the strategy of the device's tuning profile.
+     */
+    explicit BarrierBatch(const LogicalDevice &device);
+
+    BarrierBatch(const LogicalDevice &device, BarrierStrategy strategy);
+
+    /**
+     * Adds a dependency covering all memory.
+     */
+    void memory_barrier(VkPipelineStageFlags2KHR source_stages, VkAccessFlags2KHR source_access,
+                        VkPipelineStageFlags2KHR destination_stages, VkAccessFlags2KHR destination_access);
+
+    /**
+     * Adds a dependency on a range of a buffer.
+     */
+    void buffer_barrier(VkBuffer buffer, VkPipelineStageFlags2KHR source_stages, VkAccessFlags2KHR source_access,
+                        VkPipelineStageFlags2KHR destination_stages, VkAccessFlags2KHR destination_access,
+                        VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+    /**
+     * Adds a dependency on a range of an image, transitioning its layout.
+     */
+    void image_barrier(VkImage image, const VkImageSubresourceRange &range, VkImageLayout old_layout,
+                       VkImageLayout new_layout, VkPipelineStageFlags2KHR source_stages,
+                       VkAccessFlags2KHR source_access, VkPipelineStageFlags2KHR destination_stages,
+                       VkAccessFlags2KHR destination_access);
+
+    /**
+     * @return Whether no barriers are pending.
+     */
+    bool empty() const;
+
+    /**
+     * Records the pending barriers into a command buffer and clears them. Does nothing if none are pending.
+     */
+    void flush(VkCommandBuffer command_buffer);
+
+private:
+    void record(VkCommandBuffer command_buffer, std::span<const VkMemoryBarrier2KHR> memory,
+                std::span<const VkBufferMemoryBarrier2KHR> buffers,
+                std::span<const VkImageMemoryBarrier2KHR> images) const;
+
+    void record_legacy(VkCommandBuffer command_buffer, std::span<const VkMemoryBarrier2KHR> memory,
+                       std::span<const VkBufferMemoryBarrier2KHR> buffers,
+                       std::span<const VkImageMemoryBarrier2KHR> images) const;
+
+    const LogicalDevice &device;
+    BarrierStrategy strategy;
+    std::vector<VkMemoryBarrier2KHR> memory_barriers;
+    std::vector<VkBufferMemoryBarrier2KHR> buffer_barriers;
+    std::vector<VkImageMemoryBarrier2KHR> image_barriers;
+};
+
+/**
+ * Tracks how each resource was last accessed, and adds to a BarrierBatch the narrowest barrier making the previous
+ * accesses safe before the next one. Reads following reads need no barrier, and a barrier already making a write
+ * visible to some stages is not repeated for them.
+ * Images are tracked as a whole, in a single layout. Resources not yet seen are assumed unused, in an undefined
+ * layout.
+ */
+class ResourceStateTracker {
+public:
+    explicit ResourceStateTracker(BarrierBatch &batch) : batch(batch) {}
+
+    /**
+     * Declares the next access to a buffer.
+     */
+    void use(VkBuffer buffer, VkPipelineStageFlags2KHR stages, VkAccessFlags2KHR access);
+
+    /**
+     * Declares the next access to an image, in a layout.
+     */
+    void use(VkImage image, VkImageAspectFlags aspect, VkImageLayout layout, VkPipelineStageFlags2KHR stages,
+             VkAccessFlags2KHR access);
+
+    /**
+     * Stops tracking a destroyed resource.
+     */
+    void forget(VkBuffer buffer) { states.erase(key(buffer)); }
+
+    void forget(VkImage image) { states.erase(key(image)); }
+
+private:
+    /**
+     * Non-dispatchable handles are pointers on 64-bit platforms and integers on 32-bit ones.
+     */
+    template<typename Handle>
+    static uint64_t key(Handle handle) { return (uint64_t) handle; }
+
+    struct State {
+        VkPipelineStageFlags2KHR write_stages = 0;
+        VkAccessFlags2KHR write_access = 0;
+        /// The stages and accesses the last write is already visible to.
+        VkPipelineStageFlags2KHR visible_stages = 0;
+        VkAccessFlags2KHR visible_access = 0;
+        /// The stages which read since the last write.
+        VkPipelineStageFlags2KHR read_stages = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct Dependency {
+        VkPipelineStageFlags2KHR source_stages;
+        VkAccessFlags2KHR source_access;
+    };
+
+    /**
+     * Updates the state of a resource for an access.
+     * @return The source of the barrier needed before the access, if one is needed.
+     */
+    static std::optional<Dependency> record_access(State &state, VkPipelineStageFlags2KHR stages,
+                                                   VkAccessFlags2KHR access, bool transition);
+
+    BarrierBatch &batch;
+    std::unordered_map<uint64_t, State> states;
+};
+
+/**
+ * Submits to a queue with vkQueueSubmit2KHR when the device enabled VK_KHR_synchronization2, and otherwise with the
+ * equivalent vkQueueSubmit, translating stage masks and timeline semaphore values.
+ */
+VkResult queue_submit2(const LogicalDevice &device, VkQueue queue, std::span<const VkSubmitInfo2KHR> submits,
+                       VkFence fence);
@@ -0,0 +1,433 @@
+/*
+ * Runs the device bootstrap against a vulkan driver, checking what it reports and timing each step.
+ *     bootstrap_tests mock      The driver must be the mock ICD. Every result is checked against the MockIcdConfig
+ *                               read from the same environment as the driver. When a queue family supports sparse
+ *                               binding, the bookkeeping of SparseBuffer and SparseImage is checked against the binds
+ *                               the driver validates. When the driver takes time to create pipelines, a
+ *                               PipelineLibrary is checked to serve a cached pipeline while compiling another.
+ *                               MemoryPool budgets and FairQueue time slicing are checked on the selected device.
+ *     bootstrap_tests lavapipe  The driver must be lavapipe. Only what holds for any CPU driver is checked.
+ * Exits with SKIPPED when GLFW cannot be initialised, which ctest reports as a skipped test.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include "extension_index.hpp"
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "mock_icd_config.hpp"
+#include "physical_device_capabilities.hpp"
+#include "pipeline_library.hpp"
+#include "shared_context.hpp"
+#include "sparse_resources.hpp"
+#include "vulkan_bootstrap.hpp"
+#include "worker_pool.hpp"
+
+static constexpr int SKIPPED = 77;
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+static void report_time(std::string_view name, std::chrono::steady_clock::time_point start, uint32_t device_count) {
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "    " << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << elapsed << " ms";
+    if (device_count > 1) {
+        std::cout << std::setw(10) << elapsed / device_count << " ms/device";
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Runs and times one step of the bootstrap.
+ * @param device_count The number of devices the step covers, reported as a per device time when above one.
+ * @return The result of the step.
+ */
+template<typename Function>
+static auto timed(std::string_view name, uint32_t device_count, Function &&function) {
+    auto start = std::chrono::steady_clock::now();
+    if constexpr (std::is_void_v<std::invoke_result_t<Function>>) {
+        function();
+        report_time(name, start, device_count);
+    } else {
+        auto result = function();
+        report_time(name, start, device_count);
+        return result;
+    }
+}
+
+/**
+ * @return The index of the device the builder should select among those faked, derived from the configuration rather
+ *         than from the capabilities the bootstrap probed.
+ */
+static uint32_t expected_selection(const MockIcdConfig &config) {
+    for (auto type: {VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU,
+                     VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU, VK_PHYSICAL_DEVICE_TYPE_CPU}) {
+        // The device local heap grows with the index, so the last device of the best type wins.
+        for (uint32_t i = config.device_count; i-- > 0;) {
+            if (config.device_properties(i).deviceType == type) {
+                return i;
+            }
+        }
+    }
+    return 0;
+}
+
+static void check_mock_devices(const MockIcdConfig &config, const std::vector<VkPhysicalDevice> &physical_devices,
+                               const std::vector<VkPhysicalDeviceProperties> &properties,
+                               const std::vector<std::vector<VkQueueFamilyProperties>> &queue_families,
+                               const std::vector<PhysicalDeviceCapabilities> &capabilities) {
+    check(physical_devices.size() == config.device_count, "get_physical_devices found " +
+          std::to_string(physical_devices.size()) + " devices, expected " + std::to_string(config.device_count));
+
+    std::set<uint32_t> seen;
+    for (std::size_t i = 0; i < std::min(physical_devices.size(), properties.size()); i++) {
+        auto index = MockIcdConfig::device_index(properties[i].deviceID);
+        auto name = std::string(properties[i].deviceName);
+        if (index >= config.device_count || !seen.insert(index).second) {
+            check(false, name + " has an unexpected or duplicate device id");
+            continue;
+        }
+
+        auto expected = config.device_properties(index);
+        check(name == expected.deviceName, name + " is not named " + expected.deviceName);
+        check(properties[i].deviceType == expected.deviceType, name + " has the wrong device type");
+        check(properties[i].vendorID == expected.vendorID, name + " has the wrong vendor id");
+        check(properties[i].apiVersion == expected.apiVersion, name + " has the wrong api version");
+
+        auto expected_families = config.queue_family_properties(index);
+        check(queue_families[i].size() == expected_families.size(), name + " has the wrong number of queue families");
+        for (std::size_t family = 0; family < std::min(queue_families[i].size(), expected_families.size()); family++) {
+            check(queue_families[i][family].queueFlags == expected_families[family].queueFlags
+                  && queue_families[i][family].queueCount == expected_families[family].queueCount,
+                  name + " reports the wrong queue family " + std::to_string(family));
+        }
+
+        auto &probed = capabilities[i];
+        check(probed.physical_device == physical_devices[i], name + " was probed out of order");
+        check(probed.properties.deviceID == properties[i].deviceID, name + " has different probed properties");
+        check(probed.queue_families.size() == expected_families.size(), name + " has different probed queue families");
+        check(probed.extensions.size() == config.device_extensions(index).size(),
+              name + " probed " + std::to_string(probed.extensions.size()) + " extensions, expected " +
+              std::to_string(config.device_extensions(index).size()));
+        check(probed.supports_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)
+              == MockIcdConfig::has_optional_extensions(index), name + " has the wrong optional extensions");
+        check(config.extension_count == 0 || probed.supports_extension(
+                      "VK_MOCK_filler_extension_" + std::to_string(config.extension_count - 1)),
+              name + " is missing its last filler extension");
+        check(probed.features.vulkan12.timelineSemaphore == VK_TRUE, name + " did not probe vulkan 1.2 features");
+        check(static_cast<bool>(probed.features.synchronization2.synchronization2)
+              == MockIcdConfig::has_optional_extensions(index),
+              name + " probed features of an unsupported extension");
+        check(probed.device_local_memory() == config.memory_properties(index).memoryHeaps[0].size,
+              name + " has the wrong amount of device local memory");
+    }
+}
+
+static void check_lavapipe_devices(const std::vector<VkPhysicalDeviceProperties> &properties,
+                                   const std::vector<std::vector<VkQueueFamilyProperties>> &queue_families,
+                                   const std::vector<PhysicalDeviceCapabilities> &capabilities) {
+    check(!properties.empty(), "lavapipe reported no devices");
+    for (std::size_t i = 0; i < properties.size(); i++) {
+        auto name = std::string(properties[i].deviceName);
+        check(properties[i].deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU, name + " is not a CPU device");
+        check(std::ranges::any_of(queue_families[i], [](const VkQueueFamilyProperties &family) {
+            return family.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        }), name + " has no graphics queue family");
+        check(capabilities[i].extensions.size() > 0, name + " reported no device extensions");
+        check(capabilities[i].device_local_memory() > 0, name + " reported no device local memory");
+    }
+}
+
+static void check_device(const LogicalDevice &device) {
+    auto &capabilities = *device.capabilities;
+    auto name = std::string(capabilities.properties.deviceName);
+    check(device.device != VK_NULL_HANDLE, "No device was created on " + name);
+
+    // Every queue of every family is created.
+    check(device.queue_families.size() == capabilities.queue_families.size(), name + " is missing queue families");
+    for (auto &family: device.queue_families) {
+        check(family.queues.size() == capabilities.queue_families[family.index].queueCount
+              && std::ranges::none_of(family.queues, [](VkQueue queue) { return queue == VK_NULL_HANDLE; }),
+              name + " is missing queues of family " + std::to_string(family.index));
+    }
+
+    auto graphics = device.find_queue_family(VK_QUEUE_GRAPHICS_BIT);
+    check(graphics != nullptr, name + " has no graphics queue family");
+    auto transfer = device.find_queue_family(VK_QUEUE_TRANSFER_BIT);
+    check(transfer != nullptr, name + " has no transfer queue family");
+    if (transfer != nullptr) {
+        for (auto &family: capabilities.queue_families) {
+            check(!(family.queueFlags & VK_QUEUE_TRANSFER_BIT)
+                  || std::popcount(family.queueFlags) >= std::popcount(transfer->properties.queueFlags),
+                  name + " did not pick the most dedicated transfer queue family");
+        }
+    }
+
+    check(device.extension_enabled(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)
+          == capabilities.supports_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME),
+          name + " did not enable exactly the supported requested extensions");
+}
+
+/**
+ * Commits and evicts pages and tiles, including an evict and a commit in one batch that reuse the same memory, which
+ * the mock ICD rejects if the binds are queued out of order or a page is handed out twice.
+ */
+static void check_mock_sparse(const LogicalDevice &device) {
+    auto sparse = device.find_queue_family(VK_QUEUE_SPARSE_BINDING_BIT);
+    auto queue = sparse->queues[0];
+    SparseBindBatch batch;
+
+    {
+        SparseBuffer buffer(device, MockIcdConfig::SPARSE_BLOCK_SIZE * 21 / 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        const auto page = buffer.page_size();
+        check(page == MockIcdConfig::SPARSE_BLOCK_SIZE, "The sparse buffer does not use the sparse block size");
+
+        buffer.commit(page + 1, 2 * page, batch);
+        check(!buffer.resident(0) && buffer.resident(page) && buffer.resident(3 * page) && !buffer.resident(4 * page),
+              "Committing a range did not make exactly the pages it overlaps resident");
+        batch.flush(queue);
+        buffer.commit(2 * page, page, batch);
+        check(batch.empty(), "Committing resident pages queued binds");
+
+        buffer.evict(2 * page, 1, batch);
+        buffer.commit(10 * page, 1, batch);
+        batch.flush(queue);
+        check(!buffer.resident(2 * page) && buffer.resident(10 * page), "Evicting and committing in one batch failed");
+
+        buffer.evict(0, 11 * page, batch);
+        batch.flush(queue);
+        check(!buffer.resident(page) && !buffer.resident(10 * page), "Evicting the whole buffer left pages resident");
+    }
+
+    {
+        SparseImage image(device, VK_FORMAT_R8G8B8A8_UNORM, {1000, 600}, 5, VK_IMAGE_USAGE_SAMPLED_BIT, batch);
+        batch.flush(queue);
+        check(image.mip_tail_first_level() == 3, "The sparse image has the wrong mip tail");
+        auto count = image.tile_count(0);
+        check(count.width == 8 && count.height == 5, "The sparse image has the wrong number of tiles");
+        count = image.tile_count(2);
+        check(count.width == 2 && count.height == 2, "The sparse image has the wrong number of tiles in level 2");
+        check(image.resident(3, 0, 0), "The mip tail is not resident");
+
+        // The corner tile is clamped to the edge of the image.
+        image.commit_tile(0, 7, 4, batch);
+        image.commit_tile(2, 1, 1, batch);
+        batch.flush(queue);
+        image.commit_tile(0, 7, 4, batch);
+        check(batch.empty(), "Committing a resident tile queued a bind");
+        check(image.resident(0, 7, 4) && image.resident(2, 1, 1) && !image.resident(0, 0, 0),
+              "Committing tiles did not make exactly them resident");
+
+        image.evict_tile(0, 7, 4, batch);
+        batch.flush(queue);
+        check(!image.resident(0, 7, 4) && image.resident(2, 1, 1), "Evicting a tile failed");
+
+        bool thrown = false;
+        try {
+            image.commit_tile(0, 8, 0, batch);
+        } catch (const std::out_of_range &) {
+            thrown = true;
+        }
+        check(thrown, "Committing a tile outside the image did not throw");
+    }
+}
+
+/**
+ * Gets a cached pipeline while another is compiling, which must not wait for the compile. The mock ICD takes
+ * config.pipeline_milliseconds to create each pipeline, and ignores the shaders and states.
+ */
+static void check_mock_pipeline_library(const LogicalDevice &device, const MockIcdConfig &config) {
+    const auto delay = std::chrono::milliseconds(config.pipeline_milliseconds);
+    WorkerPool workers(1);
+    PipelineLibrary library(device, workers);
+
+    GraphicsPipelineDescription cached;
+    auto other = cached;
+    other.cull_mode = VK_CULL_MODE_NONE;
+    auto pipeline = library.get(cached);
+
+    auto compiling = std::async(std::launch::async, [&] { return library.get(other); });
+    std::this_thread::sleep_for(delay / 4);
+    auto start = std::chrono::steady_clock::now();
+    auto hit = library.get(cached);
+    auto waited = std::chrono::steady_clock::now() - start;
+    check(hit == pipeline, "Getting a cached pipeline returned a different one");
+    check(waited < delay / 2, "Getting a cached pipeline waited for another pipeline's compile");
+    check(compiling.get() != pipeline, "Pipelines of different descriptions are the same");
+}
+
+/**
+ * Fills a budget smaller than a block, then checks allocations beyond it are rejected. The mock ICD reports memory
+ * the pool leaves allocated, including the dedicated allocation, when the device is destroyed.
+ */
+static void check_mock_memory_budget(const LogicalDevice &device) {
+    constexpr VkDeviceSize budget = VkDeviceSize(4) << 20;
+    MemoryPool pool(device, budget, MemoryPool::DEFAULT_BLOCK_SIZE);
+    const auto allocate = [&](VkDeviceSize size) {
+        // Memory type 0 is the mock's device local type, which is not mapped.
+        const VkMemoryRequirements requirements = {size, 256, 1};
+        try {
+            return pool.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        } catch (const std::runtime_error &) {
+            return MemoryAllocation();
+        }
+    };
+
+    auto first = allocate(VkDeviceSize(1) << 20);
+    check(first.memory != VK_NULL_HANDLE, "An allocation within a budget smaller than a block was rejected");
+    auto second = allocate(VkDeviceSize(3) << 20);
+    check(second.memory == first.memory, "The rest of the budget was not one block");
+    check(pool.reserved() == budget, "The pool did not reserve exactly its budget");
+    check(allocate(256).memory == VK_NULL_HANDLE, "An allocation beyond the budget was not rejected");
+
+    pool.free(second);
+    check(allocate(budget * 2).memory == VK_NULL_HANDLE, "An allocation larger than the budget was not rejected");
+    MemoryPool unlimited(device, MemoryPool::UNLIMITED, VkDeviceSize(1) << 20);
+    const VkMemoryRequirements dedicated = {VkDeviceSize(2) << 20, 256, 1};
+    check(unlimited.allocate(dedicated, 0).block == MemoryAllocation::DEDICATED,
+          "An allocation larger than a block did not get dedicated memory");
+}
+
+/**
+ * Runs a tenant with long turns against two with short ones, all wanting the queue all the time, and checks the
+ * long one gets no more than its share of the queue's time rather than a share of the turns.
+ */
+static void check_fair_queue(const LogicalDevice &device) {
+    FairQueue queue(device, device.queue_families[0].queues[0]);
+    constexpr uint32_t tenant_count = 3;
+    const std::chrono::milliseconds turn_lengths[tenant_count] = {std::chrono::milliseconds(20),
+                                                                  std::chrono::milliseconds(1),
+                                                                  std::chrono::milliseconds(1)};
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(600);
+    std::vector<std::thread> tenants;
+    for (uint32_t tenant = 0; tenant < tenant_count; tenant++) {
+        tenants.emplace_back([&, tenant] {
+            while (std::chrono::steady_clock::now() < end) {
+                queue.with_queue(tenant, [&](VkQueue) { std::this_thread::sleep_for(turn_lengths[tenant]); });
+            }
+        });
+    }
+    for (auto &thread: tenants) {
+        thread.join();
+    }
+
+    std::chrono::nanoseconds total(0);
+    for (uint32_t tenant = 0; tenant < tenant_count; tenant++) {
+        total += queue.held_time(tenant);
+    }
+    // Taking turns in arrival order would give the long tenant over 90% of the time.
+    check(queue.held_time(0) * 2 < total, "The tenant with long turns took more than its share of the queue");
+    check(queue.held_time(1) * 5 > total && queue.held_time(2) * 5 > total,
+          "A tenant with short turns got too little of the queue");
+}
+
+static void run(bool mock) {
+    const auto config = MockIcdConfig::from_environment();
+
+    auto availability = timed("probe_instance_availability", 1, probe_instance_availability);
+    check(availability.extensions.supported(VK_KHR_SURFACE_EXTENSION_NAME), "VK_KHR_surface is not available");
+
+    auto instance = timed("initialise_vulkan", 1, [&] { return initialise_vulkan(availability, {}, {}); });
+    check(availability.extensions.enabled(VK_KHR_SURFACE_EXTENSION_NAME),
+          "The extensions required by GLFW were not enabled");
+    timed("load_vulkan_functions", 1, [&] { load_vulkan_functions(instance); });
+
+    auto physical_devices = timed("get_physical_devices", 1, [&] { return get_physical_devices(instance); });
+    uint32_t device_count = physical_devices.size();
+    check(get_physical_devices(instance) == physical_devices, "get_physical_devices is not stable");
+
+    auto properties = timed("get_physical_device_properties", device_count, [&] {
+        return get_physical_device_properties(physical_devices);
+    });
+    auto queue_families = timed("get_physical_device_queue_family_properties", device_count, [&] {
+        return get_physical_device_queue_family_properties(physical_devices);
+    });
+    auto capabilities = timed("probe_physical_device_capabilities", device_count, [&] {
+        return probe_physical_device_capabilities(physical_devices);
+    });
+
+    if (mock) {
+        check_mock_devices(config, physical_devices, properties, queue_families, capabilities);
+    } else {
+        check_lavapipe_devices(properties, queue_families, capabilities);
+    }
+
+    auto device = timed("DeviceBuilder::build", device_count, [&] {
+        return DeviceBuilder().request_performance_features().request_sparse_residency().build(capabilities);
+    });
+    check_device(device);
+    if (mock) {
+        auto expected = config.device_properties(expected_selection(config));
+        check(device.capabilities->properties.deviceID == expected.deviceID,
+              std::string("Selected ") + device.capabilities->properties.deviceName + ", expected " +
+              expected.deviceName);
+        if (device.find_queue_family(VK_QUEUE_SPARSE_BINDING_BIT) != nullptr) {
+            timed("check_mock_sparse", 1, [&] { check_mock_sparse(device); });
+        }
+        timed("check_mock_memory_budget", 1, [&] { check_mock_memory_budget(device); });
+        timed("check_fair_queue", 1, [&] { check_fair_queue(device); });
+        if (config.pipeline_milliseconds > 0) {
+            timed("check_mock_pipeline_library", 1, [&] { check_mock_pipeline_library(device, config); });
+        }
+    }
+
+    timed("destroy_logical_device", 1, [&] { destroy_logical_device(device); });
+    vkDestroyInstance(instance, nullptr);
+}
+
+int main(int argc, char **argv) {
+    std::string_view mode = argc > 1 ? argv[1] : "";
+    if (mode != "mock" && mode != "lavapipe") {
+        std::cerr << "Usage: bootstrap_tests mock|lavapipe" << std::endl;
+        return 2;
+    }
+
+    // Tests run without a display, and only need GLFW to report its instance extensions. The mock driver is built with
+    // the tests, so failing to load it is a failure. Lavapipe is optional, so its tests are skipped without it.
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 4
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (glfwInit() != GLFW_TRUE || !glfwVulkanSupported()) {
+        if (mode == "mock") {
+            std::cerr << "GLFW or the vulkan loader is unavailable" << std::endl;
+            return 1;
+        }
+        std::cerr << "GLFW or the vulkan loader is unavailable, skipping" << std::endl;
+        return SKIPPED;
+    }
+
+    std::cout << "Bootstrap against " << mode << ":" << std::endl;
+    try {
+        run(mode == "mock");
+    } catch (const std::exception &exception) {
+        check(false, exception.what());
+    }
+    glfwTerminate();
+
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
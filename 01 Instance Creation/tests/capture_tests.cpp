@@ -0,0 +1,180 @@
+/*
+ * Runs a frame of transfer work under the capture layer, then checks the capture it wrote holds the frame's buffers
+ * with their contents from before it, ready for vulkan_replay.
+ *     capture_tests <capture file>  The layer must be enabled and VK_CAPTURE_FILE name the same file.
+ * Exits with SKIPPED when GLFW cannot be initialised, which ctest reports as a skipped test.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include "capture_format.hpp"
+#include "immediate_commands.hpp"
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "physical_device_capabilities.hpp"
+#include "synchronization.hpp"
+#include "vulkan_bootstrap.hpp"
+
+static constexpr int SKIPPED = 77;
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+static constexpr VkDeviceSize BUFFER_SIZE = 4096;
+
+/**
+ * A host visible buffer, which the host fills before the frame.
+ */
+class HostBuffer {
+public:
+    HostBuffer(const LogicalDevice &device, MemoryPool &pool) : device(device), pool(pool) {
+        VkBufferCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.size = BUFFER_SIZE;
+        create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        create_info.queueFamilyIndexCount = 0;
+        create_info.pQueueFamilyIndices = nullptr;
+        check_device_result(vkCreateBuffer(device.device, &create_info, nullptr, &buffer),
+                            "Unable to create test buffer");
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+        allocation = pool.allocate(requirements,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        check_device_result(vkBindBufferMemory(device.device, buffer, allocation.memory, allocation.offset),
+                            "Unable to bind test buffer memory");
+    }
+
+    HostBuffer(const HostBuffer &) = delete;
+
+    HostBuffer &operator=(const HostBuffer &) = delete;
+
+    ~HostBuffer() {
+        vkDestroyBuffer(device.device, buffer, nullptr);
+        pool.free(allocation);
+    }
+
+    std::byte *data() const { return static_cast<std::byte *>(allocation.mapped); }
+
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+};
+
+static std::vector<std::byte> pattern() {
+    std::vector<std::byte> bytes(BUFFER_SIZE);
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<std::byte>(i * 7 + 3);
+    }
+    return bytes;
+}
+
+/**
+ * Copies a buffer the host filled with pattern() into a zeroed one, then overwrites part of the source, in one
+ * submission, all of which the layer captures.
+ */
+static void run_frame(const LogicalDevice &device) {
+    const auto *family = device.find_queue_family(VK_QUEUE_TRANSFER_BIT);
+    if (family == nullptr) {
+        family = device.find_queue_family(VK_QUEUE_COMPUTE_BIT);
+    }
+    if (family == nullptr) {
+        throw std::runtime_error("The device has no queue family supporting transfers");
+    }
+    MemoryPool pool(device);
+    ImmediateCommands commands(device, *family);
+    HostBuffer source(device, pool);
+    HostBuffer destination(device, pool);
+    const auto bytes = pattern();
+    std::memcpy(source.data(), bytes.data(), bytes.size());
+    std::memset(destination.data(), 0, BUFFER_SIZE);
+
+    BarrierBatch barriers(device);
+    commands.run([&](VkCommandBuffer command_buffer) {
+        const VkBufferCopy region = {0, 0, BUFFER_SIZE};
+        vkCmdCopyBuffer(command_buffer, source.buffer, destination.buffer, 1, &region);
+        barriers.memory_barrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR);
+        barriers.flush(command_buffer);
+        vkCmdFillBuffer(command_buffer, source.buffer, 0, BUFFER_SIZE / 2, 0xFFFFFFFF);
+    });
+    check(std::equal(bytes.begin(), bytes.end(), destination.data()), "The frame did not copy the buffer");
+}
+
+static void run(const std::filesystem::path &capture_path) {
+    std::filesystem::remove(capture_path);
+    auto availability = probe_instance_availability();
+    auto instance = initialise_vulkan(availability, {}, {});
+    load_vulkan_functions(instance);
+    auto device = DeviceBuilder().build(probe_physical_device_capabilities(get_physical_devices(instance)));
+    std::cout << "Capturing on " << device.capabilities->properties.deviceName << std::endl;
+    run_frame(device);
+    // The layer writes the capture when the device is destroyed, as the frame never presents.
+    destroy_logical_device(device);
+    vkDestroyInstance(instance, nullptr);
+
+    const auto capture = read_capture_file(capture_path);
+    check(capture.submits.size() == 1 && capture.submits[0].size() == 1,
+          "The capture does not hold the one submission of the frame");
+    check(capture.command_buffers.size() == 1 && !capture.command_buffers[0].commands.empty(),
+          "The capture does not hold the commands of the frame");
+    check(capture.buffers.size() == 2, "The capture does not hold the two buffers of the frame");
+
+    const auto bytes = pattern();
+    const auto source = std::ranges::count_if(capture.buffers, [&](const CapturedBuffer &buffer) {
+        return buffer.contents.size() == bytes.size() && std::ranges::equal(buffer.contents, bytes);
+    });
+    const auto destination = std::ranges::count_if(capture.buffers, [&](const CapturedBuffer &buffer) {
+        return buffer.contents.size() == BUFFER_SIZE
+               && std::ranges::all_of(buffer.contents, [](std::byte value) { return value == std::byte(0); });
+    });
+    check(source == 1 && destination == 1, "The captured buffers do not hold their contents from before the frame");
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: capture_tests <capture file>" << std::endl;
+        return 2;
+    }
+
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 4
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (glfwInit() != GLFW_TRUE || !glfwVulkanSupported()) {
+        std::cerr << "GLFW or the vulkan loader is unavailable, skipping" << std::endl;
+        return SKIPPED;
+    }
+
+    try {
+        run(argv[1]);
+    } catch (const std::exception &exception) {
+        check(false, exception.what());
+    }
+    glfwTerminate();
+
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
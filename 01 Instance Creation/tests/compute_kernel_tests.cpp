@@ -0,0 +1,912 @@
+/*
+ * Runs the GPU systems with their reference kernels on a vulkan driver, reading back what the kernels write and
+ * checking it against what the systems promise.
+ *     compute_kernel_tests <shader directory>  The directory holds the kernels' SPIR-V. The driver must support
+ *                                              buffer device addresses, scalar block layout and storage image
+ *                                              writes without a format, as lavapipe does.
+ * Exits with SKIPPED when GLFW cannot be initialised, which ctest reports as a skipped test.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <initializer_list>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include "compute_skinning.hpp"
+#include "dynamic_resolution.hpp"
+#include "extension_index.hpp"
+#include "immediate_commands.hpp"
+#include "logical_device.hpp"
+#include "memory_pool.hpp"
+#include "object_cache.hpp"
+#include "particle_system.hpp"
+#include "physical_device_capabilities.hpp"
+#include "post_process.hpp"
+#include "shader_permutations.hpp"
+#include "staging_uploader.hpp"
+#include "synchronization.hpp"
+#include "vulkan_bootstrap.hpp"
+#include "workgroup_tuner.hpp"
+
+static constexpr int SKIPPED = 77;
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * A reference kernel, loaded from its SPIR-V.
+ */
+class Kernel {
+public:
+    Kernel(const LogicalDevice &device, const std::filesystem::path &directory, std::string name) : device(device) {
+        ShaderPermutations shader;
+        shader.name = std::move(name);
+        const auto spirv = precompiled_shader_compiler(directory)(shader, {});
+
+        VkShaderModuleCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.codeSize = spirv.size() * sizeof(uint32_t);
+        create_info.pCode = spirv.data();
+        if (vkCreateShaderModule(device.device, &create_info, nullptr, &module) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create shader module for " + shader.name);
+        }
+    }
+
+    Kernel(const Kernel &) = delete;
+
+    Kernel &operator=(const Kernel &) = delete;
+
+    ~Kernel() { vkDestroyShaderModule(device.device, module, nullptr); }
+
+    const LogicalDevice &device;
+    VkShaderModule module = VK_NULL_HANDLE;
+};
+
+/**
+ * A host visible buffer which results are copied into.
+ */
+class Readback {
+public:
+    Readback(const LogicalDevice &device, MemoryPool &pool, VkDeviceSize size)
+            : device(device), pool(pool), barriers(device) {
+        VkBufferCreateInfo create_info;
+        create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.flags = 0;
+        create_info.size = size;
+        create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        create_info.queueFamilyIndexCount = 0;
+        create_info.pQueueFamilyIndices = nullptr;
+        check_device_result(vkCreateBuffer(device.device, &create_info, nullptr, &buffer),
+                            "Unable to create readback buffer");
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device.device, buffer, &requirements);
+        allocation = pool.allocate(requirements,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        check_device_result(vkBindBufferMemory(device.device, buffer, allocation.memory, allocation.offset),
+                            "Unable to bind readback memory");
+    }
+
+    Readback(const Readback &) = delete;
+
+    Readback &operator=(const Readback &) = delete;
+
+    ~Readback() {
+        vkDestroyBuffer(device.device, buffer, nullptr);
+        pool.free(allocation);
+    }
+
+    /**
+     * Records copying ranges written by compute shaders into the buffer, one after the other, and making them
+     * visible to the host.
+     */
+    void copy(VkCommandBuffer command_buffer, std::initializer_list<VkDescriptorBufferInfo> ranges) {
+        barriers.memory_barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR);
+        barriers.flush(command_buffer);
+        VkDeviceSize offset = 0;
+        for (auto &range: ranges) {
+            const VkBufferCopy region = {range.offset, offset, range.range};
+            vkCmdCopyBuffer(command_buffer, range.buffer, buffer, 1, &region);
+            offset += range.range;
+        }
+        barriers.memory_barrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR);
+        barriers.flush(command_buffer);
+    }
+
+    /**
+     * Records copying an image written by compute shaders, in the general layout, into the buffer, and making it
+     * visible to the host.
+     */
+    void copy(VkCommandBuffer command_buffer, VkImage image, VkExtent2D extent) {
+        barriers.memory_barrier(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR);
+        barriers.flush(command_buffer);
+        VkBufferImageCopy region;
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_GENERAL, buffer, 1, &region);
+        barriers.memory_barrier(VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+                                VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR);
+        barriers.flush(command_buffer);
+    }
+
+    /**
+     * @return The data at an offset, once the copy has completed.
+     */
+    template<typename T>
+    const T *data(VkDeviceSize offset = 0) const {
+        return reinterpret_cast<const T *>(static_cast<const std::byte *>(allocation.mapped) + offset);
+    }
+
+private:
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+    BarrierBatch barriers;
+};
+
+/**
+ * A device local image of 32 bit float RGBA pixels, with a view.
+ */
+class Image {
+public:
+    Image(const LogicalDevice &device, MemoryPool &pool, VkExtent2D extent, VkImageUsageFlags usage)
+            : device(device), pool(pool) {
+        VkImageCreateInfo image_create_info;
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.pNext = nullptr;
+        image_create_info.flags = 0;
+        image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        image_create_info.format = FORMAT;
+        image_create_info.extent = {extent.width, extent.height, 1};
+        image_create_info.mipLevels = 1;
+        image_create_info.arrayLayers = 1;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = usage;
+        image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_create_info.queueFamilyIndexCount = 0;
+        image_create_info.pQueueFamilyIndices = nullptr;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        check_device_result(vkCreateImage(device.device, &image_create_info, nullptr, &image),
+                            "Unable to create test image");
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device.device, image, &requirements);
+        allocation = pool.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        check_device_result(vkBindImageMemory(device.device, image, allocation.memory, allocation.offset),
+                            "Unable to bind test image memory");
+
+        VkImageViewCreateInfo view_create_info;
+        view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_create_info.pNext = nullptr;
+        view_create_info.flags = 0;
+        view_create_info.image = image;
+        view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_create_info.format = FORMAT;
+        view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                                       VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+        view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        check_device_result(vkCreateImageView(device.device, &view_create_info, nullptr, &view),
+                            "Unable to create test image view");
+    }
+
+    Image(const Image &) = delete;
+
+    Image &operator=(const Image &) = delete;
+
+    ~Image() {
+        vkDestroyImageView(device.device, view, nullptr);
+        vkDestroyImage(device.device, image, nullptr);
+        pool.free(allocation);
+    }
+
+    static constexpr VkFormat FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+
+    const LogicalDevice &device;
+    MemoryPool &pool;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+};
+
+static uint32_t pcg_hash(uint32_t value) {
+    const uint32_t state = value * 747796405u + 2891336453u;
+    const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+/**
+ * Emits particles, updates them until they have all died, and checks after each update that every slot is either
+ * on the dead list or drawn exactly once, and that the draw order is sorted.
+ */
+static void check_particles(const LogicalDevice &device, const DeviceQueueFamily &family, MemoryPool &pool,
+                            StagingUploader &uploader, ImmediateCommands &commands,
+                            const std::filesystem::path &shader_directory) {
+    const Kernel emit(device, shader_directory, "particle_emit");
+    const Kernel prepare(device, shader_directory, "particle_prepare");
+    const Kernel simulate(device, shader_directory, "particle_simulate");
+    const Kernel sort(device, shader_directory, "particle_sort");
+    const ParticleShaders shaders = {emit.module, prepare.module, simulate.module, sort.module};
+
+    constexpr uint32_t CAPACITY = 1000;
+    ParticleSystem particles(device, family, pool, uploader, shaders, CAPACITY);
+    uploader.flush();
+
+    const auto counters = particles.counters();
+    const auto draw_order = particles.draw_order();
+    Readback readback(device, pool, counters.range + draw_order.range);
+
+    // The reference kernels give particles lifetimes from one to three seconds.
+    constexpr uint32_t UNKNOWN = UINT32_MAX;
+    struct Step {
+        uint32_t emit_count;
+        float delta_time;
+        bool sort;
+        uint32_t alive;
+    };
+    const Step steps[] = {
+            {300, 0.016f, true, 300},
+            // Only 700 slots are free.
+            {900, 0.016f, true, CAPACITY},
+            {0, 0.5f, false, CAPACITY},
+            {40, 0.5f, true, UNKNOWN},
+            {40, 0.5f, true, UNKNOWN},
+            {40, 0.5f, true, UNKNOWN},
+            {0, 3.0f, true, 0},
+    };
+
+    for (std::size_t i = 0; i < std::size(steps); i++) {
+        const auto &step = steps[i];
+        ParticleFrame frame;
+        frame.delta_time = step.delta_time;
+        frame.emit_count = step.emit_count;
+        frame.camera_position[0] = static_cast<float>(i);
+        frame.camera_position[1] = 2.0f;
+        frame.camera_position[2] = -5.0f;
+        frame.sort = step.sort;
+        commands.run([&](VkCommandBuffer command_buffer) {
+            particles.update(command_buffer, frame);
+            readback.copy(command_buffer, {counters, draw_order});
+        });
+
+        const auto name = "After particle update " + std::to_string(i) + ", ";
+        const auto &result = *readback.data<ParticleCounters>();
+        const auto alive = result.draw.instanceCount;
+        check(result.draw.vertexCount == 6 && result.draw.firstVertex == 0 && result.draw.firstInstance == 0,
+              name + "the indirect draw was overwritten");
+        check(result.dead_count + alive == CAPACITY, name + std::to_string(result.dead_count) + " slots are dead and "
+                                                     + std::to_string(alive) + " alive, out of "
+                                                     + std::to_string(CAPACITY));
+        check(step.alive == UNKNOWN || alive == step.alive,
+              name + std::to_string(alive) + " particles are alive rather than " + std::to_string(step.alive));
+        if (alive > CAPACITY) {
+            continue;
+        }
+
+        // uvec2(sort key, particle index) per survivor.
+        const auto *entries = readback.data<uint32_t>(counters.range);
+        std::set<uint32_t> drawn;
+        bool sorted = true;
+        for (uint32_t entry = 0; entry < alive; entry++) {
+            drawn.insert(entries[2 * entry + 1]);
+            sorted = sorted && (entry == 0 || entries[2 * entry - 2] <= entries[2 * entry]);
+        }
+        check(drawn.size() == alive && (drawn.empty() || *drawn.rbegin() < CAPACITY),
+              name + "the draw order does not hold each survivor once");
+        check(!step.sort || sorted, name + "the draw order is not sorted back to front");
+    }
+}
+
+/**
+ * @return A mesh whose vertices each have four different joints, weighted unevenly.
+ */
+static std::vector<SkinnedVertex> make_skinned_mesh(uint32_t vertex_count, uint32_t joint_count) {
+    std::vector<SkinnedVertex> vertices(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        const auto t = static_cast<float>(i);
+        auto &vertex = vertices[i];
+        vertex.position[0] = std::sin(t);
+        vertex.position[1] = std::cos(0.7f * t);
+        vertex.position[2] = 0.01f * t;
+        vertex.normal[0] = std::cos(t);
+        vertex.normal[1] = std::sin(t);
+        vertex.normal[2] = 0.5f;
+        vertex.uv[0] = t / static_cast<float>(vertex_count);
+        vertex.uv[1] = 0.5f;
+        vertex.joints = 0;
+        for (uint32_t joint = 0; joint < 4; joint++) {
+            vertex.joints |= (i + joint) % joint_count << (8 * joint);
+        }
+        vertex.weights = 128 | 64 << 8 | 48 << 16 | 15 << 24;
+    }
+    return vertices;
+}
+
+/**
+ * @return A rotation about z followed by a translation.
+ */
+static JointTransform joint_transform(float angle, float x, float y, float z) {
+    return {{{std::cos(angle), -std::sin(angle), 0.0f, x},
+             {std::sin(angle), std::cos(angle), 0.0f, y},
+             {0.0f, 0.0f, 1.0f, z}}};
+}
+
+/**
+ * Skins a vertex on the CPU, as the skinning shader promises to.
+ */
+static SkinnedOutputVertex skin(const SkinnedVertex &vertex, std::span<const JointTransform> joints) {
+    float rows[3][4] = {};
+    for (uint32_t i = 0; i < 4; i++) {
+        const auto weight = static_cast<float>(vertex.weights >> (8 * i) & 0xFF) / 255.0f;
+        const auto &joint = joints[vertex.joints >> (8 * i) & 0xFF];
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 4; column++) {
+                rows[row][column] += weight * joint.rows[row][column];
+            }
+        }
+    }
+
+    SkinnedOutputVertex result;
+    float length = 0.0f;
+    for (int row = 0; row < 3; row++) {
+        result.position[row] = rows[row][3];
+        result.normal[row] = 0.0f;
+        for (int column = 0; column < 3; column++) {
+            result.position[row] += rows[row][column] * vertex.position[column];
+            result.normal[row] += rows[row][column] * vertex.normal[column];
+        }
+        length += result.normal[row] * result.normal[row];
+    }
+    for (auto &component: result.normal) {
+        component /= std::sqrt(length);
+    }
+    result.uv[0] = vertex.uv[0];
+    result.uv[1] = vertex.uv[1];
+    return result;
+}
+
+static bool nearly_equal(const SkinnedOutputVertex &a, const SkinnedOutputVertex &b) {
+    constexpr float TOLERANCE = 1e-4f;
+    for (int i = 0; i < 3; i++) {
+        if (std::abs(a.position[i] - b.position[i]) > TOLERANCE || std::abs(a.normal[i] - b.normal[i]) > TOLERANCE) {
+            return false;
+        }
+    }
+    return std::abs(a.uv[0] - b.uv[0]) <= TOLERANCE && std::abs(a.uv[1] - b.uv[1]) <= TOLERANCE;
+}
+
+/**
+ * Tunes the workgroup width of the skinning kernel from the candidates of the device's tuning profile, and checks the
+ * result is one of them and is persisted, so a second tuner reuses it without benchmarking.
+ * @return The tuned workgroup width.
+ */
+static uint32_t tune_skinning(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader,
+                              const std::filesystem::path &shader_directory) {
+    const Kernel shader(device, shader_directory, "skinning");
+    ComputeSkinningLimits limits;
+    limits.source_vertices = 4096;
+    limits.output_vertices = 4 * 4096;
+    limits.instances_per_update = 4;
+    limits.joints_per_update = 16;
+    ComputeSkinning skinning(device, pool, shader.module, limits, device.tuning.frames_in_flight);
+
+    const auto mesh = make_skinned_mesh(4096, 4);
+    skinning.add_mesh(uploader, mesh, 4);
+    uploader.flush();
+    const std::vector<JointTransform> joints = {
+            joint_transform(0.3f, 1.0f, 0.0f, 0.0f), joint_transform(-1.2f, 0.0f, 2.0f, 0.0f),
+            joint_transform(2.0f, 0.0f, 0.0f, -1.0f), joint_transform(0.0f, 0.5f, 0.5f, 0.5f)};
+    std::vector<SkinningPose> poses;
+    for (uint32_t instance = 0; instance < limits.instances_per_update; instance++) {
+        poses.push_back({skinning.add_instance(0), joints});
+    }
+
+    const auto &profile = device.tuning;
+    const auto candidates = WorkgroupTuner::seeded_workgroup_sizes(profile, 1);
+    check(candidates.front().width == profile.workgroup_size_1d, "The tuning profile does not seed the candidates");
+
+    const auto results_path = std::filesystem::temp_directory_path() / "compute_kernel_tests_workgroups.txt";
+    std::filesystem::remove(results_path);
+    WorkgroupTuner tuner(device, results_path);
+    tuner.register_kernel(skinning.tunable_kernel(shader.module, poses, candidates));
+    const auto tuned = tuner.configuration("skinning");
+    check(std::ranges::any_of(candidates, [&](const VkExtent2D &candidate) {
+        return candidate.width == tuned.workgroup_size.width && candidate.height == tuned.workgroup_size.height;
+    }), "The skinning kernel was tuned to a workgroup size that is not a candidate");
+
+    // A second tuner must load the result rather than measure again.
+    WorkgroupTuner reloaded(device, results_path);
+    auto kernel = skinning.tunable_kernel(shader.module, poses, candidates);
+    bool benchmarked = false;
+    kernel.dispatch = [&](VkCommandBuffer, const KernelConfiguration &) {
+        benchmarked = true;
+    };
+    reloaded.register_kernel(std::move(kernel));
+    const auto loaded = reloaded.configuration("skinning");
+    check(!benchmarked && loaded.workgroup_size.width == tuned.workgroup_size.width,
+          "The tuned skinning workgroup size is not reused from the results file");
+    std::filesystem::remove(results_path);
+
+    std::cout << "Skinning tuned to workgroups of " << tuned.workgroup_size.width << " from the " << profile.name
+              << " profile's " << profile.workgroup_size_1d << std::endl;
+    return tuned.workgroup_size.width;
+}
+
+/**
+ * Skins instances of two meshes and checks their vertices against skinning on the CPU, then poses one instance alone
+ * and checks the others keep their vertices.
+ */
+static void check_skinning(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader,
+                           ImmediateCommands &commands, const std::filesystem::path &shader_directory,
+                           uint32_t workgroup_size) {
+    const Kernel shader(device, shader_directory, "skinning");
+    ComputeSkinningLimits limits;
+    limits.source_vertices = 256;
+    limits.output_vertices = 512;
+    limits.instances_per_update = 4;
+    limits.joints_per_update = 16;
+    ComputeSkinning skinning(device, pool, shader.module, limits, device.tuning.frames_in_flight, workgroup_size);
+
+    // The first mesh spans several workgroups.
+    const uint32_t joint_counts[] = {4, 2};
+    const std::vector<SkinnedVertex> meshes[] = {make_skinned_mesh(150, joint_counts[0]),
+                                                 make_skinned_mesh(70, joint_counts[1])};
+    for (uint32_t mesh = 0; mesh < std::size(meshes); mesh++) {
+        skinning.add_mesh(uploader, meshes[mesh], joint_counts[mesh]);
+    }
+    uploader.flush();
+    const uint32_t instance_meshes[] = {0, 1, 0};
+    for (auto mesh: instance_meshes) {
+        skinning.add_instance(mesh);
+    }
+
+    const VkDeviceSize vertex_count = 2 * meshes[0].size() + meshes[1].size();
+    Readback readback(device, pool, vertex_count * sizeof(SkinnedOutputVertex));
+    std::vector<JointTransform> joints[] = {
+            {joint_transform(0.3f, 1.0f, 0.0f, 0.0f), joint_transform(-1.2f, 0.0f, 2.0f, 0.0f),
+             joint_transform(2.0f, 0.0f, 0.0f, -1.0f), joint_transform(0.0f, 0.5f, 0.5f, 0.5f)},
+            {joint_transform(1.0f, -1.0f, 0.0f, 3.0f), joint_transform(0.1f, 0.0f, 0.0f, 0.0f)},
+            {joint_transform(3.0f, 0.0f, 1.0f, 0.0f), joint_transform(-0.4f, 2.0f, 0.0f, 0.0f),
+             joint_transform(0.7f, 0.0f, 0.0f, 0.0f), joint_transform(-2.5f, -1.0f, -1.0f, 1.0f)},
+    };
+
+    const auto check_instances = [&](const std::string &name) {
+        const auto *vertices = readback.data<SkinnedOutputVertex>();
+        for (uint32_t instance = 0; instance < std::size(instance_meshes); instance++) {
+            const auto &mesh = meshes[instance_meshes[instance]];
+            uint32_t wrong = 0;
+            for (uint32_t vertex = 0; vertex < mesh.size(); vertex++) {
+                const auto expected = skin(mesh[vertex], joints[instance]);
+                wrong += !nearly_equal(vertices[skinning.first_vertex(instance) + vertex], expected);
+            }
+            check(wrong == 0, name + std::to_string(wrong) + " vertices of skinned instance "
+                              + std::to_string(instance) + " differ from skinning on the CPU");
+        }
+    };
+
+    const auto update = [&](std::span<const SkinningPose> poses) {
+        commands.run([&](VkCommandBuffer command_buffer) {
+            skinning.update(command_buffer, 0, poses);
+            readback.copy(command_buffer, {{skinning.vertex_buffer(), 0,
+                                            vertex_count * sizeof(SkinnedOutputVertex)}});
+        });
+    };
+
+    const SkinningPose poses[] = {{0, joints[0]}, {1, joints[1]}, {2, joints[2]}};
+    update(poses);
+    check_instances("After posing every instance, ");
+
+    joints[1][0] = joint_transform(-0.8f, 0.0f, -2.0f, 1.0f);
+    const SkinningPose pose = {1, joints[1]};
+    update({&pose, 1});
+    check_instances("After posing one instance, ");
+}
+
+using Pixel = std::array<float, 4>;
+
+struct ReferenceImage {
+    VkExtent2D extent;
+    std::vector<Pixel> pixels;
+};
+
+/**
+ * Applies a sequence of per pixel effects to a pixel of an image of the extent, as the post-processing kernel does.
+ */
+static Pixel apply_effects(uint32_t sequence, Pixel color, uint32_t x, uint32_t y, VkExtent2D extent,
+                           const PostProcessSettings &settings) {
+    for (; sequence != 0; sequence >>= 4) {
+        switch (static_cast<PostEffect>((sequence & 0xF) - 1)) {
+            case PostEffect::Tonemap:
+                for (int i = 0; i < 3; i++) {
+                    color[i] = color[i] * settings.exposure / (1.0f + color[i] * settings.exposure);
+                }
+                break;
+            case PostEffect::ColorGrade: {
+                const Pixel rgb = {color[0], color[1], color[2], 1.0f};
+                for (int row = 0; row < 3; row++) {
+                    color[row] = 0.0f;
+                    for (int column = 0; column < 4; column++) {
+                        color[row] += settings.color_matrix[row][column] * rgb[column];
+                    }
+                }
+                break;
+            }
+            case PostEffect::Vignette: {
+                const auto offset_x = (static_cast<float>(x) + 0.5f) / static_cast<float>(extent.width) - 0.5f;
+                const auto offset_y = (static_cast<float>(y) + 0.5f) / static_cast<float>(extent.height) - 0.5f;
+                const auto factor = 1.0f - settings.vignette_strength * 2.0f * (offset_x * offset_x
+                                                                                + offset_y * offset_y);
+                for (int i = 0; i < 3; i++) {
+                    color[i] *= factor;
+                }
+                break;
+            }
+            case PostEffect::FilmGrain: {
+                const auto hash = pcg_hash(x + pcg_hash(y + pcg_hash(settings.seed)));
+                const auto grain = settings.grain_intensity
+                                   * (static_cast<float>(hash >> 8) / 16777216.0f - 0.5f);
+                for (int i = 0; i < 3; i++) {
+                    color[i] += grain;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return color;
+}
+
+/**
+ * Runs a pass of the post-processing kernel on the CPU, in full precision.
+ */
+static ReferenceImage reference_pass(const FusedPostPass &pass, const ReferenceImage &input,
+                                     const PostProcessSettings &settings) {
+    const auto scale = pass.scale();
+    ReferenceImage output;
+    output.extent = {(input.extent.width + scale - 1) / scale, (input.extent.height + scale - 1) / scale};
+    const auto read = [&](int64_t x, int64_t y) {
+        const auto clamped_x = static_cast<uint32_t>(std::clamp<int64_t>(x, 0, input.extent.width - 1));
+        const auto clamped_y = static_cast<uint32_t>(std::clamp<int64_t>(y, 0, input.extent.height - 1));
+        return apply_effects(pass.prefix, input.pixels[clamped_y * input.extent.width + clamped_x], clamped_x,
+                             clamped_y, input.extent, settings);
+    };
+
+    for (uint32_t y = 0; y < output.extent.height; y++) {
+        for (uint32_t x = 0; x < output.extent.width; x++) {
+            Pixel color = {};
+            if (!pass.filter) {
+                color = read(x, y);
+            } else if (pass.filter == PostEffect::Sharpen) {
+                const auto center = read(x, y);
+                const Pixel neighbours[] = {read(x + 1, y), read(int64_t(x) - 1, y), read(x, y + 1),
+                                            read(x, int64_t(y) - 1)};
+                for (int i = 0; i < 4; i++) {
+                    auto edges = 4.0f * center[i];
+                    for (auto &neighbour: neighbours) {
+                        edges -= neighbour[i];
+                    }
+                    color[i] = center[i] + settings.sharpen_amount * edges;
+                }
+            } else if (pass.filter == PostEffect::Blur) {
+                const auto radius = static_cast<int64_t>(pass.radius);
+                float total = 0.0f;
+                for (auto dy = -radius; dy <= radius; dy++) {
+                    for (auto dx = -radius; dx <= radius; dx++) {
+                        const auto weight = std::exp(-static_cast<float>(dx * dx + dy * dy)
+                                                     / (2.0f * settings.blur_sigma * settings.blur_sigma));
+                        const auto pixel = read(x + dx, y + dy);
+                        for (int i = 0; i < 4; i++) {
+                            color[i] += weight * pixel[i];
+                        }
+                        total += weight;
+                    }
+                }
+                for (auto &component: color) {
+                    component /= total;
+                }
+            } else {
+                constexpr float WEIGHTS[] = {0.125f, 0.375f, 0.375f, 0.125f};
+                for (int64_t dy = 0; dy < 4; dy++) {
+                    for (int64_t dx = 0; dx < 4; dx++) {
+                        const auto pixel = read(2 * int64_t(x) + dx - 1, 2 * int64_t(y) + dy - 1);
+                        for (int i = 0; i < 4; i++) {
+                            color[i] += WEIGHTS[dx] * WEIGHTS[dy] * pixel[i];
+                        }
+                    }
+                }
+            }
+            output.pixels.push_back(apply_effects(pass.suffix, color, x, y, output.extent, settings));
+        }
+    }
+    return output;
+}
+
+/**
+ * Runs chains of effects and checks their output against running the same passes on the CPU. The GPU rounds to half
+ * precision in shared memory and between passes, which the tolerance allows for.
+ */
+static void check_post_process(const LogicalDevice &device, MemoryPool &pool, StagingUploader &uploader,
+                               ImmediateCommands &commands, const std::filesystem::path &shader_directory) {
+    const Kernel kernel(device, shader_directory, "post_process");
+    ObjectCache objects(device);
+
+    // Not a multiple of the tile size, so edge tiles are partly outside the image.
+    constexpr VkExtent2D EXTENT = {40, 24};
+    ReferenceImage input_pixels = {EXTENT, std::vector<Pixel>(EXTENT.width * EXTENT.height)};
+    for (uint32_t i = 0; i < input_pixels.pixels.size(); i++) {
+        for (uint32_t component = 0; component < 4; component++) {
+            const auto random = static_cast<float>(pcg_hash(4 * i + component) >> 8) / 16777216.0f;
+            input_pixels.pixels[i][component] = component == 3 ? random : 3.0f * random;
+        }
+    }
+    Image input(device, pool, EXTENT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    uploader.upload(input.image, {EXTENT.width, EXTENT.height, 1}, VK_IMAGE_ASPECT_COLOR_BIT,
+                    std::as_bytes(std::span(input_pixels.pixels)), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uploader.flush();
+
+    PostProcessSettings settings;
+    settings.exposure = 1.3f;
+    const float color_matrix[3][4] = {{0.9f, 0.1f, 0.0f, 0.02f}, {0.05f, 0.9f, 0.05f, 0.0f},
+                                      {0.0f, 0.2f, 0.8f, -0.01f}};
+    std::memcpy(settings.color_matrix, color_matrix, sizeof(color_matrix));
+    settings.vignette_strength = 0.4f;
+    settings.seed = 17;
+
+    struct Chain {
+        std::vector<PostEffect> effects;
+        std::size_t passes;
+    };
+    const Chain chains[] = {
+            {{PostEffect::Tonemap, PostEffect::ColorGrade, PostEffect::Vignette, PostEffect::FilmGrain}, 1},
+            {{PostEffect::Tonemap, PostEffect::Sharpen, PostEffect::Vignette, PostEffect::Blur, PostEffect::Downsample,
+              PostEffect::ColorGrade, PostEffect::FilmGrain}, 3},
+    };
+    for (std::size_t i = 0; i < std::size(chains); i++) {
+        PostProcessChainDescription description;
+        description.effects = chains[i].effects;
+        description.extent = EXTENT;
+        PostProcessChain chain(device, pool, objects, kernel.module, description, device.tuning.frames_in_flight);
+        const auto name = "Post-processing chain " + std::to_string(i);
+        check(chain.passes().size() == chains[i].passes,
+              name + " has " + std::to_string(chain.passes().size()) + " passes rather than "
+              + std::to_string(chains[i].passes));
+
+        const auto extent = chain.output_extent();
+        Image output(device, pool, extent, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        Readback readback(device, pool, VkDeviceSize(extent.width) * extent.height * sizeof(Pixel));
+        BarrierBatch barriers(device);
+        commands.run([&](VkCommandBuffer command_buffer) {
+            barriers.image_barrier(output.image, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}, VK_IMAGE_LAYOUT_UNDEFINED,
+                                   VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR,
+                                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+            barriers.flush(command_buffer);
+            chain.record(command_buffer, 0, input.view, output.view, settings);
+            readback.copy(command_buffer, output.image, extent);
+        });
+
+        auto expected = input_pixels;
+        for (auto &pass: chain.passes()) {
+            expected = reference_pass(pass, expected, settings);
+        }
+        const auto *pixels = readback.data<Pixel>();
+        uint32_t wrong = 0;
+        for (uint32_t pixel = 0; pixel < expected.pixels.size(); pixel++) {
+            for (uint32_t component = 0; component < 4; component++) {
+                const auto value = expected.pixels[pixel][component];
+                wrong += std::abs(pixels[pixel][component] - value) > 1e-2f * (1.0f + std::abs(value));
+            }
+        }
+        check(wrong == 0, name + " differs from the reference in " + std::to_string(wrong) + " components");
+    }
+}
+
+/**
+ * Samples an image bilinearly at a uv, clamping to the edge, as a linear sampler does.
+ */
+static Pixel sample_bilinear(const ReferenceImage &image, float u, float v) {
+    const auto x = u * static_cast<float>(image.extent.width) - 0.5f;
+    const auto y = v * static_cast<float>(image.extent.height) - 0.5f;
+    const auto x0 = std::floor(x);
+    const auto y0 = std::floor(y);
+    const auto texel = [&](float texel_x, float texel_y) {
+        const auto clamped_x = std::clamp<int64_t>(static_cast<int64_t>(texel_x), 0, image.extent.width - 1);
+        const auto clamped_y = std::clamp<int64_t>(static_cast<int64_t>(texel_y), 0, image.extent.height - 1);
+        return image.pixels[clamped_y * image.extent.width + clamped_x];
+    };
+
+    const auto fraction_x = x - x0;
+    const auto fraction_y = y - y0;
+    const Pixel corners[] = {texel(x0, y0), texel(x0 + 1, y0), texel(x0, y0 + 1), texel(x0 + 1, y0 + 1)};
+    Pixel result;
+    for (int i = 0; i < 4; i++) {
+        const auto top = corners[0][i] + fraction_x * (corners[1][i] - corners[0][i]);
+        const auto bottom = corners[2][i] + fraction_x * (corners[3][i] - corners[2][i]);
+        result[i] = top + fraction_y * (bottom - top);
+    }
+    return result;
+}
+
+/**
+ * Upscales a frame rendered at half resolution into native size, with the texels beyond the rendered region far
+ * brighter than any rendered, and checks the output against upscaling on the CPU. Any of those texels bleeding in
+ * would stand out.
+ */
+static void check_upscale(const LogicalDevice &device, const DeviceQueueFamily &family, MemoryPool &pool,
+                          StagingUploader &uploader, ImmediateCommands &commands,
+                          const std::filesystem::path &shader_directory) {
+    const Kernel kernel(device, shader_directory, "upscale");
+    ObjectCache objects(device);
+
+    // Not a multiple of the tile size, so edge tiles are partly outside the image.
+    constexpr VkExtent2D NATIVE = {56, 36};
+    constexpr VkExtent2D RENDERED = {28, 18};
+    constexpr float LEFT_OVER = 1000.0f;
+    ReferenceImage input_pixels = {NATIVE, std::vector<Pixel>(NATIVE.width * NATIVE.height)};
+    for (uint32_t y = 0; y < NATIVE.height; y++) {
+        for (uint32_t x = 0; x < NATIVE.width; x++) {
+            const auto i = y * NATIVE.width + x;
+            for (uint32_t component = 0; component < 4; component++) {
+                const auto random = static_cast<float>(pcg_hash(4 * i + component) >> 8) / 16777216.0f;
+                input_pixels.pixels[i][component] = x < RENDERED.width && y < RENDERED.height ? random : LEFT_OVER;
+            }
+        }
+    }
+    Image input(device, pool, NATIVE, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    uploader.upload(input.image, {NATIVE.width, NATIVE.height, 1}, VK_IMAGE_ASPECT_COLOR_BIT,
+                    std::as_bytes(std::span(input_pixels.pixels)), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    uploader.flush();
+
+    DynamicResolutionSettings settings;
+    settings.min_scale = 0.5f;
+    settings.max_scale = 0.5f;
+    DynamicResolution resolution(device, family, NATIVE, settings, device.tuning.frames_in_flight);
+    SpatialUpscaler upscaler(device, objects, kernel.module, device.tuning.frames_in_flight);
+    constexpr float SHARPNESS = 0.5f;
+
+    Image output(device, pool, NATIVE, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    Readback readback(device, pool, VkDeviceSize(NATIVE.width) * NATIVE.height * sizeof(Pixel));
+    BarrierBatch barriers(device);
+    commands.run([&](VkCommandBuffer command_buffer) {
+        resolution.begin_frame(command_buffer, 0);
+        barriers.image_barrier(output.image, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}, VK_IMAGE_LAYOUT_UNDEFINED,
+                               VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR,
+                               VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR);
+        barriers.flush(command_buffer);
+        upscaler.record(command_buffer, 0, resolution, input.view, output.view, SHARPNESS);
+        readback.copy(command_buffer, output.image, NATIVE);
+        resolution.end_frame(command_buffer, 0);
+    });
+    const auto extent = resolution.render_extent();
+    check(extent.width == RENDERED.width && extent.height == RENDERED.height,
+          "The frame rendered at " + std::to_string(extent.width) + "x" + std::to_string(extent.height)
+          + " rather than " + std::to_string(RENDERED.width) + "x" + std::to_string(RENDERED.height));
+
+    const auto uv_limit_u = (static_cast<float>(RENDERED.width) - 0.5f) / static_cast<float>(NATIVE.width);
+    const auto uv_limit_v = (static_cast<float>(RENDERED.height) - 0.5f) / static_cast<float>(NATIVE.height);
+    const auto tap = [&](float u, float v) {
+        return sample_bilinear(input_pixels, std::min(u, uv_limit_u), std::min(v, uv_limit_v));
+    };
+
+    const auto *pixels = readback.data<Pixel>();
+    uint32_t wrong = 0;
+    uint32_t bled = 0;
+    for (uint32_t y = 0; y < NATIVE.height; y++) {
+        for (uint32_t x = 0; x < NATIVE.width; x++) {
+            const auto u = (static_cast<float>(x) + 0.5f) / static_cast<float>(NATIVE.width)
+                           * static_cast<float>(RENDERED.width) / static_cast<float>(NATIVE.width);
+            const auto v = (static_cast<float>(y) + 0.5f) / static_cast<float>(NATIVE.height)
+                           * static_cast<float>(RENDERED.height) / static_cast<float>(NATIVE.height);
+            const auto texel_u = 1.0f / static_cast<float>(NATIVE.width);
+            const auto texel_v = 1.0f / static_cast<float>(NATIVE.height);
+            const auto center = tap(u, v);
+            const Pixel neighbours[] = {tap(u - texel_u, v), tap(u + texel_u, v), tap(u, v - texel_v),
+                                        tap(u, v + texel_v)};
+
+            const auto &pixel = pixels[y * NATIVE.width + x];
+            for (int i = 0; i < 4; i++) {
+                auto lowest = center[i];
+                auto highest = center[i];
+                auto edges = 4.0f * center[i];
+                for (auto &neighbour: neighbours) {
+                    lowest = std::min(lowest, neighbour[i]);
+                    highest = std::max(highest, neighbour[i]);
+                    edges -= neighbour[i];
+                }
+                const auto expected = std::clamp(center[i] + SHARPNESS * 0.25f * edges, lowest, highest);
+                wrong += std::abs(pixel[i] - expected) > 1e-2f * (1.0f + std::abs(expected));
+                bled += pixel[i] > 1.0f;
+            }
+        }
+    }
+    check(bled == 0, "Texels beyond the rendered region bleed into " + std::to_string(bled) + " components");
+    check(wrong == 0, "The upscale differs from the reference in " + std::to_string(wrong) + " components");
+}
+
+static void run(const std::filesystem::path &shader_directory) {
+    auto availability = probe_instance_availability();
+    auto instance = initialise_vulkan(availability, {}, {});
+    load_vulkan_functions(instance);
+    const auto capabilities = probe_physical_device_capabilities(get_physical_devices(instance));
+
+    auto device = DeviceBuilder()
+            .require_feature(&VkPhysicalDeviceVulkan12Features::bufferDeviceAddress)
+            .require_feature(&VkPhysicalDeviceVulkan12Features::scalarBlockLayout)
+            .require_feature(&VkPhysicalDeviceFeatures::shaderStorageImageWriteWithoutFormat)
+            .build(capabilities);
+    std::cout << "Reference kernels on " << device.capabilities->properties.deviceName << ":" << std::endl;
+    {
+        // The systems barrier against graphics stages, so they run on a graphics queue.
+        const auto *family = device.find_queue_family(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+        if (family == nullptr) {
+            throw std::runtime_error("The device has no queue family with graphics and compute support");
+        }
+        MemoryPool pool(device);
+        StagingUploader uploader(device, pool);
+        ImmediateCommands commands(device, *family);
+        check_particles(device, *family, pool, uploader, commands, shader_directory);
+        check_skinning(device, pool, uploader, commands, shader_directory,
+                       tune_skinning(device, pool, uploader, shader_directory));
+        check_post_process(device, pool, uploader, commands, shader_directory);
+        check_upscale(device, *family, pool, uploader, commands, shader_directory);
+    }
+    destroy_logical_device(device);
+    vkDestroyInstance(instance, nullptr);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: compute_kernel_tests <shader directory>" << std::endl;
+        return 2;
+    }
+
+#if GLFW_VERSION_MAJOR > 3 || GLFW_VERSION_MINOR >= 4
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (glfwInit() != GLFW_TRUE || !glfwVulkanSupported()) {
+        std::cerr << "GLFW or the vulkan loader is unavailable, skipping" << std::endl;
+        return SKIPPED;
+    }
+
+    try {
+        run(argv[1]);
+    } catch (const std::exception &exception) {
+        check(false, exception.what());
+    }
+    glfwTerminate();
+
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
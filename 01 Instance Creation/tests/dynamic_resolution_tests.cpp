@@ -0,0 +1,109 @@
+/*
+ * Runs the ResolutionController against a synthetic GPU whose frame time is proportional to the area rendered,
+ * checking that it settles on the target without overshooting much, and that it recovers straight away from being
+ * pinned at a limit.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "dynamic_resolution.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * A GPU taking a fixed time per pixel.
+ */
+struct SyntheticPlant {
+    /// The GPU time of a frame at full scale, in nanoseconds.
+    double native_time_ns;
+
+    double frame_time(float scale) const { return native_time_ns * scale * scale; }
+};
+
+static constexpr double TARGET_NS = 14.0e6;
+
+/**
+ * Runs frames through the controller.
+ * @return The GPU time of the last frame, relative to the target.
+ */
+static double run_frames(ResolutionController &controller, const SyntheticPlant &plant, int frames) {
+    double relative = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        relative = plant.frame_time(controller.scale()) / TARGET_NS;
+        controller.update(plant.frame_time(controller.scale()));
+    }
+    return relative;
+}
+
+/**
+ * Checks that the controller settles within 1% of the target, and stays there.
+ * @param native_cost The GPU time at full scale, relative to the target.
+ */
+static void check_settles(double native_cost) {
+    DynamicResolutionSettings settings;
+    settings.target_frame_time_ms = TARGET_NS / 1e6;
+    ResolutionController controller(settings);
+    const SyntheticPlant plant{native_cost * TARGET_NS};
+
+    double worst = 0.0;
+    for (int frame = 0; frame < 120; frame++) {
+        const auto relative = plant.frame_time(controller.scale()) / TARGET_NS;
+        if (frame >= 30) {
+            worst = std::max(worst, std::abs(relative - 1.0));
+        }
+        controller.update(plant.frame_time(controller.scale()));
+    }
+    const auto name = "at " + std::to_string(native_cost) + "x the target";
+    const auto expected_scale = static_cast<float>(std::sqrt(1.0 / native_cost));
+    check(worst < 0.01, name + ", the frame time is still " + std::to_string(worst * 100) + "% off after 30 frames");
+    check(std::abs(controller.scale() - expected_scale) < 0.005f,
+          name + ", the scale settles at " + std::to_string(controller.scale()) + " rather than "
+          + std::to_string(expected_scale));
+}
+
+/**
+ * Pins the controller at the lowest scale for a long time, then lightens the load.
+ */
+static void check_recovers_from_limit() {
+    DynamicResolutionSettings settings;
+    settings.target_frame_time_ms = TARGET_NS / 1e6;
+    ResolutionController controller(settings);
+
+    // Even the lowest scale takes 1.5x the target.
+    run_frames(controller, {6.0 * TARGET_NS}, 500);
+    check(controller.scale() == settings.min_scale, "an overloaded GPU does not pin the scale at its minimum");
+
+    const auto error = std::abs(run_frames(controller, {2.0 * TARGET_NS}, 30) - 1.0);
+    check(error < 0.01, "after being pinned at the minimum, the frame time is still " + std::to_string(error * 100)
+                        + "% off 30 frames after the load drops");
+
+    // An idle GPU pins it at the highest.
+    run_frames(controller, {0.25 * TARGET_NS}, 500);
+    check(controller.scale() == settings.max_scale, "an idle GPU does not pin the scale at its maximum");
+}
+
+int main() {
+    std::cout << "Dynamic resolution against a synthetic GPU:" << std::endl;
+    try {
+        for (auto native_cost: {1.2, 1.5, 2.0, 3.0}) {
+            check_settles(native_cost);
+        }
+        check_recovers_from_limit();
+    } catch (const std::exception &exception) {
+        check(false, exception.what());
+    }
+
+    std::cout << (failures == 0 ? "All checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
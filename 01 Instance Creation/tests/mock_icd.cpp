@@ -0,0 +1,785 @@
+/*
+ * A vulkan driver faking the physical devices described by MockIcdConfig, so that the bootstrap can be tested without
+ * a GPU. Only the entry points used by the bootstrap and by the loader itself are implemented, and device creation
+ * validates its arguments the way the validation layers would, so that a bad queue allocation fails the tests.
+ * Sparse binding is validated the same way: binds outside a resource, memory bound to two places at once and memory
+ * freed while still bound are all reported.
+ * Graphics pipelines are empty handles, which take MockIcdConfig::pipeline_milliseconds to create as if compiled, and
+ * may be created from several threads at once.
+ * Entry points are static so that they never interpose on the loader's exports. The loader finds them through
+ * vk_icdGetInstanceProcAddr.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vk_icd.h>
+#include <vulkan/vulkan.h>
+
+#include "mock_icd_config.hpp"
+#include "vulkan_reflection_tables.hpp"
+
+/**
+ * The newest loader interface this driver implements. Version 5 lets the application ask for any api version.
+ */
+static constexpr uint32_t LOADER_INTERFACE_VERSION = 5;
+
+static constexpr VkFormatFeatureFlags TILING_FEATURES = 0x1FFFF;
+static constexpr VkFormatFeatureFlags BUFFER_FEATURES = 0x7F;
+
+// Dispatchable handles point to objects starting with the loader's dispatch table slot.
+
+struct MockPhysicalDevice {
+    VK_LOADER_DATA loader_data;
+    uint32_t index = 0;
+    VkPhysicalDeviceProperties properties = {};
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+    std::vector<VkQueueFamilyProperties> queue_families;
+    std::vector<VkExtensionProperties> extensions;
+    uint32_t pipeline_milliseconds = 0;
+};
+
+struct MockInstance {
+    VK_LOADER_DATA loader_data;
+    std::vector<std::unique_ptr<MockPhysicalDevice>> physical_devices;
+};
+
+struct MockDevice;
+
+struct MockQueue {
+    VK_LOADER_DATA loader_data;
+    MockDevice *device = nullptr;
+    VkQueueFlags flags = 0;
+};
+
+struct MockMemory {
+    VkDeviceSize size = 0;
+};
+
+/**
+ * A buffer or image.
+ */
+struct MockResource {
+    bool image = false;
+    bool sparse_residency = false;
+    /// The size of the resource's memory requirements.
+    VkDeviceSize size = 0;
+    VkExtent3D extent = {};
+    uint32_t mip_levels = 1;
+    uint32_t mip_tail_first_lod = 0;
+    VkDeviceSize mip_tail_offset = 0;
+    /// The memory and offset bound to each block, keyed by mip level plus one and tile for image tiles, and by zero
+    /// and offset for opaque binds.
+    std::map<std::pair<uint32_t, uint64_t>, std::pair<uint64_t, VkDeviceSize>> bindings;
+};
+
+struct MockDevice {
+    VK_LOADER_DATA loader_data;
+    /// The queues created, per queue family.
+    std::vector<std::vector<std::unique_ptr<MockQueue>>> queues;
+    /// Non-dispatchable objects, by handle value.
+    uint64_t next_handle = 1;
+    std::map<uint64_t, MockMemory> memory;
+    std::map<uint64_t, MockResource> resources;
+    /// Every block of memory bound to a resource, as memory handle and offset.
+    std::set<std::pair<uint64_t, VkDeviceSize>> bound_blocks;
+    uint32_t pipeline_milliseconds = 0;
+    /// Pipelines are created concurrently, so they are numbered apart from the other objects, under their own lock.
+    std::mutex pipeline_mutex;
+    uint64_t next_pipeline = uint64_t(1) << 32;
+    std::set<uint64_t> pipelines;
+};
+
+static const char *const INSTANCE_EXTENSIONS[] = {
+        VK_KHR_SURFACE_EXTENSION_NAME,
+        "VK_EXT_headless_surface",
+        "VK_KHR_xcb_surface",
+        "VK_KHR_xlib_surface",
+        "VK_KHR_wayland_surface",
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+};
+
+template<typename Handle, typename Object>
+static Handle to_handle(Object *object) {
+    return reinterpret_cast<Handle>(object);
+}
+
+template<typename Object, typename Handle>
+static Object *from_handle(Handle handle) {
+    return reinterpret_cast<Object *>(handle);
+}
+
+// Non-dispatchable handles are pointers on 64-bit platforms and integers elsewhere. The driver numbers them.
+
+template<typename Handle>
+static Handle to_non_dispatchable(uint64_t value) {
+    if constexpr (std::is_pointer_v<Handle>) {
+        return reinterpret_cast<Handle>(static_cast<uintptr_t>(value));
+    } else {
+        return static_cast<Handle>(value);
+    }
+}
+
+template<typename Handle>
+static uint64_t from_non_dispatchable(Handle handle) {
+    if constexpr (std::is_pointer_v<Handle>) {
+        return reinterpret_cast<uintptr_t>(handle);
+    } else {
+        return static_cast<uint64_t>(handle);
+    }
+}
+
+/**
+ * Reports a misuse which a void entry point cannot return, the way the validation layers would, then stops.
+ */
+[[noreturn]] static void report_misuse(const char *message) {
+    std::fprintf(stderr, "mock_icd: %s\n", message);
+    std::abort();
+}
+
+/**
+ * Implements the two call idiom of vulkan enumerations.
+ */
+template<typename T>
+static VkResult enumerate(const std::vector<T> &items, uint32_t *count, T *output) {
+    if (output == nullptr) {
+        *count = items.size();
+        return VK_SUCCESS;
+    }
+    auto copied = std::min<uint32_t>(*count, items.size());
+    std::copy_n(items.begin(), copied, output);
+    *count = copied;
+    return copied < items.size() ? VK_INCOMPLETE : VK_SUCCESS;
+}
+
+/**
+ * Enables every VkBool32 member of a feature structure.
+ */
+template<typename Struct>
+static void enable_all(Struct *features) {
+    for (auto member: vk_reflection::FeatureTraits<Struct>::members) {
+        features->*member = VK_TRUE;
+    }
+}
+
+template<typename Struct>
+static void enable_all(VkBaseOutStructure *features) {
+    enable_all(reinterpret_cast<Struct *>(features));
+}
+
+/**
+ * @return The extension a feature structure belongs to, or nullptr for core structures.
+ */
+static const char *feature_extension(VkStructureType type) {
+    switch (type) {
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR:
+            return VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME;
+        case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT:
+            return VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+        default:
+            return nullptr;
+    }
+}
+
+static VkResult VKAPI_CALL enumerate_instance_extension_properties(const char *layer_name, uint32_t *count,
+                                                                   VkExtensionProperties *properties) {
+    if (layer_name != nullptr) {
+        return VK_ERROR_LAYER_NOT_PRESENT;
+    }
+    std::vector<VkExtensionProperties> extensions(std::size(INSTANCE_EXTENSIONS));
+    for (std::size_t i = 0; i < extensions.size(); i++) {
+        std::string_view(INSTANCE_EXTENSIONS[i]).copy(extensions[i].extensionName, VK_MAX_EXTENSION_NAME_SIZE - 1);
+        extensions[i].specVersion = 1;
+    }
+    return enumerate(extensions, count, properties);
+}
+
+static VkResult VKAPI_CALL enumerate_instance_version(uint32_t *version) {
+    *version = VK_API_VERSION_1_2;
+    return VK_SUCCESS;
+}
+
+static VkResult VKAPI_CALL create_instance(const VkInstanceCreateInfo *create_info, const VkAllocationCallbacks *,
+                                           VkInstance *instance) {
+    for (uint32_t i = 0; i < create_info->enabledExtensionCount; i++) {
+        auto supported = std::ranges::any_of(INSTANCE_EXTENSIONS, [&](const char *name) {
+            return std::string_view(name) == create_info->ppEnabledExtensionNames[i];
+        });
+        if (!supported) {
+            return VK_ERROR_EXTENSION_NOT_PRESENT;
+        }
+    }
+
+    // Exceptions must not cross into the loader.
+    try {
+        auto config = MockIcdConfig::from_environment();
+        auto mock = std::make_unique<MockInstance>();
+        set_loader_magic_value(mock.get());
+        for (uint32_t i = 0; i < config.device_count; i++) {
+            auto &device = mock->physical_devices.emplace_back(std::make_unique<MockPhysicalDevice>());
+            set_loader_magic_value(device.get());
+            device->index = i;
+            device->properties = config.device_properties(i);
+            device->memory_properties = config.memory_properties(i);
+            device->queue_families = config.queue_family_properties(i);
+            device->extensions = config.device_extensions(i);
+            device->pipeline_milliseconds = config.pipeline_milliseconds;
+        }
+        *instance = to_handle<VkInstance>(mock.release());
+        return VK_SUCCESS;
+    } catch (...) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+}
+
+static void VKAPI_CALL destroy_instance(VkInstance instance, const VkAllocationCallbacks *) {
+    delete from_handle<MockInstance>(instance);
+}
+
+static VkResult VKAPI_CALL enumerate_physical_devices(VkInstance instance, uint32_t *count,
+                                                      VkPhysicalDevice *physical_devices) {
+    std::vector<VkPhysicalDevice> handles;
+    for (auto &device: from_handle<MockInstance>(instance)->physical_devices) {
+        handles.push_back(to_handle<VkPhysicalDevice>(device.get()));
+    }
+    return enumerate(handles, count, physical_devices);
+}
+
+static VkResult VKAPI_CALL enumerate_physical_device_groups(VkInstance instance, uint32_t *count,
+                                                            VkPhysicalDeviceGroupProperties *groups) {
+    // Every device is alone in its group.
+    std::vector<VkPhysicalDeviceGroupProperties> handles;
+    for (auto &device: from_handle<MockInstance>(instance)->physical_devices) {
+        auto &group = handles.emplace_back();
+        group.physicalDeviceCount = 1;
+        group.physicalDevices[0] = to_handle<VkPhysicalDevice>(device.get());
+        group.subsetAllocation = VK_FALSE;
+    }
+    if (groups != nullptr) {
+        // The application owns sType and pNext.
+        for (uint32_t i = 0; i < std::min<std::size_t>(*count, handles.size()); i++) {
+            handles[i].sType = groups[i].sType;
+            handles[i].pNext = groups[i].pNext;
+        }
+    }
+    return enumerate(handles, count, groups);
+}
+
+static void VKAPI_CALL get_physical_device_properties(VkPhysicalDevice physical_device,
+                                                      VkPhysicalDeviceProperties *properties) {
+    *properties = from_handle<MockPhysicalDevice>(physical_device)->properties;
+}
+
+static void VKAPI_CALL get_physical_device_properties2(VkPhysicalDevice physical_device,
+                                                       VkPhysicalDeviceProperties2 *properties) {
+    properties->properties = from_handle<MockPhysicalDevice>(physical_device)->properties;
+}
+
+static void VKAPI_CALL get_physical_device_memory_properties(VkPhysicalDevice physical_device,
+                                                             VkPhysicalDeviceMemoryProperties *properties) {
+    *properties = from_handle<MockPhysicalDevice>(physical_device)->memory_properties;
+}
+
+static void VKAPI_CALL get_physical_device_queue_family_properties(VkPhysicalDevice physical_device,
+                                                                   uint32_t *count,
+                                                                   VkQueueFamilyProperties *properties) {
+    enumerate(from_handle<MockPhysicalDevice>(physical_device)->queue_families, count, properties);
+}
+
+static void VKAPI_CALL get_physical_device_features(VkPhysicalDevice, VkPhysicalDeviceFeatures *features) {
+    enable_all(features);
+}
+
+static void VKAPI_CALL get_physical_device_features2(VkPhysicalDevice, VkPhysicalDeviceFeatures2 *features) {
+    for (auto *structure = reinterpret_cast<VkBaseOutStructure *>(features); structure != nullptr;
+         structure = structure->pNext) {
+        switch (structure->sType) {
+            case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2:
+                enable_all(&reinterpret_cast<VkPhysicalDeviceFeatures2 *>(structure)->features);
+                break;
+            case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES:
+                enable_all<VkPhysicalDeviceVulkan11Features>(structure);
+                break;
+            case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES:
+                enable_all<VkPhysicalDeviceVulkan12Features>(structure);
+                break;
+            case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR:
+                enable_all<VkPhysicalDeviceSynchronization2FeaturesKHR>(structure);
+                break;
+            case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT:
+                enable_all<VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>(structure);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void VKAPI_CALL get_physical_device_format_properties(VkPhysicalDevice, VkFormat,
+                                                             VkFormatProperties *properties) {
+    properties->linearTilingFeatures = TILING_FEATURES;
+    properties->optimalTilingFeatures = TILING_FEATURES;
+    properties->bufferFeatures = BUFFER_FEATURES;
+}
+
+static VkResult VKAPI_CALL enumerate_device_extension_properties(VkPhysicalDevice physical_device,
+                                                                 const char *layer_name, uint32_t *count,
+                                                                 VkExtensionProperties *properties) {
+    if (layer_name != nullptr) {
+        return VK_ERROR_LAYER_NOT_PRESENT;
+    }
+    return enumerate(from_handle<MockPhysicalDevice>(physical_device)->extensions, count, properties);
+}
+
+static VkResult VKAPI_CALL create_device(VkPhysicalDevice physical_device, const VkDeviceCreateInfo *create_info,
+                                         const VkAllocationCallbacks *, VkDevice *device) {
+    auto &physical = *from_handle<MockPhysicalDevice>(physical_device);
+
+    std::set<std::string_view> enabled_extensions;
+    for (uint32_t i = 0; i < create_info->enabledExtensionCount; i++) {
+        std::string_view name = create_info->ppEnabledExtensionNames[i];
+        auto supported = std::ranges::any_of(physical.extensions, [&](const VkExtensionProperties &extension) {
+            return name == extension.extensionName;
+        });
+        if (!supported || !enabled_extensions.insert(name).second) {
+            return VK_ERROR_EXTENSION_NOT_PRESENT;
+        }
+    }
+
+    // Feature structures may only be chained once each, and only for enabled extensions.
+    std::set<VkStructureType> chained;
+    for (auto *structure = static_cast<const VkBaseInStructure *>(create_info->pNext); structure != nullptr;
+         structure = structure->pNext) {
+        auto extension = feature_extension(structure->sType);
+        if (!chained.insert(structure->sType).second || (extension && !enabled_extensions.contains(extension))) {
+            return VK_ERROR_FEATURE_NOT_PRESENT;
+        }
+    }
+
+    auto mock = std::make_unique<MockDevice>();
+    set_loader_magic_value(mock.get());
+    mock->pipeline_milliseconds = physical.pipeline_milliseconds;
+    mock->queues.resize(physical.queue_families.size());
+    for (uint32_t i = 0; i < create_info->queueCreateInfoCount; i++) {
+        auto &queue_info = create_info->pQueueCreateInfos[i];
+        if (queue_info.queueFamilyIndex >= physical.queue_families.size()
+            || !mock->queues[queue_info.queueFamilyIndex].empty()
+            || queue_info.queueCount == 0
+            || queue_info.queueCount > physical.queue_families[queue_info.queueFamilyIndex].queueCount
+            || queue_info.pQueuePriorities == nullptr) {
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+        for (uint32_t queue = 0; queue < queue_info.queueCount; queue++) {
+            auto priority = queue_info.pQueuePriorities[queue];
+            if (priority < 0.0f || priority > 1.0f) {
+                return VK_ERROR_INITIALIZATION_FAILED;
+            }
+            auto &created = mock->queues[queue_info.queueFamilyIndex].emplace_back(std::make_unique<MockQueue>());
+            set_loader_magic_value(created.get());
+            created->device = mock.get();
+            created->flags = physical.queue_families[queue_info.queueFamilyIndex].queueFlags;
+        }
+    }
+
+    *device = to_handle<VkDevice>(mock.release());
+    return VK_SUCCESS;
+}
+
+static void VKAPI_CALL destroy_device(VkDevice device, const VkAllocationCallbacks *) {
+    auto *mock = from_handle<MockDevice>(device);
+    if (!mock->memory.empty()) {
+        report_misuse("vkDestroyDevice: memory was not freed");
+    }
+    delete mock;
+}
+
+static void VKAPI_CALL get_device_queue(VkDevice device, uint32_t family, uint32_t index, VkQueue *queue) {
+    auto &queues = from_handle<MockDevice>(device)->queues;
+    if (family >= queues.size() || index >= queues[family].size()) {
+        *queue = VK_NULL_HANDLE;
+        return;
+    }
+    *queue = to_handle<VkQueue>(queues[family][index].get());
+}
+
+static VkResult VKAPI_CALL allocate_memory(VkDevice device, const VkMemoryAllocateInfo *allocate_info,
+                                           const VkAllocationCallbacks *, VkDeviceMemory *memory) {
+    auto &mock = *from_handle<MockDevice>(device);
+    if (allocate_info->allocationSize == 0 || allocate_info->memoryTypeIndex >= 4) {
+        return VK_ERROR_VALIDATION_FAILED_EXT;
+    }
+    const auto handle = mock.next_handle++;
+    mock.memory[handle].size = allocate_info->allocationSize;
+    *memory = to_non_dispatchable<VkDeviceMemory>(handle);
+    return VK_SUCCESS;
+}
+
+static void VKAPI_CALL free_memory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *) {
+    auto &mock = *from_handle<MockDevice>(device);
+    const auto handle = from_non_dispatchable(memory);
+    if (handle == 0) {
+        return;
+    }
+    auto bound = mock.bound_blocks.lower_bound({handle, 0});
+    if (bound != mock.bound_blocks.end() && bound->first == handle) {
+        report_misuse("vkFreeMemory: the memory is still bound to a sparse resource");
+    }
+    if (mock.memory.erase(handle) == 0) {
+        report_misuse("vkFreeMemory: unknown memory");
+    }
+}
+
+static VkResult VKAPI_CALL create_buffer(VkDevice device, const VkBufferCreateInfo *create_info,
+                                         const VkAllocationCallbacks *, VkBuffer *buffer) {
+    auto &mock = *from_handle<MockDevice>(device);
+    if (create_info->size == 0) {
+        return VK_ERROR_VALIDATION_FAILED_EXT;
+    }
+    const auto block = MockIcdConfig::SPARSE_BLOCK_SIZE;
+    const auto handle = mock.next_handle++;
+    auto &resource = mock.resources[handle];
+    resource.sparse_residency = create_info->flags & VK_BUFFER_CREATE_SPARSE_RESIDENCY_BIT;
+    resource.size = (create_info->size + block - 1) / block * block;
+    *buffer = to_non_dispatchable<VkBuffer>(handle);
+    return VK_SUCCESS;
+}
+
+static VkResult VKAPI_CALL create_image(VkDevice device, const VkImageCreateInfo *create_info,
+                                        const VkAllocationCallbacks *, VkImage *image) {
+    auto &mock = *from_handle<MockDevice>(device);
+    if (create_info->imageType != VK_IMAGE_TYPE_2D || create_info->arrayLayers != 1 || create_info->mipLevels == 0
+        || create_info->extent.depth != 1) {
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    // Levels smaller than a tile in either dimension go in a mip tail of one block.
+    const auto granularity = MockIcdConfig::SPARSE_IMAGE_GRANULARITY;
+    MockResource resource;
+    resource.image = true;
+    resource.sparse_residency = create_info->flags & VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+    resource.extent = create_info->extent;
+    resource.mip_levels = create_info->mipLevels;
+    resource.mip_tail_first_lod = resource.mip_levels;
+    for (uint32_t level = 0; level < resource.mip_levels; level++) {
+        const auto width = std::max(resource.extent.width >> level, 1u);
+        const auto height = std::max(resource.extent.height >> level, 1u);
+        if (width < granularity.width || height < granularity.height) {
+            resource.mip_tail_first_lod = level;
+            break;
+        }
+        const auto tiles = ((width + granularity.width - 1) / granularity.width)
+                           * ((height + granularity.height - 1) / granularity.height);
+        resource.mip_tail_offset += tiles * MockIcdConfig::SPARSE_BLOCK_SIZE;
+    }
+    resource.size = resource.mip_tail_offset + MockIcdConfig::SPARSE_BLOCK_SIZE;
+
+    const auto handle = mock.next_handle++;
+    mock.resources[handle] = std::move(resource);
+    *image = to_non_dispatchable<VkImage>(handle);
+    return VK_SUCCESS;
+}
+
+/**
+ * Destroys a buffer or image, which unbinds its memory.
+ */
+template<typename Handle>
+static void destroy_resource(VkDevice device, Handle handle) {
+    auto &mock = *from_handle<MockDevice>(device);
+    const auto value = from_non_dispatchable(handle);
+    if (value == 0) {
+        return;
+    }
+    auto resource = mock.resources.find(value);
+    if (resource == mock.resources.end()) {
+        report_misuse("vkDestroyBuffer or vkDestroyImage: unknown resource");
+    }
+    for (auto &[location, block]: resource->second.bindings) {
+        mock.bound_blocks.erase(block);
+    }
+    mock.resources.erase(resource);
+}
+
+static void VKAPI_CALL destroy_buffer(VkDevice device, VkBuffer buffer, const VkAllocationCallbacks *) {
+    destroy_resource(device, buffer);
+}
+
+static void VKAPI_CALL destroy_image(VkDevice device, VkImage image, const VkAllocationCallbacks *) {
+    destroy_resource(device, image);
+}
+
+static void VKAPI_CALL get_buffer_memory_requirements(VkDevice device, VkBuffer buffer,
+                                                      VkMemoryRequirements *requirements) {
+    auto &resource = from_handle<MockDevice>(device)->resources.at(from_non_dispatchable(buffer));
+    requirements->size = resource.size;
+    requirements->alignment = MockIcdConfig::SPARSE_BLOCK_SIZE;
+    requirements->memoryTypeBits = 0xF;
+}
+
+static void VKAPI_CALL get_image_memory_requirements(VkDevice device, VkImage image,
+                                                     VkMemoryRequirements *requirements) {
+    auto &resource = from_handle<MockDevice>(device)->resources.at(from_non_dispatchable(image));
+    requirements->size = resource.size;
+    requirements->alignment = MockIcdConfig::SPARSE_BLOCK_SIZE;
+    // The device local types.
+    requirements->memoryTypeBits = 0x9;
+}
+
+static void VKAPI_CALL get_image_sparse_memory_requirements(VkDevice device, VkImage image, uint32_t *count,
+                                                            VkSparseImageMemoryRequirements *requirements) {
+    auto &resource = from_handle<MockDevice>(device)->resources.at(from_non_dispatchable(image));
+    std::vector<VkSparseImageMemoryRequirements> reported;
+    if (resource.sparse_residency) {
+        auto &requirement = reported.emplace_back();
+        requirement.formatProperties.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        requirement.formatProperties.imageGranularity = MockIcdConfig::SPARSE_IMAGE_GRANULARITY;
+        requirement.formatProperties.flags = 0;
+        requirement.imageMipTailFirstLod = resource.mip_tail_first_lod;
+        requirement.imageMipTailSize = MockIcdConfig::SPARSE_BLOCK_SIZE;
+        requirement.imageMipTailOffset = resource.mip_tail_offset;
+        requirement.imageMipTailStride = 0;
+    }
+    enumerate(reported, count, requirements);
+}
+
+/**
+ * Binds one block of a resource, replacing what was bound there, or unbinds it if memory is 0.
+ * @return Whether the bind is valid.
+ */
+static bool bind_block(MockDevice &device, MockResource &resource, std::pair<uint32_t, uint64_t> location,
+                       uint64_t memory, VkDeviceSize memory_offset) {
+    if (auto bound = resource.bindings.find(location); bound != resource.bindings.end()) {
+        device.bound_blocks.erase(bound->second);
+        resource.bindings.erase(bound);
+    }
+    if (memory == 0) {
+        return true;
+    }
+
+    auto allocation = device.memory.find(memory);
+    if (allocation == device.memory.end() || memory_offset % MockIcdConfig::SPARSE_BLOCK_SIZE != 0
+        || memory_offset + MockIcdConfig::SPARSE_BLOCK_SIZE > allocation->second.size) {
+        return false;
+    }
+    // Resources are never created aliased, so a block may only back one place at a time.
+    if (!device.bound_blocks.insert({memory, memory_offset}).second) {
+        return false;
+    }
+    resource.bindings[location] = {memory, memory_offset};
+    return true;
+}
+
+static bool bind_opaque(MockDevice &device, MockResource &resource, const VkSparseMemoryBind &bind) {
+    const auto block = MockIcdConfig::SPARSE_BLOCK_SIZE;
+    if (bind.size == 0 || bind.resourceOffset % block != 0 || bind.size % block != 0
+        || bind.resourceOffset + bind.size > resource.size) {
+        return false;
+    }
+    for (VkDeviceSize offset = 0; offset < bind.size; offset += block) {
+        if (!bind_block(device, resource, {0, bind.resourceOffset + offset}, from_non_dispatchable(bind.memory),
+                        bind.memoryOffset + offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bind_tiles(MockDevice &device, MockResource &resource, const VkSparseImageMemoryBind &bind) {
+    const auto granularity = MockIcdConfig::SPARSE_IMAGE_GRANULARITY;
+    const auto level = bind.subresource.mipLevel;
+    if (!resource.image || !resource.sparse_residency || bind.subresource.aspectMask != VK_IMAGE_ASPECT_COLOR_BIT
+        || bind.subresource.arrayLayer != 0 || level >= resource.mip_tail_first_lod) {
+        return false;
+    }
+
+    // Binds cover whole tiles, except at the right and bottom edges of the level.
+    const auto width = std::max(resource.extent.width >> level, 1u);
+    const auto height = std::max(resource.extent.height >> level, 1u);
+    if (bind.offset.x < 0 || bind.offset.y < 0 || bind.offset.z != 0 || bind.extent.depth != 1
+        || bind.offset.x % granularity.width != 0 || bind.offset.y % granularity.height != 0
+        || bind.offset.x + bind.extent.width > width || bind.offset.y + bind.extent.height > height
+        || (bind.extent.width % granularity.width != 0 && bind.offset.x + bind.extent.width != width)
+        || (bind.extent.height % granularity.height != 0 && bind.offset.y + bind.extent.height != height)) {
+        return false;
+    }
+
+    const uint64_t first_x = bind.offset.x / granularity.width;
+    const uint64_t first_y = bind.offset.y / granularity.height;
+    const auto columns = (bind.extent.width + granularity.width - 1) / granularity.width;
+    const auto rows = (bind.extent.height + granularity.height - 1) / granularity.height;
+    VkDeviceSize memory_offset = bind.memoryOffset;
+    for (uint64_t y = first_y; y < first_y + rows; y++) {
+        for (uint64_t x = first_x; x < first_x + columns; x++) {
+            if (!bind_block(device, resource, {level + 1, y << 32 | x}, from_non_dispatchable(bind.memory),
+                            memory_offset)) {
+                return false;
+            }
+            memory_offset += MockIcdConfig::SPARSE_BLOCK_SIZE;
+        }
+    }
+    return true;
+}
+
+static VkResult VKAPI_CALL queue_bind_sparse(VkQueue queue, uint32_t count, const VkBindSparseInfo *infos,
+                                             VkFence) {
+    auto &mock_queue = *from_handle<MockQueue>(queue);
+    if (!(mock_queue.flags & VK_QUEUE_SPARSE_BINDING_BIT)) {
+        return VK_ERROR_VALIDATION_FAILED_EXT;
+    }
+    auto &device = *mock_queue.device;
+    auto find = [&](auto handle, bool image) -> MockResource * {
+        auto resource = device.resources.find(from_non_dispatchable(handle));
+        if (resource == device.resources.end() || resource->second.image != image) {
+            return nullptr;
+        }
+        return &resource->second;
+    };
+
+    // Binds are applied in order, so a batch may unbind a block and bind its memory elsewhere.
+    for (uint32_t i = 0; i < count; i++) {
+        auto &info = infos[i];
+        for (uint32_t j = 0; j < info.bufferBindCount; j++) {
+            auto *resource = find(info.pBufferBinds[j].buffer, false);
+            for (uint32_t k = 0; k < info.pBufferBinds[j].bindCount; k++) {
+                if (resource == nullptr || !bind_opaque(device, *resource, info.pBufferBinds[j].pBinds[k])) {
+                    return VK_ERROR_VALIDATION_FAILED_EXT;
+                }
+            }
+        }
+        for (uint32_t j = 0; j < info.imageOpaqueBindCount; j++) {
+            auto *resource = find(info.pImageOpaqueBinds[j].image, true);
+            for (uint32_t k = 0; k < info.pImageOpaqueBinds[j].bindCount; k++) {
+                if (resource == nullptr || !bind_opaque(device, *resource, info.pImageOpaqueBinds[j].pBinds[k])) {
+                    return VK_ERROR_VALIDATION_FAILED_EXT;
+                }
+            }
+        }
+        for (uint32_t j = 0; j < info.imageBindCount; j++) {
+            auto *resource = find(info.pImageBinds[j].image, true);
+            for (uint32_t k = 0; k < info.pImageBinds[j].bindCount; k++) {
+                if (resource == nullptr || !bind_tiles(device, *resource, info.pImageBinds[j].pBinds[k])) {
+                    return VK_ERROR_VALIDATION_FAILED_EXT;
+                }
+            }
+        }
+    }
+    return VK_SUCCESS;
+}
+
+static VkResult VKAPI_CALL create_graphics_pipelines(VkDevice device, VkPipelineCache, uint32_t count,
+                                                     const VkGraphicsPipelineCreateInfo *,
+                                                     const VkAllocationCallbacks *, VkPipeline *pipelines) {
+    auto &mock = *from_handle<MockDevice>(device);
+    std::this_thread::sleep_for(std::chrono::milliseconds(mock.pipeline_milliseconds));
+    std::lock_guard lock(mock.pipeline_mutex);
+    for (uint32_t i = 0; i < count; i++) {
+        const auto handle = mock.next_pipeline++;
+        mock.pipelines.insert(handle);
+        pipelines[i] = to_non_dispatchable<VkPipeline>(handle);
+    }
+    return VK_SUCCESS;
+}
+
+static void VKAPI_CALL destroy_pipeline(VkDevice device, VkPipeline pipeline, const VkAllocationCallbacks *) {
+    auto &mock = *from_handle<MockDevice>(device);
+    const auto handle = from_non_dispatchable(pipeline);
+    if (handle == 0) {
+        return;
+    }
+    std::lock_guard lock(mock.pipeline_mutex);
+    if (mock.pipelines.erase(handle) == 0) {
+        report_misuse("vkDestroyPipeline: unknown pipeline");
+    }
+}
+
+static PFN_vkVoidFunction VKAPI_CALL get_device_proc_addr(VkDevice, const char *name);
+
+struct EntryPoint {
+    std::string_view name;
+    PFN_vkVoidFunction function;
+};
+
+#define ENTRY_POINT(NAME, FUNCTION) {NAME, reinterpret_cast<PFN_vkVoidFunction>(&FUNCTION)}
+
+static const EntryPoint DEVICE_ENTRY_POINTS[] = {
+        ENTRY_POINT("vkDestroyDevice", destroy_device),
+        ENTRY_POINT("vkGetDeviceQueue", get_device_queue),
+        ENTRY_POINT("vkGetDeviceProcAddr", get_device_proc_addr),
+        ENTRY_POINT("vkAllocateMemory", allocate_memory),
+        ENTRY_POINT("vkFreeMemory", free_memory),
+        ENTRY_POINT("vkCreateBuffer", create_buffer),
+        ENTRY_POINT("vkDestroyBuffer", destroy_buffer),
+        ENTRY_POINT("vkCreateImage", create_image),
+        ENTRY_POINT("vkDestroyImage", destroy_image),
+        ENTRY_POINT("vkGetBufferMemoryRequirements", get_buffer_memory_requirements),
+        ENTRY_POINT("vkGetImageMemoryRequirements", get_image_memory_requirements),
+        ENTRY_POINT("vkGetImageSparseMemoryRequirements", get_image_sparse_memory_requirements),
+        ENTRY_POINT("vkQueueBindSparse", queue_bind_sparse),
+        ENTRY_POINT("vkCreateGraphicsPipelines", create_graphics_pipelines),
+        ENTRY_POINT("vkDestroyPipeline", destroy_pipeline),
+};
+
+static const EntryPoint INSTANCE_ENTRY_POINTS[] = {
+        ENTRY_POINT("vkEnumerateInstanceExtensionProperties", enumerate_instance_extension_properties),
+        ENTRY_POINT("vkEnumerateInstanceVersion", enumerate_instance_version),
+        ENTRY_POINT("vkCreateInstance", create_instance),
+        ENTRY_POINT("vkDestroyInstance", destroy_instance),
+        ENTRY_POINT("vkEnumeratePhysicalDevices", enumerate_physical_devices),
+        ENTRY_POINT("vkEnumeratePhysicalDeviceGroups", enumerate_physical_device_groups),
+        ENTRY_POINT("vkEnumeratePhysicalDeviceGroupsKHR", enumerate_physical_device_groups),
+        ENTRY_POINT("vkGetPhysicalDeviceProperties", get_physical_device_properties),
+        ENTRY_POINT("vkGetPhysicalDeviceProperties2", get_physical_device_properties2),
+        ENTRY_POINT("vkGetPhysicalDeviceProperties2KHR", get_physical_device_properties2),
+        ENTRY_POINT("vkGetPhysicalDeviceMemoryProperties", get_physical_device_memory_properties),
+        ENTRY_POINT("vkGetPhysicalDeviceQueueFamilyProperties", get_physical_device_queue_family_properties),
+        ENTRY_POINT("vkGetPhysicalDeviceFeatures", get_physical_device_features),
+        ENTRY_POINT("vkGetPhysicalDeviceFeatures2", get_physical_device_features2),
+        ENTRY_POINT("vkGetPhysicalDeviceFeatures2KHR", get_physical_device_features2),
+        ENTRY_POINT("vkGetPhysicalDeviceFormatProperties", get_physical_device_format_properties),
+        ENTRY_POINT("vkEnumerateDeviceExtensionProperties", enumerate_device_extension_properties),
+        ENTRY_POINT("vkCreateDevice", create_device),
+};
+
+#undef ENTRY_POINT
+
+template<std::size_t N>
+static PFN_vkVoidFunction find_entry_point(const EntryPoint (&entry_points)[N], std::string_view name) {
+    for (auto &entry_point: entry_points) {
+        if (entry_point.name == name) {
+            return entry_point.function;
+        }
+    }
+    return nullptr;
+}
+
+static PFN_vkVoidFunction VKAPI_CALL get_device_proc_addr(VkDevice, const char *name) {
+    return find_entry_point(DEVICE_ENTRY_POINTS, name);
+}
+
+extern "C" {
+
+VKAPI_ATTR VkResult VKAPI_CALL vk_icdNegotiateLoaderICDInterfaceVersion(uint32_t *supported_version) {
+    *supported_version = std::min(*supported_version, LOADER_INTERFACE_VERSION);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vk_icdGetInstanceProcAddr(VkInstance, const char *name) {
+    if (auto function = find_entry_point(INSTANCE_ENTRY_POINTS, name)) {
+        return function;
+    }
+    return find_entry_point(DEVICE_ENTRY_POINTS, name);
+}
+
+}
@@ -0,0 +1,185 @@
+#include "mock_icd_config.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr uint32_t FIRST_DEVICE_ID = 0x1000;
+
+static constexpr VkPhysicalDeviceType DEVICE_TYPES[] = {
+        VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU,
+        VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU,
+        VK_PHYSICAL_DEVICE_TYPE_CPU,
+        VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU,
+};
+
+static constexpr uint32_t VENDOR_IDS[] = {0x8086, 0x10DE, 0x10005, 0x1AE0};
+
+static uint32_t parse_count(std::string_view text, const char *what) {
+    uint32_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::runtime_error(std::string("Unable to parse ") + what + ": " + std::string(text));
+    }
+    return value;
+}
+
+static VkQueueFlags parse_queue_flag(std::string_view name) {
+    if (name == "graphics") {
+        return VK_QUEUE_GRAPHICS_BIT;
+    } else if (name == "compute") {
+        return VK_QUEUE_COMPUTE_BIT;
+    } else if (name == "transfer") {
+        return VK_QUEUE_TRANSFER_BIT;
+    } else if (name == "sparse") {
+        return VK_QUEUE_SPARSE_BINDING_BIT;
+    }
+    throw std::runtime_error("Unable to parse queue flag " + std::string(name));
+}
+
+MockIcdConfig MockIcdConfig::from_environment() {
+    MockIcdConfig config;
+    if (const char *device_count = std::getenv("MOCK_ICD_DEVICE_COUNT")) {
+        config.device_count = parse_count(device_count, "MOCK_ICD_DEVICE_COUNT");
+    }
+    if (const char *extension_count = std::getenv("MOCK_ICD_EXTENSION_COUNT")) {
+        config.extension_count = parse_count(extension_count, "MOCK_ICD_EXTENSION_COUNT");
+    }
+    if (const char *pipeline_milliseconds = std::getenv("MOCK_ICD_PIPELINE_MILLISECONDS")) {
+        config.pipeline_milliseconds = parse_count(pipeline_milliseconds, "MOCK_ICD_PIPELINE_MILLISECONDS");
+    }
+    if (const char *queue_layout = std::getenv("MOCK_ICD_QUEUE_LAYOUT")) {
+        config.queue_families = parse_queue_layout(queue_layout);
+    }
+    return config;
+}
+
+std::vector<MockQueueFamily> MockIcdConfig::parse_queue_layout(std::string_view layout) {
+    std::vector<MockQueueFamily> families;
+    while (!layout.empty()) {
+        auto family_end = std::min(layout.find(','), layout.size());
+        auto family = layout.substr(0, family_end);
+        layout.remove_prefix(std::min(family_end + 1, layout.size()));
+
+        auto separator = family.find(':');
+        if (separator == std::string_view::npos) {
+            throw std::runtime_error("Unable to parse queue family " + std::string(family));
+        }
+        auto &parsed = families.emplace_back();
+        parsed.count = parse_count(family.substr(separator + 1), "queue count");
+
+        auto flags = family.substr(0, separator);
+        while (!flags.empty()) {
+            auto flag_end = std::min(flags.find('+'), flags.size());
+            parsed.flags |= parse_queue_flag(flags.substr(0, flag_end));
+            flags.remove_prefix(std::min(flag_end + 1, flags.size()));
+        }
+        if (parsed.flags == 0 || parsed.count == 0) {
+            throw std::runtime_error("Unable to parse queue family " + std::string(family));
+        }
+    }
+    return families;
+}
+
+VkPhysicalDeviceProperties MockIcdConfig::device_properties(uint32_t index) const {
+    VkPhysicalDeviceProperties properties = {};
+    properties.apiVersion = VK_API_VERSION_1_2;
+    properties.driverVersion = VK_MAKE_VERSION(1, 0, index);
+    properties.vendorID = VENDOR_IDS[index % std::size(VENDOR_IDS)];
+    properties.deviceID = FIRST_DEVICE_ID + index;
+    properties.deviceType = DEVICE_TYPES[index % std::size(DEVICE_TYPES)];
+    std::snprintf(properties.deviceName, sizeof(properties.deviceName), "Mock Device %u", index);
+    std::memcpy(properties.pipelineCacheUUID, &properties.deviceID, sizeof(properties.deviceID));
+
+    auto &limits = properties.limits;
+    limits.maxImageDimension2D = 16384;
+    limits.maxUniformBufferRange = 65536;
+    limits.maxStorageBufferRange = UINT32_MAX;
+    limits.maxPushConstantsSize = 128;
+    limits.maxMemoryAllocationCount = 4096;
+    limits.bufferImageGranularity = 1;
+    limits.maxBoundDescriptorSets = 8;
+    limits.maxComputeWorkGroupCount[0] = 65535;
+    limits.maxComputeWorkGroupCount[1] = 65535;
+    limits.maxComputeWorkGroupCount[2] = 65535;
+    limits.maxComputeWorkGroupInvocations = 1024;
+    limits.maxComputeWorkGroupSize[0] = 1024;
+    limits.maxComputeWorkGroupSize[1] = 1024;
+    limits.maxComputeWorkGroupSize[2] = 64;
+    limits.minMemoryMapAlignment = 64;
+    limits.minUniformBufferOffsetAlignment = 64;
+    limits.minStorageBufferOffsetAlignment = 16;
+    limits.optimalBufferCopyOffsetAlignment = 16;
+    limits.optimalBufferCopyRowPitchAlignment = 16;
+    limits.nonCoherentAtomSize = 64;
+    limits.timestampComputeAndGraphics = VK_TRUE;
+    limits.timestampPeriod = 1.0f;
+    return properties;
+}
+
+VkPhysicalDeviceMemoryProperties MockIcdConfig::memory_properties(uint32_t index) const {
+    VkPhysicalDeviceMemoryProperties properties = {};
+    properties.memoryHeapCount = 2;
+    properties.memoryHeaps[0].size = VkDeviceSize(index + 1) << 28;
+    properties.memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    properties.memoryHeaps[1].size = VkDeviceSize(1) << 30;
+
+    properties.memoryTypeCount = 4;
+    properties.memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+    properties.memoryTypes[1] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1};
+    properties.memoryTypes[2] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1};
+    properties.memoryTypes[3] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0};
+    return properties;
+}
+
+std::vector<VkQueueFamilyProperties> MockIcdConfig::queue_family_properties(uint32_t index) const {
+    std::vector<VkQueueFamilyProperties> properties;
+    for (auto &family: queue_families) {
+        auto &family_properties = properties.emplace_back();
+        family_properties.queueFlags = family.flags;
+        family_properties.queueCount = family.count;
+        family_properties.timestampValidBits = 64;
+        family_properties.minImageTransferGranularity = {1, 1, 1};
+    }
+    if (index % 2 == 1) {
+        std::reverse(properties.begin(), properties.end());
+    }
+    return properties;
+}
+
+std::vector<VkExtensionProperties> MockIcdConfig::device_extensions(uint32_t index) const {
+    std::vector<VkExtensionProperties> extensions;
+    auto add = [&](const char *name, uint32_t spec_version) {
+        auto &extension = extensions.emplace_back();
+        std::snprintf(extension.extensionName, sizeof(extension.extensionName), "%s", name);
+        extension.specVersion = spec_version;
+    };
+
+    add(VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_SWAPCHAIN_SPEC_VERSION);
+    add("VK_EXT_memory_budget", 1);
+    if (has_optional_extensions(index)) {
+        add(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME, VK_KHR_SYNCHRONIZATION_2_SPEC_VERSION);
+        add(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME, VK_KHR_PIPELINE_LIBRARY_SPEC_VERSION);
+        add(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_SPEC_VERSION);
+    }
+
+    char name[VK_MAX_EXTENSION_NAME_SIZE];
+    for (uint32_t i = 0; i < extension_count; i++) {
+        std::snprintf(name, sizeof(name), "VK_MOCK_filler_extension_%u", i);
+        add(name, 1);
+    }
+    return extensions;
+}
+
+bool MockIcdConfig::has_optional_extensions(uint32_t index) {
+    return index % 3 != 2;
+}
+
+uint32_t MockIcdConfig::device_index(uint32_t device_id) {
+    return device_id - FIRST_DEVICE_ID;
+}
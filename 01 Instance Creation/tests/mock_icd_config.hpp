@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+/**
+ * A queue family reported by every fake device.
+ */
+struct MockQueueFamily {
+    VkQueueFlags flags = 0;
+    uint32_t count = 1;
+};
+
+/**
+ * The devices faked by the mock ICD. The ICD and the tests both build it from the environment, so the tests know
+ * exactly what the driver reported without a side channel:
+ *     MOCK_ICD_DEVICE_COUNT     The number of physical devices, 1 by default.
+ *     MOCK_ICD_EXTENSION_COUNT  The number of filler extensions reported by each device on top of the real ones.
+ *     MOCK_ICD_QUEUE_LAYOUT     The queue families, as comma separated flags:count pairs where flags are joined by
+ *                               '+', e.g. "graphics+compute+transfer:1,transfer:2". Odd devices report the families in
+ *                               reverse order, so the graphics family is not always first.
+ *     MOCK_ICD_PIPELINE_MILLISECONDS  How long each vkCreateGraphicsPipelines call takes, standing in for a shader
+ *                               compile. 0 by default.
+ * Every property of a device is derived from its index, so that selection has a single right answer:
+ *     - types cycle through integrated, discrete, CPU and virtual;
+ *     - the device local heap grows with the index;
+ *     - every third device lacks the optional extensions (synchronization2 and the pipeline libraries).
+ * Sparse resources use SPARSE_BLOCK_SIZE blocks, and images SPARSE_IMAGE_GRANULARITY tiles whatever their format.
+ */
+struct MockIcdConfig {
+    static constexpr VkDeviceSize SPARSE_BLOCK_SIZE = 64 << 10;
+    static constexpr VkExtent3D SPARSE_IMAGE_GRANULARITY = {128, 128, 1};
+
+    uint32_t device_count = 1;
+    uint32_t extension_count = 0;
+    uint32_t pipeline_milliseconds = 0;
+    std::vector<MockQueueFamily> queue_families = {
+            {VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, 16},
+            {VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,                         8},
+            {VK_QUEUE_TRANSFER_BIT,                                                2},
+    };
+
+    /**
+     * Reads the configuration from the environment.
+     * @throws std::runtime_error if a variable cannot be parsed.
+     */
+    static MockIcdConfig from_environment();
+
+    /**
+     * Parses a queue layout, as given in MOCK_ICD_QUEUE_LAYOUT.
+     * @throws std::runtime_error if the layout cannot be parsed.
+     */
+    static std::vector<MockQueueFamily> parse_queue_layout(std::string_view layout);
+
+    VkPhysicalDeviceProperties device_properties(uint32_t index) const;
+
+    VkPhysicalDeviceMemoryProperties memory_properties(uint32_t index) const;
+
+    std::vector<VkQueueFamilyProperties> queue_family_properties(uint32_t index) const;
+
+    std::vector<VkExtensionProperties> device_extensions(uint32_t index) const;
+
+    /**
+     * @return Whether the device reports synchronization2 and the graphics pipeline library extensions.
+     */
+    static bool has_optional_extensions(uint32_t index);
+
+    /**
+     * @return The index of a device from its deviceID, as the loader may reorder devices.
+     */
+    static uint32_t device_index(uint32_t device_id);
+};
@@ -0,0 +1,315 @@
+#include "tuning_profile.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "settings_file.hpp"
+
+bool TuningOverride::matches(const VkPhysicalDeviceProperties &properties) const {
+    return (!vendor_id || *vendor_id == properties.vendorID)
+           && (!device_id || (*device_id & device_id_mask) == (properties.deviceID & device_id_mask))
+           && (!device_type || *device_type == properties.deviceType)
+           && properties.driverVersion >= min_driver_version
+           && properties.driverVersion <= max_driver_version;
+}
+
+void TuningOverride::apply(TuningProfile &profile) const {
+    profile.name += " + " + name;
+    if (workgroup_size_1d) profile.workgroup_size_1d = *workgroup_size_1d;
+    if (workgroup_size_2d) profile.workgroup_size_2d = *workgroup_size_2d;
+    if (staging_memory) profile.staging_memory = *staging_memory;
+    if (dynamic_memory) profile.dynamic_memory = *dynamic_memory;
+    if (barrier_strategy) profile.barrier_strategy = *barrier_strategy;
+    if (staging_size) profile.staging_size = *staging_size;
+    if (async_compute) profile.async_compute = *async_compute;
+    if (frames_in_flight) profile.frames_in_flight = *frames_in_flight;
+    if (worker_threads) profile.worker_threads = *worker_threads;
+}
+
+TuningProfiles::TuningProfiles() {
+    constexpr VkMemoryPropertyFlags host_coherent =
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    // Warps are 32 wide and barriers are cheap, so narrow barriers pay off. The 256MiB host visible device local heap
+    // suits per frame data.
+    TuningOverride nvidia;
+    nvidia.name = "nvidia";
+    nvidia.vendor_id = vendor_id::NVIDIA;
+    nvidia.workgroup_size_1d = 128;
+    nvidia.workgroup_size_2d = {16, 8};
+    nvidia.dynamic_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | host_coherent;
+    nvidia.barrier_strategy = BarrierStrategy::Precise;
+    nvidia.staging_size = VkDeviceSize(64) << 20;
+    nvidia.async_compute = true;
+    add(nvidia);
+
+    // GCN waves are 64 wide (RDNA runs wave64 too). Barriers flush caches, so they are best issued together. With
+    // resizable BAR the host can write device local memory directly, skipping a copy.
+    TuningOverride amd;
+    amd.name = "amd";
+    amd.vendor_id = vendor_id::AMD;
+    amd.workgroup_size_1d = 64;
+    amd.workgroup_size_2d = {8, 8};
+    amd.staging_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    amd.dynamic_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | host_coherent;
+    amd.barrier_strategy = BarrierStrategy::Batched;
+    amd.staging_size = VkDeviceSize(64) << 20;
+    amd.async_compute = true;
+    add(amd);
+
+    // Unified memory makes device local memory host visible, and a separate compute queue shares the same EUs.
+    TuningOverride intel;
+    intel.name = "intel";
+    intel.vendor_id = vendor_id::INTEL;
+    intel.workgroup_size_1d = 64;
+    intel.workgroup_size_2d = {8, 8};
+    intel.staging_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    intel.dynamic_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | host_coherent;
+    intel.barrier_strategy = BarrierStrategy::Batched;
+    intel.staging_size = VkDeviceSize(16) << 20;
+    intel.async_compute = false;
+    add(intel);
+
+    // Tile based mobile GPUs with unified memory, where precise stage masks keep tiles from being flushed early.
+    for (auto [mobile_vendor, mobile_name]: {std::pair{vendor_id::ARM, "arm"},
+                                             std::pair{vendor_id::QUALCOMM, "qualcomm"}}) {
+        TuningOverride mobile;
+        mobile.name = mobile_name;
+        mobile.vendor_id = mobile_vendor;
+        mobile.workgroup_size_1d = 64;
+        mobile.workgroup_size_2d = {8, 8};
+        mobile.staging_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        mobile.dynamic_memory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | host_coherent;
+        mobile.barrier_strategy = BarrierStrategy::Precise;
+        mobile.staging_size = VkDeviceSize(16) << 20;
+        mobile.async_compute = false;
+        add(mobile);
+    }
+
+    // Software rasterisers (lavapipe, SwiftShader) run every queue on the same CPU threads, and every barrier is a
+    // full synchronisation point. Small workgroups spread better over those threads, and a frame recorded ahead only
+    // competes with the one being rasterised.
+    TuningOverride cpu;
+    cpu.name = "cpu";
+    cpu.device_type = VK_PHYSICAL_DEVICE_TYPE_CPU;
+    cpu.workgroup_size_1d = 32;
+    cpu.workgroup_size_2d = {8, 4};
+    cpu.staging_memory = 0;
+    cpu.dynamic_memory = host_coherent;
+    cpu.barrier_strategy = BarrierStrategy::Global;
+    cpu.staging_size = VkDeviceSize(8) << 20;
+    cpu.async_compute = false;
+    cpu.frames_in_flight = 1;
+    add(cpu);
+}
+
+void TuningProfiles::add(TuningOverride tuning_override) {
+    overrides.push_back(std::move(tuning_override));
+}
+
+TuningProfile TuningProfiles::select(const VkPhysicalDeviceProperties &properties) const {
+    TuningProfile profile;
+    for (auto &tuning_override: overrides) {
+        if (tuning_override.matches(properties)) {
+            tuning_override.apply(profile);
+        }
+    }
+
+    // Worker threads beyond the cores the driver leaves free only preempt its rasterizer threads. By default the
+    // driver starts a thread per core, which leaves none free, but its threads idle while the CPU records the next
+    // frame, so the workers share the cores with them.
+    if (profile.worker_threads == 0 && properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+        const auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+        const auto driver_threads = cpu_driver_thread_count(properties);
+        profile.worker_threads = driver_threads < cores ? cores - driver_threads : std::max(cores / 2, 1u);
+    }
+    return profile;
+}
+
+uint32_t cpu_driver_thread_count(const VkPhysicalDeviceProperties &properties) {
+    if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU) {
+        return 0;
+    }
+    if (properties.vendorID == vendor_id::MESA) {
+        if (const char *threads = std::getenv("LP_NUM_THREADS")) {
+            uint32_t count = 0;
+            const auto end = threads + std::strlen(threads);
+            if (std::from_chars(threads, end, count).ptr == end) {
+                return count;
+            }
+        }
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+static std::optional<uint64_t> parse_number(std::string_view text) {
+    int base = 10;
+    if (text.starts_with("0x") || text.starts_with("0X")) {
+        text.remove_prefix(2);
+        base = 16;
+    }
+    uint64_t value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+static std::optional<uint64_t> parse_size(std::string_view text) {
+    uint32_t shift = 0;
+    switch (text.empty() ? '\0' : text.back()) {
+        case 'K': shift = 10; break;
+        case 'M': shift = 20; break;
+        case 'G': shift = 30; break;
+        default: break;
+    }
+    if (shift) {
+        text.remove_suffix(1);
+    }
+    auto value = parse_number(text);
+    if (value) {
+        *value <<= shift;
+    }
+    return value;
+}
+
+static std::optional<VkMemoryPropertyFlags> parse_memory_flags(std::string_view text) {
+    VkMemoryPropertyFlags flags = 0;
+    while (!text.empty()) {
+        const auto separator = text.find('|');
+        const auto flag = trim(text.substr(0, separator));
+        text = separator == std::string_view::npos ? std::string_view() : text.substr(separator + 1);
+
+        if (flag == "device_local") {
+            flags |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        } else if (flag == "host_visible") {
+            flags |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        } else if (flag == "host_coherent") {
+            flags |= VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        } else if (flag == "host_cached") {
+            flags |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        } else if (flag != "none") {
+            return std::nullopt;
+        }
+    }
+    return flags;
+}
+
+/**
+ * Sets the setting of an override named by a key.
+ * @return Whether the key and value were valid.
+ */
+static bool parse_setting(TuningOverride &tuning_override, std::string_view key, std::string_view value) {
+    if (key == "vendor" || key == "device" || key == "device_mask" || key == "min_driver" || key == "max_driver"
+        || key == "workgroup_size_1d" || key == "frames_in_flight" || key == "worker_threads") {
+        auto number = parse_number(value);
+        if (!number || *number > UINT32_MAX) {
+            return false;
+        }
+        const auto number32 = static_cast<uint32_t>(*number);
+        if (key == "frames_in_flight" && number32 == 0) {
+            return false;
+        }
+        if (key == "vendor") tuning_override.vendor_id = number32;
+        if (key == "device") tuning_override.device_id = number32;
+        if (key == "device_mask") tuning_override.device_id_mask = number32;
+        if (key == "min_driver") tuning_override.min_driver_version = number32;
+        if (key == "max_driver") tuning_override.max_driver_version = number32;
+        if (key == "workgroup_size_1d") tuning_override.workgroup_size_1d = number32;
+        if (key == "frames_in_flight") tuning_override.frames_in_flight = number32;
+        if (key == "worker_threads") tuning_override.worker_threads = number32;
+        return true;
+    }
+
+    if (key == "device_type") {
+        if (value == "discrete") tuning_override.device_type = VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+        else if (value == "integrated") tuning_override.device_type = VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+        else if (value == "virtual") tuning_override.device_type = VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU;
+        else if (value == "cpu") tuning_override.device_type = VK_PHYSICAL_DEVICE_TYPE_CPU;
+        else if (value == "other") tuning_override.device_type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+        else return false;
+        return true;
+    }
+
+    if (key == "workgroup_size_2d") {
+        const auto separator = value.find('x');
+        if (separator == std::string_view::npos) {
+            return false;
+        }
+        auto width = parse_number(trim(value.substr(0, separator)));
+        auto height = parse_number(trim(value.substr(separator + 1)));
+        if (!width || !height || *width > UINT32_MAX || *height > UINT32_MAX) {
+            return false;
+        }
+        tuning_override.workgroup_size_2d = VkExtent2D{static_cast<uint32_t>(*width), static_cast<uint32_t>(*height)};
+        return true;
+    }
+
+    if (key == "staging_memory" || key == "dynamic_memory") {
+        auto flags = parse_memory_flags(value);
+        if (!flags) {
+            return false;
+        }
+        (key == "staging_memory" ? tuning_override.staging_memory : tuning_override.dynamic_memory) = *flags;
+        return true;
+    }
+
+    if (key == "barrier_strategy") {
+        if (value == "precise") tuning_override.barrier_strategy = BarrierStrategy::Precise;
+        else if (value == "batched") tuning_override.barrier_strategy = BarrierStrategy::Batched;
+        else if (value == "global") tuning_override.barrier_strategy = BarrierStrategy::Global;
+        else return false;
+        return true;
+    }
+
+    if (key == "staging_size") {
+        auto size = parse_size(value);
+        if (!size) {
+            return false;
+        }
+        tuning_override.staging_size = *size;
+        return true;
+    }
+
+    if (key == "async_compute") {
+        if (value == "true") tuning_override.async_compute = true;
+        else if (value == "false") tuning_override.async_compute = false;
+        else return false;
+        return true;
+    }
+
+    return false;
+}
+
+void TuningProfiles::load(const std::filesystem::path &path) {
+    std::vector<TuningOverride> loaded;
+    const bool found = read_settings_file(path, "tuning profile file", [&](std::string_view name) {
+        loaded.emplace_back().name = name;
+    }, [&](std::string_view key, std::string_view value) {
+        return parse_setting(loaded.back(), key, value);
+    });
+    if (!found) {
+        throw std::runtime_error("Unable to open tuning profile file " + path.string());
+    }
+
+    for (auto &tuning_override: loaded) {
+        add(std::move(tuning_override));
+    }
+}
+
+std::string_view barrier_strategy_to_string(BarrierStrategy strategy) {
+    switch (strategy) {
+        case BarrierStrategy::Precise:
+            return "Precise";
+        case BarrierStrategy::Batched:
+            return "Batched";
+        case BarrierStrategy::Global:
+            return "Global";
+    }
+    return "Unknown";
+}
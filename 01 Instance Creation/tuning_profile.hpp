@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+/**
+ * How barriers are issued between passes.
+ */
+enum class BarrierStrategy {
+    /// One barrier per resource, covering only the stages and accesses involved.
+    Precise,
+    /// Per resource barriers, collected and issued together at the next point of use.
+    Batched,
+    /// A single global memory barrier, for drivers where per resource barriers cost more than they save.
+    Global,
+};
+
+/**
+ * The vendor ids of PCI vendors and of the Khronos registered vendors without one.
+ */
+namespace vendor_id {
+    constexpr uint32_t AMD = 0x1002;
+    constexpr uint32_t APPLE = 0x106B;
+    constexpr uint32_t NVIDIA = 0x10DE;
+    constexpr uint32_t ARM = 0x13B5;
+    constexpr uint32_t GOOGLE = 0x1AE0;
+    constexpr uint32_t QUALCOMM = 0x5143;
+    constexpr uint32_t INTEL = 0x8086;
+    constexpr uint32_t MESA = 0x10005;
+}
+
+/**
+ * Settings of the renderer that perform best with different values on different devices.
+ */
+struct TuningProfile {
+    /// The names of every preset and override applied, most specific last.
+    std::string name = "default";
+    uint32_t workgroup_size_1d = 64;
+    VkExtent2D workgroup_size_2d = {8, 8};
+    /// Memory properties preferred for staging buffers, on top of host visible and coherent.
+    VkMemoryPropertyFlags staging_memory = 0;
+    /// Memory properties preferred for buffers rewritten by the host every frame.
+    VkMemoryPropertyFlags dynamic_memory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    BarrierStrategy barrier_strategy = BarrierStrategy::Batched;
+    VkDeviceSize staging_size = VkDeviceSize(32) << 20;
+    bool async_compute = false;
+    /// The number of frames recorded ahead of the GPU.
+    uint32_t frames_in_flight = 2;
+    /// The threads of background worker pools, or zero for WorkerPool::default_thread_count().
+    uint32_t worker_threads = 0;
+};
+
+/**
+ * A set of tuning settings applied to the devices it matches. Unset settings keep their previous value.
+ */
+struct TuningOverride {
+    std::string name;
+
+    /// The vendor matched, or any vendor if unset.
+    std::optional<uint32_t> vendor_id;
+    /// The device matched, or any device if unset. Matched against deviceID & device_id_mask, which lets one override
+    /// cover a range of device ids belonging to one architecture.
+    std::optional<uint32_t> device_id;
+    uint32_t device_id_mask = ~0u;
+    /// The device type matched, or any type if unset.
+    std::optional<VkPhysicalDeviceType> device_type;
+    /// The range of raw driverVersion values matched, inclusive.
+    uint32_t min_driver_version = 0;
+    uint32_t max_driver_version = ~0u;
+
+    std::optional<uint32_t> workgroup_size_1d;
+    std::optional<VkExtent2D> workgroup_size_2d;
+    std::optional<VkMemoryPropertyFlags> staging_memory;
+    std::optional<VkMemoryPropertyFlags> dynamic_memory;
+    std::optional<BarrierStrategy> barrier_strategy;
+    std::optional<VkDeviceSize> staging_size;
+    std::optional<bool> async_compute;
+    std::optional<uint32_t> frames_in_flight;
+    std::optional<uint32_t> worker_threads;
+
+    /**
+     * @return Whether the override applies to a device.
+     */
+    bool matches(const VkPhysicalDeviceProperties &properties) const;
+
+    /**
+     * Sets the settings of a profile that this override sets.
+     */
+    void apply(TuningProfile &profile) const;
+};
+
+/**
+ * Chooses a tuning profile for a device from built-in per vendor presets, followed by overrides loaded from files.
+ * Every matching override is applied in order, so later and more specific overrides win.
+ */
+class TuningProfiles {
+public:
+    /**
+     * Creates the registry with the built-in presets.
+     */
+    TuningProfiles();
+
+    /**
+     * Loads overrides from a file, applied after those already present. The file consists of sections, each starting
+     * with a [name] line and followed by key = value lines. '#' starts a comment. Keys are:
+     *     vendor, device, device_mask, device_type (discrete, integrated, virtual, cpu, other),
+     *     min_driver, max_driver, workgroup_size_1d, workgroup_size_2d (e.g. 16x16),
+     *     staging_memory, dynamic_memory (flags joined by '|': device_local, host_visible, host_coherent,
+     *     host_cached), barrier_strategy (precise, batched, global), staging_size (bytes, or with a K/M/G suffix),
+     *     async_compute (true, false), frames_in_flight (at least 1), worker_threads (0 for the default).
+     * Numbers may be decimal or hexadecimal with a 0x prefix.
+     * @param path The path of the file.
+     * @throws std::runtime_error if the file cannot be read or contains an invalid line.
+     */
+    void load(const std::filesystem::path &path);
+
+    /**
+     * Appends an override.
+     */
+    void add(TuningOverride tuning_override);
+
+    /**
+     * @return The profile for a device. On CPU devices, unless an override sets worker_threads, worker pools get the
+     *         cores left over by the driver's own threads, or half the cores if its threads take all of them.
+     */
+    TuningProfile select(const VkPhysicalDeviceProperties &properties) const;
+
+private:
+    std::vector<TuningOverride> overrides;
+};
+
+/**
+ * Estimates the threads a CPU device's driver runs its rasterizer and shaders on. lavapipe uses LP_NUM_THREADS when
+ * set, and like SwiftShader otherwise starts one thread per core.
+ * @param properties The properties of the device.
+ * @return The number of driver threads, or zero if the device is not a CPU device.
+ */
+uint32_t cpu_driver_thread_count(const VkPhysicalDeviceProperties &properties);
+
+/**
+ * @return The name of a barrier strategy.
+ */
+std::string_view barrier_strategy_to_string(BarrierStrategy strategy);
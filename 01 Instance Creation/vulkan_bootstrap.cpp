@@ -0,0 +1,214 @@
+#include "vulkan_bootstrap.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "logger.hpp"
+#include "pipeline_cache.hpp"
+#include "vulkan_reflection.hpp"
+
+/**
+ * Loads a vulkan function from an instance. Creates the variable in which to store the function pointer in-place.
+ * @param INSTANCE The vulkan instance to load the function from (may be NULL/nullptr for certain function names).
+ * @param NAME     The name of the function to load and the name of the variable which will keep the function pointer.
+ */
+#define LOAD_VK_FN(INSTANCE, NAME) glfwGetInstanceProcAddress(instance, #NAME);
+
+std::string vulkan_api_version_to_string(uint32_t version) {
+    std::stringstream stream;
+    stream << VK_VERSION_MAJOR(version) << "."
+           << VK_VERSION_MINOR(version) << "."
+           << VK_VERSION_PATCH(version) <<
+           " (Variant: " << VK_API_VERSION_VARIANT(version) << ")";
+    return stream.str();
+}
+
+std::string_view vulkan_physical_device_type_to_string(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_OTHER:
+            return "Other";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "Integrated GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "Discrete GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "Virtual GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "CPU";
+        default:
+            // Types added to the registry after this was written still get their name.
+            return vk_reflection::enum_name_or(type, "Unknown Physical Device Type");
+    }
+}
+
+VkInstance initialise_vulkan(InstanceAvailability &availability,
+                             const std::vector<const char *> &layers,
+                             const std::vector<const char *> &extensions) {
+    VkInstance instance = VK_NULL_HANDLE;
+    VkInstanceCreateInfo instance_create_info;
+    VkApplicationInfo instance_application_info;
+
+    for (auto &layer: layers) {
+        if (!availability.layers.supported(layer)) {
+            throw std::runtime_error(std::string("Vulkan layer ") + layer + " is not available");
+        }
+        availability.layers.enable(layer);
+    }
+
+    uint32_t glfw_required_extension_count = 0;
+    const char **glfw_required_extensions = glfwGetRequiredInstanceExtensions(&glfw_required_extension_count);
+
+    // Enabling through the index skips extensions which are already enabled.
+    for (auto &extension: extensions) {
+        if (!availability.extensions.supported(extension)) {
+            throw std::runtime_error(std::string("Vulkan instance extension ") + extension + " is not available");
+        }
+        availability.extensions.enable(extension);
+    }
+    for (uint32_t i = 0; i < glfw_required_extension_count; i++) {
+        if (!availability.extensions.supported(glfw_required_extensions[i])) {
+            throw std::runtime_error(std::string("Vulkan instance extension ") + glfw_required_extensions[i] +
+                                     " is required by GLFW but not available");
+        }
+        availability.extensions.enable(glfw_required_extensions[i]);
+    }
+
+#ifndef NDEBUG
+    if (availability.layers.supported("VK_LAYER_KHRONOS_validation")) {
+        availability.layers.enable("VK_LAYER_KHRONOS_validation");
+    } else {
+        LOGGER_WARNING("VK_LAYER_KHRONOS_validation is not available, continuing without validation");
+    }
+#endif
+
+    const auto enabled_layers = availability.layers.enabled_names();
+    const auto enabled_extensions = availability.extensions.enabled_names();
+
+    LOAD_VK_FN(nullptr, vkCreateInstance)
+    LOAD_VK_FN(nullptr, vkDestroyInstance);
+
+    instance_create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_create_info.pNext = nullptr;
+    instance_create_info.flags = 0;
+    instance_create_info.pApplicationInfo = &instance_application_info;
+    instance_create_info.enabledLayerCount = enabled_layers.size();
+    instance_create_info.ppEnabledLayerNames = enabled_layers.data();
+    instance_create_info.enabledExtensionCount = enabled_extensions.size();
+    instance_create_info.ppEnabledExtensionNames = enabled_extensions.data();
+    instance_application_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    instance_application_info.pNext = nullptr;
+    instance_application_info.pApplicationName = "LearnVulkan";
+    instance_application_info.applicationVersion = VK_MAKE_VERSION(0, 1, 0);
+    instance_application_info.pEngineName = "LearnVulkanEngine";
+    instance_application_info.engineVersion = VK_MAKE_VERSION(0, 1, 0);
+    instance_application_info.apiVersion = VK_API_VERSION_1_2;
+
+    if (vkCreateInstance(&instance_create_info, nullptr, &instance) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create vulkan instance");
+    }
+
+    return instance;
+}
+
+void load_vulkan_functions(VkInstance instance) {
+    LOAD_VK_FN(instance, vkEnumerateInstanceVersion)
+    LOAD_VK_FN(instance, vkEnumeratePhysicalDevices)
+    LOAD_VK_FN(instance, vkGetPhysicalDeviceProperties)
+    LOAD_VK_FN(instance, vkGetPhysicalDeviceQueueFamilyProperties)
+    LOAD_VK_FN(instance, vkGetPhysicalDeviceMemoryProperties)
+    LOAD_VK_FN(instance, vkGetPhysicalDeviceFeatures2)
+    LOAD_VK_FN(instance, vkGetPhysicalDeviceFormatProperties)
+    LOAD_VK_FN(instance, vkEnumerateDeviceExtensionProperties)
+    LOAD_VK_FN(instance, vkCreateDevice)
+    LOAD_VK_FN(instance, vkDestroyDevice)
+    LOAD_VK_FN(instance, vkGetDeviceQueue)
+    LOAD_VK_FN(instance, vkGetDeviceProcAddr)
+}
+
+std::vector<VkPhysicalDevice> get_physical_devices(VkInstance instance) {
+    uint32_t device_count = 0;
+    if (vkEnumeratePhysicalDevices(instance, &device_count, nullptr) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to enumerate physical vulkan devices");
+    }
+
+    std::vector<VkPhysicalDevice> devices = {};
+    devices.resize(device_count);
+    if (vkEnumeratePhysicalDevices(instance, &device_count, devices.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to enumerate physical vulkan devices");
+    }
+
+    return devices;
+}
+
+std::vector<VkPhysicalDeviceProperties>
+get_physical_device_properties(const std::vector<VkPhysicalDevice> &physical_devices) {
+    std::vector<VkPhysicalDeviceProperties> physical_device_properties;
+    for (auto &physical_device: physical_devices) {
+        auto &properties = physical_device_properties.emplace_back();
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+    }
+
+    return physical_device_properties;
+}
+
+std::vector<std::vector<VkQueueFamilyProperties>>
+get_physical_device_queue_family_properties(const std::vector<VkPhysicalDevice> &physical_devices) {
+    std::vector<std::vector<VkQueueFamilyProperties>> physical_device_queue_family_properties;
+    for (int i = 0; i < physical_devices.size(); i++) {
+        // Get queue family count
+        uint32_t queue_family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &queue_family_count, nullptr);
+        // Read queue family properties
+        std::vector<VkQueueFamilyProperties> queue_properties;
+        queue_properties.resize(queue_family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_devices[i], &queue_family_count, queue_properties.data());
+        physical_device_queue_family_properties.push_back(queue_properties);
+    }
+
+    return physical_device_queue_family_properties;
+}
+
+std::string queue_family_properties_to_string(unsigned int index, VkQueueFamilyProperties properties) {
+    std::stringstream str;
+    str << "    [Queue " << index << "]" << std::endl
+        << "        Queue Count: " << properties.queueCount << std::endl
+        << "        Queue Capabilities: " << std::endl;
+    const auto capabilities = vk_reflection::flag_names<VkQueueFlagBits>(properties.queueFlags);
+    for (auto capability: capabilities) {
+        str << "            " << capability << std::endl;
+    }
+    if (capabilities.unknown_bits != 0) {
+        str << "            Unknown: 0x" << std::hex << capabilities.unknown_bits << std::dec << std::endl;
+    }
+    str << std::endl;
+    return str.str();
+}
+
+std::future<VulkanBootstrap> start_vulkan_bootstrap(std::vector<const char *> layers,
+                                                    std::vector<const char *> extensions,
+                                                    std::filesystem::path pipeline_cache_path) {
+    return std::async(std::launch::async, [layers = std::move(layers), extensions = std::move(extensions),
+                                           pipeline_cache_path = std::move(pipeline_cache_path)] {
+        const auto start = std::chrono::steady_clock::now();
+        if (!glfwVulkanSupported()) {
+            throw std::runtime_error("Vulkan is not supported on this host");
+        }
+
+        VulkanBootstrap bootstrap;
+        bootstrap.availability = probe_instance_availability();
+        bootstrap.instance = initialise_vulkan(bootstrap.availability, layers, extensions);
+        try {
+            load_vulkan_functions(bootstrap.instance);
+            vkEnumerateInstanceVersion(&bootstrap.instance_version);
+            bootstrap.physical_devices = get_physical_devices(bootstrap.instance);
+            bootstrap.capabilities = probe_physical_device_capabilities(bootstrap.physical_devices);
+            bootstrap.pipeline_cache_data = read_pipeline_cache_file(pipeline_cache_path);
+        } catch (...) {
+            vkDestroyInstance(bootstrap.instance, nullptr);
+            throw;
+        }
+
+        bootstrap.duration = std::chrono::steady_clock::now() - start;
+        return bootstrap;
+    });
+}
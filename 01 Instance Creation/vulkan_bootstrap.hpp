@@ -0,0 +1,105 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+
+#include <GLFW/glfw3.h>
+
+#include "extension_index.hpp"
+#include "physical_device_capabilities.hpp"
+
+/**
+ * Gets the string version of version.
+ * @param version The vulkan version number.
+ * @return A string representation of vulkan.
+ */
+std::string vulkan_api_version_to_string(uint32_t version);
+
+/**
+ * Gets the string of a physical device type.
+ * @param type The vulkan physical device type.
+ * @return A readable name for the type, or for types this does not know its name as spelled in the vulkan headers.
+ */
+std::string_view vulkan_physical_device_type_to_string(VkPhysicalDeviceType type);
+
+/**
+ * Initialises vulkan instance object.
+ * If not already specified, adds the necessary GLFW extensions for surface display.
+ * @param availability The layers and extensions available on this host. Those loaded in the instance are marked as
+ *                     enabled.
+ * @param layers The names of the layers to load in the instance.
+ * @param extensions The names of the extensions to load in the instance.
+ * @return An initialised vulkan instance.
+ */
+VkInstance initialise_vulkan(InstanceAvailability &availability,
+                             const std::vector<const char *> &layers,
+                             const std::vector<const char *> &extensions);
+
+/**
+ * Loads needed vulkan functions.
+ * @param instance The instance from which to load vulkan functions.
+ */
+void load_vulkan_functions(VkInstance instance);
+
+/**
+ * Enumerates and vectorises all vulkan physical devices.
+ * @param instance The vulkan instance with which the devices are associated.
+ * @return A vector array of vulkan devices.
+ */
+std::vector<VkPhysicalDevice> get_physical_devices(VkInstance instance);
+
+/**
+ * Returns the properties of an array of vulkan physical devices.
+ * @param physical_devices The devices of which properties should be queried.
+ * @return A array of physical device properties. In the same order as the physical device array given.
+ */
+std::vector<VkPhysicalDeviceProperties>
+get_physical_device_properties(const std::vector<VkPhysicalDevice> &physical_devices);
+
+std::vector<std::vector<VkQueueFamilyProperties>>
+get_physical_device_queue_family_properties(const std::vector<VkPhysicalDevice> &physical_devices);
+
+/**
+ * Return a human-readable string describing an instance of a VkQueueFamilyProperties object.
+ * @param index The queue index of the queue.
+ * @param properties The properties obect to be printed.
+ * @return The string describing the object.
+ */
+std::string queue_family_properties_to_string(unsigned int index, VkQueueFamilyProperties properties);
+
+/**
+ * Everything start_vulkan_bootstrap creates and probes.
+ */
+struct VulkanBootstrap {
+    InstanceAvailability availability;
+    VkInstance instance = VK_NULL_HANDLE;
+    uint32_t instance_version = 0;
+    std::vector<VkPhysicalDevice> physical_devices;
+    std::vector<PhysicalDeviceCapabilities> capabilities;
+    /// The saved pipeline cache, not yet checked against any device.
+    std::vector<std::byte> pipeline_cache_data;
+    /// How long the bootstrap took on its thread.
+    std::chrono::steady_clock::duration duration = {};
+};
+
+/**
+ * Creates the instance, loads its functions, enumerates and probes the physical devices and reads the saved pipeline
+ * cache on a background thread. Loading the ICDs can take hundreds of milliseconds, which this hides behind whatever
+ * startup work the caller does before waiting on the future.
+ * GLFW must be initialised first, and must not be terminated before the future is ready.
+ * @param layers The names of the layers to load in the instance.
+ * @param extensions The names of the extensions to load in the instance.
+ * @param pipeline_cache_path The file of the saved pipeline cache, which need not exist.
+ * @return The bootstrapped instance and devices. Wait on it where they are first needed. Carries any exception thrown,
+ *         in which case nothing is left to destroy.
+ */
+std::future<VulkanBootstrap> start_vulkan_bootstrap(std::vector<const char *> layers,
+                                                    std::vector<const char *> extensions,
+                                                    std::filesystem::path pipeline_cache_path);
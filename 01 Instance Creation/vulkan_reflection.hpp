@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+#include "vulkan_reflection_tables.hpp"
+
+namespace vk_reflection {
+
+/**
+ * The names of the bits set in a flags value. Holds views into the static name tables, so building one never
+ * allocates.
+ */
+class FlagNameList {
+public:
+    constexpr void push_back(std::string_view name) noexcept { names[count++] = name; }
+
+    constexpr const std::string_view *begin() const noexcept { return names.data(); }
+
+    constexpr const std::string_view *end() const noexcept { return names.data() + count; }
+
+    constexpr std::size_t size() const noexcept { return count; }
+
+    constexpr bool empty() const noexcept { return count == 0; }
+
+    /// Bits which were set but have no name in the registry this build was generated from.
+    uint64_t unknown_bits = 0;
+
+private:
+    std::array<std::string_view, 64> names = {};
+    std::size_t count = 0;
+};
+
+/**
+ * Decomposes a flags value into the names of its set bits, in ascending bit order.
+ * @tparam FlagBits The flag bits enum of the flags value, or for 64-bit flags the tag type in vk_reflection::flags64.
+ * @param flags The flags value to decompose.
+ * @return The names of the set bits.
+ */
+template<typename FlagBits>
+constexpr FlagNameList flag_names(uint64_t flags) noexcept {
+    FlagNameList list;
+    while (flags != 0) {
+        const auto bit = static_cast<unsigned>(std::countr_zero(flags));
+        flags &= flags - 1;
+        if (bit < FlagBitsTraits<FlagBits>::bit_width && !FlagBitsTraits<FlagBits>::names[bit].empty()) {
+            list.push_back(FlagBitsTraits<FlagBits>::names[bit]);
+        } else {
+            list.unknown_bits |= uint64_t(1) << bit;
+        }
+    }
+    return list;
+}
+
+/**
+ * Gets the name of an enum value, or a fallback if the value is not known to the registry.
+ * @param value The vulkan enum value.
+ * @param fallback The string returned for unknown values.
+ * @return The name of the value as spelled in the vulkan headers.
+ */
+template<typename Enum>
+constexpr std::string_view enum_name_or(Enum value, std::string_view fallback) noexcept {
+    const auto name = enum_name(value);
+    return name.empty() ? fallback : name;
+}
+
+} // namespace vk_reflection
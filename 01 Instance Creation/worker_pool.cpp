@@ -0,0 +1,44 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = default_thread_count();
+    }
+    threads.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; i++) {
+        threads.emplace_back([this] { run(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    task_added.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+uint32_t WorkerPool::default_thread_count() {
+    return std::max(std::thread::hardware_concurrency(), 2u) - 1;
+}
+
+void WorkerPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex);
+            task_added.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
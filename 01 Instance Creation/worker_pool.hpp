@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A fixed set of threads running background work, such as pipeline compilation, off the render thread.
+ */
+class WorkerPool {
+public:
+    /**
+     * Starts the threads.
+     * @param thread_count The number of threads, or zero for default_thread_count().
+     */
+    explicit WorkerPool(uint32_t thread_count = 0);
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /**
+     * Runs every queued task, then joins the threads.
+     */
+    ~WorkerPool();
+
+    /**
+     * Queues a task.
+     * @param function The task, taking no arguments.
+     * @return A future for the task's result, which also carries any exception it throws.
+     */
+    template<typename Function>
+    auto submit(Function &&function) -> std::future<std::invoke_result_t<Function>> {
+        using Result = std::invoke_result_t<Function>;
+        // std::function must be copyable, which packaged_task is not.
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        auto future = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            tasks.emplace_back([task] { (*task)(); });
+        }
+        task_added.notify_one();
+        return future;
+    }
+
+    uint32_t thread_count() const { return threads.size(); }
+
+    /**
+     * @return One thread fewer than the hardware has, leaving one for the render thread, and at least one.
+     */
+    static uint32_t default_thread_count();
+
+private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable task_added;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
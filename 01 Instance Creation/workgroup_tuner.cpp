@@ -0,0 +1,257 @@
+#include "workgroup_tuner.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+#include "gpu_timer.hpp"
+#include "immediate_commands.hpp"
+#include "settings_file.hpp"
+
+/**
+ * The number of timed runs of each candidate, of which the fastest counts. Taking the minimum filters out runs slowed
+ * by other work on the GPU.
+ */
+static constexpr uint32_t MEASUREMENTS = 5;
+
+static std::optional<VkExtent2D> parse_extent(std::string_view text) {
+    const auto separator = text.find('x');
+    if (separator == std::string_view::npos) {
+        return std::nullopt;
+    }
+    VkExtent2D extent;
+    const auto width = text.substr(0, separator);
+    const auto height = text.substr(separator + 1);
+    if (std::from_chars(width.data(), width.data() + width.size(), extent.width).ptr != width.data() + width.size()
+        || std::from_chars(height.data(), height.data() + height.size(), extent.height).ptr
+           != height.data() + height.size()) {
+        return std::nullopt;
+    }
+    return extent;
+}
+
+WorkgroupTuner::WorkgroupTuner(const LogicalDevice &device, std::filesystem::path results_path, VkPipelineCache cache)
+        : device(device), results_path(std::move(results_path)), cache(cache) {
+    load();
+}
+
+void WorkgroupTuner::register_kernel(TunableKernel kernel) {
+    auto name = kernel.name;
+    kernels.insert_or_assign(std::move(name), std::move(kernel));
+}
+
+KernelConfiguration WorkgroupTuner::configuration(std::string_view name) {
+    auto &device_results = results[device_key(device.capabilities->properties)];
+    if (auto result = device_results.find(name); result != device_results.end()) {
+        return result->second;
+    }
+
+    auto kernel = kernels.find(name);
+    if (kernel == kernels.end()) {
+        throw std::runtime_error("Unable to tune unregistered kernel " + std::string(name));
+    }
+    auto best = benchmark(kernel->second);
+    device_results.emplace(kernel->first, best);
+    save();
+    return best;
+}
+
+void WorkgroupTuner::tune_all() {
+    auto &device_results = results[device_key(device.capabilities->properties)];
+    bool tuned = false;
+    for (auto &[name, kernel]: kernels) {
+        if (!device_results.contains(name)) {
+            device_results.emplace(name, benchmark(kernel));
+            tuned = true;
+        }
+    }
+    if (tuned) {
+        save();
+    }
+}
+
+std::string WorkgroupTuner::device_key(const VkPhysicalDeviceProperties &properties) {
+    char key[40];
+    std::snprintf(key, sizeof(key), "%x:%x:%x", properties.vendorID, properties.deviceID, properties.driverVersion);
+    return key;
+}
+
+std::vector<VkExtent2D> WorkgroupTuner::default_workgroup_sizes(uint32_t dimensions) {
+    if (dimensions == 1) {
+        return {{32, 1}, {64, 1}, {128, 1}, {256, 1}, {512, 1}, {1024, 1}};
+    }
+    return {{8, 4}, {8, 8}, {16, 4}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {32, 16}, {32, 32}};
+}
+
+std::vector<VkExtent2D> WorkgroupTuner::seeded_workgroup_sizes(const TuningProfile &profile, uint32_t dimensions) {
+    const auto seed = dimensions == 1 ? VkExtent2D{profile.workgroup_size_1d, 1} : profile.workgroup_size_2d;
+    std::vector<VkExtent2D> sizes = {seed};
+    for (auto &size: default_workgroup_sizes(dimensions)) {
+        if (size.width != seed.width || size.height != seed.height) {
+            sizes.push_back(size);
+        }
+    }
+    return sizes;
+}
+
+bool WorkgroupTuner::fits(const VkExtent2D &workgroup_size) const {
+    const auto &limits = device.capabilities->properties.limits;
+    return workgroup_size.width <= limits.maxComputeWorkGroupSize[0]
+           && workgroup_size.height <= limits.maxComputeWorkGroupSize[1]
+           && workgroup_size.width * workgroup_size.height <= limits.maxComputeWorkGroupInvocations;
+}
+
+VkPipeline WorkgroupTuner::create_pipeline(const TunableKernel &kernel,
+                                           const KernelConfiguration &configuration) const {
+    const uint32_t constants[] = {configuration.workgroup_size.width, configuration.workgroup_size.height,
+                                  configuration.tile_size.width, configuration.tile_size.height};
+    VkSpecializationMapEntry entries[std::size(constants)];
+    for (uint32_t i = 0; i < std::size(constants); i++) {
+        entries[i].constantID = i;
+        entries[i].offset = i * sizeof(uint32_t);
+        entries[i].size = sizeof(uint32_t);
+    }
+
+    VkSpecializationInfo specialization_info;
+    specialization_info.mapEntryCount = std::size(entries);
+    specialization_info.pMapEntries = entries;
+    specialization_info.dataSize = sizeof(constants);
+    specialization_info.pData = constants;
+
+    VkComputePipelineCreateInfo create_info;
+    create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    create_info.pNext = nullptr;
+    create_info.flags = 0;
+    create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    create_info.stage.pNext = nullptr;
+    create_info.stage.flags = 0;
+    create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    create_info.stage.module = kernel.shader;
+    create_info.stage.pName = "main";
+    create_info.stage.pSpecializationInfo = &specialization_info;
+    create_info.layout = kernel.layout;
+    create_info.basePipelineHandle = VK_NULL_HANDLE;
+    create_info.basePipelineIndex = -1;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if (vkCreateComputePipelines(device.device, cache, 1, &create_info, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create compute pipeline for kernel " + kernel.name);
+    }
+    return pipeline;
+}
+
+KernelConfiguration WorkgroupTuner::benchmark(const TunableKernel &kernel) const {
+    // Candidates are measured on the queue the kernels run on, which async compute changes.
+    const auto *family = device.compute_queue_family();
+    if (!family) {
+        throw std::runtime_error("Unable to find a compute queue family for tuning");
+    }
+    ImmediateCommands commands(device, *family);
+    // Without timestamps, whole submissions are timed on the host, which includes their overhead in every candidate.
+    std::optional<GpuTimer> timer;
+    if (GpuTimer::supported(device, *family)) {
+        timer.emplace(device, *family, 2);
+    }
+
+    if (kernel.tile_sizes.empty()) {
+        throw std::runtime_error("Kernel " + kernel.name + " has no tile sizes to tune");
+    }
+    auto workgroup_sizes = kernel.workgroup_sizes.empty() ? seeded_workgroup_sizes(device.tuning, kernel.dimensions)
+                                                          : kernel.workgroup_sizes;
+    std::optional<KernelConfiguration> best;
+    double best_time = std::numeric_limits<double>::infinity();
+
+    for (auto &workgroup_size: workgroup_sizes) {
+        if (!fits(workgroup_size)) {
+            continue;
+        }
+        for (auto &tile_size: kernel.tile_sizes) {
+            const KernelConfiguration candidate = {workgroup_size, tile_size};
+            const auto pipeline = create_pipeline(kernel, candidate);
+
+            auto time = std::numeric_limits<double>::infinity();
+            try {
+                // The first run pays for lazy compilation and cold caches on some drivers, so it is not timed.
+                commands.run([&](VkCommandBuffer command_buffer) {
+                    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+                    kernel.dispatch(command_buffer, candidate);
+                });
+
+                for (uint32_t i = 0; i < MEASUREMENTS; i++) {
+                    const auto start = std::chrono::steady_clock::now();
+                    commands.run([&](VkCommandBuffer command_buffer) {
+                        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+                        if (timer) {
+                            timer->reset(command_buffer);
+                            timer->timestamp(command_buffer, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+                        }
+                        kernel.dispatch(command_buffer, candidate);
+                        if (timer) {
+                            timer->timestamp(command_buffer, 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+                        }
+                    });
+                    const auto measured = timer ? timer->elapsed(0, 1).value()
+                                                : std::chrono::duration<double, std::nano>(
+                                    std::chrono::steady_clock::now() - start).count();
+                    time = std::min(time, measured);
+                }
+            } catch (...) {
+                vkDestroyPipeline(device.device, pipeline, nullptr);
+                throw;
+            }
+            vkDestroyPipeline(device.device, pipeline, nullptr);
+
+            if (time < best_time) {
+                best_time = time;
+                best = candidate;
+            }
+        }
+    }
+
+    if (!best) {
+        throw std::runtime_error("No workgroup size of kernel " + kernel.name + " fits the device");
+    }
+    return *best;
+}
+
+void WorkgroupTuner::load() {
+    std::map<std::string, KernelConfiguration, std::less<>> *section = nullptr;
+    read_settings_file(results_path, "workgroup results file", [&](std::string_view name) {
+        section = &results[std::string(name)];
+    }, [&](std::string_view key, std::string_view value) {
+        const auto space = value.find(' ');
+        auto workgroup_size = parse_extent(value.substr(0, space));
+        auto tile_size = space == std::string_view::npos ? VkExtent2D{1, 1}
+                                                         : parse_extent(trim(value.substr(space + 1)));
+        if (!workgroup_size || !tile_size) {
+            return false;
+        }
+        section->insert_or_assign(std::string(key), KernelConfiguration{*workgroup_size, *tile_size});
+        return true;
+    });
+}
+
+void WorkgroupTuner::save() const {
+    // Written aside and renamed, so that a crash mid-write never loses the results of other devices.
+    auto temporary = results_path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << "# Fastest compute kernel launch shapes, measured per vendor:device:driver" << std::endl;
+        for (auto &[key, device_results]: results) {
+            file << "[" << key << "]" << std::endl;
+            for (auto &[name, result]: device_results) {
+                file << name << " = " << result.workgroup_size.width << "x" << result.workgroup_size.height << " "
+                     << result.tile_size.width << "x" << result.tile_size.height << std::endl;
+            }
+        }
+        if (!file) {
+            throw std::runtime_error("Unable to write workgroup results file " + temporary.string());
+        }
+    }
+    std::filesystem::rename(temporary, results_path);
+}
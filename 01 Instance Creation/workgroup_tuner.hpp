@@ -0,0 +1,116 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "logical_device.hpp"
+#include "tuning_profile.hpp"
+
+/**
+ * The launch shape of a compute kernel: its workgroup size, and the tile of items each invocation processes.
+ */
+struct KernelConfiguration {
+    VkExtent2D workgroup_size = {64, 1};
+    VkExtent2D tile_size = {1, 1};
+};
+
+/**
+ * A compute kernel whose launch shape is chosen by measurement. Its shader declares the shape as specialization
+ * constants, e.g. layout(local_size_x_id = 0, local_size_y_id = 1) in; and constant_id 2 and 3 for the tile width and
+ * height.
+ */
+struct TunableKernel {
+    /// The name results are persisted under.
+    std::string name;
+    VkShaderModule shader = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    /// 1 for kernels over a buffer, 2 for kernels over an image.
+    uint32_t dimensions = 1;
+    /// The workgroup sizes to try, or empty for WorkgroupTuner::seeded_workgroup_sizes() of the device's profile.
+    std::vector<VkExtent2D> workgroup_sizes;
+    /// The tile sizes to try with every workgroup size, at least one.
+    std::vector<VkExtent2D> tile_sizes = {{1, 1}};
+    /// Records a representative run of the kernel with the pipeline already bound: binds its resources and dispatches
+    /// enough workgroups to cover the problem for the given shape.
+    std::function<void(VkCommandBuffer, const KernelConfiguration &)> dispatch;
+};
+
+/**
+ * Benchmarks the launch shapes of compute kernels on first use on a device and driver, and persists the fastest so
+ * later runs reuse them. Results are keyed by vendorID, deviceID and driverVersion, so a driver update measures again.
+ * The results file keeps one [vendor:device:driver] section per device, with kernel = WxH TxT lines.
+ */
+class WorkgroupTuner {
+public:
+    /**
+     * Loads the results persisted for every device.
+     * @param device The device to tune kernels on.
+     * @param results_path The results file, which need not exist.
+     * @param cache The pipeline cache used to compile candidates, or VK_NULL_HANDLE.
+     * @throws std::runtime_error if the results file exists but cannot be parsed.
+     */
+    WorkgroupTuner(const LogicalDevice &device, std::filesystem::path results_path,
+                   VkPipelineCache cache = VK_NULL_HANDLE);
+
+    /**
+     * Registers a kernel, replacing any registered under the same name.
+     */
+    void register_kernel(TunableKernel kernel);
+
+    /**
+     * Gets the launch shape of a kernel, benchmarking it and saving the results if this device and driver has none.
+     * @param name The name of a registered kernel.
+     * @return The fastest launch shape.
+     */
+    KernelConfiguration configuration(std::string_view name);
+
+    /**
+     * Benchmarks every registered kernel without a result, then saves the results.
+     */
+    void tune_all();
+
+    /**
+     * Writes the results of every device to the results file, replacing it.
+     */
+    void save() const;
+
+    /**
+     * @return The key results on a device are stored under.
+     */
+    static std::string device_key(const VkPhysicalDeviceProperties &properties);
+
+    /**
+     * @return Common workgroup sizes, from one to two wavefronts up to the largest the device allows.
+     */
+    static std::vector<VkExtent2D> default_workgroup_sizes(uint32_t dimensions);
+
+    /**
+     * Candidates are measured in order and a later one only replaces a strictly faster one, so the first wins ties.
+     * @return The workgroup size of a tuning profile, then the default workgroup sizes.
+     */
+    static std::vector<VkExtent2D> seeded_workgroup_sizes(const TuningProfile &profile, uint32_t dimensions);
+
+private:
+    /**
+     * Measures every candidate shape of a kernel.
+     * @return The fastest shape.
+     */
+    KernelConfiguration benchmark(const TunableKernel &kernel) const;
+
+    VkPipeline create_pipeline(const TunableKernel &kernel, const KernelConfiguration &configuration) const;
+
+    bool fits(const VkExtent2D &workgroup_size) const;
+
+    void load();
+
+    const LogicalDevice &device;
+    std::filesystem::path results_path;
+    VkPipelineCache cache;
+    std::map<std::string, TunableKernel, std::less<>> kernels;
+    /// Results per device key, then per kernel name.
+    std::map<std::string, std::map<std::string, KernelConfiguration, std::less<>>, std::less<>> results;
+};
@@ -0,0 +1,427 @@
+#!/usr/bin/env python3
+"""
+Generates constexpr reflection tables for every Vulkan enum and flag type from the Vulkan registry (vk.xml).
+
+Usage: generate_vulkan_reflection.py <path to vk.xml> <output header>
+
+For each enum type an `enum_name` overload is emitted. Values in the dense core range are looked up by indexing into
+a table; extension values (which the registry encodes as 1000000000 + (extension - 1) * 1000 + offset) fall through
+to a switch. For each flag bits type a `FlagBitsTraits` specialisation is emitted holding the name of every bit
+indexed by bit position, which makes flag decomposition a walk over the set bits. For VkPhysicalDeviceFeatures and
+every structure extending VkPhysicalDeviceFeatures2 a `FeatureTraits` specialisation is emitted holding a pointer to
+each of its VkBool32 members, so features can be combined without assuming anything about the structure's layout.
+VK_REFLECTION_COMMAND_BUFFER_COMMANDS(X) expands X(name) for every command recorded into a command buffer, so that a
+layer can intercept all of them with the right signatures.
+"""
+
+import sys
+import xml.etree.ElementTree as ET
+
+API = 'vulkan'
+EXTENSION_BASE = 1000000000
+EXTENSION_BLOCK = 1000
+
+
+def supports_api(element):
+    api = element.get('api')
+    return api is None or API in api.split(',')
+
+
+def type_name(element):
+    name = element.get('name')
+    if name is None and element.find('name') is not None:
+        name = element.find('name').text
+    return name
+
+
+class Registry:
+    def __init__(self, root):
+        self.platforms = {p.get('name'): p.get('protect') for p in root.find('platforms').findall('platform')}
+
+        # Type and command dependency graph, used to find out which types actually end up in the headers.
+        self.types = {}
+        self.type_deps = {}
+        for element in root.find('types').findall('type'):
+            if not supports_api(element):
+                continue
+            name = type_name(element)
+            if name is None:
+                continue
+            self.types[name] = element
+            deps = set()
+            for key in ('requires', 'bitvalues', 'alias'):
+                if element.get(key):
+                    deps.add(element.get(key))
+            for child in element.iter('type'):
+                if child is not element and child.text:
+                    deps.add(child.text)
+            self.type_deps[name] = deps
+
+        self.command_deps = {}
+        # The type of the first parameter of each command, following aliases.
+        self.command_handles = {}
+        aliases = {}
+        for element in root.find('commands').findall('command'):
+            if not supports_api(element):
+                continue
+            if element.get('alias'):
+                self.command_deps[element.get('name')] = {('command', element.get('alias'))}
+                aliases[element.get('name')] = element.get('alias')
+                continue
+            name = element.find('proto').find('name').text
+            deps = set()
+            for child in element.iter('type'):
+                deps.add(('type', child.text))
+            self.command_deps[name] = deps
+            params = [param for param in element.findall('param') if supports_api(param)]
+            self.command_handles[name] = params[0].find('type').text if params else None
+        for name, alias in aliases.items():
+            self.command_handles[name] = self.command_handles.get(alias)
+
+        # Enum blocks declared in <enums>.
+        self.enum_blocks = {}
+        for element in root.findall('enums'):
+            if element.get('type') not in ('enum', 'bitmask'):
+                continue
+            values = []
+            for value in element.findall('enum'):
+                if not supports_api(value) or value.get('alias'):
+                    continue
+                values.append(self.enumerant(value, None, None))
+            self.enum_blocks[element.get('name')] = {
+                'kind': element.get('type'),
+                'bitwidth': int(element.get('bitwidth', '32')),
+                'values': values,
+            }
+
+        # Walk features and extensions for required types, commands and enumerants added to existing enums.
+        self.type_protect = {}
+        self.command_protect = {}
+        for feature in root.findall('feature'):
+            if not supports_api(feature):
+                continue
+            self.walk_requires(feature, None, None)
+
+        for extension in root.find('extensions').findall('extension'):
+            supported = extension.get('supported', '')
+            if API not in supported.split(','):
+                continue
+            protect = self.platforms.get(extension.get('platform')) if extension.get('platform') else None
+            # Enumerants of platform extensions that extend core enums are always declared in vulkan_core.h,
+            # only provisional ones are guarded there.
+            value_protect = protect if extension.get('provisional') == 'true' else None
+            self.walk_requires(extension, protect, value_protect, int(extension.get('number')))
+
+    @staticmethod
+    def enumerant(element, extension_number, protect):
+        name = element.get('name')
+        if element.get('bitpos') is not None:
+            return {'name': name, 'bitpos': int(element.get('bitpos')), 'value': 1 << int(element.get('bitpos')),
+                    'protect': protect}
+        if element.get('offset') is not None:
+            number = int(element.get('extnumber', extension_number))
+            value = EXTENSION_BASE + (number - 1) * EXTENSION_BLOCK + int(element.get('offset'))
+            if element.get('dir') == '-':
+                value = -value
+            return {'name': name, 'bitpos': None, 'value': value, 'protect': protect}
+        value = element.get('value')
+        return {'name': name, 'bitpos': None, 'value': int(value.rstrip('ULul'), 0), 'protect': protect}
+
+    def walk_requires(self, parent, protect, value_protect, extension_number=None):
+        for require in parent.findall('require'):
+            if not supports_api(require):
+                continue
+            for element in require:
+                if element.tag == 'type':
+                    self.mark_type(element.get('name'), protect)
+                elif element.tag == 'command':
+                    self.mark_command(element.get('name'), protect)
+                elif element.tag == 'enum' and element.get('extends') and not element.get('alias'):
+                    if not supports_api(element):
+                        continue
+                    block = self.enum_blocks.get(element.get('extends'))
+                    if block is not None:
+                        block['values'].append(self.enumerant(element, extension_number, value_protect))
+
+    def mark_type(self, name, protect):
+        if name not in self.types:
+            return
+        if name in self.type_protect and (self.type_protect[name] is None or self.type_protect[name] == protect):
+            return
+        self.type_protect[name] = protect
+        for dependency in self.type_deps.get(name, ()):
+            self.mark_type(dependency, protect)
+
+    def mark_command(self, name, protect):
+        if name not in self.command_deps:
+            return
+        if name in self.command_protect and (self.command_protect[name] is None
+                                             or self.command_protect[name] == protect):
+            return
+        self.command_protect[name] = protect
+        for kind, dependency in self.command_deps.get(name, ()):
+            if kind == 'type':
+                self.mark_type(dependency, protect)
+            else:
+                self.mark_command(dependency, protect)
+
+    def enum_types(self):
+        """Yields (name, protect, block) for every non-alias enum or flag bits type present in the headers."""
+        for name, element in self.types.items():
+            if element.get('category') != 'enum' or element.get('alias') or name not in self.type_protect:
+                continue
+            block = self.enum_blocks.get(name)
+            # 64-bit flag bits are plain VkFlags64 typedefs in the headers, see flags64_types.
+            if block is None or block['bitwidth'] == 64:
+                continue
+            yield name, self.type_protect[name], block
+
+    def flags64_types(self):
+        """Yields (name, protect, block) for every 64-bit flag bits typedef present in the headers."""
+        for name, element in self.types.items():
+            if element.get('category') != 'bitmask' or element.get('bitvalues') is None:
+                continue
+            bits = element.get('bitvalues')
+            if bits not in self.enum_blocks or name not in self.type_protect:
+                continue
+            yield bits, self.type_protect[name], self.enum_blocks[bits]
+
+    def feature_structs(self):
+        """Yields (name, protect, members) for every feature structure present in the headers, with the names of its
+        VkBool32 members."""
+        for name, element in self.types.items():
+            if element.get('category') != 'struct' or element.get('alias') or name not in self.type_protect:
+                continue
+            extends = element.get('structextends', '').split(',')
+            if name != 'VkPhysicalDeviceFeatures' and 'VkPhysicalDeviceFeatures2' not in extends:
+                continue
+            members = []
+            for member in element.findall('member'):
+                if not supports_api(member) or member.find('type') is None or member.find('type').text != 'VkBool32':
+                    continue
+                member_name = member.find('name')
+                # Arrays of booleans are not individual features.
+                if member_name.tail and '[' in member_name.tail:
+                    continue
+                members.append(member_name.text)
+            if members:
+                yield name, self.type_protect[name], members
+
+    def command_buffer_commands(self):
+        """Yields the name of every vkCmd command present in the headers. Commands behind a platform guard are left
+        out, as they cannot be guarded inside a macro."""
+        for name in sorted(self.command_protect):
+            if name.startswith('vkCmd') and self.command_protect[name] is None \
+                    and self.command_handles.get(name) == 'VkCommandBuffer':
+                yield name
+
+
+def unique_values(values):
+    """Drops enumerants repeated across require blocks, and ones sharing a value with an earlier enumerant."""
+    seen_names = set()
+    seen_values = set()
+    result = []
+    for value in values:
+        if value['name'] in seen_names or value['value'] in seen_values:
+            continue
+        seen_names.add(value['name'])
+        seen_values.add(value['value'])
+        result.append(value)
+    return result
+
+
+class Writer:
+    def __init__(self):
+        self.lines = []
+        self.protect = None
+
+    def guard(self, protect):
+        if protect == self.protect:
+            return
+        if self.protect is not None:
+            self.lines.append(f'#endif // {self.protect}')
+        if protect is not None:
+            self.lines.append(f'#ifdef {protect}')
+        self.protect = protect
+
+    def emit(self, line=''):
+        self.lines.append(line)
+
+    def switch_cases(self, values, indent):
+        for value in values:
+            if value['protect'] is not None:
+                self.emit(f'#ifdef {value["protect"]}')
+            self.emit(f'{indent}case {value["name"]}: return "{value["name"]}";')
+            if value['protect'] is not None:
+                self.emit('#endif')
+
+
+def write_enum(writer, name, values):
+    dense = [v for v in values if v['protect'] is None and abs(v['value']) < EXTENSION_BASE]
+    sparse = [v for v in values if v not in dense]
+    if dense:
+        low = min(v['value'] for v in dense)
+        high = max(v['value'] for v in dense)
+        # Fall back to the switch when the core values are too scattered for a table to pay off.
+        if high - low + 1 > 4 * len(dense) + 16:
+            sparse, dense = values, []
+
+    writer.emit(f'constexpr std::string_view enum_name({name} value) noexcept {{')
+    if dense:
+        table = [''] * (high - low + 1)
+        for value in dense:
+            table[value['value'] - low] = value['name']
+        writer.emit(f'    constexpr std::array<std::string_view, {len(table)}> core_names = {{')
+        for entry in table:
+            writer.emit(f'        "{entry}",' if entry else '        {},')
+        writer.emit('    };')
+        writer.emit(f'    const auto index = static_cast<int64_t>(value) - ({low});')
+        writer.emit(f'    if (index >= 0 && index < {len(table)}) {{')
+        writer.emit('        return core_names[index];')
+        writer.emit('    }')
+    write_switch(writer, sparse, bool(dense))
+    writer.emit('}')
+    writer.emit()
+
+
+def write_flag_bits_enum(writer, name, values):
+    # Single bits are looked up by bit position, only combined and zero values need the switch.
+    combined = [v for v in values if v['bitpos'] is None]
+    writer.emit(f'constexpr std::string_view enum_name({name} value) noexcept {{')
+    writer.emit('    const auto bits = static_cast<uint32_t>(value);')
+    writer.emit('    if (std::has_single_bit(bits)) {')
+    writer.emit(f'        return FlagBitsTraits<{name}>::names[std::countr_zero(bits)];')
+    writer.emit('    }')
+    write_switch(writer, combined, True)
+    writer.emit('}')
+    writer.emit()
+
+
+def write_switch(writer, values, value_used):
+    if values:
+        writer.emit('    switch (value) {')
+        writer.switch_cases(values, '        ')
+        writer.emit('        default:')
+        writer.emit('            break;')
+        writer.emit('    }')
+    elif not value_used:
+        writer.emit('    (void) value;')
+    writer.emit('    return {};')
+
+
+def write_flag_traits(writer, traits_type, bitwidth, values):
+    names = [''] * bitwidth
+    for value in values:
+        if value['bitpos'] is not None and value['bitpos'] < bitwidth and not names[value['bitpos']]:
+            names[value['bitpos']] = value['name'] if value['protect'] is None else (value['protect'], value['name'])
+    writer.emit('template<>')
+    writer.emit(f'struct FlagBitsTraits<{traits_type}> {{')
+    writer.emit(f'    static constexpr unsigned bit_width = {bitwidth};')
+    writer.emit(f'    static constexpr std::array<std::string_view, {bitwidth}> names = {{')
+    for entry in names:
+        if isinstance(entry, tuple):
+            writer.emit(f'#ifdef {entry[0]}')
+            writer.emit(f'        "{entry[1]}",')
+            writer.emit('#else')
+            writer.emit('        {},')
+            writer.emit('#endif')
+        else:
+            writer.emit(f'        "{entry}",' if entry else '        {},')
+    writer.emit('    };')
+    writer.emit('};')
+    writer.emit()
+
+
+def write_feature_traits(writer, name, members):
+    writer.emit('template<>')
+    writer.emit(f'struct FeatureTraits<{name}> {{')
+    writer.emit(f'    static constexpr std::array<VkBool32 {name}::*, {len(members)}> members = {{')
+    for member in members:
+        writer.emit(f'        &{name}::{member},')
+    writer.emit('    };')
+    writer.emit('};')
+    writer.emit()
+
+
+def generate(registry_path):
+    registry = Registry(ET.parse(registry_path).getroot())
+
+    writer = Writer()
+    writer.emit('// Generated by scripts/generate_vulkan_reflection.py from vk.xml. Do not edit.')
+    writer.emit('#pragma once')
+    writer.emit()
+    writer.emit('#include <array>')
+    writer.emit('#include <bit>')
+    writer.emit('#include <cstdint>')
+    writer.emit('#include <string_view>')
+    writer.emit()
+    writer.emit('#include <vulkan/vulkan.h>')
+    writer.emit()
+    writer.emit('namespace vk_reflection {')
+    writer.emit()
+    writer.emit('/**')
+    writer.emit(' * Names of each bit of a flag bits type, indexed by bit position. Specialised for every flag bits type.')
+    writer.emit(' * @tparam FlagBits The flag bits enum, or for 64-bit flags the tag type in vk_reflection::flags64.')
+    writer.emit(' */')
+    writer.emit('template<typename FlagBits>')
+    writer.emit('struct FlagBitsTraits;')
+    writer.emit()
+    writer.emit('/**')
+    writer.emit(' * Pointers to the VkBool32 members of a feature structure. Specialised for VkPhysicalDeviceFeatures and')
+    writer.emit(' * every structure extending VkPhysicalDeviceFeatures2.')
+    writer.emit(' */')
+    writer.emit('template<typename Features>')
+    writer.emit('struct FeatureTraits;')
+    writer.emit()
+
+    flags64 = sorted(registry.flags64_types(), key=lambda t: t[0])
+    writer.emit('namespace flags64 {')
+    for name, protect, _ in flags64:
+        writer.guard(protect)
+        writer.emit(f'struct {name};')
+    writer.guard(None)
+    writer.emit('} // namespace flags64')
+    writer.emit()
+
+    for name, protect, block in sorted(registry.enum_types(), key=lambda t: t[0]):
+        values = unique_values(block['values'])
+        writer.guard(protect)
+        if block['kind'] == 'bitmask':
+            write_flag_traits(writer, name, 32, values)
+            write_flag_bits_enum(writer, name, values)
+        else:
+            write_enum(writer, name, values)
+    writer.guard(None)
+
+    for name, protect, block in flags64:
+        writer.guard(protect)
+        write_flag_traits(writer, f'flags64::{name}', 64, unique_values(block['values']))
+    writer.guard(None)
+
+    for name, protect, members in sorted(registry.feature_structs(), key=lambda t: t[0]):
+        writer.guard(protect)
+        write_feature_traits(writer, name, members)
+    writer.guard(None)
+
+    writer.emit('} // namespace vk_reflection')
+    writer.emit()
+    writer.emit('// Expands X(name) for every command recorded into a command buffer, except those behind a platform')
+    writer.emit('// guard.')
+    writer.emit('#define VK_REFLECTION_COMMAND_BUFFER_COMMANDS(X) \\')
+    for name in registry.command_buffer_commands():
+        writer.emit(f'    X({name}) \\')
+    writer.emit()
+    return '\n'.join(writer.lines) + '\n'
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip(), file=sys.stderr)
+        sys.exit(1)
+    output = generate(sys.argv[1])
+    with open(sys.argv[2], 'w', newline='\n') as file:
+        file.write(output)
+
+
+if __name__ == '__main__':
+    main()